@@ -0,0 +1,757 @@
+/* seqfbench.c - Throughput benchmark of the seqf read functions
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * Generates FASTQ, multi-line FASTA and .reads files from a fixed seed, plain
+ * and compressed as gzip and zlib, then times every read function over them
+ * with several buffer sizes. Results go to stdout, and optionally to CSV and
+ * JSON files, so that runs of two builds or versions can be compared.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "seqfile.h"
+
+#define TXT(x) #x
+#define TXT2STR(x) TXT(x)
+
+/* Caller buffer of the read functions, large enough for any generated record */
+#define BENCH_CALLER ((size_t)16 << 20)
+
+/* Longest generated sequence */
+#define BENCH_MAXLEN ((size_t)4 << 20)
+
+/* Generated text is gathered in chunks of this size before being written */
+#define BENCH_CHUNK ((size_t)1 << 20)
+
+#define BENCH_MAXBUFS 16
+
+
+/**
+ * @brief Distribution of sequence lengths: fixed "N", uniform "MIN-MAX", or
+ * lognormal "ln:MEAN:SIGMA", which has the long tail of nanopore reads.
+ */
+struct bench_dist {
+	char kind;   /** 'f', 'u' or 'l' */
+	double a;    /** Length, minimum or mean */
+	double b;    /** Maximum or sigma */
+};
+
+
+/**
+ * @brief Command line options
+ */
+struct bench_opts {
+	const char *dir;               /** Directory of the generated files */
+	size_t size;                   /** Size of each plain file, in bytes */
+	uint64_t seed;                 /** Seed of the generator */
+	int level;                     /** Compression level of gzip and zlib files */
+	const char *fastq_spec;        /** FASTQ read lengths */
+	const char *fasta_spec;        /** FASTA sequence lengths */
+	const char *reads_spec;        /** Read lengths of .reads files */
+	size_t fasta_width;            /** Line width of FASTA sequences */
+	size_t bufsizes[BENCH_MAXBUFS];/** Sizes passed to seqfsetbuf */
+	size_t nbufsizes;              /** Number of buffer sizes */
+	int reps;                      /** Runs of each measurement, the best is kept */
+	const char *kinds;             /** File kinds to run, NULL for all */
+	const char *forms;             /** Compressions to run, NULL for all */
+	const char *funcs;             /** Functions to run, NULL for all */
+	const char *csv;               /** CSV output, or NULL */
+	const char *json;              /** JSON output, or NULL */
+	int generate_only;             /** Only write the files */
+};
+
+
+/**
+ * @brief Text being written to a plain, a gzip and a zlib file at once
+ */
+struct bench_out {
+	FILE *plain;
+	FILE *z[2];                    /** gzip and zlib files */
+	z_stream zs[2];
+	unsigned char *chunk;          /** Text not written yet */
+	size_t nchunk;                 /** Bytes in chunk */
+	unsigned char *zbuf;           /** Compressed output */
+	size_t bytes;                  /** Bytes of text so far */
+	size_t records;                /** Records so far */
+	uint64_t rng;                  /** State of the generator */
+};
+
+
+/**
+ * @brief A generated file, in one of its compressions
+ */
+struct bench_file {
+	const char *kind;              /** "fastq", "fasta" or "reads" */
+	const char *form;              /** "plain", "gzip" or "zlib" */
+	const char *mode;              /** Mode for seqfopen */
+	char path[1024];
+	size_t bytes;                  /** Size of the plain file */
+	size_t records;                /** Number of records */
+};
+
+
+/**
+ * @brief Result of one measurement
+ */
+struct bench_result {
+	const char *kind;
+	const char *form;
+	size_t bufsize;
+	const char *func;
+	size_t bytes;
+	size_t records;
+	double seconds;
+};
+
+
+/* Generator
+ * ========= */
+
+static uint64_t
+bench_rand(uint64_t *s)
+{
+	/* xorshift64* */
+	*s ^= *s >> 12;
+	*s ^= *s << 25;
+	*s ^= *s >> 27;
+	return *s * 0x2545F4914F6CDD1DULL;
+}
+
+static double
+bench_unit(uint64_t *s)
+{
+	return (double)(bench_rand(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int
+bench_parsedist(const char *spec, struct bench_dist *d)
+{
+	if(strncmp(spec, "ln:", 3) == 0) {
+		d->kind = 'l';
+		return sscanf(spec + 3, "%lf:%lf", &d->a, &d->b) == 2 && d->a >= 1 && d->b >= 0 ? 0 : -1;
+	}
+	if(strchr(spec, '-') != NULL) {
+		d->kind = 'u';
+		return sscanf(spec, "%lf-%lf", &d->a, &d->b) == 2 && d->a >= 1 && d->b >= d->a ? 0 : -1;
+	}
+	d->kind = 'f';
+	return sscanf(spec, "%lf", &d->a) == 1 && d->a >= 1 ? 0 : -1;
+}
+
+static size_t
+bench_len(const struct bench_dist *d, uint64_t *s)
+{
+	double x = d->a;
+	if(d->kind == 'u') {
+		x = d->a + floor(bench_unit(s) * (d->b - d->a + 1));
+	} else if(d->kind == 'l') {
+		/* Box-Muller, with mu chosen so that the mean is d->a */
+		double u1 = 1.0 - bench_unit(s), u2 = bench_unit(s);
+		double z = sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+		x = exp(log(d->a) - d->b * d->b / 2 + d->b * z);
+	}
+	if(x < 1)
+		return 1;
+	return x > (double)BENCH_MAXLEN ? BENCH_MAXLEN : (size_t)x;
+}
+
+static int
+bench_deflate(struct bench_out *o, int flush)
+{
+	for(int i = 0; i < 2; i++) {
+		z_stream *zs = &o->zs[i];
+		zs->next_in = o->chunk;
+		zs->avail_in = (uInt)o->nchunk;
+		do {
+			zs->next_out = o->zbuf;
+			zs->avail_out = BENCH_CHUNK;
+			if(deflate(zs, flush) == Z_STREAM_ERROR)
+				return -1;
+			size_t n = BENCH_CHUNK - zs->avail_out;
+			if(fwrite(o->zbuf, 1, n, o->z[i]) != n)
+				return -1;
+		} while(zs->avail_out == 0);
+	}
+	if(fwrite(o->chunk, 1, o->nchunk, o->plain) != o->nchunk)
+		return -1;
+	o->nchunk = 0;
+	return 0;
+}
+
+static int
+bench_put(struct bench_out *o, const void *data, size_t n)
+{
+	const unsigned char *p = data;
+	o->bytes += n;
+	while(n) {
+		size_t k = BENCH_CHUNK - o->nchunk < n ? BENCH_CHUNK - o->nchunk : n;
+		memcpy(o->chunk + o->nchunk, p, k);
+		o->nchunk += k;
+		p += k;
+		n -= k;
+		if(o->nchunk == BENCH_CHUNK && bench_deflate(o, Z_NO_FLUSH) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Write `n' random nucleotides, or quality scores if `qual', with a
+ * newline every `width' characters (0 for a single line).
+ */
+static int
+bench_putseq(struct bench_out *o, size_t n, size_t width, int qual)
+{
+	static const char nt[4] = {'A', 'C', 'G', 'T'};
+	unsigned char line[4096];
+	size_t col = 0;
+	while(n) {
+		size_t k = 0;
+		while(k < sizeof line - 1 && n) {
+			uint64_t r = bench_rand(&o->rng);
+			for(int i = 0; i < 8 && k < sizeof line - 1 && n; i++, r >>= 8) {
+				line[k++] = qual ? (unsigned char)('!' + (r & 0xFF) % 41) : nt[r & 3];
+				n--;
+				if(width && ++col == width && n) {
+					line[k++] = '\n';
+					col = 0;
+				}
+			}
+		}
+		if(bench_put(o, line, k) != 0)
+			return -1;
+	}
+	return bench_put(o, "\n", 1);
+}
+
+static int
+bench_record(struct bench_out *o, const char *kind, const struct bench_dist *d, size_t width)
+{
+	char header[64];
+	size_t len = bench_len(d, &o->rng);
+	int ret = 0;
+	o->records++;
+	if(strcmp(kind, "fastq") == 0) {
+		int n = snprintf(header, sizeof header, "@read%zu length=%zu\n", o->records, len);
+		ret |= bench_put(o, header, (size_t)n);
+		ret |= bench_putseq(o, len, 0, 0);
+		ret |= bench_put(o, "+\n", 2);
+		ret |= bench_putseq(o, len, 0, 1);
+	} else if(strcmp(kind, "fasta") == 0) {
+		int n = snprintf(header, sizeof header, ">contig%zu length=%zu\n", o->records, len);
+		ret |= bench_put(o, header, (size_t)n);
+		ret |= bench_putseq(o, len, width, 0);
+	} else {
+		ret |= bench_putseq(o, len, 0, 0);
+	}
+	return ret;
+}
+
+static void
+bench_paths(const struct bench_opts *opts, const char *kind, char paths[4][1024])
+{
+	const char *ext[4] = {"", ".gz", ".zz", ".count"};
+	for(int i = 0; i < 4; i++)
+		snprintf(paths[i], sizeof paths[i], "%s/seqfbench-%zuM-%llu.%s%s", opts->dir,
+		         opts->size >> 20, (unsigned long long)opts->seed, kind, ext[i]);
+}
+
+/**
+ * @brief Write the plain, gzip and zlib files of `kind', unless files of an
+ * earlier run with the same options are there. The number of records and
+ * the options are kept in a ".count" file next to them.
+ *
+ * @return int 0 on success, -1 on error
+ */
+static int
+bench_generate(const struct bench_opts *opts, const char *kind, struct bench_file files[3])
+{
+	char paths[4][1024], spec[256], line[512];
+	const char *dspec = strcmp(kind, "fastq") == 0 ? opts->fastq_spec :
+	                    strcmp(kind, "fasta") == 0 ? opts->fasta_spec : opts->reads_spec;
+	snprintf(spec, sizeof spec, "%s level=%d width=%zu", dspec, opts->level, opts->fasta_width);
+	bench_paths(opts, kind, paths);
+
+	const char *forms[3] = {"plain", "gzip", "zlib"};
+	const char *mode = strcmp(kind, "fastq") == 0 ? "q" : strcmp(kind, "fasta") == 0 ? "a" : "s";
+	for(int i = 0; i < 3; i++) {
+		files[i].kind = kind;
+		files[i].form = forms[i];
+		files[i].mode = mode;
+		memcpy(files[i].path, paths[i], sizeof files[i].path);
+	}
+
+	/* Reuse the files of an earlier run */
+	FILE *count = fopen(paths[3], "r");
+	if(count != NULL) {
+		size_t records, bytes;
+		int same = fscanf(count, "%zu %zu ", &records, &bytes) == 2 &&
+		           fgets(line, sizeof line, count) != NULL &&
+		           strncmp(line, spec, strlen(spec)) == 0;
+		fclose(count);
+		if(same) {
+			for(int i = 0; i < 3; i++) {
+				files[i].records = records;
+				files[i].bytes = bytes;
+			}
+			return 0;
+		}
+	}
+
+	struct bench_dist dist;
+	if(bench_parsedist(dspec, &dist) != 0) {
+		fprintf(stderr, "seqf-bench: invalid length distribution '%s'\n", dspec);
+		return -1;
+	}
+
+	struct bench_out o;
+	memset(&o, 0, sizeof o);
+	o.rng = opts->seed ? opts->seed : 1;
+	o.chunk = malloc(BENCH_CHUNK);
+	o.zbuf = malloc(BENCH_CHUNK);
+	o.plain = fopen(paths[0], "wb");
+	o.z[0] = fopen(paths[1], "wb");
+	o.z[1] = fopen(paths[2], "wb");
+	int ret = -1;
+	if(o.chunk == NULL || o.zbuf == NULL || o.plain == NULL || o.z[0] == NULL || o.z[1] == NULL ||
+	   deflateInit2(&o.zs[0], opts->level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		fprintf(stderr, "seqf-bench: cannot write %s files in %s\n", kind, opts->dir);
+		goto done;
+	}
+	if(deflateInit2(&o.zs[1], opts->level, Z_DEFLATED, MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		deflateEnd(&o.zs[0]);
+		goto done;
+	}
+
+	fprintf(stderr, "seqf-bench: generating %zu MB of %s\n", opts->size >> 20, kind);
+	ret = 0;
+	while(ret == 0 && o.bytes < opts->size)
+		ret = bench_record(&o, kind, &dist, opts->fasta_width);
+	if(ret == 0)
+		ret = bench_deflate(&o, Z_FINISH);
+	deflateEnd(&o.zs[0]);
+	deflateEnd(&o.zs[1]);
+
+	if(ret == 0 && (count = fopen(paths[3], "w")) != NULL) {
+		fprintf(count, "%zu %zu %s\n", o.records, o.bytes, spec);
+		fclose(count);
+	}
+	for(int i = 0; i < 3; i++) {
+		files[i].records = o.records;
+		files[i].bytes = o.bytes;
+	}
+
+done:
+	if(o.plain != NULL && fclose(o.plain) != 0)
+		ret = -1;
+	for(int i = 0; i < 2; i++)
+		if(o.z[i] != NULL && fclose(o.z[i]) != 0)
+			ret = -1;
+	free(o.chunk);
+	free(o.zbuf);
+	if(ret != 0)
+		fprintf(stderr, "seqf-bench: failed to generate %s\n", kind);
+	return ret;
+}
+
+
+/* Read loops, one per function. Each returns a checksum so that nothing is
+ * optimized away.
+ * ========== */
+
+typedef size_t (*bench_fn)(SeqFile file, char *buf, size_t size);
+
+#define BENCH_READ(name, read) \
+	static size_t name(SeqFile file, char *buf, size_t size) \
+	{ \
+		size_t n, sum = 0; \
+		while((n = read(file, buf, size)) > 0) \
+			sum += n + (unsigned char)buf[n - 1]; \
+		return sum; \
+	}
+
+#define BENCH_GETS(name, gets) \
+	static size_t name(SeqFile file, char *buf, size_t size) \
+	{ \
+		size_t sum = 0; \
+		while(gets(file, buf, size) != NULL) \
+			sum += (unsigned char)buf[0]; \
+		return sum; \
+	}
+
+#define BENCH_GETC(name, getc) \
+	static size_t name(SeqFile file, char *buf, size_t size) \
+	{ \
+		(void)buf; \
+		(void)size; \
+		size_t sum = 0; \
+		int c; \
+		while((c = getc(file)) != EOF) \
+			sum += (size_t)c; \
+		return sum; \
+	}
+
+#define BENCH_NEXTREC(name, nextrec) \
+	static size_t name(SeqFile file, char *buf, size_t size) \
+	{ \
+		(void)buf; \
+		(void)size; \
+		size_t sum = 0; \
+		SeqfRecord rec; \
+		while(nextrec(file, &rec) == 0) \
+			sum += rec.seq_len; \
+		return sum; \
+	}
+
+#define BENCH_READNT(name, readnt) \
+	static size_t name(SeqFile file, char *buf, size_t size) \
+	{ \
+		size_t n, sum = 0; \
+		while((n = readnt(file, buf, size, NULL, NULL)) > 0) \
+			sum += n + (unsigned char)buf[n - 1]; \
+		return sum; \
+	}
+
+#define BENCH_GETSEQ(name, getseq) \
+	static size_t name(SeqFile file, char *buf, size_t size) \
+	{ \
+		(void)buf; \
+		(void)size; \
+		size_t sum = 0, cap = 0, len; \
+		char *seq = NULL; \
+		while(getseq(file, &seq, &cap, &len) == 0) \
+			sum += len; \
+		free(seq); \
+		return sum; \
+	}
+
+BENCH_READ(bench_read, seqfread)
+BENCH_READ(bench_read_unlocked, seqfread_unlocked)
+BENCH_GETS(bench_gets, seqfgets)
+BENCH_GETS(bench_gets_unlocked, seqfgets_unlocked)
+BENCH_GETC(bench_getnt, seqfgetnt)
+BENCH_GETC(bench_getnt_unlocked, seqfgetnt_unlocked)
+BENCH_GETC(bench_getc, seqfgetc)
+BENCH_GETC(bench_getc_unlocked, seqfgetc_unlocked)
+BENCH_NEXTREC(bench_nextrec, seqfnextrec)
+BENCH_NEXTREC(bench_nextrec_unlocked, seqfnextrec_unlocked)
+BENCH_READNT(bench_readnt, seqfreadnt)
+BENCH_READNT(bench_readnt_unlocked, seqfreadnt_unlocked)
+BENCH_GETSEQ(bench_getseq, seqfgetseq)
+BENCH_GETSEQ(bench_getseq_unlocked, seqfgetseq_unlocked)
+
+static const struct {
+	const char *name;
+	bench_fn fn;
+} bench_funcs[] = {
+	{"seqfread", bench_read},
+	{"seqfread_unlocked", bench_read_unlocked},
+	{"seqfgets", bench_gets},
+	{"seqfgets_unlocked", bench_gets_unlocked},
+	{"seqfgetnt", bench_getnt},
+	{"seqfgetnt_unlocked", bench_getnt_unlocked},
+	{"seqfgetc", bench_getc},
+	{"seqfgetc_unlocked", bench_getc_unlocked},
+	{"seqfnextrec", bench_nextrec},
+	{"seqfnextrec_unlocked", bench_nextrec_unlocked},
+	{"seqfreadnt", bench_readnt},
+	{"seqfreadnt_unlocked", bench_readnt_unlocked},
+	{"seqfgetseq", bench_getseq},
+	{"seqfgetseq_unlocked", bench_getseq_unlocked},
+};
+
+
+/* Driver
+ * ====== */
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Whether `name' is in the comma separated `list', or `list' is NULL
+ */
+static int
+bench_listed(const char *list, const char *name)
+{
+	if(list == NULL)
+		return 1;
+	size_t len = strlen(name);
+	for(const char *p = list; p != NULL; p = strchr(p, ',')) {
+		if(*p == ',')
+			p++;
+		if(strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\0'))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Time `fn' over `file' with buffers of `bufsize', best of opts->reps
+ *
+ * @return double Seconds, or a negative number if the file could not be read
+ */
+static double
+bench_time(const struct bench_opts *opts, const struct bench_file *file, size_t bufsize,
+           bench_fn fn, char *buf, size_t *sum)
+{
+	double best = -1;
+	for(int rep = 0; rep < opts->reps; rep++) {
+		SeqFile sf = seqfopen(file->path, file->mode);
+		if(sf == NULL || seqfsetbuf(sf, bufsize) != 0) {
+			fprintf(stderr, "seqf-bench: %s: %s\n", file->path, seqfstrerror(seqferrno));
+			seqfclose(sf);
+			return -1;
+		}
+		double start = bench_now();
+		*sum = fn(sf, buf, BENCH_CALLER);
+		double t = bench_now() - start;
+		seqfclose(sf);
+		if(best < 0 || t < best)
+			best = t;
+	}
+	return best;
+}
+
+static void
+bench_print(FILE *out, const struct bench_result *r)
+{
+	double mb = (double)r->bytes / 1e6;
+	fprintf(out, "%-5s %-5s %8zu  %-22s %9.1f MB/s %12.0f rec/s %10.1f ns/rec\n",
+	        r->kind, r->form, r->bufsize, r->func, mb / r->seconds,
+	        (double)r->records / r->seconds, r->seconds * 1e9 / (double)r->records);
+}
+
+static int
+bench_writecsv(const char *path, const struct bench_result *res, size_t nres)
+{
+	FILE *out = fopen(path, "w");
+	if(out == NULL)
+		return -1;
+	fprintf(out, "backend,kind,form,bufsize,function,bytes,records,seconds,mb_per_s,records_per_s,ns_per_record\n");
+	for(size_t i = 0; i < nres; i++) {
+		const struct bench_result *r = &res[i];
+		fprintf(out, "%s,%s,%s,%zu,%s,%zu,%zu,%.6f,%.3f,%.1f,%.3f\n",
+		        TXT2STR(SEQF_BENCH_BACKEND), r->kind, r->form, r->bufsize, r->func,
+		        r->bytes, r->records, r->seconds, (double)r->bytes / 1e6 / r->seconds,
+		        (double)r->records / r->seconds, r->seconds * 1e9 / (double)r->records);
+	}
+	return fclose(out);
+}
+
+static int
+bench_writejson(const char *path, const struct bench_opts *opts, const struct bench_result *res, size_t nres)
+{
+	FILE *out = fopen(path, "w");
+	if(out == NULL)
+		return -1;
+	fprintf(out, "{\n  \"backend\": \"%s\",\n  \"version\": \"%s\",\n  \"seed\": %llu,\n  \"results\": [",
+	        TXT2STR(SEQF_BENCH_BACKEND), SEQF_VERSION, (unsigned long long)opts->seed);
+	for(size_t i = 0; i < nres; i++) {
+		const struct bench_result *r = &res[i];
+		fprintf(out, "%s\n    {\"kind\": \"%s\", \"form\": \"%s\", \"bufsize\": %zu, "
+		        "\"function\": \"%s\", \"bytes\": %zu, \"records\": %zu, \"seconds\": %.6f, "
+		        "\"mb_per_s\": %.3f, \"records_per_s\": %.1f, \"ns_per_record\": %.3f}",
+		        i ? "," : "", r->kind, r->form, r->bufsize, r->func, r->bytes, r->records,
+		        r->seconds, (double)r->bytes / 1e6 / r->seconds,
+		        (double)r->records / r->seconds, r->seconds * 1e9 / (double)r->records);
+	}
+	fprintf(out, "\n  ]\n}\n");
+	return fclose(out);
+}
+
+static void
+bench_usage(FILE *out)
+{
+	fprintf(out,
+	  "usage: seqf-bench [options]\n"
+	  "\n"
+	  "Generates FASTQ, FASTA and .reads files (plain, gzip and zlib) and reports\n"
+	  "the throughput of every seqf read function over them.\n"
+	  "\n"
+	  "  -d DIR            directory for the generated files (default .)\n"
+	  "  -s MB             size of each plain file in MB (default 64)\n"
+	  "  --seed N          seed of the generator (default 1)\n"
+	  "  --level N         gzip/zlib compression level (default 6)\n"
+	  "  --fastq-len SPEC  FASTQ read lengths (default 150)\n"
+	  "  --fasta-len SPEC  FASTA sequence lengths (default 100000-1000000)\n"
+	  "  --fasta-width N   FASTA line width (default 60)\n"
+	  "  --reads-len SPEC  .reads read lengths (default 100-200)\n"
+	  "  -b LIST           buffer sizes for seqfsetbuf (default 8192,65536,1048576)\n"
+	  "  -r N              runs per measurement, the best is kept (default 3)\n"
+	  "  -k LIST           kinds to run: fastq,fasta,reads (default all)\n"
+	  "  -F LIST           forms to run: plain,gzip,zlib (default all)\n"
+	  "  -f LIST           functions to run, e.g. seqfgets,seqfgetc_unlocked (default all)\n"
+	  "  --csv FILE        write the results as CSV\n"
+	  "  --json FILE       write the results as JSON\n"
+	  "  -g                only generate the files\n"
+	  "\n"
+	  "Length SPECs are N (fixed), MIN-MAX (uniform), or ln:MEAN:SIGMA (lognormal).\n");
+}
+
+static int
+bench_parse(int argc, char **argv, struct bench_opts *opts)
+{
+	opts->dir = ".";
+	opts->size = (size_t)64 << 20;
+	opts->seed = 1;
+	opts->level = 6;
+	opts->fastq_spec = "150";
+	opts->fasta_spec = "100000-1000000";
+	opts->reads_spec = "100-200";
+	opts->fasta_width = 60;
+	opts->bufsizes[0] = 8192;
+	opts->bufsizes[1] = 65536;
+	opts->bufsizes[2] = 1048576;
+	opts->nbufsizes = 3;
+	opts->reps = 3;
+
+	for(int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if(strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+			bench_usage(stdout);
+			exit(0);
+		}
+		if(strcmp(arg, "-g") == 0) {
+			opts->generate_only = 1;
+			continue;
+		}
+		if(i + 1 == argc) {
+			fprintf(stderr, "seqf-bench: %s needs a value\n", arg);
+			return -1;
+		}
+		const char *val = argv[++i];
+		if(strcmp(arg, "-d") == 0) {
+			opts->dir = val;
+		} else if(strcmp(arg, "-s") == 0) {
+			opts->size = (size_t)strtoull(val, NULL, 10) << 20;
+		} else if(strcmp(arg, "--seed") == 0) {
+			opts->seed = strtoull(val, NULL, 10);
+		} else if(strcmp(arg, "--level") == 0) {
+			opts->level = atoi(val);
+		} else if(strcmp(arg, "--fastq-len") == 0) {
+			opts->fastq_spec = val;
+		} else if(strcmp(arg, "--fasta-len") == 0) {
+			opts->fasta_spec = val;
+		} else if(strcmp(arg, "--fasta-width") == 0) {
+			opts->fasta_width = strtoull(val, NULL, 10);
+		} else if(strcmp(arg, "--reads-len") == 0) {
+			opts->reads_spec = val;
+		} else if(strcmp(arg, "-b") == 0) {
+			opts->nbufsizes = 0;
+			for(char *end; *val && opts->nbufsizes < BENCH_MAXBUFS; val = *end ? end + 1 : end) {
+				opts->bufsizes[opts->nbufsizes] = strtoull(val, &end, 10);
+				if(end == val || opts->bufsizes[opts->nbufsizes] == 0)
+					return -1;
+				opts->nbufsizes++;
+			}
+		} else if(strcmp(arg, "-r") == 0) {
+			opts->reps = atoi(val);
+		} else if(strcmp(arg, "-k") == 0) {
+			opts->kinds = val;
+		} else if(strcmp(arg, "-F") == 0) {
+			opts->forms = val;
+		} else if(strcmp(arg, "-f") == 0) {
+			opts->funcs = val;
+		} else if(strcmp(arg, "--csv") == 0) {
+			opts->csv = val;
+		} else if(strcmp(arg, "--json") == 0) {
+			opts->json = val;
+		} else {
+			fprintf(stderr, "seqf-bench: unknown option %s\n", arg);
+			return -1;
+		}
+	}
+	if(opts->size == 0 || opts->reps < 1 || opts->level < 0 || opts->level > 9 ||
+	   opts->nbufsizes == 0)
+		return -1;
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bench_opts opts;
+	memset(&opts, 0, sizeof opts);
+	if(bench_parse(argc, argv, &opts) != 0) {
+		bench_usage(stderr);
+		return 2;
+	}
+
+	const char *kinds[3] = {"fastq", "fasta", "reads"};
+	size_t nfuncs = sizeof bench_funcs / sizeof bench_funcs[0];
+	size_t maxres = 3 * 3 * opts.nbufsizes * nfuncs;
+	struct bench_result *res = malloc(maxres * sizeof *res);
+	char *buf = malloc(BENCH_CALLER);
+	if(res == NULL || buf == NULL) {
+		fprintf(stderr, "seqf-bench: out of memory\n");
+		return 1;
+	}
+
+	size_t nres = 0;
+	int status = 0;
+	printf("backend %s, seqf %s\n", TXT2STR(SEQF_BENCH_BACKEND), SEQF_VERSION);
+	for(int k = 0; k < 3; k++) {
+		if(!bench_listed(opts.kinds, kinds[k]))
+			continue;
+		struct bench_file files[3];
+		if(bench_generate(&opts, kinds[k], files) != 0) {
+			status = 1;
+			continue;
+		}
+		if(opts.generate_only)
+			continue;
+
+		for(int f = 0; f < 3; f++) {
+			if(!bench_listed(opts.forms, files[f].form))
+				continue;
+			for(size_t b = 0; b < opts.nbufsizes; b++) {
+				for(size_t i = 0; i < nfuncs; i++) {
+					if(!bench_listed(opts.funcs, bench_funcs[i].name))
+						continue;
+					size_t sum;
+					double t = bench_time(&opts, &files[f], opts.bufsizes[b], bench_funcs[i].fn, buf, &sum);
+					if(t < 0) {
+						status = 1;
+						continue;
+					}
+					struct bench_result *r = &res[nres++];
+					r->kind = files[f].kind;
+					r->form = files[f].form;
+					r->bufsize = opts.bufsizes[b];
+					r->func = bench_funcs[i].name;
+					r->bytes = files[f].bytes;
+					r->records = files[f].records;
+					r->seconds = t > 0 ? t : 1e-9;
+					bench_print(stdout, r);
+					fflush(stdout);
+				}
+			}
+		}
+	}
+
+	if(opts.csv != NULL && bench_writecsv(opts.csv, res, nres) != 0) {
+		fprintf(stderr, "seqf-bench: cannot write %s\n", opts.csv);
+		status = 1;
+	}
+	if(opts.json != NULL && bench_writejson(opts.json, &opts, res, nres) != 0) {
+		fprintf(stderr, "seqf-bench: cannot write %s\n", opts.json);
+		status = 1;
+	}
+	free(res);
+	free(buf);
+	return status;
+}
@@ -26,6 +26,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,6 +39,7 @@ extern "C" {
 #define SEQF_VERSION_PATCH 0
 
 #define SEQFBUFSIZ 8192
+#define SEQFBUFMAX ((size_t)256 << 20)
 #ifndef EOF
 #define EOF (-1)
 #endif
@@ -67,7 +69,21 @@ typedef struct SeqFile *SeqFile;
  * which type of file is used for reading. "a" for fasta, "q" for fastq, "s"
  * for sequence file, and "b" for binary.
  * 
- * @param path Path to the file you want to open for reading
+ * Uncompressed regular files are memory mapped and parsed in place. Adding "u"
+ * to the mode (e.g. "qu") disables the mapping and uses plain `read` calls.
+ * Adding "t" decompresses gzip/zlib files on background threads, see
+ * `seqfsetpipeline()` and `seqfsetthreads()`.
+ * 
+ * Adding "w" opens (and truncates, or creates) the file for writing instead,
+ * see `seqfputrec()` and `seqfwrite()`. As in htslib, "g" then writes a gzip
+ * file and "z" a BGZF file, and a digit sets the compression level (6 by
+ * default), e.g. "wqz1". Compressed files are written in blocks that are
+ * compressed on the thread pool, see `seqfsetpipeline()`.
+ * 
+ * A cache written by `seqfcache()` is found by its magic and read like the
+ * file it was made from, whatever type the mode gives.
+ * 
+ * @param path Path to the file you want to open
  * @param mode Type of file being opened
  * @return SeqFile 
  */
@@ -80,8 +96,8 @@ SeqFile seqfopen(const char *path, const char *mode);
  * for sequence file, and "b" for binary. 
  * 
  * This takes an existing file descriptor (obtained through open/creat/dup/etc)
- * and uses it to process SeqFile. Since SeqFile is currently only supported
- * for file reading, the file descriptor must be opened with for reading. Once
+ * and uses it to process SeqFile. The file descriptor must be opened for
+ * reading, or for writing if the mode has a "w" (see `seqfopen()`). Once
  * `seqfclose` is called, the the file descriptor will be closed alongside the
  * SeqFile handle.
  * 
@@ -92,6 +108,48 @@ SeqFile seqfopen(const char *path, const char *mode);
 SeqFile seqfdopen(int fd, const char *mode);
 
 
+/**
+ * @brief Open part of an uncompressed fasta/fastq/sequence file for reading,
+ * so that several readers can each parse a share of one file. Mode is the same
+ * as in `seqfopen()`.
+ * 
+ * The range covers the records that start at an offset in [`start`, `end`):
+ * both ends are moved forward to the start of the next record, so ranges that
+ * split a file between them hand out each record exactly once. FASTA records
+ * start at a '>' line, and FASTQ records at an '@' line that is followed by a
+ * '+' line two lines later, which tells them apart from quality lines that
+ * happen to start with '@'. Other types are split into lines. Rewinding
+ * returns to the start of the range.
+ * 
+ * Compressed files cannot be entered in the middle and fail with seqferrno 12.
+ * 
+ * @param path  Path to the file you want to open for reading
+ * @param mode  Type of file being opened
+ * @param start Offset at which the range starts
+ * @param end   Offset at which the range ends
+ * @return SeqFile 
+ */
+SeqFile seqfopen_range(const char *path, const char *mode, size_t start, size_t end);
+
+
+/**
+ * @brief Open part of an uncompressed file for reading from an existing file
+ * descriptor, see `seqfopen_range()`.
+ * 
+ * The range is read with `pread`, so the file offset of `fd` is never used.
+ * Ranges of the same file can therefore share one open file through `dup()`'d
+ * descriptors, without any coordination between readers. As with
+ * `seqfdopen()`, `seqfclose` closes `fd`.
+ * 
+ * @param fd    File descriptor of the file you want to read
+ * @param mode  Type of file being opened
+ * @param start Offset at which the range starts
+ * @param end   Offset at which the range ends
+ * @return SeqFile 
+ */
+SeqFile seqfdopen_range(int fd, const char *mode, size_t start, size_t end);
+
+
 /**
  * @brief Close an SeqFile handle.
  * 
@@ -102,11 +160,29 @@ SeqFile seqfdopen(int fd, const char *mode);
 int seqfclose(SeqFile file);
 
 
+/**
+ * @brief Close the file of `file` and open `path` in its place, as if with
+ * `seqfopen(path, mode)`. The handle keeps its buffers (and their sizes),
+ * mutex and decompressor, which are reset instead of created again, so that
+ * going through many small files costs little more than opening each one.
+ * Settings made with `seqfsetpipeline()`, `seqfsetthreads()` and
+ * `seqfsetshared()` do not carry over.
+ * 
+ * @param file SeqFile to reuse, NULL to open a new one
+ * @param path Path to the file you want to open for reading
+ * @param mode Type of file being opened, see `seqfopen()`
+ * @return SeqFile `file`, or NULL on error. On error `file` is closed
+ * (seqferrno is set).
+ */
+SeqFile seqfreopen(SeqFile file, const char *path, const char *mode);
+
+
 /**
  * @brief Rewind a SeqFile to read from the beginning of the file.
  * 
  * @param file SeqFile to rewind
- * @return int return code: 0 if success, failure otherwise
+ * @return int return code: 0 if success, failure otherwise (seqferrno 12 if
+ * `file` was opened for writing)
  */
 int seqfrewind(SeqFile file);
 
@@ -147,6 +223,28 @@ int
 seqfsetobuf(SeqFile file, size_t bufsize);
 
 
+/**
+ * @brief Let the output buffer grow up to `maxsize` bytes when a record does
+ * not fit in it.
+ *
+ * `seqfread()` and the type specific *read functions keep the part of the last
+ * record that did not fit in the caller's buffer in the output buffer. When
+ * that part is larger than the output buffer, the buffer is doubled until it
+ * fits, instead of failing with seqferrno set to 5. Once records fit in the
+ * size given to `seqfsetobuf()` (`2*SEQFBUFSIZ` by default) many times in a
+ * row, the buffer shrinks back to that size.
+ *
+ * The default maximum is `SEQFBUFMAX`. A record must still fit in the buffer
+ * passed to the *read functions.
+ *
+ * @param file    SeqFile handle
+ * @param maxsize Largest size of the output buffer, 0 to never grow it
+ * @return int 0 on success, -1 if `file` is NULL
+ */
+int
+seqfsetobufmax(SeqFile file, size_t maxsize);
+
+
 /**
  * @brief Set both the input buffer of the SeqFile handle to be of size
  * `bufsize`, and the output buffer to be of size `2*bufsize`.
@@ -165,6 +263,250 @@ int
 seqfsetbuf(SeqFile file, size_t bufsize);
 
 
+/**
+ * @brief Put input and output buffers of at least 2 MiB on transparent huge
+ * pages. Such buffers are mapped on their own, 2 MiB aligned and rounded up
+ * to a whole number of huge pages, so that a large buffer takes a handful of
+ * TLB entries instead of one per 4 KiB page. Only affects buffers resized
+ * afterwards with `seqfsetibuf()`, `seqfsetobuf()` or `seqfsetbuf()`.
+ * 
+ * Huge pages are a hint to the kernel (Linux `madvise`), and buffers fall back
+ * to the allocator on systems without them. The mappings bypass the allocator
+ * of `seqfsetallocator()`.
+ * 
+ * @param file   SeqFile handle
+ * @param enable Use huge pages for large buffers
+ * @return int 0 on success, -1 if `file` is NULL
+ */
+int
+seqfsethugepages(SeqFile file, bool enable);
+
+
+/**
+ * @brief Functions that allocate and release the memory of the library. They
+ * follow `malloc`, `realloc` and `free`, with `opaque` passed as the last
+ * argument of each, e.g. to pick an arena. `resize` is called with a NULL
+ * pointer to allocate, and `release` is never called with a NULL pointer.
+ */
+typedef struct SeqfAllocator {
+	void *(*alloc)(size_t size, void *opaque);               /** Like malloc */
+	void *(*resize)(void *ptr, size_t size, void *opaque);   /** Like realloc */
+	void (*release)(void *ptr, void *opaque);                /** Like free */
+	void *opaque;                                            /** Passed to each call */
+} SeqfAllocator;
+
+
+/**
+ * @brief Route every allocation of the library through `allocator`: SeqFile
+ * handles and their buffers, the decompressors (through zlib's zalloc and
+ * zfree), the background pipeline, the thread pool, and the arrays of
+ * `SeqfBatch` and `SeqfPacked`.
+ * 
+ * Memory is released by the allocator that allocated it, so the allocator is
+ * only changed while the library holds no memory: before the first file is
+ * opened, or after every file, batch and packed sequence is released and
+ * `seqfpoolfree()` was called. It is shared by all threads, so the functions
+ * must be thread safe.
+ * 
+ * @param allocator Allocator to use, NULL for the C library's
+ * @return int 0 on success, -1 if one of the functions is missing (seqferrno
+ * is set)
+ */
+int
+seqfsetallocator(const SeqfAllocator *allocator);
+
+
+/**
+ * @brief Decompress the SeqFile in the background into a ring of `nblocks`
+ * output blocks, so that decompression overlaps with parsing.
+ * 
+ * Only has an effect on gzip/zlib compressed files. It can be called until the
+ * ring has started, which happens on the next read; reading then carries on
+ * from where it was. The blocks are filled by tasks on the thread pool, see
+ * `seqfpoolcreate()`, from that read until `seqfclose()`. Each block is
+ * `2*SEQFBUFSIZ` bytes or the size of the output buffer, whichever is
+ * larger. Opening the file with "t" in the mode is equivalent to calling this
+ * function with a ring of 4 blocks. While the ring is running, `seqfsetibuf()`
+ * fails.
+ * 
+ * For a file opened for writing with "g" or "z", `nblocks` is the number of
+ * blocks being compressed at once instead. It then defaults to twice the
+ * threads of the pool, and must be set before the first write.
+ * 
+ * @param file    SeqFile handle to decompress in the background
+ * @param nblocks Number of blocks in the ring (at least 2), 0 to disable
+ * @return int 0 on success, -1 if the ring (or, for a writer, compression) has
+ * already started
+ */
+int
+seqfsetpipeline(SeqFile file, size_t nblocks);
+
+
+/**
+ * @brief Set the number of threads that fill the ring of `seqfsetpipeline()`.
+ * By default there are as many as the threads of the pool, see
+ * `seqfpoolcreate()`. The ring is filled by tasks on the pool, so this bounds
+ * how many workers of the pool `file` can take at once.
+ * 
+ * BGZF files are always inflated in the background, one run of members per
+ * thread. A plain gzip file, which is usually a single member, can only be
+ * inflated by several threads when it is a regular file: it is then split
+ * into chunks of compressed bytes, and each thread starts inflating its chunk
+ * at a deflate block it finds by searching the chunk, before the data that
+ * precedes it is known. The chunks are checked against each other and against
+ * the CRC-32 of the member, so the result is always exactly that of a serial
+ * inflate, and a chunk that started at the wrong place is inflated again;
+ * `chunks_kept` of `seqfgetstats()` counts those that did not need to be. Any
+ * other stream is inflated by a single thread. Must be called before the first
+ * read from `file`.
+ * 
+ * @param file     SeqFile handle to decompress in the background
+ * @param nthreads Number of threads, 0 for every thread of the pool
+ * @return int 0 on success, -1 if reading from `file` has already started
+ */
+int
+seqfsetthreads(SeqFile file, size_t nthreads);
+
+
+/**
+ * @brief Counters of the work done by a SeqFile handle since it was opened,
+ * see `seqfgetstats()`. The times are in nanoseconds, and are only kept while
+ * timing is enabled with `seqfsettiming()`.
+ */
+typedef struct SeqfStats {
+	uint64_t bytes_in;      /** Bytes read from the file, compressed or not */
+	uint64_t bytes_out;     /** Decompressed bytes produced */
+	uint64_t reads;         /** read() and pread() calls on the file */
+	uint64_t fetches;       /** Refills of the output buffer */
+	uint64_t records;       /** Records returned by the record, gets and nucleotide functions */
+	uint64_t bytes_copied;  /** Bytes the gets functions copied out of the output buffer */
+	uint64_t read_ns;       /** Time spent in read() and pread() */
+	uint64_t inflate_ns;    /** Time spent decompressing */
+	uint64_t parse_ns;      /** Time the locked functions held the handle, less refills */
+	uint64_t wait_ns;       /** Time spent waiting for the background decompression */
+	uint64_t lock_ns;       /** Time spent waiting for the lock of the handle */
+	uint64_t chunks_kept;   /** Gzip chunks inflated in parallel and kept, see `seqfsetthreads()` */
+} SeqfStats;
+
+
+/**
+ * @brief Get the counters of `file`.
+ *
+ * Reads and decompression done in the background by `seqfsetpipeline()` are
+ * counted once the reader reaches the block they filled, and `read_ns` and
+ * `inflate_ns` then add up the time of every thread, so they may exceed the
+ * wall clock time. `parse_ns` only covers the locked functions, as it is the
+ * time they held the lock of the handle, less the time spent refilling the
+ * output buffer meanwhile; `*_unlocked` functions are not timed.
+ *
+ * @param file  SeqFile handle
+ * @param stats Filled with the counters of `file`
+ * @return int 0 on success, -1 if `file` or `stats` is NULL
+ */
+int
+seqfgetstats(SeqFile file, SeqfStats *stats);
+
+
+/**
+ * @brief Time reads, decompression, parsing and waits for the lock of `file`
+ * from now on, see `seqfgetstats()`. Timing costs two clock reads for each
+ * call that is timed, so it is off by default. Must not be called while
+ * other threads use `file`.
+ *
+ * @param file   SeqFile handle
+ * @param enable Keep the times of `SeqfStats`
+ * @return int 0 on success, -1 if `file` is NULL
+ */
+int
+seqfsettiming(SeqFile file, bool enable);
+
+
+/**
+ * @brief Start the thread pool of the process with `nthreads` workers. Every
+ * SeqFile decompresses in the background on this one pool, so the number of
+ * threads stays the same however many files are open at once. Without a call
+ * to this function, the pool is started with one thread per processor when
+ * it is first needed.
+ * 
+ * Each worker has a deque of tasks. Tasks submitted by a worker go to its own
+ * deque, and a worker whose deque is empty steals the oldest task of another.
+ * 
+ * @param nthreads Number of workers, 0 for one per processor
+ * @param pin      Pin worker i to processor i (Linux only, ignored elsewhere)
+ * @return int 0 on success, -1 if the pool is already running or could not
+ * be started (seqferrno is set)
+ */
+int
+seqfpoolcreate(size_t nthreads, bool pin);
+
+
+/**
+ * @brief Stop the thread pool of the process after it runs every queued task.
+ * No SeqFile may be reading in the background, i.e. every file opened with a
+ * pipeline must be closed. The next use of the pool starts it again.
+ */
+void
+seqfpoolfree(void);
+
+
+/**
+ * @brief Number of workers in the thread pool of the process, starting it if
+ * needed.
+ * 
+ * @return size_t Number of workers, 0 if the pool could not be started
+ */
+size_t
+seqfpoolthreads(void);
+
+
+/**
+ * @brief Group of tasks submitted to the thread pool, which can be waited for
+ * together.
+ */
+typedef struct SeqfTaskGroup *SeqfTaskGroup;
+
+
+/**
+ * @brief Create an empty group of tasks.
+ * 
+ * @return SeqfTaskGroup Group, NULL when out of memory (seqferrno is set)
+ */
+SeqfTaskGroup
+seqftaskgroup(void);
+
+
+/**
+ * @brief Run `fn(arg)` on the thread pool, as part of `group`. Tasks may
+ * submit more tasks, which then run on the same worker unless stolen.
+ * 
+ * @param group Group the task belongs to
+ * @param fn    Function to run
+ * @param arg   Argument of `fn`
+ * @return int 0 on success, -1 on error (seqferrno is set)
+ */
+int
+seqfsubmit(SeqfTaskGroup group, void (*fn)(void *), void *arg);
+
+
+/**
+ * @brief Wait until every task of `group` has finished. The calling thread
+ * runs queued tasks while it waits, so tasks can wait for groups of their own.
+ * 
+ * @param group Group to wait for
+ */
+void
+seqfwait(SeqfTaskGroup group);
+
+
+/**
+ * @brief Wait for the tasks of `group`, then release it.
+ * 
+ * @param group Group to release
+ */
+void
+seqftaskgroupfree(SeqfTaskGroup group);
+
+
 /**
  * @brief Return an allocated string detailing the error encountered from SeqFile
  * 
@@ -225,6 +567,200 @@ size_t seqfsread(SeqFile file, char *buffer, size_t bufsize);
 size_t seqfsread_unlocked(SeqFile file, char *buffer, size_t bufsize);
 
 
+/**
+ * @brief Read only the nucleotides of `file` into `buffer`: headers, '+'
+ * lines, quality scores and newlines are left out, and the sequences of
+ * consecutive records follow each other with nothing in between. A record can
+ * be continued by the next call. The buffer is not null terminated.
+ * 
+ * If `breaks` and `nbreaks` are not NULL, `*nbreaks` is the number of entries
+ * `breaks` has room for. The offset in `buffer` at which each record ends is
+ * stored in `breaks`, and `*nbreaks` is set to the number stored. Reading
+ * stops early when `breaks` is full.
+ * 
+ * @param file    SeqFile to read from, opened as "a", "q", or "s"
+ * @param buffer  Buffer to write the nucleotides to
+ * @param bufsize Size of the buffer being passed
+ * @param breaks  Array for the offsets where records end, or NULL
+ * @param nbreaks Room in breaks on input, number of breaks stored on output
+ * @return size_t Number of bytes read into buffer. 0 at the end of file or on
+ * error (seqferrno is set), unless only the ends of empty records were read.
+ * 
+ * @note
+ * Do not mix with other read functions on the same file, except after
+ * `seqfrewind()`.
+ */
+size_t seqfreadnt(SeqFile file, char *buffer, size_t bufsize, size_t *breaks, size_t *nbreaks);
+
+
+/**
+ * @brief Read only the nucleotides of `file` into `buffer`. See `seqfreadnt()`.
+ * 
+ * @param file    SeqFile to read from, opened as "a", "q", or "s"
+ * @param buffer  Buffer to write the nucleotides to
+ * @param bufsize Size of the buffer being passed
+ * @param breaks  Array for the offsets where records end, or NULL
+ * @param nbreaks Room in breaks on input, number of breaks stored on output
+ * @return size_t Number of bytes read into buffer
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+size_t seqfreadnt_unlocked(SeqFile file, char *buffer, size_t bufsize, size_t *breaks, size_t *nbreaks);
+
+
+/**
+ * @brief Read the sequence of the next record of `file` into `*buf`, growing
+ * it as needed, like POSIX `getline()`.
+ *
+ * `*buf` is NULL or a buffer of `*cap` bytes allocated with `malloc()`. It is
+ * enlarged with `realloc()` until the whole sequence fits, and `*buf` and
+ * `*cap` are updated; the caller frees it. The sequence is null terminated,
+ * without newlines, and its length is stored in `*len`. Unlike `seqfgets()`,
+ * a sequence is never truncated.
+ *
+ * @param file SeqFile to read from, opened as "a", "q", or "s"
+ * @param buf  Buffer to grow and fill
+ * @param cap  Size of *buf
+ * @param len  Set to the length of the sequence
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ *
+ * @note
+ * Do not mix with other read functions on the same file, except for
+ * `seqfreadnt()` and `seqfgetseqpart()`, or after `seqfrewind()`.
+ */
+int seqfgetseq(SeqFile file, char **buf, size_t *cap, size_t *len);
+
+
+/**
+ * @brief Read the sequence of the next record of `file` into `*buf`, growing
+ * it as needed. See `seqfgetseq()`.
+ *
+ * @param file SeqFile to read from, opened as "a", "q", or "s"
+ * @param buf  Buffer to grow and fill
+ * @param cap  Size of *buf
+ * @param len  Set to the length of the sequence
+ * @return int 0 on success, or EOF at the end of file or on error
+ *
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+int seqfgetseq_unlocked(SeqFile file, char **buf, size_t *cap, size_t *len);
+
+
+/**
+ * @brief Read the sequence of a record of `file` in parts of at most `bufsize`
+ * bytes, so that sequences of any length can be streamed through a fixed
+ * buffer.
+ *
+ * Each call stores the next part of the sequence in `buffer`, without
+ * newlines and not null terminated, and its length in `*len`. `*more` is set
+ * to true when the sequence continues in the next call, and to false when
+ * this part ends it; the following call then starts the next record. A
+ * sequence that fills the buffer exactly may end with an empty part.
+ *
+ * @param file    SeqFile to read from, opened as "a", "q", or "s"
+ * @param buffer  Buffer to fill
+ * @param bufsize Size of the buffer, at least 1
+ * @param len     Set to the number of bytes stored in buffer
+ * @param more    Set to whether the sequence continues
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ *
+ * @note
+ * Do not mix with other read functions on the same file, except for
+ * `seqfreadnt()` and `seqfgetseq()`, or after `seqfrewind()`.
+ */
+int seqfgetseqpart(SeqFile file, char *buffer, size_t bufsize, size_t *len, bool *more);
+
+
+/**
+ * @brief Read the sequence of a record of `file` in parts of at most `bufsize`
+ * bytes. See `seqfgetseqpart()`.
+ *
+ * @param file    SeqFile to read from, opened as "a", "q", or "s"
+ * @param buffer  Buffer to fill
+ * @param bufsize Size of the buffer, at least 1
+ * @param len     Set to the number of bytes stored in buffer
+ * @param more    Set to whether the sequence continues
+ * @return int 0 on success, or EOF at the end of file or on error
+ *
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+int seqfgetseqpart_unlocked(SeqFile file, char *buffer, size_t bufsize, size_t *len, bool *more);
+
+
+/**
+ * @brief Borrow the next whole records of `file` without copying them.
+ * 
+ * `*ptr` is set to the first byte of as many whole records as the internal
+ * buffer holds (all of the rest of a memory mapped file), and `*len` to their
+ * length. The bytes are not null terminated and must not be modified. They are
+ * consumed, and stay valid, until `seqfread_release()` or the next borrow,
+ * which releases them first. Only a record that straddles the end of the buffer
+ * is copied, on its own, into an internal scratch buffer that grows as needed.
+ * 
+ * @param file SeqFile to read from
+ * @param ptr  Set to the first byte of the borrowed records
+ * @param len  Set to the number of bytes borrowed
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ * 
+ * @note
+ * Release the records before using other read functions on `file`.
+ */
+int seqfread_borrow(SeqFile file, const char **ptr, size_t *len);
+
+
+/**
+ * @brief Borrow the next whole records of `file` without copying them. See
+ * `seqfread_borrow()`.
+ * 
+ * @param file SeqFile to read from
+ * @param ptr  Set to the first byte of the borrowed records
+ * @param len  Set to the number of bytes borrowed
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+int seqfread_borrow_unlocked(SeqFile file, const char **ptr, size_t *len);
+
+
+/**
+ * @brief Give back the records borrowed by `seqfread_borrow()`, after which
+ * they must no longer be used.
+ * 
+ * @param file SeqFile the records were borrowed from
+ */
+void seqfread_release(SeqFile file);
+
+
+/**
+ * @brief Give back the records borrowed by `seqfread_borrow()`. See
+ * `seqfread_release()`.
+ * 
+ * @param file SeqFile the records were borrowed from
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+void seqfread_release_unlocked(SeqFile file);
+
+
 /**
  * @brief Read a record's sequence into `buffer`.
  * 
@@ -268,6 +804,642 @@ char *seqfqgets(SeqFile file, char *buffer, size_t bufsize);
 char *seqfqgets_unlocked(SeqFile file, char *buffer, size_t bufsize);
 
 
+/**
+ * @brief View of one record of a fasta/fastq/sequence file, filled by
+ * `seqfnextrec()`. Each field is a pointer and length pair that is not null
+ * terminated. Fields a file type lacks (the header of a sequence file, the
+ * quality of a fasta file, or a missing comment) are NULL with a length of 0.
+ */
+typedef struct SeqfRecord {
+	const char *name;     /** Header up to the first space or tab, without '>'/'@' */
+	size_t name_len;      /** Number of bytes in name */
+	const char *comment;  /** Rest of the header after the name and its blanks */
+	size_t comment_len;   /** Number of bytes in comment */
+	const char *seq;      /** Sequence, with the newlines of wrapped lines removed */
+	size_t seq_len;       /** Number of bytes in seq */
+	const char *qual;     /** Quality scores of a fastq record */
+	size_t qual_len;      /** Number of bytes in qual */
+} SeqfRecord;
+
+
+/**
+ * @brief Read the next whole record of `file` into `rec`, without copying it.
+ * 
+ * The fields of `rec` point straight into the internal buffer (or into the
+ * memory mapping of the file) whenever the record lies within it. Only a
+ * record that straddles the end of the buffer, or whose sequence or quality
+ * is wrapped over several lines, is gathered in an internal scratch buffer
+ * that grows as needed. Either way, the fields stay valid until the next
+ * read from `file`, and must not be modified.
+ * 
+ * @param file SeqFile to read from, opened as "a", "q", or "s"
+ * @param rec  Record to fill
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ */
+int seqfnextrec(SeqFile file, SeqfRecord *rec);
+
+
+/**
+ * @brief Read the next whole record of `file` into `rec`, without copying it.
+ * See `seqfnextrec()`.
+ * 
+ * @param file SeqFile to read from, opened as "a", "q", or "s"
+ * @param rec  Record to fill
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+int seqfnextrec_unlocked(SeqFile file, SeqfRecord *rec);
+
+
+/**
+ * @brief Write `rec` to `file` in the format `file` was opened with: "a"
+ * writes `>name` and the sequence, "q" writes the four fastq lines, and "s"
+ * writes the sequence alone. The sequence is written on a single line.
+ * 
+ * Records are staged in a large buffer, and written out (after being
+ * compressed, for "g" and "z") once it fills, on `seqfflush()`, or on
+ * `seqfclose()`.
+ * 
+ * @param file SeqFile opened with "w"
+ * @param rec  Record to write. For "q", `qual_len` must equal `seq_len`
+ * @return int 0 on success, or EOF on error (seqferrno is set, 12 if `file`
+ * was opened for reading)
+ */
+int seqfputrec(SeqFile file, const SeqfRecord *rec);
+
+
+/**
+ * @brief Write `rec` to `file`. See `seqfputrec()`.
+ * 
+ * @param file SeqFile opened with "w"
+ * @param rec  Record to write
+ * @return int 0 on success, or EOF on error (seqferrno is set)
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+int seqfputrec_unlocked(SeqFile file, const SeqfRecord *rec);
+
+
+/**
+ * @brief Write `len` bytes of `buf` to `file` as they are, e.g. records that
+ * are already formatted. Staged like the records of `seqfputrec()`.
+ * 
+ * @param file SeqFile opened with "w"
+ * @param buf  Bytes to write
+ * @param len  Number of bytes in buf
+ * @return size_t `len` on success, or 0 on error (seqferrno is set, 12 if
+ * `file` was opened for reading)
+ */
+size_t seqfwrite(SeqFile file, const char *buf, size_t len);
+
+
+/**
+ * @brief Write `len` bytes of `buf` to `file`. See `seqfwrite()`.
+ * 
+ * @param file SeqFile opened with "w"
+ * @param buf  Bytes to write
+ * @param len  Number of bytes in buf
+ * @return size_t `len` on success, or 0 on error (seqferrno is set, 12 if
+ * `file` was opened for reading)
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+size_t seqfwrite_unlocked(SeqFile file, const char *buf, size_t len);
+
+
+/**
+ * @brief Write out everything staged in `file`. A compressed file ends the
+ * member being filled, so that what was written so far can be decompressed.
+ * 
+ * @param file SeqFile opened with "w"
+ * @return int 0 on success, or EOF on error (seqferrno is set)
+ */
+int seqfflush(SeqFile file);
+
+
+/**
+ * @brief Write out everything staged in `file`. See `seqfflush()`.
+ * 
+ * @param file SeqFile opened with "w"
+ * @return int 0 on success, or EOF on error (seqferrno is set)
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+int seqfflush_unlocked(SeqFile file);
+
+
+/**
+ * @brief A batch of records laid out as parallel arrays, filled by
+ * `seqfnextbatch()`. The bytes of every field are copied one after the other
+ * into the `data` arena, each followed by a '\0', and record `i`'s sequence
+ * is the `seq_len[i]` bytes at `data + seq_off[i]` (likewise for the name,
+ * comment and quality). Missing fields have a length of 0.
+ * 
+ * Initialize a batch to all zeros before its first use, e.g. `SeqfBatch batch
+ * = {0};`, and release it with `seqfbatchfree()`. The arena and arrays only
+ * ever grow, so a batch that is reused for every call stops allocating once it
+ * is large enough.
+ */
+typedef struct SeqfBatch {
+	size_t nrecords;      /** Number of records in the batch */
+	size_t capacity;      /** Number of records the arrays have room for */
+	char *data;           /** Arena holding the bytes of every field */
+	size_t data_len;      /** Number of bytes used in data */
+	size_t data_size;     /** Capacity of data */
+	size_t *name_off;     /** Offset of each record's name in data */
+	size_t *name_len;     /** Length of each record's name */
+	size_t *comment_off;  /** Offset of each record's comment in data */
+	size_t *comment_len;  /** Length of each record's comment */
+	size_t *seq_off;      /** Offset of each record's sequence in data */
+	size_t *seq_len;      /** Length of each record's sequence */
+	size_t *qual_off;     /** Offset of each record's quality in data */
+	size_t *qual_len;     /** Length of each record's quality */
+} SeqfBatch;
+
+
+/**
+ * @brief Read up to `max_records` records of `file` into `batch`, replacing
+ * what it held. The file is locked once for the whole batch, so this is much
+ * cheaper per record than `seqfgets()` when several threads share `file`.
+ * Records are parsed as in `seqfnextrec()`.
+ * 
+ * @param file        SeqFile to read from, opened as "a", "q", or "s"
+ * @param batch       Batch to fill, see `SeqfBatch`
+ * @param max_records Largest number of records to read
+ * @return size_t Number of records read into `batch`. 0 at the end of file or
+ * on error (seqferrno is set).
+ */
+size_t seqfnextbatch(SeqFile file, SeqfBatch *batch, size_t max_records);
+
+
+/**
+ * @brief Read up to `max_records` records of `file` into `batch`. See
+ * `seqfnextbatch()`.
+ * 
+ * @param file        SeqFile to read from, opened as "a", "q", or "s"
+ * @param batch       Batch to fill, see `SeqfBatch`
+ * @param max_records Largest number of records to read
+ * @return size_t Number of records read into `batch`
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+size_t seqfnextbatch_unlocked(SeqFile file, SeqfBatch *batch, size_t max_records);
+
+
+/**
+ * @brief Release the arena and arrays of `batch`, leaving it empty and ready
+ * to be reused.
+ * 
+ * @param batch Batch to release
+ */
+void seqfbatchfree(SeqfBatch *batch);
+
+
+/**
+ * @brief Share `file` between many consumer threads. A background thread
+ * parses the file into a pool of `nbatches` batches of up to `nrecords`
+ * records each, and consumers take them with `seqfclaimbatch()` and give them
+ * back with `seqfreturnbatch()`. Claiming and returning a batch take a single
+ * atomic operation each; threads only sleep when no batch is ready.
+ * 
+ * Every batch must be returned before `file` is rewound or closed, which
+ * restart or stop the background thread. The file should not be read by any
+ * other function while it is shared.
+ * 
+ * @param file      SeqFile to share, opened as "a", "q", or "s"
+ * @param nbatches  Number of batches in the pool, 0 to stop sharing the file
+ * @param nrecords  Largest number of records in each batch, 0 for the default
+ * (256)
+ * @return int 0 on success, -1 on error (seqferrno is set)
+ */
+int seqfsetshared(SeqFile file, size_t nbatches, size_t nrecords);
+
+
+/**
+ * @brief Claim the next batch of a file shared with `seqfsetshared()`,
+ * waiting for one to be parsed if needed. Batches are parsed in file order and
+ * numbered from 0, so that consumers can put their results back in order.
+ * 
+ * @param file   Shared SeqFile
+ * @param seqno  Set to the number of the batch in the file, may be NULL
+ * @return const SeqfBatch* Batch, owned by the caller until it is returned
+ * with `seqfreturnbatch()`. NULL at the end of file or on error (seqferrno is
+ * set).
+ */
+const SeqfBatch *seqfclaimbatch(SeqFile file, size_t *seqno);
+
+
+/**
+ * @brief Give back a batch claimed with `seqfclaimbatch()`, so that it can be
+ * filled again.
+ * 
+ * @param file   Shared SeqFile
+ * @param batch  Batch to give back
+ */
+void seqfreturnbatch(SeqFile file, const SeqfBatch *batch);
+
+
+/**
+ * @brief Opaque handle of files read in step, such as the R1/R2 (and I1/I2)
+ * files of a paired-end run, see `seqfopen_paired()`.
+ */
+typedef struct SeqfPaired *SeqfPaired;
+
+
+/**
+ * @brief Open `n` files whose records belong together, the i-th record of
+ * each file being a mate of the i-th record of the others. Every file is
+ * opened with `mode` and decompressed in the background, as with
+ * `seqfsetpipeline()`, so that all mates are inflated at once.
+ *
+ * @param paths Paths of the files, e.g. {"R1.fastq.gz", "R2.fastq.gz"}
+ * @param n     Number of files, at least 1
+ * @param mode  Mode of every file, see `seqfopen()`
+ * @return SeqfPaired Handle, NULL on error (seqferrno is set)
+ */
+SeqfPaired seqfopen_paired(const char *const *paths, size_t n, const char *mode);
+
+
+/**
+ * @brief Read the next `max_records` records of every file of `paired`, the
+ * records of file i going to `batches[i]`. The files are parsed concurrently
+ * on the thread pool, see `seqfpoolcreate()`, so reading the mates takes about
+ * as long as reading the slowest one.
+ *
+ * Every batch holds the same number of records. When one file ends before the
+ * others, or the names of mates differ while `seqfsetpairedcheck()` is on, the
+ * files are out of step: 0 is returned and seqferrno is set to 9.
+ *
+ * @param paired      Files to read
+ * @param batches     Array of one batch per file, see `SeqfBatch`
+ * @param max_records Largest number of records to read from each file
+ * @return size_t Number of records read into each batch. 0 at the end of the
+ * files or on error (seqferrno is set).
+ */
+size_t seqfnextpaired(SeqfPaired paired, SeqfBatch *batches, size_t max_records);
+
+
+/**
+ * @brief Check that mates have the same name in `seqfnextpaired()`. A final
+ * "/1", "/2" (or any other "/" and digit) is ignored, so that both the old and
+ * new Illumina naming schemes pass. Off by default.
+ *
+ * @param paired Files read in step
+ * @param enable Compare the names of mates
+ * @return int 0 on success, -1 if `paired` is NULL
+ */
+int seqfsetpairedcheck(SeqfPaired paired, bool enable);
+
+
+/**
+ * @brief Get the i-th file of `paired`, e.g. for `seqfgetstats()`. The file
+ * belongs to `paired` and must not be read or closed.
+ *
+ * @param paired Files read in step
+ * @param i      Index of the file, as in `seqfopen_paired()`
+ * @return SeqFile File, NULL if `i` is out of range
+ */
+SeqFile seqfpairedfile(SeqfPaired paired, size_t i);
+
+
+/**
+ * @brief Close every file of `paired` and release it.
+ *
+ * @param paired Files read in step
+ * @return int 0 on success, 1 if closing one of the files failed (seqferrno
+ * is set)
+ */
+int seqfclose_paired(SeqfPaired paired);
+
+
+/**
+ * @brief Write the records left in `file` to a binary cache at `path`, which
+ * `seqfopen()` reads like the original file, for datasets that are read many
+ * times over.
+ * 
+ * The cache is memory mapped when opened, and holds the sequences at 2 bits a
+ * base, with other bytes (e.g. N) kept as runs, the headers, the qualities and
+ * a table of records. Reading it costs no decompression, and `seqfnextrec()`
+ * only decodes the sequence: the header and qualities point into the mapping.
+ * Any record can be reached at once with `seqfseekrec()`.
+ * 
+ * Bases keep their case, with soft-masked stretches kept as runs like N's. A
+ * header is kept as its name and comment after a single space, and the '+'
+ * line of a FASTQ record is left bare. With `bin_quals`, Phred+33 qualities
+ * are binned into the 8 levels of Illumina and take 4 bits each.
+ * 
+ * @param file      SeqFile opened as "a", "q", or "s"
+ * @param path      Path of the cache, which is created or truncated
+ * @param bin_quals Bin the qualities of a FASTQ file
+ * @return int 0 on success, 1 on error (seqferrno is set, and no cache is left
+ * at `path`). A FASTQ record whose quality is not as long as its sequence is
+ * an error.
+ */
+int seqfcache(SeqFile file, const char *path, bool bin_quals);
+
+
+/**
+ * @brief Make record `record` (counting from 0) of a cache the next one read,
+ * see `seqfcache()`, or of a file with a checkpoint index, see
+ * `seqfzindex_build()`. Seeking to the number of records goes to the end of
+ * file.
+ * 
+ * @param file   SeqFile of a cache or of an indexed file
+ * @param record Record to read next
+ * @return int 0 on success, -1 if `file` is neither (seqferrno 12) or has no
+ * such record (seqferrno is set)
+ */
+int seqfseekrec(SeqFile file, size_t record);
+
+
+/**
+ * @brief Number of records in a cache, see `seqfcache()`, or in a file with a
+ * checkpoint index, see `seqfzindex_build()`.
+ * 
+ * @param file SeqFile of a cache or of an indexed file
+ * @return size_t Number of records, or (size_t)-1 if `file` is neither
+ * (seqferrno 12)
+ */
+size_t seqfnrecords(SeqFile file);
+
+
+/**
+ * @brief Index the FASTA file at `path` as samtools faidx does, writing
+ * `path`.fai, and `path`.gzi as well when the file is BGZF.
+ *
+ * Each line of the .fai gives the name of a sequence (its header up to the
+ * first blank), its length, the offset of its first base and the bases and
+ * bytes in each of its lines. Every line of a sequence but the last must hold
+ * the same number of bases, so that any base can be found by its position.
+ *
+ * @param path Path to a plain or BGZF FASTA file
+ * @return int 0 on success, 1 on error (seqferrno is set). Lines of a sequence
+ * that differ give seqferrno 8, and a gzip file that is not BGZF seqferrno 12.
+ */
+int seqfaidx_build(const char *path);
+
+
+/**
+ * @brief Load the index of `file` from `path`.fai (and `path`.gzi when BGZF)
+ * instead of that of the path it was opened with, e.g. for a file opened with
+ * `seqfdopen()`. See `seqfaidx_build()`. A BGZF file without a .gzi has its
+ * members found when the index is loaded.
+ *
+ * @param file SeqFile of a plain or BGZF FASTA file
+ * @param path Path of the FASTA file the index was built for
+ * @return int 0 on success, 1 on error (seqferrno is set, 12 if `file` is a
+ * gzip file that is not BGZF)
+ */
+int seqfaidx_load(SeqFile file, const char *path);
+
+
+/**
+ * @brief Fetch bases [`start`, `end`) (counting from 0) of the sequence
+ * `name` of an indexed FASTA file into `buf`, e.g. chr7:55,000,000-55,250,000
+ * is `start` 54999999 and `end` 55250000. The index is loaded on the first
+ * fetch, see `seqfaidx_build()`.
+ *
+ * Only the bytes of the region are read, with `pread`, or only the BGZF
+ * members that hold them. The last 16 members inflated are kept, so that nearby
+ * regions cost no more reads. Reading `file` otherwise is not disturbed.
+ *
+ * @param file  SeqFile of a plain or BGZF FASTA file
+ * @param name  Name of the sequence
+ * @param start First base of the region
+ * @param end   Base after the last of the region, cut to the length of the
+ *              sequence
+ * @param buf   Buffer of at least `end - start + 1` bytes, in which the bases
+ *              are null terminated
+ * @return size_t Number of bases fetched. 0 on error (seqferrno is set, 11 if
+ * there is no sequence `name`), or if the region is empty.
+ */
+size_t seqfafetch(SeqFile file, const char *name, size_t start, size_t end, char *buf);
+
+
+/**
+ * @brief Fetch a region of an indexed FASTA file. See `seqfafetch()`.
+ *
+ * @param file  SeqFile of a plain or BGZF FASTA file
+ * @param name  Name of the sequence
+ * @param start First base of the region
+ * @param end   Base after the last of the region
+ * @param buf   Buffer of at least `end - start + 1` bytes
+ * @return size_t Number of bases fetched, 0 on error (seqferrno is set)
+ *
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile. As such,
+ * it is not thread-safe. Only use in single-threaded applications.
+ */
+size_t seqfafetch_unlocked(SeqFile file, const char *name, size_t start, size_t end, char *buf);
+
+
+/**
+ * @brief Build a checkpoint index of `file`, so that `seqfseekrec()` and
+ * `seqfseek_offset()` can reach any record or offset of a compressed file
+ * without inflating it from the start.
+ *
+ * As zlib's zran, the index keeps a point about every `span` bytes of output:
+ * the start of a deflate block along with the 32 KiB of output before it
+ * (kept compressed), or the start of a member of a BGZF file. A seek inflates
+ * from the last point before its target, so costs at most about `span` bytes
+ * of inflation. Records are counted while the index is built, so that
+ * `seqfnrecords()` is known. Plain files can be indexed too.
+ *
+ * The file is read with `pread`, and reading `file` otherwise is not
+ * disturbed. Save the index with `seqfzindex_save()` to spare a later build.
+ *
+ * @param file SeqFile of a regular file opened for reading
+ * @param span Bytes of output between points, or 0 for 4 MiB
+ * @return int 0 on success, 1 on error (seqferrno is set). A cache, a range
+ * or a compressed file when seqf uses ISA-L give seqferrno 12.
+ */
+int seqfzindex_build(SeqFile file, size_t span);
+
+
+/**
+ * @brief Save the checkpoint index of `file` to `path`, see
+ * `seqfzindex_build()`.
+ *
+ * @param file SeqFile with a checkpoint index
+ * @param path Path of the index, which is created or truncated
+ * @return int 0 on success, 1 on error (seqferrno is set, 12 if `file` has no
+ * index)
+ */
+int seqfzindex_save(SeqFile file, const char *path);
+
+
+/**
+ * @brief Load the checkpoint index of `file` from `path`, replacing any index
+ * it had. See `seqfzindex_build()`.
+ *
+ * @param file SeqFile opened for reading
+ * @param path Path of an index saved by `seqfzindex_save()`
+ * @return int 0 on success, 1 on error (seqferrno is set). An index that is
+ * malformed, or was built for a file of another size, type or compression,
+ * gives seqferrno 10, and a cache or a range seqferrno 12.
+ */
+int seqfzindex_load(SeqFile file, const char *path);
+
+
+/**
+ * @brief Make byte `offset` of the (uncompressed) output of `file` the next one
+ * read. A compressed file needs a checkpoint index, see `seqfzindex_build()`,
+ * and a plain file is entered anywhere. Reading does not resync to the next
+ * record, so `offset` is best the start of one.
+ *
+ * @param file   SeqFile of a plain or indexed file
+ * @param offset Offset in the output, up to its size
+ * @return int 0 on success, -1 on error (seqferrno is set, 12 if `file` is
+ * compressed and has no index)
+ */
+int seqfseek_offset(SeqFile file, size_t offset);
+
+
+/**
+ * @brief A sequence packed as 2-bit codes, filled by `seqfgets2b()`. A, C, G
+ * and T (in either case) are coded 0, 1, 2 and 3, 32 bases to a word: base
+ * `i` is `(words[i / 32] >> (2 * (i % 32))) & 3`. Any other character, such as
+ * N or an IUPAC code, is stored as 0 and recorded in the runs of ambiguous
+ * bases, which are sorted and never adjacent.
+ * 
+ * Initialize to all zeros before its first use, e.g. `SeqfPacked seq = {0};`,
+ * and release it with `seqfpackedfree()`. Like `SeqfBatch`, its arrays only
+ * ever grow.
+ */
+typedef struct SeqfPacked {
+	size_t len;           /** Number of bases in the sequence */
+	uint64_t *words;      /** (len + 31) / 32 words of packed bases */
+	size_t words_size;    /** Capacity of words */
+	size_t nruns;         /** Number of runs of ambiguous bases */
+	size_t *run_start;    /** Position of the first base of each run */
+	size_t *run_len;      /** Number of bases in each run */
+	size_t runs_size;     /** Capacity of run_start and run_len */
+} SeqfPacked;
+
+
+/**
+ * @brief Read the sequence of the next record of `file` into `seq`, packed as
+ * 2-bit codes, see `SeqfPacked`. Records are parsed as in `seqfnextrec()`, and
+ * the bases are packed 8 at a time straight from where they were parsed.
+ * 
+ * @param file SeqFile to read from, opened as "a", "q", or "s"
+ * @param seq  Packed sequence to fill
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ */
+int seqfgets2b(SeqFile file, SeqfPacked *seq);
+
+
+/**
+ * @brief Read the sequence of the next record of `file` into `seq`, packed as
+ * 2-bit codes. See `seqfgets2b()`.
+ * 
+ * @param file SeqFile to read from, opened as "a", "q", or "s"
+ * @param seq  Packed sequence to fill
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+int seqfgets2b_unlocked(SeqFile file, SeqfPacked *seq);
+
+
+/**
+ * @brief Release the arrays of `seq`, leaving it empty and ready to be reused.
+ * 
+ * @param seq Packed sequence to release
+ */
+void seqfpackedfree(SeqfPacked *seq);
+
+
+/**
+ * @brief Iterator over the k-mers of a file, set up by `seqfkmerinit()`. The
+ * k-mers are rolled straight over the records as `seqfnextrec()` parses them,
+ * 2 bits a base as in `SeqfPacked`, with the first base in the highest bits.
+ * The fields are the iterator's own and should not be modified.
+ */
+typedef struct SeqfKmerIter {
+	SeqFile file;         /** File the k-mers are read from */
+	int k;                /** Length of the k-mers, 1 to 32 */
+	bool canonical;       /** Return the smaller of a k-mer and its reverse complement */
+	uint64_t mask;        /** Lowest 2k bits set */
+	uint64_t fwd;         /** Current k-mer */
+	uint64_t rev;         /** Reverse complement of the current k-mer */
+	int filled;           /** Bases in the current k-mer, up to k */
+	const char *seq;      /** Sequence of the current record */
+	size_t seq_len;       /** Number of bytes in seq */
+	size_t pos;           /** Next base of seq to roll in */
+} SeqfKmerIter;
+
+
+/**
+ * @brief Set up `it` to iterate over the k-mers of `file`, from the next
+ * record on.
+ * 
+ * @param it        Iterator to set up
+ * @param file      SeqFile to read from, opened as "a", "q", or "s"
+ * @param k         Length of the k-mers, 1 to 32
+ * @param canonical Return the smaller of each k-mer and its reverse complement
+ * @return int 0 on success, 1 if k is out of range (seqferrno is set)
+ */
+int seqfkmerinit(SeqfKmerIter *it, SeqFile file, int k, bool canonical);
+
+
+/**
+ * @brief Store up to `max` of the next k-mers of `it` into `kmers`. K-mers
+ * never span two records or a base other than A, C, G or T: the window starts
+ * over after either.
+ * 
+ * The current record is read in place, so `file` must not be read by other
+ * means while the iterator is in use.
+ * 
+ * @param it     Iterator set up by `seqfkmerinit()`
+ * @param kmers  Array to store the k-mers in
+ * @param max    Largest number of k-mers to store
+ * @return size_t Number of k-mers stored. 0 at the end of file or on error
+ * (seqferrno is set).
+ */
+size_t seqfkmernext(SeqfKmerIter *it, uint64_t *kmers, size_t max);
+
+
+/**
+ * @brief Store up to `max` of the next k-mers of `it` into `kmers`. See
+ * `seqfkmernext()`.
+ * 
+ * @param it     Iterator set up by `seqfkmerinit()`
+ * @param kmers  Array to store the k-mers in
+ * @param max    Largest number of k-mers to store
+ * @return size_t Number of k-mers stored
+ * 
+ * @note
+ * This function does not use a mutex to lock access to the SeqFile internal 
+ * buffer. As such, it is not thread-safe. Only use in single-threaded
+ * applications.
+ */
+size_t seqfkmernext_unlocked(SeqfKmerIter *it, uint64_t *kmers, size_t max);
+
+
 /**
  * @brief Read only one nucleotide from the SeqFile stream. 
  * 
@@ -7,6 +7,13 @@
  * seqf library and is subject to change.
  */
 
+#if defined(__linux__)
+#  ifndef _GNU_SOURCE
+#    define _GNU_SOURCE /* memrchr */
+#  endif
+#  define SEQF_HAVE_MEMRCHR
+#endif
+
 #include "seqf_read.h"
 
 size_t
@@ -19,18 +26,13 @@ seqf_aread(seqf_statep state, unsigned char *buffer, size_t bufsize)
 
 	/* Trim sequence that was not fully read */
 	if(buffer_end == bufsize) {
-		while(--buffer_end && buffer[buffer_end] != '>');
+		unsigned char *start = seqf_memrchr(buffer + 1, '>', buffer_end - 1);
+		buffer_end = start != NULL ? (size_t)(start - buffer) : 0;
 		size_t offset = bufsize - buffer_end;
-		if(offset > state->out_bufsiz) {
-			seqferrno_ = 5;
+		if(seqf_unread(state, buffer+buffer_end, offset) != 0)
 			return 0;
-		}
-		memcpy(state->out_buf, buffer+buffer_end, offset);
-		state->next = state->out_buf;
-		state->have = offset;
 	} else {
 		state->have = 0;
-		memset(state->out_buf, 0, state->out_bufsiz);
 	}
 
 	buffer[buffer_end] = 0;
@@ -42,9 +44,9 @@ seqfaread(SeqFile file, char *buffer, size_t bufsize)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	size_t bytes_read = seqf_aread(state, (unsigned char *)buffer, bufsize);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return bytes_read;
 }
@@ -91,6 +93,7 @@ seqfagets_unlocked(SeqFile file, char *buffer, size_t bufsize)
 	} while(left);
 	buf[0] = '\0';
 
+	state->stats.records++;
 	return buffer;
 }
 
@@ -99,9 +102,9 @@ seqfagets(SeqFile file, char *buffer, size_t bufsize)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	char *ret = seqfagets_unlocked(file, buffer, bufsize);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
@@ -112,20 +115,28 @@ seqfagetnt_unlocked(SeqFile file)
 	seqf_statep state = (seqf_statep)file;
 	if(state == NULL || state->eof)
 		return EOF;
-	if(state->have == 0 && seqf_fetch(state) != 0)
-		return EOF;
-	if(state->have == 0) /* Fetched no bytes, return EOF */
-		return EOF;
-	
-	/* Skip past newline characters, we're interested in what comes next */
-	if(*state->next == '\n') {
-		state->have--;
-		state->next++;
-	}
 
-	/* If start of fasta header, skip it to get to nt, or return on error */
-	if(*state->next == '>' && seqf_skipline(state) == NULL)
-		return EOF;
+	do {
+		if(state->have == 0 && seqf_fetch(state) != 0)
+			return EOF;
+		if(state->have == 0) /* Fetched no bytes, return EOF */
+			return EOF;
+
+		/* Skip past newline characters, we're interested in what comes next */
+		if(*state->next == '\n') {
+			state->have--;
+			state->next++;
+			continue;
+		}
+
+		/* If start of fasta header, skip it to get to nt, or return on error */
+		if(*state->next == '>') {
+			if(seqf_skipline(state) == NULL)
+				return EOF;
+			continue;
+		}
+		break;
+	} while(true);
 
 	state->have--;
 	return *state->next++;
@@ -136,9 +147,9 @@ seqfagetnt(SeqFile file)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	int ret = seqfagetnt_unlocked(file);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
@@ -4,6 +4,13 @@
  * Subject to the MIT License
  */
 
+#if defined(__linux__)
+#  ifndef _GNU_SOURCE
+#    define _GNU_SOURCE /* memrchr */
+#  endif
+#  define SEQF_HAVE_MEMRCHR
+#endif
+
 #include "seqf_read.h"
 
 size_t
@@ -25,24 +32,24 @@ seqf_qread(seqf_statep state, unsigned char *buffer, size_t bufsize)
 			}
 
 			/* Validate by searching for '@', which must be followed by a '+' */
-			while(--buffer_end && buffer[buffer_end] != '@');
-			register int validate = buffer_end, count = 0;
-			while(validate && count < 3) if(buffer[--validate] == '\n') count++;
-			if(++validate && buffer[validate] == '+') not_validated = false;
+			unsigned char *at = seqf_memrchr(buffer + 1, '@', buffer_end - 1);
+			buffer_end = at != NULL ? (size_t)(at - buffer) : 0;
+
+			/* Walk back three lines, the '+' line starts after the third */
+			size_t validate = buffer_end;
+			for(int count = 0; validate && count < 3; count++) {
+				unsigned char *eol = seqf_memrchr(buffer, '\n', validate);
+				validate = eol != NULL ? (size_t)(eol - buffer) : 0;
+			}
+			if(buffer[validate + 1] == '+') not_validated = false;
 		} while(not_validated);
 
 		/* Copy seq that wasn't fully read into internal buffer */
 		size_t offset = bufsize - buffer_end;
-		if(offset > state->out_bufsiz) {
-			seqferrno_ = 5;
+		if(seqf_unread(state, buffer+buffer_end, offset) != 0)
 			return 0;
-		}
-		memcpy(state->out_buf, buffer+buffer_end, offset);
-		state->have = offset;
-		state->next = state->out_buf;
 	} else {
 		state->have = 0;
-		memset(state->out_buf, 0, state->out_bufsiz);
 	}
 	buffer[buffer_end] = 0;
 	return buffer_end;
@@ -53,9 +60,9 @@ seqfqread(SeqFile file, char *buffer, size_t bufsize)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	size_t bytes_read = seqf_qread(state, (unsigned char *)buffer, bufsize);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return bytes_read;
 }
@@ -83,6 +90,7 @@ seqfqgets_unlocked(SeqFile file, char *buffer, size_t bufsize)
 	unsigned char *buf = (unsigned char *)buffer;
 	unsigned char *eol;
 	size_t left = bufsize - 1;
+	size_t nlines = 0;
 
 	/* Fill buffer with fastq sequence */
 	if(left) do {
@@ -94,13 +102,27 @@ seqfqgets_unlocked(SeqFile file, char *buffer, size_t bufsize)
 			break;
 
 		seqf_shiftandcopy(state, buf, left, eol);
+		nlines += eol != NULL;
 	} while(left);
 
-	seqf_skipline(state); /* Skip '+' line */
-	seqf_skipline(state); /* Skip quality scores */
+	/* A complete sequence of one line gives the length of its quality line,
+	 * so when the '+' line is bare the end of the record is checked, not
+	 * searched for. The next record must start right after it, or a short
+	 * quality line could end within the next header. */
+	size_t len = (size_t)(buf - (unsigned char *)buffer);
+	if(left && nlines == 1 && state->have > len + 3 && state->next[0] == '+'
+	   && state->next[1] == '\n' && state->next[len + 2] == '\n'
+	   && state->next[len + 3] == '@') {
+		state->have -= len + 3;
+		state->next += len + 3;
+	} else {
+		seqf_skipline(state); /* Skip '+' line */
+		seqf_skipline(state); /* Skip quality scores */
+	}
 
 	/* Null terminate and return buffer */
 	buf[0] = '\0';
+	state->stats.records++;
 	return buffer;
 }
 
@@ -109,9 +131,9 @@ seqfqgets(SeqFile file, char *buffer, size_t bufsize)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	char *ret = seqfqgets_unlocked(file, buffer, bufsize);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
@@ -122,25 +144,36 @@ seqfqgetnt_unlocked(SeqFile file)
 	seqf_statep state = (seqf_statep)file;
 	if(state == NULL || state->eof)
 		return EOF;
-	if(state->have == 0 && seqf_fetch(state) != 0)
-		return EOF;
-	if(state->have == 0) /* Fetched no bytes, return EOF */
-		return EOF;
-	
-	/* Skip past newline character, we want to see what's next */
-	if(*state->next == '\n') {
-		state->have--;
-		state->next++;
-	}
 
-	/* If start if fastq header, skip it to get to the nt */
-	if(*state->next == '@' && seqf_skipline(state) == NULL)
-		return EOF;
-	
-	/* If quality scores, skip it and get to the next nt */
-	if(*state->next == '+' && seqf_skipheader(state, '@') == NULL)
-		return EOF;
-	
+	do {
+		if(state->have == 0 && seqf_fetch(state) != 0)
+			return EOF;
+		if(state->have == 0) /* Fetched no bytes, return EOF */
+			return EOF;
+
+		/* Skip past newline character, we want to see what's next */
+		if(*state->next == '\n') {
+			state->have--;
+			state->next++;
+			continue;
+		}
+
+		/* If start if fastq header, skip it to get to the nt */
+		if(*state->next == '@') {
+			if(seqf_skipline(state) == NULL)
+				return EOF;
+			continue;
+		}
+
+		/* If quality scores, skip it and get to the next nt */
+		if(*state->next == '+') {
+			if(seqf_skipheader(state, '@') == NULL)
+				return EOF;
+			continue;
+		}
+		break;
+	} while(true);
+
 	/* In nt, return it and update next & num available bytes */
 	state->have--;
 	return *state->next++;
@@ -151,9 +184,9 @@ seqfqgetnt(SeqFile file)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	int ret = seqfqgetnt_unlocked(file);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
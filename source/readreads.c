@@ -4,6 +4,13 @@
  * Subject to the MIT License
  */
 
+#if defined(__linux__)
+#  ifndef _GNU_SOURCE
+#    define _GNU_SOURCE /* memrchr */
+#  endif
+#  define SEQF_HAVE_MEMRCHR
+#endif
+
 #include "seqf_read.h"
 
 size_t
@@ -16,18 +23,13 @@ seqf_sread(seqf_statep state, unsigned char *buffer, size_t bufsize)
 
 	/* Trim sequence that was not fully read */
 	if(buffer_end == bufsize) {
-		while(--buffer_end && buffer[buffer_end] != '\n');
+		unsigned char *eol = seqf_memrchr(buffer + 1, '\n', buffer_end - 1);
+		buffer_end = eol != NULL ? (size_t)(eol - buffer) : 0;
 		size_t offset = bufsize - ++buffer_end; // increase to include \n
-		if(offset > state->out_bufsiz) {
-			seqferrno_ = 5;
+		if(seqf_unread(state, buffer+buffer_end, offset) != 0)
 			return 0;
-		}
-		memcpy(state->out_buf, buffer+buffer_end, offset);
-		state->have = offset;
-		state->next = state->out_buf;
 	} else {
 		state->have = 0;
-		memset(state->out_buf, 0, state->out_bufsiz);
 	}
 
 	buffer[buffer_end] = '\0';
@@ -39,9 +41,9 @@ seqfsread(SeqFile file, char *buffer, size_t bufsize)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	size_t bytes_read = seqf_sread(state, (unsigned char *)buffer, bufsize);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return bytes_read;
 }
@@ -83,6 +85,7 @@ seqfsgets_unlocked(SeqFile file, char *buffer, size_t bufsize)
 	/* Null terminate the string */
 	*buf = '\0';
 
+	state->stats.records++;
 	return buffer;
 }
 
@@ -91,9 +94,9 @@ seqfsgets(SeqFile file, char *buffer, size_t bufsize)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	char *ret = seqfsgets_unlocked(file, buffer, bufsize);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
@@ -104,16 +107,19 @@ seqfsgetnt_unlocked(SeqFile file)
 	seqf_statep state = (seqf_statep)file;
 	if(state == NULL || state->eof)
 		return EOF;
-	if(state->have == 0 && seqf_fetch(state) != 0)
-		return EOF;
-	if(state->have == 0) /* Fetched no bytes, return EOF */
-		return EOF;
-	
-	/* Skip past newline character to get to nt */
-	if(*state->next == '\n') {
+
+	do {
+		if(state->have == 0 && seqf_fetch(state) != 0)
+			return EOF;
+		if(state->have == 0) /* Fetched no bytes, return EOF */
+			return EOF;
+
+		/* Skip past newline character to get to nt */
+		if(*state->next != '\n')
+			break;
 		state->have--;
 		state->next++;
-	}
+	} while(true);
 
 	/* Now in a nucleotide, return it */
 	state->have--;
@@ -125,9 +131,9 @@ seqfsgetnt(SeqFile file)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	int ret = seqfsgetnt_unlocked(file);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
@@ -0,0 +1,134 @@
+/* seqf_cache.h - Header for seqf's binary cache of sequence files
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * This file should not be used in applications. It is used to implement the
+ * seqf library and is subject to change.
+ *
+ * A cache starts with a SEQF_CACHE_HDRSIZ byte header:
+ *
+ *   0  "SQFC"          magic
+ *   4  u32 version     SEQF_CACHE_VERSION
+ *   8  u8  type        'a', 'q' or 's', as in seqfopen()
+ *   9  u8  flags       SEQF_CACHE_BINNED
+ *  12  u32 block_recs  records in every block but the last
+ *  16  u64 nrecords    records in the file
+ *  24  u64 nblocks     blocks in the file
+ *  32  u64 table       offset of the block table, nblocks u64 offsets
+ *  40  u8  bins[16]    quality character of each bin, if binned
+ *
+ * and is followed by blocks of records, each 8 byte aligned:
+ *
+ *   u64 nrecords, nbases, nruns, name_bytes, qual_bytes, 0
+ *   u64 name_end[nrecords]  end of the header of each record in names
+ *   u64 seq_end[nrecords]   end of the sequence of each record, in bases
+ *   u64 run_end[nrecords]   end of the runs of each record
+ *   runs[nruns]             u64 first base, u32 length, u8 byte, 3 bytes 0
+ *   names                   headers without '>'/'@', padded to 8 bytes
+ *   seq                     2 bits a base, 4 bases a byte, first in the
+ *                           lowest bits, padded to 8 bytes
+ *   qual                    a byte a base, or a bin a nibble when binned,
+ *                           padded to 8 bytes
+ *
+ * Bases other than A, C, G and T are stored as 0 in seq and as runs of the
+ * same byte, so that N's cost nothing until there are some. Lowercase a, c, g
+ * and t are stored as their base in seq and as runs of byte 0, which lower the
+ * bases they cover, so that soft-masking is kept. All integers are little
+ * endian.
+ */
+
+#ifndef SEQF_CACHE_H
+#define SEQF_CACHE_H
+
+#include "seqf_core.h"
+
+#define SEQF_CACHE_MAGIC "SQFC"
+#define SEQF_CACHE_VERSION 2
+#define SEQF_CACHE_HDRSIZ 64
+#define SEQF_CACHE_BLKHDRSIZ 48
+#define SEQF_CACHE_RUNSIZ 16
+
+/* Records in each block, which bounds the memory of the converter */
+#define SEQF_CACHE_BLOCK 4096
+
+/* Qualities are stored as one of 8 bins rather than as they are */
+#define SEQF_CACHE_BINNED 0x01
+
+
+/**
+ * @brief Mapped cache file being read, and the record it is at.
+ */
+struct seqf_cache {
+	const unsigned char *map;      /** Whole file */
+	size_t size;                   /** Size of the file */
+	bool mapped;                   /** map is a mapping, rather than allocated */
+	bool binned;                   /** Qualities are binned */
+	unsigned char bins[16];        /** Quality character of each bin */
+	uint64_t nrecords;             /** Records in the file */
+	uint64_t nblocks;              /** Blocks in the file */
+	uint64_t block_recs;           /** Records in every block but the last */
+	const unsigned char *table;    /** Offsets of the blocks */
+	uint64_t rec;                  /** Next record to read */
+
+	uint64_t blk;                  /** Block the pointers below are of */
+	uint64_t blk_first;            /** First record of the block */
+	uint64_t blk_nrecords;         /** Records in the block */
+	const unsigned char *name_end; /** Arrays and streams of the block */
+	const unsigned char *seq_end;
+	const unsigned char *run_end;
+	const unsigned char *runs;
+	const unsigned char *names;
+	const unsigned char *seq;
+	const unsigned char *qual;
+
+	unsigned char *scratch;        /** Decoded sequence and qualities, or text */
+	size_t scratch_size;           /** Size of scratch */
+	size_t text_len;               /** Text of a record left in scratch */
+	size_t text_pos;               /** Bytes of that text handed out */
+};
+
+
+/**
+ * @brief Map the cache `state' was opened on, which seqfopen() found by its
+ * magic, and read its header. The type of the file becomes that of the cache.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+extern int seqf_cache_open(seqf_statep state);
+
+
+/**
+ * @brief Unmap the cache of `state', if it has one.
+ */
+extern void seqf_cache_close(seqf_statep state);
+
+
+/**
+ * @brief Fill `buffer' with the text of the next records of the cache, as
+ * they would read in a FASTA/FASTQ/sequence file. Only whole records are put
+ * in, unless the first one does not fit in `bufsize' bytes.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+extern int seqf_cache_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread);
+
+
+/**
+ * @brief Read the next record of the cache into `rec'. The header and plain
+ * qualities point into the mapping, and only the sequence is decoded.
+ *
+ * @return int 0 on success, or EOF at the end of file or on error (seqferrno
+ * is set)
+ */
+extern int seqf_cache_nextrec(seqf_statep state, SeqfRecord *rec);
+
+
+/**
+ * @brief Make record `record' of the cache the next one read.
+ *
+ * @return int 0 on success, 1 if there is no such record (seqferrno is set)
+ */
+extern int seqf_cache_seek(seqf_statep state, uint64_t record);
+
+#endif
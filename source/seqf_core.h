@@ -8,6 +8,9 @@
  * seqf library and is subject to change.
  */
 
+#ifndef SEQF_CORE_H
+#define SEQF_CORE_H
+
 #if (_HAS_ISA_L_ == 1)
 #  include <igzip_lib.h>
 #else
@@ -20,16 +23,108 @@
 #  include <tinycthread.h>
 #endif
 
+#include <time.h>
+
 #include "seqfile.h"
 
 extern _Thread_local int seqferrno_;
 
+/* Size and alignment of the buffers of `seqfsethugepages()' */
+#define SEQF_HUGEPAGE ((size_t)2 << 20)
+
+/* Allocation functions of the library, see `seqfsetallocator()' */
+extern void *seqf_malloc(size_t size);
+extern void *seqf_calloc(size_t n, size_t size);
+extern void *seqf_realloc(void *ptr, size_t size);
+extern void seqf_free(void *ptr);
+#if !defined _IGZIP_H
+extern voidpf seqf_zalloc(voidpf opaque, uInt items, uInt size);
+extern void seqf_zfree(voidpf opaque, voidpf address);
+#endif
+
+/* Resize `*buf' from `*bufsiz' to `size' bytes, keeping its contents, on huge
+   pages when `want_huge' and it is large enough. `*huge' tells whether the
+   buffer is on huge pages, and is passed on to `seqf_buffree()'. Returns 0 on
+   success, 1 when out of memory (the buffer is left as it was). */
+extern int seqf_bufresize(unsigned char **buf, size_t *bufsiz, bool *huge, size_t size, bool want_huge);
+extern void seqf_buffree(unsigned char *buf, size_t bufsiz, bool huge);
+
 typedef enum SEQF_COMPRESSION {
 	GZIP,
 	ZLIB,
-	PLAIN
+	BGZF,
+	PLAIN,
+	SQFC                           /** Binary cache, see seqf_cache.h */
 } SEQF_COMPRESSION;
 
+/* Size of a BGZF member header, up to and including the BSIZE subfield */
+#define BGZF_HDRSIZ 18
+
+/* Little endian integers of the gzip, BGZF, index and cache formats */
+static inline uint16_t
+seqf_get16(const unsigned char *p)
+{
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t
+seqf_get32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t
+seqf_get64(const unsigned char *p)
+{
+	return (uint64_t)p[0]       | (uint64_t)p[1] << 8  |
+	       (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+	       (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+	       (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static inline void
+seqf_put16(unsigned char *p, uint16_t v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+static inline void
+seqf_put32(unsigned char *p, uint32_t v)
+{
+	for(int i = 0; i < 4; i++)
+		p[i] = (unsigned char)(v >> 8*i);
+}
+
+static inline void
+seqf_put64(unsigned char *p, uint64_t v)
+{
+	for(int i = 0; i < 8; i++)
+		p[i] = (unsigned char)(v >> 8*i);
+}
+
+/**
+ * @brief Check whether the `n' bytes at `hdr' start a BGZF member: a gzip
+ * header with an extra field whose first subfield is 'BC', of 2 bytes.
+ */
+static inline bool
+seqf_isbgzf(const unsigned char *hdr, size_t n)
+{
+	return n >= BGZF_HDRSIZ && hdr[0] == 0x1F && hdr[1] == 0x8B && (hdr[3] & 0x04) &&
+	       hdr[12] == 'B' && hdr[13] == 'C' && hdr[14] == 2 && hdr[15] == 0;
+}
+
+/* Reads and decompression done for a SeqFile, counted by the thread that does
+   them: on the state when inline, in the block of the ring otherwise */
+struct seqf_io {
+	bool timing;                   /** Also time the calls */
+	uint64_t bytes_in;             /** Bytes read from the file */
+	uint64_t reads;                /** read() and pread() calls */
+	uint64_t read_ns;              /** Time spent in them */
+	uint64_t inflate_ns;           /** Time spent decompressing */
+	uint64_t chunks_kept;          /** Speculative gzip chunks that were kept */
+};
+
 struct seqf_state {
 	int fd;                        /** File descriptor */
 	SEQF_COMPRESSION compression;  /** Type of compression, if any */
@@ -39,14 +134,64 @@ struct seqf_state {
 #else
 	z_stream stream;               /** ZLIB Decompressor */
 	bool stream_is_init;           /** Check is stream is initialized */
+	bool zraw;                     /** Stream was resumed within a deflate block, and
+	                                   inflates raw deflate to the end of the member */
 #endif
+	bool zresumed;                 /** Stream was resumed at a point of zindex */
 
 	unsigned char *in_buf;         /** Input buffer*/
 	size_t in_bufsiz;              /** Size of the input buffer */
 	unsigned char *out_buf;        /** Output buffer */
 	size_t out_bufsiz;             /** Size of the output buffer */
+	size_t out_bufbase;            /** Size out_buf shrinks back to after growing */
+	size_t out_bufmax;             /** Size out_buf may grow to, 0 to never grow */
+	size_t out_small;              /** Records in a row that fit in out_bufbase */
+	bool huge_pages;               /** Put large input/output buffers on huge pages */
+	bool in_huge;                  /** in_buf is on huge pages */
+	bool out_huge;                 /** out_buf is on huge pages */
 	unsigned char *next;           /** Next available byte in output buffer */
 	size_t have;                   /** Numberof bytes available in next */
+	unsigned char *rec_buf;        /** Scratch for records that straddle a fetch */
+	size_t rec_bufsiz;             /** Size of the scratch buffer */
+	int nt_part;                   /** Part of the record seqfreadnt stopped in */
+	size_t nt_seq;                 /** Sequence bytes of that record so far */
+	size_t nt_qual;                /** Quality bytes of that record so far */
+	bool nt_break;                 /** End of a record not yet reported by seqfreadnt */
+	size_t lent;                   /** Bytes at next lent by seqfread_borrow, until released */
+
+	bool use_map;                  /** Allow memory mapping of plain files */
+	unsigned char *map;            /** Read-only mapping of the file, or NULL */
+	size_t map_size;               /** Size of the mapping in bytes */
+	size_t map_pos;                /** Offset of the next unconsumed byte in map */
+	size_t map_off;                /** Bytes mapped before map, to page align it */
+
+	bool ranged;                   /** Only a byte range of the file is read, with pread */
+	size_t range_start;            /** Offset of the first byte of the range */
+	size_t range_pos;              /** Offset of the next byte to read */
+	size_t range_end;              /** Offset where the range stops */
+
+	size_t pipe_nblocks;           /** Blocks in the decompression ring, 0 if inline */
+	size_t pipe_nthreads;          /** Threads filling the ring, 0 for one per processor */
+	struct seqf_pipe *pipe;        /** Background decompression thread, or NULL */
+
+	bool writing;                  /** File was opened for writing */
+	int level;                     /** Compression level of a file opened for writing */
+	struct seqf_writer *writer;    /** Writer of a file opened for writing, or NULL */
+
+	struct seqf_cache *cache;      /** Binary cache being read, or NULL */
+	struct seqf_faidx *faidx;      /** Index of a FASTA file, once loaded */
+	struct seqf_zindex *zindex;    /** Checkpoint index of the file, or NULL */
+	char *path;                    /** Path the file was opened with, or NULL */
+
+	size_t share_nbatches;         /** Batches in shared mode, 0 if not shared */
+	size_t share_nrecords;         /** Records in each batch of shared mode */
+	struct seqf_share *share;      /** Background parser thread, or NULL */
+
+	struct seqf_io io;             /** Reads and decompression done inline or consumed */
+	SeqfStats stats;               /** Other counters, those of io are not used */
+	uint64_t refill_ns;            /** Time spent refilling the output buffer */
+	uint64_t held_at;              /** When the mutex was taken, if timing */
+	uint64_t held_refill;          /** refill_ns when the mutex was taken */
 
 	mtx_t mutex;                   /** Mutex for thread safe functions */
 	bool mutex_is_init;            /** Check if mutex is initialized (for rnafclose) */
@@ -55,3 +200,62 @@ struct seqf_state {
 };
 
 typedef struct seqf_state *seqf_statep;
+
+/* Monotonic time in nanoseconds, for the timings of `seqfsettiming()' */
+static inline uint64_t
+seqf_clock(void)
+{
+	struct timespec ts;
+#if defined CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+	timespec_get(&ts, TIME_UTC);
+#endif
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Start and stop a timing, which costs nothing unless `timing' */
+static inline uint64_t
+seqf_tick(bool timing)
+{
+	return timing ? seqf_clock() : 0;
+}
+
+static inline uint64_t
+seqf_tock(bool timing, uint64_t start)
+{
+	return timing ? seqf_clock() - start : 0;
+}
+
+/* Lock the state for a locked function. With timing, the wait for the mutex
+   and the time it is held, less the refills meanwhile, go to the stats. */
+static inline void
+seqf_lock(seqf_statep state)
+{
+	if(!state->io.timing) {
+		mtx_lock(&state->mutex);
+		return;
+	}
+	uint64_t start = seqf_clock();
+	if(mtx_trylock(&state->mutex) != thrd_success) {
+		mtx_lock(&state->mutex);
+		uint64_t now = seqf_clock();
+		state->stats.lock_ns += now - start;
+		start = now;
+	}
+	state->held_at = start;
+	state->held_refill = state->refill_ns;
+}
+
+static inline void
+seqf_unlock(seqf_statep state)
+{
+	if(state->io.timing) {
+		uint64_t held = seqf_clock() - state->held_at;
+		uint64_t refill = state->refill_ns - state->held_refill;
+		state->stats.parse_ns += held > refill ? held - refill : 0;
+	}
+	mtx_unlock(&state->mutex);
+}
+
+#endif
@@ -0,0 +1,102 @@
+/* seqf_faidx.h - Header for seqf's FASTA index and region fetches
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * This file should not be used in applications. It is used to implement the
+ * seqf library and is subject to change.
+ *
+ * The index is that of samtools faidx. The .fai has a line per sequence:
+ *
+ *   NAME  LENGTH  OFFSET  LINEBASES  LINEWIDTH
+ *
+ * tab separated, where OFFSET is that of the first base in the uncompressed
+ * file, and every line of the sequence but the last holds LINEBASES bases in
+ * LINEWIDTH bytes. A BGZF file also has a .gzi, which is a u64 count followed
+ * by that many u64 pairs, the compressed and uncompressed offset of each BGZF
+ * member but the first, little endian.
+ */
+
+#ifndef SEQF_FAIDX_H
+#define SEQF_FAIDX_H
+
+#include "seqf_core.h"
+
+/* Largest uncompressed size of a BGZF member */
+#define SEQF_BGZF_MAXSIZ 65536
+
+/* Bytes read at a time by a fetch from a plain file */
+#define SEQF_FAIDX_CHUNK ((size_t)1 << 18)
+
+/* Inflated BGZF members kept for the next fetches */
+#define SEQF_FAIDX_NBLKS 16
+
+
+/**
+ * @brief Sequence of the index
+ */
+struct seqf_faidx_seq {
+	const char *name;              /** Name, in the names of the index */
+	size_t name_len;               /** Length of the name */
+	uint64_t length;               /** Bases in the sequence */
+	uint64_t offset;               /** Uncompressed offset of the first base */
+	uint64_t linebases;            /** Bases in each full line */
+	uint64_t linewidth;            /** Bytes in each full line, with its end */
+};
+
+
+/**
+ * @brief Inflated BGZF member
+ */
+struct seqf_faidx_blk {
+	unsigned char *data;           /** Uncompressed bytes, or NULL */
+	size_t len;                    /** Bytes in data */
+	uint64_t coff;                 /** Compressed offset of the member */
+	uint64_t csize;                /** Compressed size of the member */
+	uint64_t uoff;                 /** Uncompressed offset of the member */
+	uint64_t used;                 /** Last use of the member, 0 if none */
+};
+
+
+/**
+ * @brief Index of a FASTA file, and what a fetch keeps between calls.
+ */
+struct seqf_faidx {
+	struct seqf_faidx_seq *seqs;   /** Sequences, in the order of the file */
+	size_t nseqs;                  /** Number of sequences */
+	char *names;                   /** Names of the sequences */
+	size_t *slots;                 /** Hash table of the names, index + 1 or 0 */
+	size_t nslots;                 /** Size of slots, a power of 2 */
+
+	uint64_t *gzi;                 /** Compressed and uncompressed offset of
+	                                   BGZF members, from (0, 0) on */
+	size_t ngzi;                   /** Number of members in gzi */
+
+#if defined _IGZIP_H
+	struct inflate_state *stream;  /** Decompressor of BGZF members */
+#else
+	z_stream stream;               /** Decompressor of BGZF members */
+	bool stream_is_init;           /** Check if stream is initialized */
+#endif
+	unsigned char *member;         /** Compressed member, or a chunk of a plain file */
+	struct seqf_faidx_blk blks[SEQF_FAIDX_NBLKS]; /** Members inflated last */
+	struct seqf_faidx_blk *blk;    /** Member bytes were last taken from, or NULL */
+	uint64_t tick;                 /** Uses of members so far */
+};
+
+
+/**
+ * @brief Load the index of the FASTA file of `state' from `path'.fai, and
+ * `path'.gzi when the file is BGZF, replacing any index it had.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+extern int seqf_faidx_load(seqf_statep state, const char *path);
+
+
+/**
+ * @brief Free the index of `state', if it has one.
+ */
+extern void seqf_faidx_free(seqf_statep state);
+
+#endif
@@ -0,0 +1,131 @@
+/* seqf_inflate.h - Header for seqf's speculative deflate decoder
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * This file should not be used in applications. It is used to implement the
+ * seqf library and is subject to change.
+ */
+
+#ifndef SEQF_INFLATE_H
+#define SEQF_INFLATE_H
+
+#include <stdint.h>
+
+#include "seqf_core.h"
+
+/**
+ * @brief Size of the deflate window, the furthest a match can reach back
+ */
+#define SEQF_WINSIZ 32768
+
+
+/**
+ * @brief Bits resolved by the first level of the literal/length and distance
+ * decoding tables. Longer codes continue into a second level table.
+ */
+#define SEQF_LITBITS 10
+#define SEQF_DISTBITS 8
+
+
+/**
+ * @brief Number of entries in the decoding tables, first and second level
+ */
+#define SEQF_LITSIZ (1024 + 2048)
+#define SEQF_DISTSIZ (256 + 512)
+
+
+/**
+ * @brief Raw deflate decoder that can start at any block boundary of an
+ * in-memory stream without knowing the window that precedes it.
+ *
+ * Output is decoded into 16-bit symbols. Symbols below 256 are bytes, while a
+ * symbol 256 + i is a marker for byte i of the (unknown) 32 KiB window that
+ * precedes the first decoded block. Markers are replaced by real bytes with
+ * `seqf_inflate_resolve()' once the window is known. The output buffer is
+ * preceded by SEQF_WINSIZ context symbols, which hold the markers (or the real
+ * window, when it is known) so that matches are plain copies.
+ */
+struct seqf_inflate {
+	const unsigned char *in;       /** Compressed deflate stream */
+	size_t in_len;                 /** Number of bytes in in */
+	size_t pos;                    /** Bit offset of the next block in in */
+	bool final;                    /** The last block of the stream was decoded */
+
+	uint16_t *out;                 /** Context symbols followed by the output */
+	size_t out_len;                /** Number of output symbols after the context */
+	size_t out_size;               /** Capacity of out after the context */
+
+	uint32_t lit[SEQF_LITSIZ];     /** Literal/length decoding table */
+	uint32_t dist[SEQF_DISTSIZ];   /** Distance decoding table */
+};
+
+
+/**
+ * @brief Prepare `inf' to decode the `in_len' bytes of `in'.
+ *
+ * @return int 0 on success, -1 when out of memory (seqferrno is set)
+ */
+extern int seqf_inflate_init(struct seqf_inflate *inf, const unsigned char *in, size_t in_len);
+
+
+/**
+ * @brief Release the output buffer of `inf'.
+ */
+extern void seqf_inflate_free(struct seqf_inflate *inf);
+
+
+/**
+ * @brief Set the window preceding the next decoded block. The last `wlen'
+ * bytes of the window are `win', everything before them is left as markers.
+ * Use a `wlen' of 0 when the window is unknown, or at the start of a member.
+ */
+extern void seqf_inflate_context(struct seqf_inflate *inf, const unsigned char *win, size_t wlen);
+
+
+/**
+ * @brief Decode blocks starting at bit offset `start', until the block that
+ * starts at or after bit offset `end' is reached or the final block of the
+ * stream was decoded. On return `inf->pos' is the bit offset where decoding
+ * stopped, and the output starts over at `inf->out'+SEQF_WINSIZ.
+ *
+ * @return int 0 on success, 3 when the stream is invalid, -1 when out of
+ * memory (seqferrno is set)
+ */
+extern int seqf_inflate_run(struct seqf_inflate *inf, size_t start, size_t end);
+
+
+/**
+ * @brief Search bit offsets in [`from', `to') for the start of a dynamic
+ * Huffman block. A candidate is only accepted if its whole block decodes
+ * without error into text, which FASTA/FASTQ data always is. The search can
+ * miss blocks (stored, fixed, or final blocks are never reported) and, rarely,
+ * report a false one; callers must check the result against the real stream.
+ *
+ * @param inf   Decoder, whose output is clobbered by the search
+ * @param from  First bit offset to try
+ * @param to    Bit offset to stop searching at
+ * @param found Bit offset of the block found
+ * @return true if a block start was found
+ */
+extern bool seqf_inflate_find(struct seqf_inflate *inf, size_t from, size_t to, size_t *found);
+
+
+/**
+ * @brief Turn `n' decoded symbols into bytes, replacing markers with the bytes
+ * of the window that preceded them. The window is the `wlen' bytes in `win'.
+ *
+ * @return int 0 on success, 3 if a marker refers to a byte before the window
+ */
+extern int seqf_inflate_resolve(const uint16_t *sym, size_t n, const unsigned char *win, size_t wlen, unsigned char *dst);
+
+
+/**
+ * @brief Get the size of the gzip member header at the start of `in'.
+ *
+ * @return size_t Size of the header in bytes, or 0 if `in' does not start with
+ * a complete gzip header
+ */
+extern size_t seqf_inflate_header(const unsigned char *in, size_t in_len);
+
+#endif
@@ -0,0 +1,193 @@
+/* seqf_pipe.h - Header for seqf's background decompression ring
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * This file should not be used in applications. It is used to implement the
+ * seqf library and is subject to change.
+ */
+
+#ifndef SEQF_PIPE_H
+#define SEQF_PIPE_H
+
+#include "seqf_core.h"
+#include "seqf_inflate.h"
+#include "seqf_pool.h"
+
+/**
+ * @brief Default number of blocks in the decompression ring
+ */
+#define SEQF_PIPE_NBLOCKS 4
+
+
+/**
+ * @brief Minimum size of a single block in the decompression ring. Blocks are
+ * at least as large as the output buffer, but handing off tiny blocks between
+ * threads costs more than decompressing them.
+ */
+#define SEQF_PIPE_BLKSIZ (1 << 17)
+
+
+/**
+ * @brief Amount of decompressed data gathered into one ring block when
+ * inflating BGZF members in parallel. A BGZF member holds at most 64 KiB, so
+ * each block bundles several members to amortize the hand-off between threads.
+ */
+#define SEQF_BGZF_CHUNK (1 << 20)
+
+
+/**
+ * @brief Largest and smallest share of a gzip file's compressed bytes handed
+ * to one thread when a single member is inflated speculatively in parallel.
+ * Files are split in about four shares per thread within these bounds.
+ */
+#define SEQF_SPEC_CHUNK (1 << 20)
+#define SEQF_SPEC_MINCHUNK (1 << 15)
+
+
+/**
+ * @brief A block of decompressed bytes produced by a background task.
+ */
+struct seqf_block {
+	unsigned char *data;           /** Decompressed bytes */
+	size_t size;                   /** Capacity of data */
+	size_t len;                    /** Number of bytes filled in data */
+	int ret;                       /** Return code of the decompressor for this block */
+	int err;                       /** seqferrno set while filling this block */
+	bool ready;                    /** Block was filled and can be consumed */
+	bool last;                     /** No block follows this one */
+
+	unsigned char *in;             /** Compressed BGZF members for this block */
+	size_t in_size;                /** Capacity of in */
+	size_t in_len;                 /** Number of compressed bytes in in */
+	size_t need;                   /** Decompressed size of the members in in */
+
+	uint32_t crc;                  /** CRC-32 of data, for speculative chunks */
+	bool member_end;               /** data ends a gzip member, followed by: */
+	uint32_t trailer_crc;          /** CRC-32 stored in the member's trailer */
+	uint32_t trailer_isize;        /** Size stored in the member's trailer */
+
+	struct seqf_io io;             /** Reads and decompression done for this block */
+};
+
+
+/**
+ * @brief Decompressor of one task filling the ring. Tasks come and go, so
+ * each one borrows a context for as long as it runs, and contexts are only
+ * set up the first time they are borrowed.
+ */
+struct seqf_pipe_ctx {
+	bool init;                     /** Context was set up */
+	bool ok;                       /** Setting it up succeeded */
+#if defined _IGZIP_H
+	struct inflate_state *stream;  /** Private decompressor for BGZF members */
+#else
+	z_stream zs;                   /** Private decompressor for BGZF members */
+	z_stream *stream;              /** &zs once initialized */
+#endif
+	struct seqf_inflate *inf;      /** Private decoder for speculative chunks */
+	unsigned char *win;            /** Window of speculative chunks */
+};
+
+
+/**
+ * @brief Ring of decompressed blocks shared by the background tasks and the
+ * reader. A task claims the block at `claimed`, fills it, and marks it ready;
+ * the reader consumes the block at `head` once it is ready, so blocks reach
+ * the reader in file order even when they are filled out of order. Both
+ * counters only ever grow; the slot is the counter modulo `nblocks`.
+ * 
+ * Tasks run on the thread pool. One keeps claiming blocks until the ring is
+ * full, then leaves; the reader submits new ones as it releases blocks, up to
+ * `nthreads` at a time.
+ * 
+ * A gzip/zlib stream is filled by a single task running `seqf_loadz'. BGZF
+ * members are independent, so any number of tasks read a run of members
+ * while holding the mutex, and inflate them after releasing it.
+ *
+ * A gzip regular file can instead be split into chunks of compressed bytes,
+ * one per block, which are inflated speculatively by any number of tasks.
+ * Each chunk then waits for its turn (`resolved') to learn where the chunk
+ * before it really ended and what window it left behind, see `seqf_spec_chunk'.
+ */
+struct seqf_pipe {
+	struct seqf_pool *pool;        /** Pool running the tasks */
+	struct seqf_pipe_ctx *ctx;     /** One context per task that may run at once */
+	size_t *free_ctx;              /** Indices of the contexts no task holds */
+	size_t nfree;                  /** Number of entries in free_ctx */
+	size_t nthreads;               /** Most tasks running at once */
+	size_t running;                /** Tasks running or queued */
+	mtx_t mutex;                   /** Protects the counters and ready flags */
+	cnd_t filled;                  /** Signalled when a block becomes ready */
+	cnd_t idle;                    /** Signalled when the last task leaves */
+
+	struct seqf_block *blocks;     /** Ring of blocks */
+	size_t nblocks;                /** Number of blocks in the ring */
+	size_t head;                   /** Next block to hand to the reader */
+	size_t claimed;                /** Next block for a task to fill */
+	bool stop;                     /** Ask the tasks to leave */
+	bool eos;                      /** The last block has been claimed */
+
+	struct seqf_block *cur;        /** Block currently owned by the reader */
+	size_t cur_pos;                /** Bytes of cur already handed out */
+	bool finished;                 /** Reader consumed the last block */
+
+	bool spec;                     /** Chunks of a gzip file are inflated speculatively */
+	unsigned char *map;            /** Read-only mapping of the gzip file */
+	size_t map_size;               /** Size of the mapping in bytes */
+	size_t chunk;                  /** Compressed bytes in each chunk */
+	size_t resolved;               /** Chunks whose place in the stream is settled */
+	size_t spec_pos;               /** Bit offset where the next chunk has to start */
+	bool spec_final;               /** The last settled chunk ended a gzip member */
+	bool spec_done;                /** No more chunks follow, or one failed */
+	size_t wlen;                   /** Number of bytes in window */
+	unsigned char window[SEQF_WINSIZ]; /** Last 32 KiB decompressed by settled chunks */
+	uint32_t crc;                  /** CRC-32 of the member the reader is in */
+	size_t isize;                  /** Bytes read of the member the reader is in */
+};
+
+
+/**
+ * @brief Start the background decompression tasks for `state'. Called lazily
+ * on the first fetch so that buffer sizes set after opening are honoured.
+ *
+ * @param state Internal state pointer for the SeqFile
+ * @return int 0 on success, 1 on failure (seqferrno is set)
+ */
+extern int seqf_pipe_start(seqf_statep state);
+
+
+/**
+ * @brief Stop the background decompression tasks, wait for them to leave, and
+ * release the ring. Blocks that were decompressed but not yet consumed are discarded, so
+ * this is only used when closing or rewinding the file.
+ *
+ * @param state Internal state pointer for the SeqFile
+ */
+extern void seqf_pipe_stop(seqf_statep state);
+
+
+/**
+ * @brief Pipelined counterpart of `seqf_fetch'. Releases the block the reader
+ * was working on and points state->next at the next decompressed block,
+ * waiting for the background tasks if it is not ready yet.
+ *
+ * @param state Internal state pointer for the SeqFile
+ * @return int 0 on success, 1 on failure
+ */
+extern int seqf_pipe_fetch(seqf_statep state);
+
+
+/**
+ * @brief Pipelined counterpart of `seqf_loadz'. Copies up to `bufsize' bytes
+ * out of the ring into `buffer'.
+ *
+ * @param state   Internal state pointer for the SeqFile
+ * @param buffer  Buffer in which decompressed bytes will be stored in
+ * @param bufsize Requested number of decompressed bytes
+ * @param nread   Actual number of decompressed bytes read into buffer
+ * @return int 0 on success, otherwise the error returned by `seqf_loadz'
+ */
+extern int seqf_pipe_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread);
+
+#endif
@@ -0,0 +1,105 @@
+/* seqf_pool.h - Header for seqf's process-wide thread pool
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * This file should not be used in applications. It is used to implement the
+ * seqf library and is subject to change.
+ */
+
+#ifndef SEQF_POOL_H
+#define SEQF_POOL_H
+
+#include "seqf_core.h"
+
+/**
+ * @brief Initial number of tasks each worker's deque has room for
+ */
+#define SEQF_POOL_DEQUE 64
+
+
+/**
+ * @brief A function to run on the pool, and the group it counts towards.
+ */
+struct seqf_task {
+	void (*fn)(void *);            /** Function to run */
+	void *arg;                     /** Argument of fn */
+	struct seqf_taskgroup *group;  /** Group waiting for the task, or NULL */
+};
+
+
+/**
+ * @brief Tasks of a worker. The worker pushes and pops at `bottom`, newest
+ * first, while idle workers steal from `top`, oldest first. Both counters only
+ * ever grow; the slot is the counter masked by the size minus one.
+ */
+struct seqf_deque {
+	mtx_t mutex;                   /** Protects the deque */
+	struct seqf_task *tasks;       /** Power of two number of slots */
+	size_t size;                   /** Number of slots */
+	size_t top;                    /** Oldest task, next one to steal */
+	size_t bottom;                 /** One past the newest task */
+};
+
+
+/**
+ * @brief Tasks submitted with `seqfsubmit()` that `seqfwait()` waits for.
+ */
+struct seqf_taskgroup {
+	size_t pending;                /** Tasks not finished yet, guarded by the pool lock */
+};
+
+
+/**
+ * @brief Pool of worker threads shared by every SeqFile of the process. A task
+ * submitted by a worker goes to its own deque, any other to the deques in
+ * turn. Workers look for tasks in their own deque first, then steal from the
+ * others, and only sleep when no deque holds a task.
+ */
+struct seqf_pool {
+	thrd_t *threads;               /** Worker threads */
+	size_t nthreads;               /** Number of workers */
+	struct seqf_deque *deques;     /** One deque per worker */
+	bool pin;                      /** Pin worker i to processor i */
+
+	mtx_t lock;                    /** Protects the fields below */
+	cnd_t work;                    /** Signalled when a task is queued or a group is done */
+	size_t queued;                 /** Tasks in all deques */
+	size_t next;                   /** Deque for the next task from outside the pool */
+	bool stop;                     /** Ask the workers to exit once the deques are empty */
+};
+
+
+/**
+ * @brief Number of processors available to the process, at least 1
+ */
+extern size_t seqf_ncpu(void);
+
+
+/**
+ * @brief Get the pool of the process, starting it with one thread per
+ * processor if `seqfpoolcreate()` was not called.
+ *
+ * @return struct seqf_pool* Pool, or NULL on failure (seqferrno is set)
+ */
+extern struct seqf_pool *seqf_pool_get(void);
+
+
+/**
+ * @brief Queue `fn(arg)` on `pool'.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+extern int seqf_pool_submit(struct seqf_pool *pool, void (*fn)(void *), void *arg);
+
+
+/**
+ * @brief Run one queued task on the calling thread, if the calling thread is
+ * a worker of the pool. Used by workers that would otherwise block waiting for
+ * a task queued behind them.
+ *
+ * @return bool true if a task was run
+ */
+extern bool seqf_pool_help(void);
+
+#endif
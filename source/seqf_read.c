@@ -4,73 +4,255 @@
  * Subject to the MIT License
  */
 
+#include <stdlib.h>
+
 #include "seqf_read.h"
+#include "seqf_cache.h"
+#include "seqf_pipe.h"
 
 #ifdef _WIN32
     #include <windows.h>
     #include <io.h>
 	#include <basetsd.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
     #define read _read
 	typedef SSIZE_T ssize_t;
 #else
     #include <unistd.h>
+    #include <sys/stat.h>
 #endif
 
+/* Calls of `seqf_unread' in a row that fit in out_bufbase before a grown
+   output buffer shrinks back */
+#define SEQF_OBUF_SHRINK 64
+
 
 /**
- * @brief Load the state's buffer for PLAIN compression. Fills `buffer` with at 
- * most `bufsize` bytes. Number of bytes in buffer is specified by `nread`.
+ * @brief Read at most `bufsize` bytes from `fd` into `buffer`.
  * 
  * Read continuously until either the buffer is full, or an error/EOF is reached.
  * Multiple read calls are necessary since read is not guaranteed to fill the
  * buffer with the requested number of bytes. As such, keep track of how many
  * bytes it has read, and request the bytes that it needs.
  * 
- * EOF if set in the state when `read` function returns 0 (signifying EOF in 
- * file descriptor) **AND** `nread` is 0, meaning the buffer is empty.
+ * Unlike `seqf_loadp`, this never touches the SeqFile state, so it is safe to
+ * call from the background decompression thread.
  * 
- * @param state    File state to read from
+ * @param fd       File descriptor to read from
  * @param buffer   Buffer to fill with bytes
  * @param bufsize  Number of bytes to read
  * @param nread    Number of bytes actually read
+ * @param io       Counters of the reads
  * @return int 0 on success, -1 on error
  */
 static int
-seqf_loadp(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread)
+seqf_readfd(int fd, unsigned char *buffer, size_t bufsize, size_t *nread, struct seqf_io *io)
 {
 	size_t left = bufsize;
-	ssize_t n;
+	ssize_t n = 0;
 	*nread = 0;
+	uint64_t start = seqf_tick(io->timing);
 	if(left) do {
-		n = read(state->fd, buffer, left);
+		n = read(fd, buffer, left);
+		io->reads++;
 		if(n <= 0)
 			break;
 		left -= n;
 		buffer += n;
 	} while(left);
+	io->read_ns += seqf_tock(io->timing, start);
 	if(n == -1) {
 		seqferrno_ = 1;
 		return -1;
 	}
 	*nread = bufsize - left;
-	if(n == 0 && *nread == 0)
-		state->eof = true;
+	io->bytes_in += *nread;
 	return 0;
 }
 
+
+/**
+ * @brief Read at most `bufsize` bytes at `offset` of `fd` into `buffer`,
+ * without using or moving the file offset of `fd`. Like `seqf_readfd`, keep
+ * reading until the buffer is full, or an error/EOF is reached.
+ * 
+ * @param fd       File descriptor to read from
+ * @param buffer   Buffer to fill with bytes
+ * @param bufsize  Number of bytes to read
+ * @param offset   Offset in the file of the first byte to read
+ * @param nread    Number of bytes actually read
+ * @param io       Counters of the reads
+ * @return int 0 on success, -1 on error
+ */
 extern int
-seqf_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread)
+seqf_preadfd(int fd, unsigned char *buffer, size_t bufsize, size_t offset, size_t *nread,
+             struct seqf_io *io)
 {
-	/* Process plain file */
-	if(state->compression == PLAIN) {
-		if(seqf_loadp(state, buffer, bufsize, nread) != 0)
+	size_t left = bufsize;
+	*nread = 0;
+	uint64_t start = seqf_tick(io->timing);
+	while(left) {
+		io->reads++;
+#ifdef _WIN32
+		OVERLAPPED ov = {0};
+		DWORD n = 0;
+		ov.Offset = (DWORD)offset;
+		ov.OffsetHigh = (DWORD)((unsigned long long)offset >> 32);
+		DWORD want = left > 0x40000000 ? 0x40000000 : (DWORD)left;
+		if(!ReadFile((HANDLE)_get_osfhandle(fd), buffer, want, &n, &ov) &&
+		  GetLastError() != ERROR_HANDLE_EOF) {
+			io->read_ns += seqf_tock(io->timing, start);
+			seqferrno_ = 1;
 			return -1;
-		return 0;
+		}
+#else
+		ssize_t n = pread(fd, buffer, left, (off_t)offset);
+		if(n == -1) {
+			io->read_ns += seqf_tock(io->timing, start);
+			seqferrno_ = 1;
+			return -1;
+		}
+#endif
+		if(n == 0)
+			break;
+		left -= n;
+		buffer += n;
+		offset += n;
+	}
+	io->read_ns += seqf_tock(io->timing, start);
+	*nread = bufsize - left;
+	io->bytes_in += *nread;
+	return 0;
+}
+
+extern size_t
+seqf_filesize(int fd)
+{
+#ifndef _WIN32
+	struct stat st;
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+		return (size_t)-1;
+#else
+	struct _stat64 st;
+	if(_fstat64(fd, &st) != 0 || !(st.st_mode & _S_IFREG))
+		return (size_t)-1;
+#endif
+	return (size_t)st.st_size;
+}
+
+
+/**
+ * @brief Load the state's buffer for PLAIN compression. Fills `buffer` with at 
+ * most `bufsize` bytes. Number of bytes in buffer is specified by `nread`.
+ * 
+ * EOF if set in the state when `read` function returns 0 (signifying EOF in 
+ * file descriptor) **AND** `nread` is 0, meaning the buffer is empty.
+ * 
+ * @param state    File state to read from
+ * @param buffer   Buffer to fill with bytes
+ * @param bufsize  Number of bytes to read
+ * @param nread    Number of bytes actually read
+ * @return int 0 on success, -1 on error
+ */
+static int
+seqf_loadp(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread)
+{
+	if(state->ranged) {
+		/* Byte ranges are read with pread, and stop at the end of the range */
+		size_t n = MIN2(bufsize, state->range_end - state->range_pos);
+		if(seqf_preadfd(state->fd, buffer, n, state->range_pos, nread, &state->io) != 0)
+			return -1;
+		state->range_pos += *nread;
+	} else if(seqf_readfd(state->fd, buffer, bufsize, nread, &state->io) != 0) {
+		return -1;
+	}
+	if(bufsize != 0 && *nread == 0)
+		state->eof = true;
+	return 0;
+}
+
+/**
+ * @brief Load the state's buffer from the memory mapping of a PLAIN file.
+ * Behaves like `seqf_loadp`, except that the bytes are copied out of the
+ * mapping rather than obtained through `read`.
+ */
+static int
+seqf_loadm(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread)
+{
+	size_t n = MIN2(bufsize, state->map_size - state->map_pos);
+	memcpy(buffer, state->map + state->map_pos, n);
+	state->map_pos += n;
+	state->io.bytes_in += n;
+	*nread = n;
+	if(n == 0 && bufsize != 0)
+		state->eof = true;
+	return 0;
+}
+
+/**
+ * @brief Check whether another gzip member follows the one that just ended,
+ * refilling the input buffer if it ran dry. Concatenated gzip files, such as
+ * BGZF, consist of many members which must each be inflated in turn.
+ * 
+ * @param state File state whose stream reached the end of a member
+ * @param io    Counters of the reads
+ * @return true if the next input byte starts another gzip member
+ */
+static bool
+seqf_nextmember(seqf_statep state, struct seqf_io *io)
+{
+	if(state->compression == ZLIB)
+		return false;
+	if(state->stream.avail_in == 0) {
+		size_t nread;
+		if(seqf_readfd(state->fd, state->in_buf, state->in_bufsiz, &nread, io) != 0)
+			return false;
+		if(nread == 0)
+			return false;
+		state->stream.avail_in = nread;
+		state->stream.next_in = state->in_buf;
+	}
+	return state->stream.next_in[0] == 0x1F;
+}
+
+#if !defined _IGZIP_H
+/**
+ * @brief Skip the gzip or zlib trailer of the member that just ended, which
+ * a raw deflate stream leaves in the input.
+ *
+ * @return int 0 on success, -1 on a file read error (seqferrno is set)
+ */
+static int
+seqf_skiptrailer(seqf_statep state, struct seqf_io *io)
+{
+	size_t left = state->compression == ZLIB ? 4 : 8;
+	while(left) {
+		if(state->stream.avail_in == 0) {
+			size_t nread;
+			if(seqf_readfd(state->fd, state->in_buf, state->in_bufsiz, &nread, io) != 0)
+				return -1;
+			if(nread == 0)
+				break;
+			state->stream.avail_in = nread;
+			state->stream.next_in = state->in_buf;
+		}
+		size_t n = MIN2(left, state->stream.avail_in);
+		state->stream.next_in += n;
+		state->stream.avail_in -= n;
+		left -= n;
 	}
+	return 0;
+}
+#endif
 
-	/* Process compressed file */
+extern int
+seqf_loadz(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread,
+           struct seqf_io *io)
+{
 	register int ret;
 	register size_t left = bufsize;
+	uint64_t start;
 	state->stream.next_out = buffer;
 	state->stream.avail_out = bufsize;
 
@@ -78,7 +260,7 @@ seqf_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nrea
 		/* Refill input buffer if empty */
 		if(state->stream.avail_in == 0) {
 			size_t nread;
-			if(seqf_loadp(state, state->in_buf, state->in_bufsiz, &nread) != 0)
+			if(seqf_readfd(state->fd, state->in_buf, state->in_bufsiz, &nread, io) != 0)
 				return -1;
 			if(nread == 0)
 				break;
@@ -87,18 +269,52 @@ seqf_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nrea
 		}
 
 		/* Decompress input buffer into output */
+		start = seqf_tick(io->timing);
 #if defined _IGZIP_H
 		ret = isal_inflate(&state->stream);
+		io->inflate_ns += seqf_tock(io->timing, start);
 		if(ret != ISAL_DECOMP_OK && ret != ISAL_END_INPUT)
 			return 3;
+		if(state->stream.block_state == ISAL_BLOCK_FINISH) {
+			if(!seqf_nextmember(state, io)) {
+				left = state->stream.avail_out;
+				break;
+			}
+			/* Reset for the next member, keeping the buffers in place */
+			uint8_t *next_in = state->stream.next_in;
+			uint32_t avail_in = state->stream.avail_in;
+			uint8_t *next_out = state->stream.next_out;
+			uint32_t avail_out = state->stream.avail_out;
+			isal_inflate_reset(&state->stream);
+			state->stream.crc_flag = ISAL_GZIP;
+			state->stream.next_in = next_in;
+			state->stream.avail_in = avail_in;
+			state->stream.next_out = next_out;
+			state->stream.avail_out = avail_out;
+		}
 		left = state->stream.avail_out;
 	} while(left && ret != ISAL_END_INPUT);
 #else
 		ret = inflate(&state->stream, Z_NO_FLUSH);
+		io->inflate_ns += seqf_tock(io->timing, start);
 		if(ret != Z_BUF_ERROR && ret != Z_OK && ret != Z_STREAM_END) {
 			seqferrno_ = 1;
 			return 3;
 		}
+		if(ret == Z_STREAM_END && state->zraw) {
+			/* Resumed at a point of the index, the stream was inflated as raw
+			   deflate, and has its trailer left to skip */
+			if(seqf_skiptrailer(state, io) != 0)
+				return -1;
+			state->zraw = false;
+			if(seqf_nextmember(state, io)) {
+				inflateReset2(&state->stream, 16 + MAX_WBITS);
+				ret = Z_OK;
+			}
+		} else if(ret == Z_STREAM_END && seqf_nextmember(state, io)) {
+			inflateReset(&state->stream);
+			ret = Z_OK;
+		}
 		left = state->stream.avail_out;
 	} while(left && ret != Z_STREAM_END);
 #endif
@@ -107,9 +323,75 @@ seqf_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nrea
 	return 0;
 }
 
+/**
+ * @brief Body of `seqf_load`, which counts the bytes it produced and times it.
+ */
+static int
+seqf_loadbuf(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread)
+{
+	/* Process memory mapped file */
+	if(state->map != NULL)
+		return seqf_loadm(state, buffer, bufsize, nread);
+
+	/* Process binary cache, whose records are written out as text */
+	if(state->cache != NULL)
+		return seqf_cache_load(state, buffer, bufsize, nread);
+
+	/* Process plain file */
+	if(state->compression == PLAIN)
+		return seqf_loadp(state, buffer, bufsize, nread);
+
+	/* Process compressed file, on the background thread if requested */
+	int ret;
+	if(state->pipe_nblocks != 0)
+		ret = seqf_pipe_load(state, buffer, bufsize, nread);
+	else
+		ret = seqf_loadz(state, buffer, bufsize, nread, &state->io);
+	if(ret != 0)
+		return ret;
+	if(bufsize != 0 && *nread == 0)
+		state->eof = true;
+	return 0;
+}
+
+extern int
+seqf_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread)
+{
+	uint64_t start = seqf_tick(state->io.timing);
+	int ret = seqf_loadbuf(state, buffer, bufsize, nread);
+	state->refill_ns += seqf_tock(state->io.timing, start);
+	if(ret == 0)
+		state->stats.bytes_out += *nread;
+	return ret;
+}
+
 extern int
 seqf_fetch(seqf_statep state)
 {
+	state->stats.fetches++;
+
+	/* Mapped files need no copy, just advance the window over the mapping */
+	if(state->map != NULL) {
+		state->next = state->map + state->map_pos;
+		state->have = state->map_size - state->map_pos;
+		state->map_pos = state->map_size;
+		state->io.bytes_in += state->have;
+		state->stats.bytes_out += state->have;
+		if(state->have == 0)
+			state->eof = true;
+		return 0;
+	}
+
+	/* Pipelined files lend the next decompressed block instead of copying */
+	if(state->pipe_nblocks != 0 && state->compression != PLAIN && state->cache == NULL) {
+		uint64_t start = seqf_tick(state->io.timing);
+		int ret = seqf_pipe_fetch(state);
+		state->refill_ns += seqf_tock(state->io.timing, start);
+		if(ret == 0)
+			state->stats.bytes_out += state->have;
+		return ret;
+	}
+
 	if(seqf_load(state, state->out_buf, state->out_bufsiz, &state->have) != 0)
 		return 1;
 	state->next = state->out_buf;
@@ -128,7 +410,7 @@ seqf_fill(seqf_statep state, unsigned char *buffer, size_t bufsize)
 	/* Fill buffer with decompressed bytes */
 	if(state->have) {
 		size_t n = MIN2(left, state->have);
-		memcpy(buffer, state->out_buf, n);
+		memcpy(buffer, state->next, n);
 
 		/* Move pointers */
 		buffer += n;
@@ -146,6 +428,51 @@ seqf_fill(seqf_statep state, unsigned char *buffer, size_t bufsize)
 	return bufsize - left;
 }
 
+extern int
+seqf_unread(seqf_statep state, const unsigned char *src, size_t n)
+{
+	/* Bytes left over from the fill directly follow the ones to put back */
+	if(state->have != 0) {
+		state->next -= n;
+		state->have += n;
+		return 0;
+	}
+
+	/* Shrink back once the grown buffer has gone unused for a while */
+	if(state->out_bufsiz > state->out_bufbase) {
+		if(n > state->out_bufbase)
+			state->out_small = 0;
+		else if(++state->out_small >= SEQF_OBUF_SHRINK) {
+			seqf_bufresize(&state->out_buf, &state->out_bufsiz, &state->out_huge,
+			               state->out_bufbase, state->huge_pages);
+			state->out_small = 0;
+		}
+	}
+
+	/* Grow geometrically, up to the cap */
+	if(n > state->out_bufsiz) {
+		size_t size = state->out_bufsiz ? state->out_bufsiz : SEQFBUFSIZ;
+		while(size < n)
+			size <<= 1;
+		size = MIN2(size, state->out_bufmax);
+		if(n > size) {
+			seqferrno_ = 5;
+			return 1;
+		}
+		if(seqf_bufresize(&state->out_buf, &state->out_bufsiz, &state->out_huge,
+		                  size, state->huge_pages) != 0) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		state->out_small = 0;
+	}
+
+	memcpy(state->out_buf, src, n);
+	state->next = state->out_buf;
+	state->have = n;
+	return 0;
+}
+
 extern unsigned char *
 seqf_skipheader(seqf_statep state, char skip)
 {
@@ -160,9 +487,10 @@ seqf_skipheader(seqf_statep state, char skip)
 		if(state->have == 0)
 			return NULL;
 		
-		/* Try and skip */
+		/* Try and skip, records usually start right where the last ended */
 		n = state->have;
-		end = memchr(state->next, find, n);
+		end = *state->next == find ? state->next
+		                           : memchr(state->next, find, n);
 		if(end != NULL) {
 			n = (size_t)(end - state->next + 1);
 			if(!found_skp) {
@@ -203,3 +531,86 @@ seqf_skipline(seqf_statep state)
 	} while(eol == NULL);
 	return state->next;
 }
+
+/**
+ * @brief Check whether the line starting at `buf[i]` starts a record of a file
+ * of type `type`. FASTQ quality lines may start with '@' too, but only a
+ * header is followed two lines later by the '+' separator, the same rule that
+ * `seqf_qread` uses to find the last complete record.
+ *
+ * @return int 1 if it is a record, 0 if not, -1 if more bytes are needed
+ */
+static int
+seqf_isrecord(const unsigned char *buf, size_t n, size_t i, unsigned char type, bool eof)
+{
+	if(type == 'a')
+		return buf[i] == '>';
+	if(type != 'q')
+		return 1;
+	if(buf[i] != '@')
+		return 0;
+
+	/* Skip header and sequence lines */
+	for(int line = 0; line < 2; line++) {
+		const unsigned char *eol = memchr(buf + i, '\n', n - i);
+		if(eol == NULL)
+			return eof ? 1 : -1;
+		i = (size_t)(eol - buf) + 1;
+	}
+	if(i >= n)
+		return eof ? 1 : -1;
+	return buf[i] == '+';
+}
+
+extern size_t
+seqf_resync(int fd, unsigned char type, size_t size, size_t offset)
+{
+	if(offset == 0 || offset >= size)
+		return MIN2(offset, size);
+
+	/* Scan from the byte before offset, to know if offset starts a line */
+	size_t base = offset - 1;
+	size_t cap = 4 * SEQFBUFSIZ;
+	unsigned char *buf = NULL;
+	struct seqf_io io = {0}; /* Not counted, no SeqFile reads it yet */
+	while(true) {
+		unsigned char *t = seqf_realloc(buf, cap);
+		if(t == NULL) {
+			seqf_free(buf);
+			seqferrno_ = 6;
+			return (size_t)-1;
+		}
+		buf = t;
+
+		size_t n;
+		if(seqf_preadfd(fd, buf, MIN2(cap, size - base), base, &n, &io) != 0) {
+			seqf_free(buf);
+			return (size_t)-1;
+		}
+		bool eof = base + n >= size;
+
+		/* Test each line that starts at or after offset */
+		size_t i = 0;
+		int found = 0;
+		while(true) {
+			const unsigned char *eol = memchr(buf + i, '\n', n - i);
+			if(eol == NULL) {
+				found = eof ? 1 : -1;
+				i = n;
+				break;
+			}
+			i = (size_t)(eol - buf) + 1;
+			if(i >= n) {
+				found = eof ? 1 : -1;
+				break;
+			}
+			if((found = seqf_isrecord(buf, n, i, type, eof)) != 0)
+				break;
+		}
+		if(found == 1) {
+			seqf_free(buf);
+			return base + i;
+		}
+		cap <<= 1;
+	}
+}
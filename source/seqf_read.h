@@ -20,6 +20,28 @@
 #define MIN2(A, B)      ((A) < (B) ? (A) : (B))
 
 
+/**
+ * @brief Find the last `c' in the `n' bytes at `s', or NULL if there is none.
+ * 
+ * Used by the *read functions to trim the record that was not fully read. The
+ * C library's memrchr is vectorised where it has one; files that use it define
+ * SEQF_HAVE_MEMRCHR along with _GNU_SOURCE before their first include, so that
+ * <string.h> declares it.
+ */
+static inline unsigned char *
+seqf_memrchr(const unsigned char *s, int c, size_t n)
+{
+#ifdef SEQF_HAVE_MEMRCHR
+	return memrchr(s, c, n);
+#else
+	while(n--)
+		if(s[n] == (unsigned char)c)
+			return (unsigned char *)s + n;
+	return NULL;
+#endif
+}
+
+
 /**
  * @brief Loads `buffer' with `bufsize' decompressed bytes and store the number
  * of decompressed bytes read into `read'. Returns 0 on success, -1 on a file
@@ -41,6 +63,68 @@
 extern int seqf_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread);
 
 
+/**
+ * @brief Decompress up to `bufsize' bytes of the compressed stream into
+ * `buffer', refilling the input buffer from the file descriptor as needed.
+ * Returns 0 on success, -1 on a file read error, and 3 when there was an error
+ * decompressing the file stream.
+ * 
+ * This is the part of `seqf_load' that touches neither the output buffer nor
+ * the eof flag, so that the background decompression thread can run it while
+ * the caller parses.
+ * 
+ * @param state   internal state pointer for the SeqFile
+ * @param buffer  Buffer in which decompressed bytes will be stored in
+ * @param bufsize Requested number of decompressed bytes
+ * @param nread   Actual number of decompressed bytes read into buffer
+ * @param io      Counters of the reads and decompression, which belong to the
+ *                thread calling it
+ * @return int 
+ */
+extern int seqf_loadz(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread,
+                      struct seqf_io *io);
+
+
+/**
+ * @brief Read at most `bufsize' bytes at `offset' of `fd' into `buffer' with
+ * pread, so the file offset of `fd' is neither used nor moved. Returns 0 on
+ * success and -1 on a file read error (seqferrno is set).
+ * 
+ * @param fd      File descriptor to read from
+ * @param buffer  Buffer to fill with bytes
+ * @param bufsize Number of bytes to read
+ * @param offset  Offset in the file of the first byte to read
+ * @param nread   Number of bytes actually read
+ * @param io      Counters of the reads
+ * @return int 
+ */
+extern int seqf_preadfd(int fd, unsigned char *buffer, size_t bufsize, size_t offset, size_t *nread,
+                        struct seqf_io *io);
+
+
+/**
+ * @brief Size of the regular file open as `fd', or (size_t)-1 if it is not a
+ * regular file.
+ */
+extern size_t seqf_filesize(int fd);
+
+
+/**
+ * @brief Find the first record of a file of type `type' (see `seqfopen') that
+ * starts at or after `offset'. FASTA records start with a '>' line, FASTQ
+ * records with an '@' line that is followed by a '+' line two lines later,
+ * and any other type is split into lines.
+ * 
+ * @param fd     File descriptor of the plain file, read with pread
+ * @param type   Type of the file
+ * @param size   Size of the file
+ * @param offset Offset to start searching at
+ * @return size_t Offset of the record, `size' if no record follows `offset',
+ * or (size_t)-1 on error (seqferrno is set)
+ */
+extern size_t seqf_resync(int fd, unsigned char type, size_t size, size_t offset);
+
+
 /**
  * @brief Fills the internal output buffer with decompressed bytes. Assumes that
  * state->have is 0 since it will overwrite everything in the output buffer. If
@@ -48,6 +132,9 @@ extern int seqf_load(seqf_statep state, unsigned char *buffer, size_t bufsize, s
  * into the output buffer. Updates state->next to point to the first byte of the
  * output buffer and sets state->have to the size of the internal output buffer.
  * 
+ * If the file is memory mapped, nothing is copied; state->next is pointed at
+ * the remainder of the mapping instead.
+ * 
  * On success return 0, otherwise return 1.
  * 
  * @param state Internal state pointer for the SeqFile
@@ -56,6 +143,23 @@ extern int seqf_load(seqf_statep state, unsigned char *buffer, size_t bufsize, s
 extern int seqf_fetch(seqf_statep state);
 
 
+/**
+ * @brief Put back the last `n' bytes that `seqf_fill' copied, now at `src',
+ * so that they are read again next. Used by the *read functions for the part
+ * of a record that did not fit in the caller's buffer.
+ * 
+ * The bytes are kept in the output buffer, which grows geometrically up to
+ * state->out_bufmax when they do not fit, and shrinks back to
+ * state->out_bufbase after enough calls in a row that did not need it.
+ * 
+ * @param state Internal state pointer for the SeqFile
+ * @param src   Bytes to put back
+ * @param n     Number of bytes at src
+ * @return int 0 on success, 1 when they cannot be kept (seqferrno is set)
+ */
+extern int seqf_unread(seqf_statep state, const unsigned char *src, size_t n);
+
+
 /**
  * @brief Fills `buffer' with `bufsize' decompressed bytes. First, it will fill
  * buffer with the next available bytes from the internal output buffer. If not
@@ -132,6 +236,7 @@ extern unsigned char *seqf_skipline(seqf_statep state);
 \
 	/* Copy the line (without \n) and shift internal pointer */ \
 	memcpy(buf, state->next, n); \
+	state->stats.bytes_copied += n; \
 	left -= n; \
 	buf  += n; \
 \
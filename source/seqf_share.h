@@ -0,0 +1,100 @@
+/* seqf_share.h - Header for seqf's shared-reader batch distribution
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * This file should not be used in applications. It is used to implement the
+ * seqf library and is subject to change.
+ */
+
+#ifndef SEQF_SHARE_H
+#define SEQF_SHARE_H
+
+#include "seqf_core.h"
+
+#if !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+
+/**
+ * @brief Default number of records in each batch handed out in shared mode.
+ */
+#define SEQF_SHARE_RECORDS 256
+
+
+/**
+ * @brief A batch together with its place in the file.
+ */
+struct seqf_shbatch {
+	SeqfBatch batch;               /** Records, first so consumers get a pointer to it */
+	size_t seqno;                  /** Number of batches that came before it */
+};
+
+
+/**
+ * @brief One slot of a `seqf_ring`. `seq` tells whose turn the slot is: equal
+ * to the position of a push that may fill it, one more than that once it is
+ * filled and waiting for the pop at the same position.
+ */
+struct seqf_slot {
+	atomic_size_t seq;             /** Turn of the slot, see above */
+	struct seqf_shbatch *item;     /** Batch stored in the slot */
+};
+
+
+/**
+ * @brief Bounded lock-free queue that any number of threads push to and pop
+ * from. Each side claims a position with a single compare-and-swap on its own
+ * counter, which sit on separate cache lines. The counters only ever grow; the
+ * slot is the counter masked by `mask`.
+ */
+struct seqf_ring {
+	struct seqf_slot *slots;       /** Power of two number of slots */
+	size_t mask;                   /** Number of slots minus one */
+	_Alignas(64) atomic_size_t head; /** Next position to pop */
+	_Alignas(64) atomic_size_t tail; /** Next position to push */
+};
+
+
+/**
+ * @brief State of a SeqFile in shared mode. A parser thread reads batches of
+ * records into free batches and pushes them to `full`, from which consumers
+ * claim them; consumers push them back to `avail` when done with them. Both
+ * rings have room for every batch, so a push never fails. Threads only take
+ * `mutex` to sleep when their ring is empty, after announcing themselves in
+ * `waiters`, which the other side checks after every push.
+ */
+struct seqf_share {
+	thrd_t thread;                 /** Parser thread */
+	struct seqf_shbatch *batches;  /** All batches, owned by whoever popped them */
+	size_t nbatches;               /** Number of batches */
+	size_t nrecords;               /** Records read into each batch */
+	struct seqf_ring full;         /** Batches ready for consumers, in file order */
+	struct seqf_ring avail;        /** Batches the parser can fill */
+
+	atomic_bool done;              /** The parser read its last batch */
+	atomic_bool stop;              /** Ask the parser to exit */
+	int err;                       /** seqferrno of the parser when it stopped */
+
+	atomic_int waiters;            /** Threads asleep, or about to sleep, on wake */
+	mtx_t mutex;                   /** Only guards sleeping on wake */
+	cnd_t wake;                    /** Signalled after a push when there are waiters */
+};
+#endif
+
+
+/**
+ * @brief Start the parser thread of shared mode, with the number of batches
+ * and records set by `seqfsetshared()`.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+int seqf_share_start(seqf_statep state);
+
+
+/**
+ * @brief Stop the parser thread of shared mode and free its batches, if it is
+ * running. Every batch must have been returned.
+ */
+void seqf_share_stop(seqf_statep state);
+
+#endif
@@ -0,0 +1,107 @@
+/* seqf_write.h - Header for seqf's buffered, multithreaded writer
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * This file should not be used in applications. It is used to implement the
+ * seqf library and is subject to change.
+ */
+
+#ifndef SEQF_WRITE_H
+#define SEQF_WRITE_H
+
+#include "seqf_core.h"
+
+/**
+ * @brief Uncompressed bytes in each block of a compressed file. A gzip file
+ * gets one member per block, and a BGZF file as many members as it takes.
+ */
+#define SEQF_WRITE_CHUNK ((size_t)1 << 18)
+
+
+/**
+ * @brief Most uncompressed bytes in one BGZF member, as in htslib, so that
+ * the member still fits in 64 KiB when its data does not compress.
+ */
+#define SEQF_BGZF_BLOCK 0xff00
+
+
+/**
+ * @brief Default compression level of files opened for writing.
+ */
+#define SEQF_WRITE_LEVEL 6
+
+
+/**
+ * @brief Block of a file opened for writing. It is filled by the writer,
+ * compressed by a task on the pool, and written out by the writer once every
+ * block before it has been.
+ */
+struct seqf_wblock {
+	struct seqf_writer *writer;    /** Writer the block belongs to */
+	unsigned char *data;           /** Uncompressed bytes */
+	size_t len;                    /** Number of bytes in data */
+	unsigned char *out;            /** Compressed members holding data */
+	size_t out_size;               /** Capacity of out */
+	size_t out_len;                /** Number of bytes in out */
+	int ret;                       /** 0 when compressed, otherwise the error */
+	int err;                       /** seqferrno set while compressing */
+	bool ready;                    /** Block was compressed and can be written */
+
+#if defined _IGZIP_H
+	struct isal_zstream stream;    /** Compressor of this block */
+	unsigned char *level_buf;      /** Work area of the compressor */
+#else
+	z_stream stream;               /** Compressor of this block */
+#endif
+	bool stream_init;              /** The compressor was set up */
+};
+
+
+/**
+ * @brief State of a SeqFile opened for writing. Plain files are staged in the
+ * output buffer of the SeqFile. Compressed files are staged in the block at
+ * `tail`, and the blocks from `head` to `tail` are being compressed.
+ */
+struct seqf_writer {
+	SEQF_COMPRESSION compression;  /** Compression of the file */
+	int level;                     /** Compression level, 0 to 9 */
+	size_t len;                    /** Bytes staged and not handed on yet */
+	struct seqf_wblock *blocks;    /** Ring of blocks, allocated on the first write */
+	size_t nblocks;                /** Number of blocks in the ring */
+	size_t head;                   /** Oldest block not written out yet */
+	size_t tail;                   /** Block being filled */
+	struct seqf_pool *pool;        /** Pool compressing the blocks, NULL for inline */
+
+	mtx_t mutex;                   /** Guards the ready flag of the blocks */
+	cnd_t done;                    /** Signalled when a block is compressed */
+	int err;                       /** seqferrno of the first failure, 0 if none */
+};
+
+
+/**
+ * @brief Write all `len' bytes of `buf' to `fd'.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+extern int seqf_writefd(int fd, const unsigned char *buf, size_t len);
+
+
+/**
+ * @brief Set up `state', whose mode asked for writing, to write `fd'.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+extern int seqf_writer_start(seqf_statep state);
+
+
+/**
+ * @brief Write out everything staged, end a BGZF file with its empty member,
+ * and release the writer, if `state' has one.
+ *
+ * @return int 0 on success, 1 if anything failed to be written (seqferrno is
+ * set)
+ */
+extern int seqf_writer_stop(seqf_statep state);
+
+#endif
@@ -0,0 +1,105 @@
+/* seqf_zindex.h - Header for seqf's checkpoint index of compressed files
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * This file should not be used in applications. It is used to implement the
+ * seqf library and is subject to change.
+ *
+ * As zlib's zran, the index keeps points where inflation can start over: the
+ * first bit of a deflate block, along with the 32 KiB of output that precede
+ * it, or the first byte of a gzip member, which needs no window. Each point
+ * also has the first record that starts at or after it. Plain files have
+ * points too, which are just offsets.
+ *
+ * An index is saved as a SEQF_ZINDEX_HDRSIZ byte header:
+ *
+ *   0  "SQFZ"          magic
+ *   4  u32 version     SEQF_ZINDEX_VERSION
+ *   8  u8  type        type of the file, as in seqfopen()
+ *   9  u8  compression of the file, see SEQF_COMPRESSION
+ *  16  u64 span        bytes of output between points
+ *  24  u64 npoints     points in the index
+ *  32  u64 nrecords    records in the file
+ *  40  u64 size        bytes of output of the whole file
+ *  48  u64 file_size   size of the file itself
+ *  56  u64 windows     bytes of compressed windows
+ *
+ * followed by npoints points of SEQF_ZINDEX_POINTSIZ bytes:
+ *
+ *   u64 coff, uoff, record, rec_off, win, u32 wsize, u16 wlen, u8 bits,
+ *   u8 kind
+ *
+ * and the windows, each compressed with zlib. All integers are little endian.
+ */
+
+#ifndef SEQF_ZINDEX_H
+#define SEQF_ZINDEX_H
+
+#include "seqf_core.h"
+
+#define SEQF_ZINDEX_MAGIC "SQFZ"
+#define SEQF_ZINDEX_VERSION 1
+#define SEQF_ZINDEX_HDRSIZ 64
+#define SEQF_ZINDEX_POINTSIZ 48
+
+/* Bytes of output between points when none are given */
+#define SEQF_ZINDEX_SPAN ((size_t)4 << 20)
+
+/* Size of the deflate window, the output a point needs to start over */
+#define SEQF_ZINDEX_WINSIZ 32768
+
+/* Kinds of points */
+#define SEQF_ZPOINT_BLOCK 0            /** Deflate block, within a member */
+#define SEQF_ZPOINT_MEMBER 1           /** First byte of a gzip member */
+#define SEQF_ZPOINT_PLAIN 2            /** Byte of a plain file */
+
+
+/**
+ * @brief Point where reading can start over
+ */
+struct seqf_zpoint {
+	uint64_t coff;                 /** Offset in the file of the first whole byte */
+	uint64_t uoff;                 /** Offset of the point in the output */
+	uint64_t record;               /** First record that starts at or after uoff */
+	uint64_t rec_off;              /** Offset of that record in the output */
+	uint64_t win;                  /** Offset of the window in the windows */
+	uint32_t wsize;                /** Compressed size of the window */
+	uint32_t wlen;                 /** Bytes of output in the window */
+	uint8_t bits;                  /** Bits of the block in the byte before coff */
+	uint8_t kind;                  /** SEQF_ZPOINT_* */
+};
+
+
+/**
+ * @brief Checkpoint index of a file
+ */
+struct seqf_zindex {
+	unsigned char type;            /** Type of the file records were counted by */
+	SEQF_COMPRESSION compression;  /** Compression of the file */
+	uint64_t span;                 /** Bytes of output between points */
+	struct seqf_zpoint *points;    /** Points, in the order of the file */
+	size_t npoints;                /** Number of points */
+	uint64_t nrecords;             /** Records in the file */
+	uint64_t size;                 /** Bytes of output of the whole file */
+	uint64_t file_size;            /** Size of the file itself */
+	unsigned char *windows;        /** Compressed windows of the points */
+	size_t windows_len;            /** Bytes in windows */
+};
+
+
+/**
+ * @brief Free the checkpoint index of `state', if it has one.
+ */
+extern void seqf_zindex_free(seqf_statep state);
+
+
+/**
+ * @brief Make record `record' of the indexed file of `state' the next one
+ * read, starting from the last point before it.
+ *
+ * @return int 0 on success, -1 on error (seqferrno is set)
+ */
+extern int seqf_zindex_seekrec(seqf_statep state, uint64_t record);
+
+#endif
@@ -0,0 +1,162 @@
+/* seqfalloc.c - seqf's memory allocation
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * Every allocation of the library goes through these functions, so that an
+ * application can route them to an allocator of its own.
+ */
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+#endif
+
+#include "seqf_read.h"
+
+/* Allocator set by seqfsetallocator, all NULL for the C library's */
+static SeqfAllocator seqf_allocator;
+
+int
+seqfsetallocator(const SeqfAllocator *allocator)
+{
+	if(allocator == NULL) {
+		memset(&seqf_allocator, 0, sizeof seqf_allocator);
+		return 0;
+	}
+	if(allocator->alloc == NULL || allocator->resize == NULL || allocator->release == NULL) {
+		seqferrno_ = 8;
+		return -1;
+	}
+	seqf_allocator = *allocator;
+	return 0;
+}
+
+extern void *
+seqf_malloc(size_t size)
+{
+	if(seqf_allocator.alloc == NULL)
+		return malloc(size);
+	return seqf_allocator.alloc(size, seqf_allocator.opaque);
+}
+
+extern void *
+seqf_calloc(size_t n, size_t size)
+{
+	if(seqf_allocator.alloc == NULL)
+		return calloc(n, size);
+	if(size != 0 && n > SIZE_MAX / size)
+		return NULL;
+	void *ptr = seqf_allocator.alloc(n * size, seqf_allocator.opaque);
+	if(ptr != NULL)
+		memset(ptr, 0, n * size);
+	return ptr;
+}
+
+extern void *
+seqf_realloc(void *ptr, size_t size)
+{
+	if(seqf_allocator.resize == NULL)
+		return realloc(ptr, size);
+	return seqf_allocator.resize(ptr, size, seqf_allocator.opaque);
+}
+
+extern void
+seqf_free(void *ptr)
+{
+	if(seqf_allocator.release == NULL)
+		free(ptr);
+	else if(ptr != NULL)
+		seqf_allocator.release(ptr, seqf_allocator.opaque);
+}
+
+#if !defined _IGZIP_H
+extern voidpf
+seqf_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	(void)opaque;
+	return seqf_calloc(items, size);
+}
+
+extern void
+seqf_zfree(voidpf opaque, voidpf address)
+{
+	(void)opaque;
+	seqf_free(address);
+}
+#endif
+
+/**
+ * @brief Map `size' bytes of anonymous memory at a multiple of
+ * SEQF_HUGEPAGE, and ask the kernel to back them with huge pages.
+ *
+ * @return unsigned char* Mapping, or NULL if it could not be made
+ */
+static unsigned char *
+seqf_hugemap(size_t size)
+{
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+	/* Map one huge page too many, then trim to the alignment */
+	size_t len = size + SEQF_HUGEPAGE;
+	unsigned char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(map == MAP_FAILED)
+		return NULL;
+	size_t head = (SEQF_HUGEPAGE - (uintptr_t)map % SEQF_HUGEPAGE) % SEQF_HUGEPAGE;
+	if(head)
+		munmap(map, head);
+	if(len - head > size)
+		munmap(map + head + size, len - head - size);
+	map += head;
+	madvise(map, size, MADV_HUGEPAGE); /* Only a hint */
+	return map;
+#else
+	(void)size;
+	return NULL;
+#endif
+}
+
+extern int
+seqf_bufresize(unsigned char **buf, size_t *bufsiz, bool *huge, size_t size, bool want_huge)
+{
+	/* Huge buffers span whole huge pages, smaller ones gain nothing from them */
+	unsigned char *map = NULL;
+	if(want_huge && size >= SEQF_HUGEPAGE)
+		map = seqf_hugemap((size + SEQF_HUGEPAGE - 1) / SEQF_HUGEPAGE * SEQF_HUGEPAGE);
+	bool mapped = map != NULL;
+
+	if(!mapped && !*huge) {
+		unsigned char *t = seqf_realloc(*buf, size);
+		if(t == NULL)
+			return 1;
+		*buf = t;
+		*bufsiz = size;
+		return 0;
+	}
+	if(!mapped && (map = seqf_malloc(size)) == NULL)
+		return 1;
+
+	/* Moving to or from a mapping, keep the contents like realloc would */
+	if(*buf != NULL)
+		memcpy(map, *buf, MIN2(*bufsiz, size));
+	seqf_buffree(*buf, *bufsiz, *huge);
+	*buf = map;
+	*bufsiz = size;
+	*huge = mapped;
+	return 0;
+}
+
+extern void
+seqf_buffree(unsigned char *buf, size_t bufsiz, bool huge)
+{
+#if !defined(_WIN32)
+	if(huge) {
+		munmap(buf, (bufsiz + SEQF_HUGEPAGE - 1) / SEQF_HUGEPAGE * SEQF_HUGEPAGE);
+		return;
+	}
+#else
+	(void)bufsiz;
+	(void)huge;
+#endif
+	seqf_free(buf);
+}
@@ -0,0 +1,816 @@
+/* seqfcache.c - seqf functions for the binary cache of sequence files
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#ifdef _WIN32
+    #include <io.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #define open _open
+    #define close _close
+    #define lseek _lseek
+    #define O_WRONLY _O_WRONLY
+    #define O_CREAT _O_CREAT
+    #define O_TRUNC _O_TRUNC
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#include "seqf_read.h"
+#include "seqf_cache.h"
+#include "seqf_share.h"
+#include "seqf_write.h"
+#include "seqf_zindex.h"
+
+/* Two bases of each nibble of the sequence stream, the first in its low bits */
+static const char seqf_cache_pairs[33] = "AACAGATAACCCGCTCAGCGGGTGATCTGTTT";
+
+/* Quality character of each bin, as Illumina bins Phred+33 qualities */
+static const unsigned char seqf_cache_bins[16] = "#'07<BFI";
+
+/* Highest Phred score of each bin but the last */
+static const unsigned char seqf_cache_binmax[7] = {2, 9, 19, 24, 29, 34, 39};
+
+/* Bytes to pad a section with */
+static const unsigned char seqf_cache_zeros[8] = {0};
+
+#define SEQF_PAD8(n) (((n) + 7) & ~(uint64_t)7)
+
+/**
+ * @brief Make sure the scratch buffer of `c' holds at least `size' bytes.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_cache_reserve(struct seqf_cache *c, size_t size)
+{
+	if(size <= c->scratch_size)
+		return 0;
+	size_t n = c->scratch_size ? c->scratch_size : SEQFBUFSIZ;
+	while(n < size)
+		n <<= 1;
+	unsigned char *tmp = seqf_realloc(c->scratch, n);
+	if(tmp == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	c->scratch = tmp;
+	c->scratch_size = n;
+	return 0;
+}
+
+extern int
+seqf_cache_open(seqf_statep state)
+{
+	size_t size = seqf_filesize(state->fd);
+	if(size == (size_t)-1) {
+		seqferrno_ = 4;
+		return 1;
+	}
+	if(size < SEQF_CACHE_HDRSIZ) {
+		seqferrno_ = 10;
+		return 1;
+	}
+	struct seqf_cache *c = seqf_calloc(1, sizeof *c);
+	if(c == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	state->cache = c;
+	c->size = size;
+
+	/* Reopening a mapped cache costs nothing, whatever was read before */
+#ifndef _WIN32
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, state->fd, 0);
+	if(map != MAP_FAILED) {
+		c->map = map;
+		c->mapped = true;
+	}
+#endif
+	if(c->map == NULL) {
+		unsigned char *buf = seqf_malloc(size);
+		if(buf == NULL) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		c->map = buf;
+		size_t pos = 0, nread = 1;
+		while(pos < size && nread != 0) {
+			if(seqf_preadfd(state->fd, buf + pos, size - pos, pos, &nread, &state->io) != 0)
+				return 1;
+			pos += nread;
+		}
+		if(pos != size) {
+			seqferrno_ = 10;
+			return 1;
+		}
+	}
+
+	/* Header */
+	const unsigned char *h = c->map;
+	unsigned char type = h[8];
+	c->binned = h[9] & SEQF_CACHE_BINNED;
+	c->block_recs = seqf_get32(h + 12);
+	c->nrecords = seqf_get64(h + 16);
+	c->nblocks = seqf_get64(h + 24);
+	uint64_t table = seqf_get64(h + 32);
+	memcpy(c->bins, h + 40, sizeof c->bins);
+	if(memcmp(h, SEQF_CACHE_MAGIC, 4) != 0 || seqf_get32(h + 4) != SEQF_CACHE_VERSION ||
+	   (type != 'a' && type != 'q' && type != 's') || (h[9] & ~SEQF_CACHE_BINNED) ||
+	   c->block_recs == 0 ||
+	   c->nblocks != c->nrecords / c->block_recs + (c->nrecords % c->block_recs != 0) ||
+	   table % 8 != 0 || table > size || (size - table) / 8 < c->nblocks) {
+		seqferrno_ = 10;
+		return 1;
+	}
+	c->table = c->map + table;
+	c->blk = UINT64_MAX;
+	state->type = type;
+	return 0;
+}
+
+extern void
+seqf_cache_close(seqf_statep state)
+{
+	struct seqf_cache *c = state->cache;
+	if(c == NULL)
+		return;
+#ifndef _WIN32
+	if(c->mapped)
+		munmap((void *)c->map, c->size);
+	else
+#endif
+	seqf_free((void *)c->map);
+	seqf_free(c->scratch);
+	seqf_free(c);
+	state->cache = NULL;
+}
+
+/**
+ * @brief Take the next section of `size' bytes, padded to 8, out of the
+ * `*left' bytes at `*p'.
+ *
+ * @return const unsigned char* The section, or NULL if the bytes run out
+ */
+static const unsigned char *
+seqf_cache_take(const unsigned char **p, uint64_t *left, uint64_t size)
+{
+	if(size > *left || SEQF_PAD8(size) > *left)
+		return NULL;
+	const unsigned char *section = *p;
+	*p += SEQF_PAD8(size);
+	*left -= SEQF_PAD8(size);
+	return section;
+}
+
+/**
+ * @brief Point `c' at the arrays and streams of block `blk', checking that
+ * they lie within the file.
+ *
+ * @return int 0 on success, 1 if the block is malformed (seqferrno is set)
+ */
+static int
+seqf_cache_block(struct seqf_cache *c, unsigned char type, uint64_t blk)
+{
+	if(blk == c->blk)
+		return 0;
+	c->blk = UINT64_MAX;
+	uint64_t off = seqf_get64(c->table + 8*blk);
+	if(off > c->size || c->size - off < SEQF_CACHE_BLKHDRSIZ) {
+		seqferrno_ = 10;
+		return 1;
+	}
+	const unsigned char *p = c->map + off;
+	uint64_t nrecords = seqf_get64(p);
+	uint64_t nbases = seqf_get64(p + 8);
+	uint64_t nruns = seqf_get64(p + 16);
+	uint64_t name_bytes = seqf_get64(p + 24);
+	uint64_t qual_bytes = seqf_get64(p + 32);
+	uint64_t first = blk * c->block_recs;
+	uint64_t left = c->size - off - SEQF_CACHE_BLKHDRSIZ;
+	p += SEQF_CACHE_BLKHDRSIZ;
+
+	uint64_t qual_want = type != 'q' ? 0 : c->binned ? nbases / 2 + nbases % 2 : nbases;
+	if(nrecords != MIN2(c->block_recs, c->nrecords - first) || nruns > left / SEQF_CACHE_RUNSIZ ||
+	   nbases / 4 > left || qual_bytes != qual_want || (type == 's' && name_bytes != 0)) {
+		seqferrno_ = 10;
+		return 1;
+	}
+	if((c->name_end = seqf_cache_take(&p, &left, 8 * nrecords)) == NULL ||
+	   (c->seq_end = seqf_cache_take(&p, &left, 8 * nrecords)) == NULL ||
+	   (c->run_end = seqf_cache_take(&p, &left, 8 * nrecords)) == NULL ||
+	   (c->runs = seqf_cache_take(&p, &left, SEQF_CACHE_RUNSIZ * nruns)) == NULL ||
+	   (c->names = seqf_cache_take(&p, &left, name_bytes)) == NULL ||
+	   (c->seq = seqf_cache_take(&p, &left, nbases / 4 + (nbases % 4 != 0))) == NULL ||
+	   (c->qual = seqf_cache_take(&p, &left, qual_bytes)) == NULL) {
+		seqferrno_ = 10;
+		return 1;
+	}
+	c->blk = blk;
+	c->blk_first = first;
+	c->blk_nrecords = nrecords;
+	return 0;
+}
+
+/**
+ * @brief Where the parts of a record lie in its block
+ */
+struct seqf_crec {
+	const unsigned char *hdr;      /** Header, without '>'/'@' */
+	size_t hdr_len;                /** Number of bytes in hdr */
+	uint64_t base;                 /** First base in the block */
+	size_t len;                    /** Number of bases */
+	uint64_t run;                  /** First run in the block */
+	uint64_t nruns;                /** Number of runs */
+};
+
+/**
+ * @brief Find record `rec' of the cache of `state', loading its block.
+ *
+ * @return int 0 on success, 1 if the record is malformed (seqferrno is set)
+ */
+static int
+seqf_cache_locate(seqf_statep state, uint64_t rec, struct seqf_crec *r)
+{
+	struct seqf_cache *c = state->cache;
+	if(seqf_cache_block(c, state->type, rec / c->block_recs) != 0)
+		return 1;
+	uint64_t i = rec - c->blk_first;
+
+	/* Every array holds the ends, so a record starts where the last ended */
+	uint64_t name0 = i ? seqf_get64(c->name_end + 8*(i-1)) : 0;
+	uint64_t name1 = seqf_get64(c->name_end + 8*i);
+	uint64_t seq0 = i ? seqf_get64(c->seq_end + 8*(i-1)) : 0;
+	uint64_t seq1 = seqf_get64(c->seq_end + 8*i);
+	uint64_t run0 = i ? seqf_get64(c->run_end + 8*(i-1)) : 0;
+	uint64_t run1 = seqf_get64(c->run_end + 8*i);
+	const unsigned char *blk = c->map + seqf_get64(c->table + 8*c->blk);
+	if(name0 > name1 || name1 > seqf_get64(blk + 24) ||
+	   seq0 > seq1 || seq1 > seqf_get64(blk + 8) ||
+	   run0 > run1 || run1 > seqf_get64(blk + 16)) {
+		seqferrno_ = 10;
+		return 1;
+	}
+	r->hdr = c->names + name0;
+	r->hdr_len = name1 - name0;
+	r->base = seq0;
+	r->len = seq1 - seq0;
+	r->run = run0;
+	r->nruns = run1 - run0;
+	return 0;
+}
+
+/**
+ * @brief Decode the sequence of `r' into `dst': the 2-bit codes a nibble at
+ * a time, then the runs of other bytes over them, and of 0 to lower them.
+ *
+ * @return int 0 on success, 1 if a run lies outside the record (seqferrno is
+ * set)
+ */
+static int
+seqf_cache_seqto(struct seqf_cache *c, const struct seqf_crec *r, unsigned char *dst)
+{
+	const unsigned char *seq = c->seq;
+	uint64_t p = r->base, end = r->base + r->len;
+	unsigned char *d = dst;
+	for(; p < end && p % 4 != 0; p++)
+		*d++ = (unsigned char)seqf_cache_pairs[2 * (seq[p / 4] >> 2*(p % 4) & 3)];
+	for(; end - p >= 4; p += 4) {
+		unsigned char b = seq[p / 4];
+		memcpy(d, seqf_cache_pairs + 2 * (b & 15), 2);
+		memcpy(d + 2, seqf_cache_pairs + 2 * (b >> 4), 2);
+		d += 4;
+	}
+	for(; p < end; p++)
+		*d++ = (unsigned char)seqf_cache_pairs[2 * (seq[p / 4] >> 2*(p % 4) & 3)];
+
+	for(uint64_t i = 0; i < r->nruns; i++) {
+		const unsigned char *run = c->runs + SEQF_CACHE_RUNSIZ * (r->run + i);
+		uint64_t start = seqf_get64(run);
+		uint32_t len = seqf_get32(run + 8);
+		if(start < r->base || start > end || len > end - start) {
+			seqferrno_ = 10;
+			return 1;
+		}
+		unsigned char *d = dst + (start - r->base);
+		if(run[12] != 0)
+			memset(d, run[12], len);
+		else
+			for(uint32_t j = 0; j < len; j++)
+				d[j] |= 0x20;
+	}
+	return 0;
+}
+
+/**
+ * @brief Decode the binned qualities of `r' into `dst'.
+ */
+static void
+seqf_cache_qualto(struct seqf_cache *c, const struct seqf_crec *r, unsigned char *dst)
+{
+	for(size_t i = 0; i < r->len; i++) {
+		uint64_t p = r->base + i;
+		dst[i] = c->bins[c->qual[p / 2] >> 4*(p % 2) & 15];
+	}
+}
+
+/**
+ * @brief Length of the text of `r' in a file of type `type'.
+ */
+static size_t
+seqf_cache_textlen(unsigned char type, const struct seqf_crec *r)
+{
+	switch(type) {
+	case 'q': return r->hdr_len + 2*r->len + 6;
+	case 'a': return r->hdr_len + r->len + 3;
+	default:  return r->len + 1;
+	}
+}
+
+/**
+ * @brief Write the text of `r' to `dst', which has room for all of it.
+ *
+ * @return int 0 on success, 1 if the record is malformed (seqferrno is set)
+ */
+static int
+seqf_cache_render(seqf_statep state, const struct seqf_crec *r, unsigned char *dst)
+{
+	struct seqf_cache *c = state->cache;
+	if(state->type != 's') {
+		*dst++ = state->type == 'q' ? '@' : '>';
+		memcpy(dst, r->hdr, r->hdr_len);
+		dst += r->hdr_len;
+		*dst++ = '\n';
+	}
+	if(seqf_cache_seqto(c, r, dst) != 0)
+		return 1;
+	dst += r->len;
+	*dst++ = '\n';
+	if(state->type == 'q') {
+		*dst++ = '+';
+		*dst++ = '\n';
+		if(c->binned)
+			seqf_cache_qualto(c, r, dst);
+		else
+			memcpy(dst, c->qual + r->base, r->len);
+		dst += r->len;
+		*dst++ = '\n';
+	}
+	return 0;
+}
+
+extern int
+seqf_cache_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread)
+{
+	struct seqf_cache *c = state->cache;
+	*nread = 0;
+
+	/* Rest of a record that did not fit the last buffer */
+	if(c->text_pos < c->text_len) {
+		size_t n = MIN2(bufsize, c->text_len - c->text_pos);
+		memcpy(buffer, c->scratch + c->text_pos, n);
+		c->text_pos += n;
+		*nread = n;
+		return 0;
+	}
+
+	size_t n = 0;
+	while(n < bufsize && c->rec < c->nrecords) {
+		struct seqf_crec r;
+		if(seqf_cache_locate(state, c->rec, &r) != 0)
+			return 1;
+		size_t len = seqf_cache_textlen(state->type, &r);
+		if(len <= bufsize - n) {
+			if(seqf_cache_render(state, &r, buffer + n) != 0)
+				return 1;
+			n += len;
+			c->rec++;
+			continue;
+		}
+		if(n != 0)
+			break;
+
+		/* A record larger than the buffer is handed out in pieces */
+		if(seqf_cache_reserve(c, len) != 0 || seqf_cache_render(state, &r, c->scratch) != 0)
+			return 1;
+		memcpy(buffer, c->scratch, bufsize);
+		c->text_len = len;
+		c->text_pos = n = bufsize;
+		c->rec++;
+	}
+	*nread = n;
+	if(bufsize != 0 && n == 0)
+		state->eof = true;
+	return 0;
+}
+
+extern int
+seqf_cache_nextrec(seqf_statep state, SeqfRecord *rec)
+{
+	struct seqf_cache *c = state->cache;
+	if(c->rec == c->nrecords) {
+		state->eof = true;
+		return EOF;
+	}
+	struct seqf_crec r;
+	if(seqf_cache_locate(state, c->rec, &r) != 0)
+		return EOF;
+	bool decode_qual = state->type == 'q' && c->binned;
+	if(seqf_cache_reserve(c, decode_qual ? 2*r.len : r.len) != 0)
+		return EOF;
+	if(seqf_cache_seqto(c, &r, c->scratch) != 0)
+		return EOF;
+
+	/* Split the header into name and comment, as seqfnextrec() does */
+	const unsigned char *h = r.hdr;
+	size_t i = 0;
+	while(i < r.hdr_len && h[i] != ' ' && h[i] != '\t')
+		i++;
+	rec->name = state->type != 's' ? (const char *)h : NULL;
+	rec->name_len = i;
+	while(i < r.hdr_len && (h[i] == ' ' || h[i] == '\t'))
+		i++;
+	rec->comment = i < r.hdr_len ? (const char *)h + i : NULL;
+	rec->comment_len = r.hdr_len - i;
+
+	rec->seq = (const char *)c->scratch;
+	rec->seq_len = r.len;
+	rec->qual = NULL;
+	rec->qual_len = 0;
+	if(state->type == 'q') {
+		if(decode_qual)
+			seqf_cache_qualto(c, &r, c->scratch + r.len);
+		rec->qual = decode_qual ? (const char *)c->scratch + r.len : (const char *)c->qual + r.base;
+		rec->qual_len = r.len;
+	}
+	c->rec++;
+	return 0;
+}
+
+extern int
+seqf_cache_seek(seqf_statep state, uint64_t record)
+{
+	struct seqf_cache *c = state->cache;
+	if(record > c->nrecords) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	c->rec = record;
+	c->text_len = c->text_pos = 0;
+	state->have = 0;
+	state->eof = false;
+	return 0;
+}
+
+/**
+ * @brief Growable stream of a block being built
+ */
+struct seqf_cstream {
+	unsigned char *data;
+	size_t len;
+	size_t size;
+};
+
+/**
+ * @brief Make room for `n' more bytes in `s', which are zeroed.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_cstream_grow(struct seqf_cstream *s, size_t n)
+{
+	if(s->len + n > s->size) {
+		size_t size = s->size ? s->size : SEQFBUFSIZ;
+		while(size < s->len + n)
+			size <<= 1;
+		unsigned char *tmp = seqf_realloc(s->data, size);
+		if(tmp == NULL) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		s->data = tmp;
+		s->size = size;
+	}
+	memset(s->data + s->len, 0, n);
+	return 0;
+}
+
+/**
+ * @brief Cache being written, and the block being built
+ */
+struct seqf_cbuild {
+	int fd;                        /** Cache file */
+	unsigned char type;            /** Type of the records */
+	bool binned;                   /** Bin the qualities */
+	uint64_t nrecords;             /** Records written so far */
+	uint64_t offset;               /** Offset of the next block */
+	struct seqf_cstream table;     /** Offsets of the blocks written */
+
+	size_t n;                      /** Records in the block */
+	uint64_t nbases;               /** Bases in the block */
+	struct seqf_cstream ends;      /** name_end, seq_end and run_end, one after the other */
+	struct seqf_cstream runs;
+	struct seqf_cstream names;
+	struct seqf_cstream seq;
+	struct seqf_cstream qual;
+};
+
+/**
+ * @brief Add the sequence and qualities of `rec' to the block of `b'.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_cbuild_seq(struct seqf_cbuild *b, const SeqfRecord *rec)
+{
+	const unsigned char *s = (const unsigned char *)rec->seq;
+	size_t len = rec->seq_len;
+	uint64_t base = b->nbases;
+	size_t nbytes = (base + len + 3) / 4;
+	if(nbytes > b->seq.len) {
+		if(seqf_cstream_grow(&b->seq, nbytes - b->seq.len) != 0)
+			return 1;
+		b->seq.len = nbytes;
+	}
+
+	for(size_t i = 0; i < len; i++) {
+		uint64_t p = base + i;
+		unsigned char c = s[i], u = c & 0xDF;
+		if(u == 'A' || u == 'C' || u == 'G' || u == 'T') {
+			b->seq.data[p / 4] |= (unsigned char)((((c >> 1) ^ (c >> 2)) & 3) << 2*(p % 4));
+			if(c == u)
+				continue;
+
+			/* Soft-masked bases are also put in a run of 0, which lowers them */
+			c = 0;
+		}
+
+		/* Anything else is left as an A, and put in a run of its byte */
+		uint64_t run0 = b->n ? seqf_get64(b->ends.data + 8*(2*SEQF_CACHE_BLOCK + b->n - 1)) : 0;
+		if(b->runs.len >= SEQF_CACHE_RUNSIZ && b->runs.len / SEQF_CACHE_RUNSIZ > run0) {
+			unsigned char *last = b->runs.data + b->runs.len - SEQF_CACHE_RUNSIZ;
+			if(last[12] == c && seqf_get64(last) + seqf_get32(last + 8) == p &&
+			   seqf_get32(last + 8) != UINT32_MAX) {
+				seqf_put32(last + 8, seqf_get32(last + 8) + 1);
+				continue;
+			}
+		}
+		if(seqf_cstream_grow(&b->runs, SEQF_CACHE_RUNSIZ) != 0)
+			return 1;
+		unsigned char *run = b->runs.data + b->runs.len;
+		seqf_put64(run, p);
+		seqf_put32(run + 8, 1);
+		run[12] = c;
+		b->runs.len += SEQF_CACHE_RUNSIZ;
+	}
+
+	if(b->type == 'q' && !b->binned) {
+		if(seqf_cstream_grow(&b->qual, len) != 0)
+			return 1;
+		memcpy(b->qual.data + b->qual.len, rec->qual, len);
+		b->qual.len += len;
+	} else if(b->type == 'q') {
+		size_t qbytes = (base + len + 1) / 2;
+		if(qbytes > b->qual.len) {
+			if(seqf_cstream_grow(&b->qual, qbytes - b->qual.len) != 0)
+				return 1;
+			b->qual.len = qbytes;
+		}
+		for(size_t i = 0; i < len; i++) {
+			uint64_t p = base + i;
+			unsigned char q = (unsigned char)rec->qual[i];
+			int phred = q > 33 ? q - 33 : 0;
+			unsigned char bin = 0;
+			while(bin < 7 && phred > seqf_cache_binmax[bin])
+				bin++;
+			b->qual.data[p / 2] |= (unsigned char)(bin << 4*(p % 2));
+		}
+	}
+	b->nbases += len;
+	return 0;
+}
+
+/**
+ * @brief Write `len' bytes of `data' to the cache of `b', padded to 8.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_cbuild_write(struct seqf_cbuild *b, const unsigned char *data, size_t len)
+{
+	size_t pad = SEQF_PAD8(len) - len;
+	if(seqf_writefd(b->fd, data, len) != 0 || seqf_writefd(b->fd, seqf_cache_zeros, pad) != 0)
+		return 1;
+	b->offset += len + pad;
+	return 0;
+}
+
+/**
+ * @brief Write the block being built, if it has any records, and start the
+ * next one.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_cbuild_flush(struct seqf_cbuild *b)
+{
+	if(b->n == 0)
+		return 0;
+	if(seqf_cstream_grow(&b->table, 8) != 0)
+		return 1;
+	seqf_put64(b->table.data + b->table.len, b->offset);
+	b->table.len += 8;
+
+	unsigned char hdr[SEQF_CACHE_BLKHDRSIZ] = {0};
+	seqf_put64(hdr, b->n);
+	seqf_put64(hdr + 8, b->nbases);
+	seqf_put64(hdr + 16, b->runs.len / SEQF_CACHE_RUNSIZ);
+	seqf_put64(hdr + 24, b->names.len);
+	seqf_put64(hdr + 32, b->qual.len);
+	if(seqf_cbuild_write(b, hdr, sizeof hdr) != 0)
+		return 1;
+	for(int a = 0; a < 3; a++)
+		if(seqf_cbuild_write(b, b->ends.data + 8*a*SEQF_CACHE_BLOCK, 8 * b->n) != 0)
+			return 1;
+	if(seqf_cbuild_write(b, b->runs.data, b->runs.len) != 0 ||
+	   seqf_cbuild_write(b, b->names.data, b->names.len) != 0 ||
+	   seqf_cbuild_write(b, b->seq.data, b->seq.len) != 0 ||
+	   seqf_cbuild_write(b, b->qual.data, b->qual.len) != 0)
+		return 1;
+
+	b->n = 0;
+	b->nbases = 0;
+	b->runs.len = b->names.len = b->seq.len = b->qual.len = 0;
+	return 0;
+}
+
+/**
+ * @brief Add `rec' to the cache of `b'.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_cbuild_add(struct seqf_cbuild *b, const SeqfRecord *rec)
+{
+	if(b->type == 'q' && rec->qual_len != rec->seq_len) {
+		seqferrno_ = 8;
+		return 1;
+	}
+
+	/* The header is kept as the name and the comment, after a space */
+	if(b->type != 's') {
+		size_t len = rec->name_len + (rec->comment_len ? rec->comment_len + 1 : 0);
+		if(seqf_cstream_grow(&b->names, len) != 0)
+			return 1;
+		memcpy(b->names.data + b->names.len, rec->name, rec->name_len);
+		if(rec->comment_len) {
+			b->names.data[b->names.len + rec->name_len] = ' ';
+			memcpy(b->names.data + b->names.len + rec->name_len + 1, rec->comment, rec->comment_len);
+		}
+		b->names.len += len;
+	}
+	if(seqf_cbuild_seq(b, rec) != 0)
+		return 1;
+
+	seqf_put64(b->ends.data + 8*b->n, b->names.len);
+	seqf_put64(b->ends.data + 8*(SEQF_CACHE_BLOCK + b->n), b->nbases);
+	seqf_put64(b->ends.data + 8*(2*SEQF_CACHE_BLOCK + b->n), b->runs.len / SEQF_CACHE_RUNSIZ);
+	b->n++;
+	b->nrecords++;
+	if(b->n == SEQF_CACHE_BLOCK)
+		return seqf_cbuild_flush(b);
+	return 0;
+}
+
+/**
+ * @brief Write the records left in `state' to the cache `b'.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_cbuild_run(seqf_statep state, struct seqf_cbuild *b)
+{
+	if(seqf_cstream_grow(&b->ends, 3 * 8 * SEQF_CACHE_BLOCK) != 0)
+		return 1;
+	unsigned char hdr[SEQF_CACHE_HDRSIZ] = {0};
+	if(seqf_cbuild_write(b, hdr, sizeof hdr) != 0)
+		return 1;
+
+	SeqfRecord rec;
+	while(seqfnextrec_unlocked((SeqFile)state, &rec) == 0)
+		if(seqf_cbuild_add(b, &rec) != 0)
+			return 1;
+	if(seqferrno_ != 0 || seqf_cbuild_flush(b) != 0)
+		return 1;
+
+	/* The header goes in last, once the blocks are known */
+	uint64_t table = b->offset;
+	if(seqf_cbuild_write(b, b->table.data, b->table.len) != 0)
+		return 1;
+	memcpy(hdr, SEQF_CACHE_MAGIC, 4);
+	seqf_put32(hdr + 4, SEQF_CACHE_VERSION);
+	hdr[8] = b->type;
+	hdr[9] = b->binned ? SEQF_CACHE_BINNED : 0;
+	seqf_put32(hdr + 12, SEQF_CACHE_BLOCK);
+	seqf_put64(hdr + 16, b->nrecords);
+	seqf_put64(hdr + 24, b->table.len / 8);
+	seqf_put64(hdr + 32, table);
+	if(b->binned)
+		memcpy(hdr + 40, seqf_cache_bins, sizeof seqf_cache_bins);
+	if(lseek(b->fd, 0, SEEK_SET) != 0) {
+		seqferrno_ = 1;
+		return 1;
+	}
+	return seqf_writefd(b->fd, hdr, sizeof hdr);
+}
+
+int
+seqfcache(SeqFile file, const char *path, bool bin_quals)
+{
+	if(file == NULL || path == NULL) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	seqf_statep state = (seqf_statep)file;
+	if(state->type != 'a' && state->type != 'q' && state->type != 's') {
+		seqferrno_ = 4;
+		return 1;
+	}
+
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef _WIN32
+	flags |= O_BINARY;
+#endif
+	struct seqf_cbuild b = {0};
+	b.fd = open(path, flags, 0666);
+	if(b.fd == -1) {
+		seqferrno_ = 1;
+		return 1;
+	}
+	b.type = state->type;
+	b.binned = bin_quals && state->type == 'q';
+
+	seqf_lock(state);
+	seqferrno_ = 0;
+	int ret = seqf_cbuild_run(state, &b);
+	seqf_unlock(state);
+
+	int err = seqferrno_;
+	if(close(b.fd) != 0 && ret == 0) {
+		err = 1;
+		ret = 1;
+	}
+	if(ret != 0)
+		remove(path);
+	seqf_free(b.table.data);
+	seqf_free(b.ends.data);
+	seqf_free(b.runs.data);
+	seqf_free(b.names.data);
+	seqf_free(b.seq.data);
+	seqf_free(b.qual.data);
+	seqferrno_ = err;
+	return ret;
+}
+
+int
+seqfseekrec(SeqFile file, size_t record)
+{
+	if(file == NULL)
+		return -1;
+	seqf_statep state = (seqf_statep)file;
+	if(state->cache == NULL && state->zindex == NULL) {
+		seqferrno_ = 12;
+		return -1;
+	}
+	seqf_share_stop(state);
+	state->nt_part = 0;
+	state->nt_break = false;
+	state->lent = 0;
+	if(state->cache != NULL ? seqf_cache_seek(state, record) != 0 : seqf_zindex_seekrec(state, record) != 0)
+		return -1;
+	if(state->share_nbatches && seqf_share_start(state) != 0)
+		return -1;
+	return 0;
+}
+
+size_t
+seqfnrecords(SeqFile file)
+{
+	if(file == NULL)
+		return (size_t)-1;
+	seqf_statep state = (seqf_statep)file;
+	if(state->cache != NULL)
+		return (size_t)state->cache->nrecords;
+	if(state->zindex != NULL)
+		return (size_t)state->zindex->nrecords;
+	seqferrno_ = 12;
+	return (size_t)-1;
+}
@@ -0,0 +1,880 @@
+/* seqffaidx.c - seqf functions for indexed FASTA, as samtools faidx
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "seqf_read.h"
+#include "seqf_faidx.h"
+
+/* FNV-1a, to find names in the hash table of the index */
+static inline size_t
+seqf_faidx_hash(const char *name, size_t len)
+{
+	uint64_t h = 14695981039346656037u;
+	for(size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char)name[i]) * 1099511628211u;
+	return (size_t)h;
+}
+
+/**
+ * @brief Read the whole of the file at `path' into an allocated buffer, with
+ * a '\0' after its `*size' bytes.
+ *
+ * @return unsigned char* The contents, or NULL on error (seqferrno is set)
+ */
+static unsigned char *
+seqf_faidx_slurp(const char *path, size_t *size)
+{
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL) {
+		seqferrno_ = 1;
+		return NULL;
+	}
+	size_t len = 0, cap = 1 << 16;
+	unsigned char *buf = seqf_malloc(cap);
+	while(buf != NULL) {
+		len += fread(buf + len, 1, cap - len - 1, fp);
+		if(len < cap - 1)
+			break;
+		unsigned char *tmp = seqf_realloc(buf, cap *= 2);
+		if(tmp == NULL)
+			seqf_free(buf);
+		buf = tmp;
+	}
+	if(buf == NULL) {
+		fclose(fp);
+		seqferrno_ = 6;
+		return NULL;
+	}
+	if(ferror(fp)) {
+		fclose(fp);
+		seqf_free(buf);
+		seqferrno_ = 1;
+		return NULL;
+	}
+	fclose(fp);
+	buf[len] = '\0';
+	*size = len;
+	return buf;
+}
+
+/**
+ * @brief Find the compressed and uncompressed offset of every member of the
+ * BGZF file `fd', from the size in the header and trailer of each. The empty
+ * member at the end of the file is counted like any other.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_faidx_members(int fd, uint64_t **gzi, size_t *ngzi, struct seqf_io *io)
+{
+	size_t n = 0, cap = 1024;
+	uint64_t *offs = seqf_malloc(2 * cap * sizeof *offs);
+	if(offs == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+
+	/* The trailer of a member is read along with the header of the next */
+	unsigned char buf[4 + BGZF_HDRSIZ];
+	uint64_t coff = 0, uoff = 0;
+	size_t nread;
+	if(seqf_preadfd(fd, buf + 4, BGZF_HDRSIZ, 0, &nread, io) != 0)
+		goto fail;
+	while(nread != 0) {
+		const unsigned char *hdr = buf + 4;
+		if(!seqf_isbgzf(hdr, nread)) {
+			seqferrno_ = 10;
+			goto fail;
+		}
+		size_t bsize = (size_t)seqf_get16(hdr + 16) + 1;
+		if(bsize < BGZF_HDRSIZ + 8) {
+			seqferrno_ = 10;
+			goto fail;
+		}
+		if(n == cap) {
+			uint64_t *tmp = seqf_realloc(offs, 4 * cap * sizeof *offs);
+			if(tmp == NULL) {
+				seqferrno_ = 6;
+				goto fail;
+			}
+			offs = tmp;
+			cap *= 2;
+		}
+		offs[2*n] = coff;
+		offs[2*n + 1] = uoff;
+		n++;
+
+		if(seqf_preadfd(fd, buf, sizeof buf, coff + bsize - 4, &nread, io) != 0)
+			goto fail;
+		if(nread < 4) {
+			seqferrno_ = 10;
+			goto fail;
+		}
+		coff += bsize;
+		uoff += seqf_get32(buf);
+		nread -= 4;
+	}
+	*gzi = offs;
+	*ngzi = n;
+	return 0;
+
+fail:
+	seqf_free(offs);
+	return 1;
+}
+
+/**
+ * @brief Read the .gzi of the BGZF file of `state' from `path', or find the
+ * members of the file when there is no such file.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_faidx_loadgzi(seqf_statep state, struct seqf_faidx *fx, const char *path)
+{
+	size_t size;
+	unsigned char *buf = seqf_faidx_slurp(path, &size);
+	if(buf == NULL) {
+		if(seqferrno_ != 1 || errno != ENOENT)
+			return 1;
+		seqferrno_ = 0;
+		return seqf_faidx_members(state->fd, &fx->gzi, &fx->ngzi, &state->io);
+	}
+
+	uint64_t n = size >= 8 ? seqf_get64(buf) : 0;
+	if(size < 8 || n > (size - 8) / 16 || size != 8 + 16*n) {
+		seqf_free(buf);
+		seqferrno_ = 10;
+		return 1;
+	}
+	fx->gzi = seqf_malloc(2 * (n + 1) * sizeof *fx->gzi);
+	if(fx->gzi == NULL) {
+		seqf_free(buf);
+		seqferrno_ = 6;
+		return 1;
+	}
+	fx->gzi[0] = fx->gzi[1] = 0;
+	for(uint64_t i = 0; i < 2*n; i++)
+		fx->gzi[i + 2] = seqf_get64(buf + 8 + 8*i);
+	fx->ngzi = n + 1;
+	seqf_free(buf);
+
+	/* Members must follow each other */
+	for(size_t i = 1; i < fx->ngzi; i++) {
+		if(fx->gzi[2*i] <= fx->gzi[2*i - 2] || fx->gzi[2*i + 1] < fx->gzi[2*i - 1]) {
+			seqferrno_ = 10;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Parse the .fai in `buf' into the sequences of `fx', whose names
+ * point into `buf'.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_faidx_parse(struct seqf_faidx *fx, char *buf)
+{
+	size_t cap = 0;
+	for(char *p = buf; *p != '\0'; p++)
+		cap += *p == '\n';
+	fx->seqs = seqf_malloc((cap + 1) * sizeof *fx->seqs);
+	if(fx->seqs == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+
+	char *p = buf;
+	while(*p != '\0') {
+		char *eol = strchr(p, '\n');
+		if(eol == p) {
+			p++;
+			continue;
+		}
+		char *tab = strchr(p, '\t');
+		if(tab == NULL || (eol != NULL && tab > eol))
+			goto malformed;
+		struct seqf_faidx_seq *s = &fx->seqs[fx->nseqs];
+		s->name = p;
+		s->name_len = (size_t)(tab - p);
+
+		/* Length, offset, line bases and line width, and for FASTQ the offset
+		   of the qualities, which is of no use here */
+		uint64_t *fields[4] = {&s->length, &s->offset, &s->linebases, &s->linewidth};
+		p = tab;
+		for(int i = 0; i < 4; i++) {
+			if(*p != '\t' || p[1] < '0' || p[1] > '9')
+				goto malformed;
+			errno = 0;
+			*fields[i] = strtoull(p + 1, &p, 10);
+			if(errno != 0)
+				goto malformed;
+		}
+		if(*p != '\t' && *p != '\n' && *p != '\r' && *p != '\0')
+			goto malformed;
+		if(s->length != 0 && (s->linebases == 0 || s->linewidth <= s->linebases))
+			goto malformed;
+		fx->nseqs++;
+		p = eol == NULL ? p + strlen(p) : eol + 1;
+	}
+	return 0;
+
+malformed:
+	seqferrno_ = 10;
+	return 1;
+}
+
+/**
+ * @brief Put the sequences of `fx' in its hash table. The first of several
+ * sequences with the same name is the one found.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_faidx_hashall(struct seqf_faidx *fx)
+{
+	fx->nslots = 16;
+	while(fx->nslots < 2 * fx->nseqs)
+		fx->nslots <<= 1;
+	fx->slots = seqf_calloc(fx->nslots, sizeof *fx->slots);
+	if(fx->slots == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	for(size_t i = 0; i < fx->nseqs; i++) {
+		const struct seqf_faidx_seq *s = &fx->seqs[i];
+		size_t h = seqf_faidx_hash(s->name, s->name_len) & (fx->nslots - 1);
+		while(fx->slots[h] != 0) {
+			const struct seqf_faidx_seq *o = &fx->seqs[fx->slots[h] - 1];
+			if(o->name_len == s->name_len && memcmp(o->name, s->name, s->name_len) == 0)
+				break;
+			h = (h + 1) & (fx->nslots - 1);
+		}
+		if(fx->slots[h] == 0)
+			fx->slots[h] = i + 1;
+	}
+	return 0;
+}
+
+static const struct seqf_faidx_seq *
+seqf_faidx_find(const struct seqf_faidx *fx, const char *name)
+{
+	size_t len = strlen(name);
+	size_t h = seqf_faidx_hash(name, len) & (fx->nslots - 1);
+	while(fx->slots[h] != 0) {
+		const struct seqf_faidx_seq *s = &fx->seqs[fx->slots[h] - 1];
+		if(s->name_len == len && memcmp(s->name, name, len) == 0)
+			return s;
+		h = (h + 1) & (fx->nslots - 1);
+	}
+	return NULL;
+}
+
+extern void
+seqf_faidx_free(seqf_statep state)
+{
+	struct seqf_faidx *fx = state->faidx;
+	if(fx == NULL)
+		return;
+#if defined _IGZIP_H
+	seqf_free(fx->stream);
+#else
+	if(fx->stream_is_init)
+		inflateEnd(&fx->stream);
+#endif
+	seqf_free(fx->seqs);
+	seqf_free(fx->names);
+	seqf_free(fx->slots);
+	seqf_free(fx->gzi);
+	seqf_free(fx->member);
+	for(size_t i = 0; i < SEQF_FAIDX_NBLKS; i++)
+		seqf_free(fx->blks[i].data);
+	seqf_free(fx);
+	state->faidx = NULL;
+}
+
+/**
+ * @brief Append `ext' to `path'.
+ *
+ * @return char* The new path, or NULL when out of memory (seqferrno is set)
+ */
+static char *
+seqf_faidx_path(const char *path, const char *ext)
+{
+	size_t len = strlen(path);
+	char *p = seqf_malloc(len + strlen(ext) + 1);
+	if(p == NULL) {
+		seqferrno_ = 6;
+		return NULL;
+	}
+	memcpy(p, path, len);
+	strcpy(p + len, ext);
+	return p;
+}
+
+extern int
+seqf_faidx_load(seqf_statep state, const char *path)
+{
+	/* Only the bytes of plain files and BGZF members can be found again */
+	if(state->compression != PLAIN && state->compression != BGZF) {
+		seqferrno_ = 12;
+		return 1;
+	}
+	seqf_faidx_free(state);
+	struct seqf_faidx *fx = seqf_calloc(1, sizeof *fx);
+	if(fx == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	state->faidx = fx;
+
+	char *fai = seqf_faidx_path(path, ".fai");
+	size_t size;
+	if(fai == NULL || (fx->names = (char *)seqf_faidx_slurp(fai, &size)) == NULL)
+		goto fail;
+	if(seqf_faidx_parse(fx, fx->names) != 0 || seqf_faidx_hashall(fx) != 0)
+		goto fail;
+
+	fx->member = seqf_malloc(SEQF_FAIDX_CHUNK);
+	if(fx->member == NULL) {
+		seqferrno_ = 6;
+		goto fail;
+	}
+	if(state->compression == BGZF) {
+		strcpy(fai + strlen(path), ".gzi");
+		if(seqf_faidx_loadgzi(state, fx, fai) != 0)
+			goto fail;
+#if defined _IGZIP_H
+		if((fx->stream = seqf_malloc(sizeof *fx->stream)) != NULL)
+			isal_inflate_init(fx->stream);
+		if(fx->stream == NULL) {
+#else
+		fx->stream.zalloc = seqf_zalloc;
+		fx->stream.zfree = seqf_zfree;
+		fx->stream.opaque = Z_NULL;
+		fx->stream.avail_in = 0;
+		fx->stream.next_in = Z_NULL;
+		fx->stream_is_init = inflateInit2(&fx->stream, 16 + MAX_WBITS) == Z_OK;
+		if(!fx->stream_is_init) {
+#endif
+			seqferrno_ = 6;
+			goto fail;
+		}
+	}
+	seqf_free(fai);
+	return 0;
+
+fail:
+	seqf_free(fai);
+	seqf_faidx_free(state);
+	return 1;
+}
+
+/**
+ * @brief Make the BGZF member at compressed offset `coff', which starts at
+ * uncompressed offset `uoff', the member of `fx' bytes are taken from. A
+ * member inflated by a recent fetch is used again, or else the one used least
+ * recently is replaced.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_faidx_member(seqf_statep state, struct seqf_faidx *fx, uint64_t coff, uint64_t uoff)
+{
+	struct seqf_faidx_blk *b = &fx->blks[0];
+	for(size_t i = 0; i < SEQF_FAIDX_NBLKS; i++) {
+		struct seqf_faidx_blk *c = &fx->blks[i];
+		if(c->used != 0 && c->coff == coff) {
+			c->used = ++fx->tick;
+			fx->blk = c;
+			return 0;
+		}
+		if(c->used < b->used)
+			b = c;
+	}
+	fx->blk = NULL;
+	b->used = 0;
+	if(b->data == NULL && (b->data = seqf_malloc(SEQF_BGZF_MAXSIZ)) == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+
+	size_t nread;
+	if(seqf_preadfd(state->fd, fx->member, SEQF_BGZF_MAXSIZ, coff, &nread, &state->io) != 0)
+		return 1;
+	const unsigned char *hdr = fx->member;
+	if(!seqf_isbgzf(hdr, nread)) {
+		/* The index points past the end of the file, or not at a member */
+		seqferrno_ = 10;
+		return 1;
+	}
+	size_t bsize = (size_t)seqf_get16(hdr + 16) + 1;
+	if(bsize > nread) {
+		seqferrno_ = 10;
+		return 1;
+	}
+
+	uint64_t start = seqf_tick(state->io.timing);
+#if defined _IGZIP_H
+	isal_inflate_reset(fx->stream);
+	fx->stream->crc_flag = ISAL_GZIP;
+	fx->stream->next_in = fx->member;
+	fx->stream->avail_in = bsize;
+	fx->stream->next_out = b->data;
+	fx->stream->avail_out = SEQF_BGZF_MAXSIZ;
+	int ret = isal_inflate(fx->stream);
+	bool ok = ret == ISAL_DECOMP_OK && fx->stream->block_state == ISAL_BLOCK_FINISH;
+	size_t len = SEQF_BGZF_MAXSIZ - fx->stream->avail_out;
+#else
+	inflateReset(&fx->stream);
+	fx->stream.next_in = fx->member;
+	fx->stream.avail_in = bsize;
+	fx->stream.next_out = b->data;
+	fx->stream.avail_out = SEQF_BGZF_MAXSIZ;
+	bool ok = inflate(&fx->stream, Z_FINISH) == Z_STREAM_END;
+	size_t len = SEQF_BGZF_MAXSIZ - fx->stream.avail_out;
+#endif
+	state->io.inflate_ns += seqf_tock(state->io.timing, start);
+	if(!ok) {
+		seqferrno_ = 1;
+		return 1;
+	}
+	b->len = len;
+	b->coff = coff;
+	b->csize = bsize;
+	b->uoff = uoff;
+	b->used = ++fx->tick;
+	fx->blk = b;
+	return 0;
+}
+
+/**
+ * @brief Get at most `want' uncompressed bytes of the file of `state' from
+ * offset `u' on, which must not be past its end. The bytes stay valid until
+ * the next call.
+ *
+ * @return const unsigned char* The bytes, of which there are `*len' (at least
+ * one), or NULL on error (seqferrno is set)
+ */
+static const unsigned char *
+seqf_faidx_bytes(seqf_statep state, struct seqf_faidx *fx, uint64_t u, uint64_t want, size_t *len)
+{
+	if(state->compression == PLAIN) {
+		size_t n = want < SEQF_FAIDX_CHUNK ? (size_t)want : SEQF_FAIDX_CHUNK;
+		if(seqf_preadfd(state->fd, fx->member, n, u, len, &state->io) != 0)
+			return NULL;
+		if(*len == 0) {
+			seqferrno_ = 10;
+			return NULL;
+		}
+		return fx->member;
+	}
+
+	struct seqf_faidx_blk *b = fx->blk;
+	if(b == NULL || u < b->uoff || u >= b->uoff + b->len) {
+		uint64_t coff, uoff;
+		if(b != NULL && u >= b->uoff + b->len && u < b->uoff + b->len + SEQF_BGZF_MAXSIZ) {
+			/* Regions usually go on into the next member */
+			coff = b->coff + b->csize;
+			uoff = b->uoff + b->len;
+		} else {
+			/* Last member that starts at or before u */
+			size_t lo = 0, hi = fx->ngzi;
+			while(hi - lo > 1) {
+				size_t mid = lo + (hi - lo) / 2;
+				if(fx->gzi[2*mid + 1] <= u)
+					lo = mid;
+				else
+					hi = mid;
+			}
+			coff = fx->gzi[2*lo];
+			uoff = fx->gzi[2*lo + 1];
+		}
+		for(;;) {
+			if(seqf_faidx_member(state, fx, coff, uoff) != 0)
+				return NULL;
+			b = fx->blk;
+			if(u < b->uoff + b->len)
+				break;
+			coff = b->coff + b->csize;
+			uoff = b->uoff + b->len;
+		}
+	}
+	size_t off = (size_t)(u - b->uoff);
+	*len = b->len - off < want ? b->len - off : (size_t)want;
+	return b->data + off;
+}
+
+/**
+ * @brief Sequence being scanned by `seqfaidx_build()'
+ */
+struct seqf_fscan {
+	FILE *fai;                     /** Index being written */
+	uint64_t pos;                  /** Uncompressed offset of the next byte */
+	bool bol;                      /** Next byte starts a line */
+	bool header;                   /** In a header line */
+	bool naming;                   /** In the name of the header */
+	char *name;                    /** Name of the sequence */
+	size_t name_len;               /** Length of the name */
+	size_t name_size;              /** Size of name */
+	bool open;                     /** A sequence was started */
+	bool ended;                    /** A line shorter than the others was seen */
+	uint64_t length;               /** Bases of the sequence so far */
+	uint64_t offset;               /** Offset of the first base */
+	uint64_t linebases;            /** Bases of the first line */
+	uint64_t linewidth;            /** Bytes of the first line */
+	uint64_t line;                 /** Bytes of the current line so far */
+	unsigned char last;            /** Last byte of the current line */
+};
+
+/**
+ * @brief Write the sequence of `s' to the index, if there is one.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_fscan_finish(struct seqf_fscan *s)
+{
+	if(!s->open)
+		return 0;
+	s->open = false;
+	if(fprintf(s->fai, "%.*s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n", (int)s->name_len,
+	           s->name, s->length, s->offset, s->linebases, s->linewidth) < 0) {
+		seqferrno_ = 1;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Count a sequence line of `bases' bases in `width' bytes. Every line
+ * but the last must have as many bases as the first, or the bases could not
+ * be found by their position.
+ *
+ * @return int 0 on success, 1 if the lines differ (seqferrno is set)
+ */
+static int
+seqf_fscan_line(struct seqf_fscan *s, uint64_t bases, uint64_t width)
+{
+	if(bases == 0) {
+		s->ended = s->open;
+		return 0;
+	}
+	if(!s->open || s->ended) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	if(s->linebases == 0) {
+		s->linebases = bases;
+		s->linewidth = width;
+	} else if(bases > s->linebases || width - bases != s->linewidth - s->linebases) {
+		seqferrno_ = 8;
+		return 1;
+	} else if(bases < s->linebases) {
+		s->ended = true;
+	}
+	s->length += bases;
+	return 0;
+}
+
+/**
+ * @brief Scan the `n' bytes of `buf', which follow those scanned before.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_fscan_bytes(struct seqf_fscan *s, const unsigned char *buf, size_t n)
+{
+	size_t i = 0;
+	while(i < n) {
+		if(s->bol) {
+			s->bol = false;
+			if(buf[i] == '>') {
+				if(seqf_fscan_finish(s) != 0)
+					return 1;
+				s->header = s->naming = true;
+				s->name_len = 0;
+				s->pos++;
+				i++;
+				continue;
+			}
+		}
+
+		const unsigned char *eol = memchr(buf + i, '\n', n - i);
+		size_t end = eol != NULL ? (size_t)(eol - buf) : n;
+		if(s->header) {
+			/* The name is the header up to the first blank */
+			size_t j = i;
+			while(s->naming && j < end && buf[j] != ' ' && buf[j] != '\t' && buf[j] != '\r')
+				j++;
+			if(j > i) {
+				if(s->name_len + (j - i) > s->name_size) {
+					size_t size = s->name_size ? 2 * s->name_size : 256;
+					while(size < s->name_len + (j - i))
+						size *= 2;
+					char *tmp = seqf_realloc(s->name, size);
+					if(tmp == NULL) {
+						seqferrno_ = 6;
+						return 1;
+					}
+					s->name = tmp;
+					s->name_size = size;
+				}
+				memcpy(s->name + s->name_len, buf + i, j - i);
+				s->name_len += j - i;
+			}
+			if(j < end)
+				s->naming = false;
+			if(eol != NULL) {
+				s->header = false;
+				s->open = true;
+				s->ended = false;
+				s->length = s->linebases = s->linewidth = 0;
+				s->offset = s->pos + (end + 1 - i);
+			}
+		} else {
+			s->line += end - i;
+			if(end > i)
+				s->last = buf[end - 1];
+			if(eol != NULL) {
+				uint64_t bases = s->line - (s->line && s->last == '\r');
+				if(seqf_fscan_line(s, bases, s->line + 1) != 0)
+					return 1;
+				s->line = 0;
+				s->last = 0;
+			}
+		}
+		if(eol != NULL) {
+			s->bol = true;
+			end++;
+		}
+		s->pos += end - i;
+		i = end;
+	}
+	return 0;
+}
+
+/**
+ * @brief Scan the FASTA file of `state' and write its index to `fai'.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_fscan_run(seqf_statep state, struct seqf_fscan *s)
+{
+	for(;;) {
+		if(state->have == 0 && seqf_fetch(state) != 0)
+			return 1;
+		if(state->have == 0)
+			break;
+		if(seqf_fscan_bytes(s, state->next, state->have) != 0)
+			return 1;
+		state->next += state->have;
+		state->have = 0;
+	}
+	if(seqferrno_ != 0)
+		return 1;
+
+	/* The last line may have no end */
+	if(s->header) {
+		s->header = false;
+		s->open = true;
+		s->length = s->linebases = s->linewidth = 0;
+		s->offset = s->pos;
+	} else if(s->line != 0) {
+		/* Its end would have been like those of the other lines */
+		uint64_t bases = s->line - (s->last == '\r');
+		uint64_t width = s->linebases ? bases + s->linewidth - s->linebases : s->line + 1;
+		if(seqf_fscan_line(s, bases, width) != 0)
+			return 1;
+	}
+	return seqf_fscan_finish(s);
+}
+
+/**
+ * @brief Write the members of the BGZF file of `state' to the .gzi `path'.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_faidx_writegzi(seqf_statep state, const char *path)
+{
+	uint64_t *gzi;
+	size_t ngzi;
+	if(seqf_faidx_members(state->fd, &gzi, &ngzi, &state->io) != 0)
+		return 1;
+	FILE *fp = fopen(path, "wb");
+	if(fp == NULL) {
+		seqf_free(gzi);
+		seqferrno_ = 1;
+		return 1;
+	}
+	unsigned char buf[8];
+	seqf_put64(buf, ngzi - 1);
+	bool ok = fwrite(buf, 8, 1, fp) == 1;
+	for(size_t i = 2; ok && i < 2*ngzi; i++) {
+		seqf_put64(buf, gzi[i]);
+		ok = fwrite(buf, 8, 1, fp) == 1;
+	}
+	seqf_free(gzi);
+	if(fclose(fp) != 0 || !ok) {
+		seqferrno_ = 1;
+		remove(path);
+		return 1;
+	}
+	return 0;
+}
+
+int
+seqfaidx_build(const char *path)
+{
+	if(path == NULL) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	seqf_statep state = (seqf_statep)seqfopen(path, "a");
+	if(state == NULL)
+		return 1;
+	if(state->compression != PLAIN && state->compression != BGZF) {
+		seqfclose((SeqFile)state);
+		seqferrno_ = 12;
+		return 1;
+	}
+
+	char *fai = seqf_faidx_path(path, ".fai");
+	if(fai == NULL) {
+		seqfclose((SeqFile)state);
+		return 1;
+	}
+	struct seqf_fscan s = {0};
+	s.bol = true;
+	s.fai = fopen(fai, "w");
+	int ret = 1;
+	if(s.fai == NULL) {
+		seqferrno_ = 1;
+	} else {
+		seqferrno_ = 0;
+		ret = seqf_fscan_run(state, &s);
+		if(fclose(s.fai) != 0 && ret == 0) {
+			seqferrno_ = 1;
+			ret = 1;
+		}
+		if(ret == 0 && state->compression == BGZF) {
+			strcpy(fai + strlen(path), ".gzi");
+			ret = seqf_faidx_writegzi(state, fai);
+			strcpy(fai + strlen(path), ".fai");
+		}
+		if(ret != 0)
+			remove(fai);
+	}
+
+	int err = seqferrno_;
+	seqf_free(s.name);
+	seqf_free(fai);
+	seqfclose((SeqFile)state);
+	seqferrno_ = err;
+	return ret;
+}
+
+int
+seqfaidx_load(SeqFile file, const char *path)
+{
+	if(file == NULL || path == NULL) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	seqf_statep state = (seqf_statep)file;
+	seqf_lock(state);
+	int ret = seqf_faidx_load(state, path);
+	seqf_unlock(state);
+	return ret;
+}
+
+size_t
+seqfafetch_unlocked(SeqFile file, const char *name, size_t start, size_t end, char *buf)
+{
+	if(file == NULL || name == NULL || buf == NULL) {
+		seqferrno_ = 8;
+		return 0;
+	}
+	seqf_statep state = (seqf_statep)file;
+	seqferrno_ = 0;
+	if(state->faidx == NULL) {
+		if(state->path == NULL) {
+			seqferrno_ = 8;
+			return 0;
+		}
+		if(seqf_faidx_load(state, state->path) != 0)
+			return 0;
+	}
+	struct seqf_faidx *fx = state->faidx;
+	const struct seqf_faidx_seq *s = seqf_faidx_find(fx, name);
+	if(s == NULL) {
+		seqferrno_ = 11;
+		return 0;
+	}
+
+	if(end > s->length)
+		end = (size_t)s->length;
+	buf[0] = '\0';
+	if(start >= end)
+		return 0;
+
+	/* Bases are where their line puts them, the ends of lines are skipped */
+	uint64_t lb = s->linebases, lw = s->linewidth;
+	uint64_t u = s->offset + start / lb * lw + start % lb;
+	uint64_t u_end = s->offset + (end - 1) / lb * lw + (end - 1) % lb + 1;
+	uint64_t col = start % lb;
+	size_t n = 0;
+	while(u < u_end) {
+		size_t len;
+		const unsigned char *src = seqf_faidx_bytes(state, fx, u, u_end - u, &len);
+		if(src == NULL) {
+			buf[0] = '\0';
+			return 0;
+		}
+		u += len;
+		while(len != 0) {
+			size_t k;
+			if(col < lb) {
+				k = (size_t)(lb - col) < len ? (size_t)(lb - col) : len;
+				memcpy(buf + n, src, k);
+				n += k;
+			} else {
+				k = (size_t)(lw - col) < len ? (size_t)(lw - col) : len;
+			}
+			src += k;
+			len -= k;
+			col += k;
+			if(col == lw)
+				col = 0;
+		}
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+size_t
+seqfafetch(SeqFile file, const char *name, size_t start, size_t end, char *buf)
+{
+	if(file == NULL) {
+		seqferrno_ = 8;
+		return 0;
+	}
+	seqf_statep state = (seqf_statep)file;
+	seqf_lock(state);
+	size_t ret = seqfafetch_unlocked(file, name, start, end, buf);
+	seqf_unlock(state);
+	return ret;
+}
@@ -0,0 +1,522 @@
+/* seqfinflate.c - Deflate decoder for speculative, parallel gzip decompression
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * zlib can only inflate a stream from its beginning. To let several threads
+ * work on one gzip member, each thread starts at a block boundary somewhere in
+ * the middle of the member and decodes with an unknown window: back references
+ * into it are kept as markers, which are resolved once the previous part of
+ * the member is decoded. See `seqf_inflate_find' and `seqf_inflate_resolve'.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "seqf_inflate.h"
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+#  define SEQF_LITTLE_ENDIAN 1
+#endif
+
+/* Table entries: symbol << 16 | code length, or a link to a second level
+   table: offset << 16 | SEQF_HUFF_LINK | bits resolved by the second level.
+   An entry of code length 0 is an invalid code. */
+#define SEQF_HUFF_LINK 0x100
+
+/* A block must produce this many bytes to be accepted by `seqf_inflate_find' */
+#define SEQF_FIND_MIN 1024
+
+static const uint16_t len_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t len_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t clen_order[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+/**
+ * @brief Little endian bit reader over the compressed stream. Reading past the
+ * end of the stream yields zero bits; callers check `byte' against `len'.
+ */
+struct seqf_bits {
+	const unsigned char *in;
+	size_t len;
+	size_t byte;                   /** Next byte to load into buf */
+	uint64_t buf;                  /** Loaded bits, least significant first */
+	unsigned cnt;                  /** Number of bits in buf */
+};
+
+static inline void
+seqf_bits_refill(struct seqf_bits *br)
+{
+#ifdef SEQF_LITTLE_ENDIAN
+	if(br->byte + 8 <= br->len) {
+		uint64_t v;
+		memcpy(&v, br->in + br->byte, 8);
+		br->buf |= v << br->cnt;
+		br->byte += (63 - br->cnt) >> 3;
+		br->cnt |= 56;
+		return;
+	}
+#endif
+	while(br->cnt <= 56) {
+		uint64_t v = br->byte < br->len ? br->in[br->byte] : 0;
+		br->buf |= v << br->cnt;
+		br->byte++;
+		br->cnt += 8;
+	}
+}
+
+static inline uint32_t
+seqf_bits_get(struct seqf_bits *br, unsigned n)
+{
+	uint32_t v = (uint32_t)(br->buf & (((uint64_t)1 << n) - 1));
+	br->buf >>= n;
+	br->cnt -= n;
+	return v;
+}
+
+static void
+seqf_bits_init(struct seqf_bits *br, const unsigned char *in, size_t len, size_t bit)
+{
+	br->in = in;
+	br->len = len;
+	br->byte = bit >> 3;
+	br->buf = 0;
+	br->cnt = 0;
+	seqf_bits_refill(br);
+	seqf_bits_get(br, bit & 7);
+}
+
+static inline size_t
+seqf_bits_pos(const struct seqf_bits *br)
+{
+	return br->byte * 8 - br->cnt;
+}
+
+/**
+ * @brief Build a two level decoding table for the canonical Huffman code given
+ * by the `n' code lengths in `lens'. As in zlib, the code must be complete,
+ * unless it is a literal/length or distance code with a single 1-bit code (or
+ * no codes at all).
+ *
+ * @return int 0 on success, -1 if the code lengths are invalid
+ */
+static int
+seqf_huff_build(const uint8_t *lens, unsigned n, uint32_t *table, size_t tabsize, unsigned bits, bool complete)
+{
+	unsigned count[16] = {0};
+	for(unsigned i = 0; i < n; i++)
+		count[lens[i]]++;
+	count[0] = 0;
+
+	int left = 1;
+	unsigned max = 0;
+	for(unsigned len = 1; len < 16; len++) {
+		left = (left << 1) - (int)count[len];
+		if(left < 0)
+			return -1; /* over-subscribed */
+		if(count[len])
+			max = len;
+	}
+	if(left > 0 && max != 0 && (complete || max != 1))
+		return -1; /* incomplete */
+
+	unsigned next[16];
+	unsigned code = 0;
+	for(unsigned len = 1; len < 16; len++) {
+		code = (code + count[len - 1]) << 1;
+		next[len] = code;
+	}
+
+	/* First level entries, and the size of each second level table */
+	size_t primary = (size_t)1 << bits;
+	uint8_t sub[1 << SEQF_LITBITS] = {0};
+	uint16_t rev[288];
+	memset(table, 0, primary * sizeof *table);
+	for(unsigned sym = 0; sym < n; sym++) {
+		unsigned len = lens[sym];
+		if(len == 0)
+			continue;
+		unsigned c = next[len]++, r = 0;
+		for(unsigned i = 0; i < len; i++, c >>= 1)
+			r = (r << 1) | (c & 1);
+		rev[sym] = (uint16_t)r;
+		if(len <= bits) {
+			for(size_t k = r; k < primary; k += (size_t)1 << len)
+				table[k] = (uint32_t)sym << 16 | len;
+		} else if(len - bits > sub[r & (primary - 1)]) {
+			sub[r & (primary - 1)] = (uint8_t)(len - bits);
+		}
+	}
+	if(max <= bits)
+		return 0;
+
+	/* Second level tables */
+	size_t used = primary;
+	for(size_t p = 0; p < primary; p++) {
+		if(sub[p] == 0)
+			continue;
+		size_t size = (size_t)1 << sub[p];
+		if(used + size > tabsize)
+			return -1;
+		table[p] = (uint32_t)used << 16 | SEQF_HUFF_LINK | sub[p];
+		memset(table + used, 0, size * sizeof *table);
+		used += size;
+	}
+	for(unsigned sym = 0; sym < n; sym++) {
+		unsigned len = lens[sym];
+		if(len <= bits)
+			continue;
+		uint32_t link = table[rev[sym] & (primary - 1)];
+		size_t base = link >> 16, size = (size_t)1 << (link & 0xFF);
+		for(size_t k = rev[sym] >> bits; k < size; k += (size_t)1 << (len - bits))
+			table[base + k] = (uint32_t)sym << 16 | len;
+	}
+	return 0;
+}
+
+static inline uint32_t
+seqf_huff_decode(const uint32_t *table, unsigned bits, struct seqf_bits *br)
+{
+	uint32_t e = table[br->buf & (((uint64_t)1 << bits) - 1)];
+	if(e & SEQF_HUFF_LINK)
+		e = table[(e >> 16) + ((br->buf >> bits) & (((uint64_t)1 << (e & 0xFF)) - 1))];
+	br->buf >>= e & 0xFF;
+	br->cnt -= e & 0xFF;
+	return e;
+}
+
+/**
+ * @brief Read the code lengths of a dynamic block and build its tables.
+ */
+static int
+seqf_inflate_dynamic(struct seqf_inflate *inf, struct seqf_bits *br)
+{
+	uint8_t lens[286 + 30];
+	uint32_t clen_table[1 << 7];
+
+	seqf_bits_refill(br);
+	unsigned nlen = seqf_bits_get(br, 5) + 257;
+	unsigned ndist = seqf_bits_get(br, 5) + 1;
+	unsigned nclen = seqf_bits_get(br, 4) + 4;
+	if(nlen > 286 || ndist > 30)
+		return 3;
+
+	uint8_t clens[19] = {0};
+	for(unsigned i = 0; i < nclen; i++) {
+		if(br->cnt < 3)
+			seqf_bits_refill(br);
+		clens[clen_order[i]] = (uint8_t)seqf_bits_get(br, 3);
+	}
+	if(seqf_huff_build(clens, 19, clen_table, 1 << 7, 7, true) != 0)
+		return 3;
+
+	unsigned i = 0;
+	while(i < nlen + ndist) {
+		seqf_bits_refill(br);
+		uint32_t e = seqf_huff_decode(clen_table, 7, br);
+		if((e & 0xFF) == 0)
+			return 3;
+		unsigned sym = e >> 16, rep;
+		uint8_t val = 0;
+		if(sym < 16) {
+			lens[i++] = (uint8_t)sym;
+			continue;
+		} else if(sym == 16) {
+			if(i == 0)
+				return 3;
+			val = lens[i - 1];
+			rep = 3 + seqf_bits_get(br, 2);
+		} else if(sym == 17) {
+			rep = 3 + seqf_bits_get(br, 3);
+		} else {
+			rep = 11 + seqf_bits_get(br, 7);
+		}
+		if(i + rep > nlen + ndist)
+			return 3;
+		memset(lens + i, val, rep);
+		i += rep;
+	}
+	if(lens[256] == 0)
+		return 3; /* no end of block code */
+
+	if(seqf_huff_build(lens, nlen, inf->lit, SEQF_LITSIZ, SEQF_LITBITS, false) != 0)
+		return 3;
+	if(seqf_huff_build(lens + nlen, ndist, inf->dist, SEQF_DISTSIZ, SEQF_DISTBITS, false) != 0)
+		return 3;
+	return 0;
+}
+
+static int
+seqf_inflate_fixed(struct seqf_inflate *inf)
+{
+	uint8_t lens[288 + 32];
+	memset(lens, 8, 144);
+	memset(lens + 144, 9, 112);
+	memset(lens + 256, 7, 24);
+	memset(lens + 280, 8, 8);
+	memset(lens + 288, 5, 32);
+	if(seqf_huff_build(lens, 288, inf->lit, SEQF_LITSIZ, SEQF_LITBITS, false) != 0)
+		return 3;
+	if(seqf_huff_build(lens + 288, 32, inf->dist, SEQF_DISTSIZ, SEQF_DISTBITS, false) != 0)
+		return 3;
+	return 0;
+}
+
+/**
+ * @brief Make room for `need' more output symbols
+ */
+static int
+seqf_inflate_grow(struct seqf_inflate *inf, size_t need)
+{
+	if(inf->out_len + need <= inf->out_size)
+		return 0;
+	size_t size = inf->out_size << 1;
+	while(size < inf->out_len + need)
+		size <<= 1;
+	uint16_t *t = seqf_realloc(inf->out, (SEQF_WINSIZ + size) * sizeof *t);
+	if(t == NULL) {
+		seqferrno_ = 6;
+		return -1;
+	}
+	inf->out = t;
+	inf->out_size = size;
+	return 0;
+}
+
+static inline bool
+seqf_istext(unsigned c)
+{
+	return (c >= ' ' && c <= '~') || c == '\n' || c == '\r' || c == '\t';
+}
+
+/**
+ * @brief Decode one block, appending to the output. With `text', literals
+ * that are not printable ASCII are treated as errors.
+ */
+static int
+seqf_inflate_block(struct seqf_inflate *inf, struct seqf_bits *br, bool text)
+{
+	int ret;
+	seqf_bits_refill(br);
+	inf->final = seqf_bits_get(br, 1);
+	unsigned type = seqf_bits_get(br, 2);
+
+	if(type == 0) {
+		/* Stored block, starts at the next byte boundary */
+		seqf_bits_get(br, br->cnt & 7);
+		uint32_t len = seqf_bits_get(br, 16);
+		uint32_t nlen = seqf_bits_get(br, 16);
+		if(len != (~nlen & 0xFFFF))
+			return 3;
+		size_t at = br->byte - br->cnt / 8;
+		if(at + len > br->len)
+			return 3;
+		if((ret = seqf_inflate_grow(inf, len)) != 0)
+			return ret;
+		uint16_t *out = inf->out + SEQF_WINSIZ + inf->out_len;
+		for(uint32_t i = 0; i < len; i++) {
+			if(text && !seqf_istext(br->in[at + i]))
+				return 3;
+			out[i] = br->in[at + i];
+		}
+		inf->out_len += len;
+		br->byte = at + len;
+		br->buf = 0;
+		br->cnt = 0;
+		seqf_bits_refill(br);
+		return 0;
+	}
+	if(type == 3)
+		return 3;
+	if((ret = type == 1 ? seqf_inflate_fixed(inf) : seqf_inflate_dynamic(inf, br)) != 0)
+		return ret;
+
+	/* Decode literals and matches until the end of block code */
+	size_t n = inf->out_len;
+	uint16_t *out = inf->out + SEQF_WINSIZ;
+	while(true) {
+		if(n + 258 > inf->out_size) {
+			inf->out_len = n;
+			if((ret = seqf_inflate_grow(inf, 258)) != 0)
+				return ret;
+			out = inf->out + SEQF_WINSIZ;
+		}
+		if(br->byte > br->len + 8)
+			return 3; /* ran past the end of the stream */
+
+		seqf_bits_refill(br);
+		uint32_t e = seqf_huff_decode(inf->lit, SEQF_LITBITS, br);
+		if((e & 0xFF) == 0)
+			return 3;
+		unsigned sym = e >> 16;
+		if(sym < 256) {
+			if(text && !seqf_istext(sym))
+				return 3;
+			out[n++] = (uint16_t)sym;
+			continue;
+		}
+		if(sym == 256)
+			break;
+
+		sym -= 257;
+		if(sym >= 29)
+			return 3;
+		unsigned len = len_base[sym] + seqf_bits_get(br, len_extra[sym]);
+		e = seqf_huff_decode(inf->dist, SEQF_DISTBITS, br);
+		if((e & 0xFF) == 0 || (e >> 16) >= 30)
+			return 3;
+		size_t dist = dist_base[e >> 16] + seqf_bits_get(br, dist_extra[e >> 16]);
+		if(dist > n + SEQF_WINSIZ)
+			return 3;
+
+		uint16_t *dst = out + n;
+		const uint16_t *src = dst - dist;
+		for(unsigned i = 0; i < len; i++)
+			dst[i] = src[i];
+		n += len;
+	}
+	inf->out_len = n;
+	return 0;
+}
+
+extern int
+seqf_inflate_init(struct seqf_inflate *inf, const unsigned char *in, size_t in_len)
+{
+	inf->in = in;
+	inf->in_len = in_len;
+	inf->pos = 0;
+	inf->final = false;
+	inf->out_len = 0;
+	inf->out_size = (size_t)1 << 20;
+	inf->out = seqf_malloc((SEQF_WINSIZ + inf->out_size) * sizeof *inf->out);
+	if(inf->out == NULL) {
+		seqferrno_ = 6;
+		return -1;
+	}
+	return 0;
+}
+
+extern void
+seqf_inflate_free(struct seqf_inflate *inf)
+{
+	seqf_free(inf->out);
+	inf->out = NULL;
+}
+
+extern void
+seqf_inflate_context(struct seqf_inflate *inf, const unsigned char *win, size_t wlen)
+{
+	size_t lo = SEQF_WINSIZ - wlen;
+	for(size_t i = 0; i < lo; i++)
+		inf->out[i] = (uint16_t)(256 + i);
+	for(size_t i = lo; i < SEQF_WINSIZ; i++)
+		inf->out[i] = win[i - lo];
+}
+
+extern int
+seqf_inflate_run(struct seqf_inflate *inf, size_t start, size_t end)
+{
+	struct seqf_bits br;
+	size_t limit = inf->in_len * 8;
+	inf->out_len = 0;
+	inf->final = false;
+	inf->pos = start;
+	if(start > limit)
+		return 3;
+
+	seqf_bits_init(&br, inf->in, inf->in_len, start);
+	while(inf->pos < end && !inf->final) {
+		int ret = seqf_inflate_block(inf, &br, false);
+		if(ret != 0)
+			return ret;
+		inf->pos = seqf_bits_pos(&br);
+		if(inf->pos > limit)
+			return 3;
+	}
+	return 0;
+}
+
+extern bool
+seqf_inflate_find(struct seqf_inflate *inf, size_t from, size_t to, size_t *found)
+{
+	struct seqf_bits br;
+	size_t limit = inf->in_len * 8;
+	if(to > limit)
+		to = limit;
+
+	for(size_t bit = from; bit < to; bit++) {
+		/* Non-final dynamic block, with a possible number of codes */
+		size_t at = bit >> 3;
+		uint32_t v = 0;
+		for(size_t k = 0; k < 3 && at + k < inf->in_len; k++)
+			v |= (uint32_t)inf->in[at + k] << (8 * k);
+		v >>= bit & 7;
+		if((v & 6) != 4 || ((v >> 3) & 31) > 29 || ((v >> 8) & 31) > 29)
+			continue;
+
+		/* Candidate is good if the whole block decodes into text */
+		inf->out_len = 0;
+		seqf_bits_init(&br, inf->in, inf->in_len, bit);
+		if(seqf_inflate_block(inf, &br, true) == 0 && inf->out_len >= SEQF_FIND_MIN &&
+		  seqf_bits_pos(&br) <= limit) {
+			*found = bit;
+			return true;
+		}
+	}
+	return false;
+}
+
+extern int
+seqf_inflate_resolve(const uint16_t *sym, size_t n, const unsigned char *win, size_t wlen, unsigned char *dst)
+{
+	size_t lo = SEQF_WINSIZ - wlen;
+	for(size_t i = 0; i < n; i++) {
+		unsigned s = sym[i];
+		if(s < 256) {
+			dst[i] = (unsigned char)s;
+		} else {
+			if(s - 256 < lo)
+				return 3;
+			dst[i] = win[s - 256 - lo];
+		}
+	}
+	return 0;
+}
+
+extern size_t
+seqf_inflate_header(const unsigned char *in, size_t in_len)
+{
+	if(in_len < 10 || in[0] != 0x1F || in[1] != 0x8B || in[2] != 8 || (in[3] & 0xE0))
+		return 0;
+	unsigned flags = in[3];
+	size_t n = 10;
+	if(flags & 0x04) { /* FEXTRA */
+		if(n + 2 > in_len)
+			return 0;
+		n += 2 + ((size_t)in[n] | (size_t)in[n + 1] << 8);
+	}
+	if(flags & 0x08) { /* FNAME */
+		while(n < in_len && in[n] != 0)
+			n++;
+		n++;
+	}
+	if(flags & 0x10) { /* FCOMMENT */
+		while(n < in_len && in[n] != 0)
+			n++;
+		n++;
+	}
+	if(flags & 0x02) /* FHCRC */
+		n += 2;
+	return n <= in_len ? n : 0;
+}
@@ -0,0 +1,115 @@
+/* seqfkmer.c - seqf functions for iterating over the k-mers of a file
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include "seqf_read.h"
+
+/* 2-bit code of each byte, 4 for anything but A, C, G and T */
+static const unsigned char seqf_kmer_code[256] = {
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+	4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4
+};
+
+int
+seqfkmerinit(SeqfKmerIter *it, SeqFile file, int k, bool canonical)
+{
+	if(it == NULL || file == NULL || k < 1 || k > 32) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	memset(it, 0, sizeof *it);
+	it->file = file;
+	it->k = k;
+	it->canonical = canonical;
+	it->mask = k == 32 ? ~(uint64_t)0 : ((uint64_t)1 << 2*k) - 1;
+	return 0;
+}
+
+/**
+ * @brief Roll the k-mers of the current record into `kmers', until it is full
+ * or the record ends. A base other than A, C, G or T empties the window, so
+ * that no k-mer spans it.
+ */
+static size_t
+seqf_rollkmers(SeqfKmerIter *it, uint64_t *kmers, size_t max)
+{
+	const unsigned char *seq = (const unsigned char *)it->seq;
+	const unsigned shift = 2 * (unsigned)(it->k - 1);
+	uint64_t fwd = it->fwd, rev = it->rev;
+	int filled = it->filled;
+	size_t pos = it->pos, n = 0;
+
+	while(n < max && pos < it->seq_len) {
+		unsigned code = seqf_kmer_code[seq[pos++]];
+		if(code > 3) {
+			filled = 0;
+			continue;
+		}
+		fwd = (fwd << 2 | code) & it->mask;
+		rev = rev >> 2 | (uint64_t)(3 - code) << shift;
+		if(filled < it->k)
+			filled++;
+		if(filled == it->k)
+			kmers[n++] = it->canonical && rev < fwd ? rev : fwd;
+	}
+
+	it->fwd = fwd;
+	it->rev = rev;
+	it->filled = filled;
+	it->pos = pos;
+	return n;
+}
+
+size_t
+seqfkmernext_unlocked(SeqfKmerIter *it, uint64_t *kmers, size_t max)
+{
+	if(it == NULL || kmers == NULL)
+		return 0;
+
+	size_t n = 0;
+	while(n < max) {
+		n += seqf_rollkmers(it, kmers + n, max - n);
+		if(it->pos < it->seq_len)
+			continue;
+
+		/* Record done, k-mers start over in the next one */
+		SeqfRecord rec;
+		if(seqfnextrec_unlocked(it->file, &rec) != 0)
+			break;
+		it->seq = rec.seq;
+		it->seq_len = rec.seq_len;
+		it->pos = 0;
+		it->filled = 0;
+	}
+	return n;
+}
+
+size_t
+seqfkmernext(SeqfKmerIter *it, uint64_t *kmers, size_t max)
+{
+	if(it == NULL || it->file == NULL)
+		return 0;
+	seqf_statep state = (seqf_statep)it->file;
+
+	seqf_lock(state);
+	size_t n = seqfkmernext_unlocked(it, kmers, max);
+	seqf_unlock(state);
+
+	return n;
+}
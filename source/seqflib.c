@@ -5,11 +5,15 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <fcntl.h>
 #ifdef _WIN32
     #include <windows.h>
     #include <io.h>
+    #include <basetsd.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
     #define open _open
     #define close _close
     #define read _read
@@ -18,11 +22,22 @@
     #define O_WRONLY _O_WRONLY
     #define O_RDWR _O_RDWR
     #define O_CREAT _O_CREAT
+    #define O_TRUNC _O_TRUNC
+    typedef SSIZE_T ssize_t;
 #else
     #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
 #endif
 
 #include "seqf_core.h"
+#include "seqf_cache.h"
+#include "seqf_faidx.h"
+#include "seqf_zindex.h"
+#include "seqf_pipe.h"
+#include "seqf_read.h"
+#include "seqf_share.h"
+#include "seqf_write.h"
 
 #define EXIT_AND_SETERR(state, _seqferrno) \
 	do { \
@@ -39,11 +54,53 @@ init_seqfstatep(seqf_statep state)
 	state->type = 'b';
 #ifndef _IGZIP_H
 	state->stream_is_init = false;
+	state->zraw = false;
 #endif
 	state->in_buf = NULL;
 	state->out_buf = NULL;
+	state->huge_pages = false;
+	state->in_huge = false;
+	state->out_huge = false;
+	state->out_bufbase = 0;
+	state->out_bufmax = SEQFBUFMAX;
+	state->out_small = 0;
 	state->next = NULL;
 	state->have = 0;
+	state->rec_buf = NULL;
+	state->rec_bufsiz = 0;
+	state->nt_part = 0;
+	state->nt_seq = 0;
+	state->nt_qual = 0;
+	state->nt_break = false;
+	state->lent = 0;
+	state->use_map = true;
+	state->map = NULL;
+	state->map_size = 0;
+	state->map_pos = 0;
+	state->map_off = 0;
+	state->ranged = false;
+	state->range_start = 0;
+	state->range_pos = 0;
+	state->range_end = 0;
+	state->pipe_nblocks = 0;
+	state->pipe_nthreads = 0;
+	state->pipe = NULL;
+	state->share_nbatches = 0;
+	state->share_nrecords = 0;
+	state->share = NULL;
+	state->writing = false;
+	state->level = SEQF_WRITE_LEVEL;
+	state->writer = NULL;
+	state->cache = NULL;
+	state->faidx = NULL;
+	state->zindex = NULL;
+	state->zresumed = false;
+	state->path = NULL;
+	state->io = (struct seqf_io){0};
+	state->stats = (SeqfStats){0};
+	state->refill_ns = 0;
+	state->held_at = 0;
+	state->held_refill = 0;
 	state->mutex_is_init = false;
 	state->eof = false;
 }
@@ -55,8 +112,10 @@ extract_mode(seqf_statep state, const char *mode)
 		return true;
 
 	bool type_set = false;
+	bool write_only = false;
 	do {
-		switch(*mode++) {
+		char c = *mode++;
+		switch(c) {
 		case 'a': 
 			if(type_set) return false;
 			state->type = 'a'; break; /* fasta file */
@@ -69,116 +128,328 @@ extract_mode(seqf_statep state, const char *mode)
 		case 'b':
 			if(type_set) return false;
 			state->type = 'b'; break; /* binary file*/
-		case '\0': return true;
+		case 'u':
+			state->use_map = false; break; /* never memory map the file */
+		case 't':
+			state->pipe_nblocks = SEQF_PIPE_NBLOCKS; break; /* threaded inflate */
+		case 'w':
+			state->writing = true; break; /* write instead of read */
+		case 'g':
+			write_only = true;
+			state->compression = GZIP; break; /* write gzip */
+		case 'z':
+			write_only = true;
+			state->compression = BGZF; break; /* write BGZF */
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+			write_only = true;
+			state->level = c - '0'; break; /* compression level */
+		case '\0': return state->writing || !write_only;
 		default: return false;
 		}
 	} while(true);
 }
 
-
-SeqFile
-seqfdopen(int fd, const char *mode)
+/**
+ * @brief Map `len' bytes at `offset' of a plain, regular file into memory so
+ * that seqf_fetch() can hand out windows of the mapping instead of read()'ing
+ * into the output buffer. Failing to map is not an error; the caller simply
+ * keeps using read().
+ */
+static void
+map_file(seqf_statep state, size_t offset, size_t len)
 {
-	seqferrno_ = 0; // no error encountered. yet.
+#ifndef _WIN32
+	if(len == 0)
+		return;
 
-	/* Initialize SeqFile */
-	seqf_statep seq_file = malloc(sizeof *seq_file);
-	if(seq_file == NULL)
-		EXIT_AND_SETERR(seq_file, 6);
+	/* Mappings start at a page boundary */
+	long page = sysconf(_SC_PAGESIZE);
+	size_t off = page > 0 ? offset % (size_t)page : 0;
+	void *map = mmap(NULL, off + len, PROT_READ, MAP_PRIVATE, state->fd, (off_t)(offset - off));
+	if(map == MAP_FAILED)
+		return;
+#ifdef MADV_SEQUENTIAL
+	madvise(map, off + len, MADV_SEQUENTIAL);
+#endif
+	state->map = (unsigned char *)map + off;
+	state->map_size = len;
+	state->map_off = off;
+	state->map_pos = 0;
+#else
+	(void)state; (void)offset; (void)len;
+#endif
+}
 
-	/* Init deafult values */
-	init_seqfstatep(seq_file);
+/**
+ * @brief Read the first bytes of the file without consuming them. A byte range
+ * is peeked with pread, so that SeqFiles sharing the file are not disturbed.
+ */
+static size_t
+peek_file(seqf_statep state, unsigned char *buf, size_t len)
+{
+	size_t nread = 0;
+	if(state->ranged) {
+		struct seqf_io io = {0}; /* Peeked bytes are counted when read again */
+		if(seqf_preadfd(state->fd, buf, len, 0, &nread, &io) != 0)
+			return (size_t)-1;
+		return nread;
+	}
+	do {
+		ssize_t n = read(state->fd, buf + nread, len - nread);
+		if(n == -1) return (size_t)-1;
+		if(n == 0) break; // reached EOF before reading magic bytes
+		nread += n;
+	} while(nread != len);
+	lseek(state->fd, 0, SEEK_SET);
+	return nread;
+}
 
+/**
+ * @brief Set up `seq_file' to read `fd', and set up decompression. Buffers,
+ * mutex and decompressor that `seq_file' already has are reused. Plain files
+ * are not mapped yet, since that depends on what part is read.
+ */
+static seqf_statep
+start_state(seqf_statep seq_file, int fd, const char *mode, bool ranged)
+{
 	/* Open file and check for errors */
 	seq_file->fd = fd;
+	seq_file->ranged = ranged;
 	if(fd < 0)
 		EXIT_AND_SETERR(seq_file, 1);
 
+	if(!extract_mode(seq_file, mode))
+		EXIT_AND_SETERR(seq_file, 3);
+
 	/* Initialize mutex */
-	if(mtx_init(&seq_file->mutex, mtx_plain) != thrd_success)
-		EXIT_AND_SETERR(seq_file, 2);
-	seq_file->mutex_is_init = true;
+	if(!seq_file->mutex_is_init) {
+		if(mtx_init(&seq_file->mutex, mtx_plain) != thrd_success)
+			EXIT_AND_SETERR(seq_file, 2);
+		seq_file->mutex_is_init = true;
+	}
 
 	/* Set input and output buffers */
-	seq_file->in_buf = malloc(SEQFBUFSIZ * sizeof *seq_file->in_buf);
-	if(seq_file->in_buf == NULL)
-		EXIT_AND_SETERR(seq_file, 6);
-	seq_file->in_bufsiz = SEQFBUFSIZ;
-	seq_file->out_buf = malloc(2*SEQFBUFSIZ * sizeof *seq_file->out_buf);
-	if(seq_file->out_buf == NULL)
-		EXIT_AND_SETERR(seq_file, 6);
-	seq_file->out_bufsiz = 2*SEQFBUFSIZ;
+	if(seq_file->in_buf == NULL) {
+		seq_file->in_buf = seqf_malloc(SEQFBUFSIZ * sizeof *seq_file->in_buf);
+		if(seq_file->in_buf == NULL)
+			EXIT_AND_SETERR(seq_file, 6);
+		seq_file->in_bufsiz = SEQFBUFSIZ;
+	}
+	if(seq_file->out_buf == NULL) {
+		seq_file->out_buf = seqf_malloc(2*SEQFBUFSIZ * sizeof *seq_file->out_buf);
+		if(seq_file->out_buf == NULL)
+			EXIT_AND_SETERR(seq_file, 6);
+		seq_file->out_bufsiz = 2*SEQFBUFSIZ;
+		seq_file->out_bufbase = 2*SEQFBUFSIZ;
+	}
 	seq_file->next = seq_file->out_buf;
 
-	/* Determine type of compression, if any */
-	size_t nread = 0;
-	do {
-		size_t n = read(seq_file->fd, seq_file->in_buf, 2);
-		if(n == -1) EXIT_AND_SETERR(seq_file, 3);
-		if(n == 0) break; // reached EOF before reading magic bytes
-		nread += n;
-	} while(nread != 2);
+	/* Files opened for writing are compressed as the mode asked */
+	if(seq_file->writing) {
+		if(ranged)
+			EXIT_AND_SETERR(seq_file, 3);
+		seq_file->use_map = false;
+		seq_file->eof = true;
+		if(seqf_writer_start(seq_file) != 0)
+			EXIT_AND_SETERR(seq_file, seqferrno_);
+		return seq_file;
+	}
+
+	/* Determine type of compression, if any. Read enough of the header to
+	   tell BGZF (gzip with a 'BC' extra subfield) apart from plain gzip. */
+	size_t nread = peek_file(seq_file, seq_file->in_buf, BGZF_HDRSIZ);
+	if(nread == (size_t)-1)
+		EXIT_AND_SETERR(seq_file, 3);
+	unsigned char *magic = seq_file->in_buf;
 	if(nread < 2) {
 		seq_file->compression = PLAIN;
-	} if(seq_file->in_buf[0] == 0x1F && seq_file->in_buf[1] == 0x8B) {
-		seq_file->compression = GZIP;
-	} else if (seq_file->in_buf[0] == 0x78 && (seq_file->in_buf[1] == 0x01 || 
-	  seq_file->in_buf[1] == 0x5E || seq_file->in_buf[1] == 0x9C || 
-	  seq_file->in_buf[1] == 0xDA)) {
+	} else if(nread >= 4 && memcmp(magic, SEQF_CACHE_MAGIC, 4) == 0) {
+		seq_file->compression = SQFC;
+	} else if(magic[0] == 0x1F && magic[1] == 0x8B) {
+		seq_file->compression = seqf_isbgzf(magic, nread) ? BGZF : GZIP;
+	} else if (magic[0] == 0x78 && (magic[1] == 0x01 || 
+	  magic[1] == 0x5E || magic[1] == 0x9C || 
+	  magic[1] == 0xDA)) {
         seq_file->compression = ZLIB;
     } else {
 		seq_file->compression = PLAIN;
 	}
-	lseek(seq_file->fd, 0, SEEK_SET);
+
+	/* A cache is mapped whole, and is read from its records */
+	if(seq_file->compression == SQFC) {
+		if(seqf_cache_open(seq_file) != 0)
+			EXIT_AND_SETERR(seq_file, seqferrno_);
+		return seq_file;
+	}
 
 	/* Initialize decompressor */
 	if(seq_file->compression != PLAIN) {
 #if defined _IGZIP_H
 		isal_inflate_init(&seq_file->stream);
-		seq_file->stream.crc_flag = seq_file->compression == GZIP ? ISAL_GZIP : ISAL_ZLIB;
+		seq_file->stream.crc_flag = seq_file->compression == ZLIB ? ISAL_ZLIB : ISAL_GZIP;
 		seq_file->stream.next_in = seq_file->in_buf;
 #else
-		/* allocate inflate state */
+		/* allocate inflate state, or reset the one of the last file */
 		int ret = Z_ERRNO;
-		seq_file->stream.zalloc   = Z_NULL;
-		seq_file->stream.zfree    = Z_NULL;
-		seq_file->stream.opaque   = Z_NULL;
-		seq_file->stream.avail_in = 0;
-		seq_file->stream.next_in  = Z_NULL;
-		if(seq_file->compression == GZIP)
-			ret = inflateInit2(&seq_file->stream, 16 + MAX_WBITS);
-		else if(seq_file->compression == ZLIB)
-			ret = inflateInit(&seq_file->stream);
-		else {
-			seqferrno_ = 1;
-			seqfclose((SeqFile)seq_file);
+		int wbits = seq_file->compression == ZLIB ? MAX_WBITS : 16 + MAX_WBITS;
+		if(seq_file->stream_is_init) {
+			ret = inflateReset2(&seq_file->stream, wbits);
+		} else {
+			seq_file->stream.zalloc   = seqf_zalloc;
+			seq_file->stream.zfree    = seqf_zfree;
+			seq_file->stream.opaque   = Z_NULL;
+			seq_file->stream.avail_in = 0;
+			seq_file->stream.next_in  = Z_NULL;
+			ret = inflateInit2(&seq_file->stream, wbits);
+			seq_file->stream_is_init = ret == Z_OK;
 		}
 		if(ret != Z_OK)
 			EXIT_AND_SETERR(seq_file, 1);
 		seq_file->stream.next_in = seq_file->in_buf;
-		seq_file->stream_is_init = true;
+		seq_file->stream.avail_in = 0;
 #endif
 	}
 
-	if(!extract_mode(seq_file, mode))
-		EXIT_AND_SETERR(seq_file, 3);
+	/* BGZF blocks are independent, so always inflate them in the background */
+	if(seq_file->compression == BGZF && seq_file->pipe_nblocks == 0)
+		seq_file->pipe_nblocks = SEQF_PIPE_NBLOCKS;
 
+	return seq_file;
+}
+
+/**
+ * @brief Create the SeqFile state for `fd'.
+ */
+static seqf_statep
+open_state(int fd, const char *mode, bool ranged)
+{
+	seqferrno_ = 0; // no error encountered. yet.
+
+	/* Initialize SeqFile */
+	seqf_statep seq_file = seqf_malloc(sizeof *seq_file);
+	if(seq_file == NULL)
+		EXIT_AND_SETERR(seq_file, 6);
+
+	/* Init deafult values */
+	init_seqfstatep(seq_file);
+	return start_state(seq_file, fd, mode, ranged);
+}
+
+/**
+ * @brief Map a plain regular file opened with seqfdopen or seqfreopen whole.
+ */
+static void
+map_whole(seqf_statep seq_file)
+{
+	if(seq_file->compression == PLAIN && seq_file->use_map) {
+		size_t size = seqf_filesize(seq_file->fd);
+		if(size != (size_t)-1)
+			map_file(seq_file, 0, size);
+	}
+}
+
+SeqFile
+seqfdopen(int fd, const char *mode)
+{
+	seqf_statep seq_file = open_state(fd, mode, false);
+	if(seq_file == NULL)
+		return NULL;
+
+	/* Plain regular files are read straight from a memory mapping */
+	map_whole(seq_file);
 	return (SeqFile)seq_file;
 }
 
 SeqFile
-seqfopen(const char *path, const char *mode)
+seqfdopen_range(int fd, const char *mode, size_t start, size_t end)
+{
+	seqf_statep seq_file = open_state(fd, mode, true);
+	if(seq_file == NULL)
+		return NULL;
+
+	/* Only plain regular files can be entered in the middle */
+	size_t size = seqf_filesize(fd);
+	if(seq_file->compression != PLAIN || size == (size_t)-1)
+		EXIT_AND_SETERR(seq_file, 12);
+
+	/* Move both ends of the range to the start of a record, so that ranges
+	   that cover a file hand out each record exactly once */
+	if(end < start)
+		end = start;
+	start = seqf_resync(fd, seq_file->type, size, start);
+	if(start == (size_t)-1)
+		EXIT_AND_SETERR(seq_file, seqferrno_);
+	end = seqf_resync(fd, seq_file->type, size, end);
+	if(end == (size_t)-1)
+		EXIT_AND_SETERR(seq_file, seqferrno_);
+	seq_file->range_start = start;
+	seq_file->range_pos = start;
+	seq_file->range_end = end;
+
+	if(seq_file->use_map)
+		map_file(seq_file, start, end - start);
+	if(start == end)
+		seq_file->eof = true;
+
+	return (SeqFile)seq_file;
+}
+
+/**
+ * @brief Open `path' for reading, or for writing when `mode' has a "w". A
+ * mode that extract_mode() will reject is opened for reading, so that a typo
+ * never truncates the file.
+ */
+static int
+open_path(const char *path, const char *mode)
 {
 	int flags = O_RDONLY;
+	if(mode != NULL && strchr(mode, 'w') != NULL &&
+	   mode[strspn(mode, "aqsbutwgz0123456789")] == '\0')
+		flags = O_WRONLY | O_CREAT | O_TRUNC;
 #ifdef _WIN32
 	flags |= O_BINARY;
 #endif
-	int fd = open(path, flags); // currently only support reading
+	return open(path, flags, 0666);
+}
+
+/**
+ * @brief Keep the path `file' was opened with, by which `seqfafetch()' finds
+ * the index of the file.
+ */
+static SeqFile
+keep_path(SeqFile file, const char *path)
+{
+	if(file == NULL)
+		return NULL;
+	seqf_statep state = (seqf_statep)file;
+	size_t len = strlen(path) + 1;
+	if((state->path = seqf_malloc(len)) == NULL)
+		EXIT_AND_SETERR(state, 6);
+	memcpy(state->path, path, len);
+	return file;
+}
+
+SeqFile
+seqfopen_range(const char *path, const char *mode, size_t start, size_t end)
+{
+	int fd = open_path(path, mode);
+	if(fd == -1) {
+		seqferrno_ = 1;
+		return NULL;
+	}
+	return keep_path(seqfdopen_range(fd, mode, start, end), path);
+}
+
+SeqFile
+seqfopen(const char *path, const char *mode)
+{
+	int fd = open_path(path, mode);
 	if(fd == -1) {
 		seqferrno_ = 1;
 		return NULL;
 	}
-	return seqfdopen(fd, mode);
+	return keep_path(seqfdopen(fd, mode), path);
 }
 
 int
@@ -188,53 +459,149 @@ seqfclose(SeqFile file)
 		return 1;
 	int return_code = 0;
 	seqf_statep state = (seqf_statep)file;
+	seqf_share_stop(state);
+	seqf_pipe_stop(state);
+	if(seqf_writer_stop(state) != 0)
+		return_code = 1;
+	seqf_cache_close(state);
+	seqf_faidx_free(state);
+	seqf_zindex_free(state);
+	seqf_free(state->path);
 	if(state->fd > 2 && close(state->fd) == -1)
 		return_code = seqferrno_ = 1;
 	if(state->mutex_is_init)
 		mtx_destroy(&state->mutex);
 	if(state->in_buf)
-		free(state->in_buf);
+		seqf_buffree(state->in_buf, state->in_bufsiz, state->in_huge);
 	if(state->out_buf)
-		free(state->out_buf);
+		seqf_buffree(state->out_buf, state->out_bufsiz, state->out_huge);
+	if(state->rec_buf)
+		seqf_free(state->rec_buf);
+#ifndef _WIN32
+	if(state->map)
+		munmap(state->map - state->map_off, state->map_size + state->map_off);
+#endif
 #ifndef _IGZIP_H
 	if(state->stream_is_init)
 		inflateEnd(&state->stream);
 #endif
-	free(state);
+	seqf_free(state);
 	return return_code;
 }
 
+SeqFile
+seqfreopen(SeqFile file, const char *path, const char *mode)
+{
+	if(file == NULL)
+		return seqfopen(path, mode);
+	seqf_statep state = (seqf_statep)file;
+	seqferrno_ = 0;
+
+	/* Let go of the last file */
+	seqf_share_stop(state);
+	seqf_pipe_stop(state);
+	seqf_writer_stop(state);
+	seqf_cache_close(state);
+	seqf_faidx_free(state);
+	seqf_zindex_free(state);
+	seqf_free(state->path);
+	state->path = NULL;
+	if(state->fd > 2 && close(state->fd) == -1)
+		seqferrno_ = 1;
+	state->fd = -1;
+#ifndef _WIN32
+	if(state->map)
+		munmap(state->map - state->map_off, state->map_size + state->map_off);
+#endif
+	state->map = NULL;
+
+	int fd = open_path(path, mode);
+	if(fd == -1 || seqferrno_ != 0) {
+		if(fd != -1)
+			close(fd);
+		EXIT_AND_SETERR(state, 1);
+	}
+
+	/* Start over from the defaults, but keep what can be reused. The mutex and
+	   decompressor themselves are left in place, only their flags are reset. */
+	struct seqf_state keep = *state;
+	init_seqfstatep(state);
+	state->in_buf = keep.in_buf;
+	state->in_bufsiz = keep.in_bufsiz;
+	state->in_huge = keep.in_huge;
+	state->out_buf = keep.out_buf;
+	state->out_bufsiz = keep.out_bufsiz;
+	state->out_huge = keep.out_huge;
+	state->out_bufbase = keep.out_bufbase;
+	state->out_bufmax = keep.out_bufmax;
+	state->huge_pages = keep.huge_pages;
+	state->io.timing = keep.io.timing;
+	state->rec_buf = keep.rec_buf;
+	state->rec_bufsiz = keep.rec_bufsiz;
+	state->mutex_is_init = keep.mutex_is_init;
+#ifndef _IGZIP_H
+	state->stream_is_init = keep.stream_is_init;
+#endif
+
+	if(start_state(state, fd, mode, false) == NULL)
+		return NULL;
+	map_whole(state);
+	return keep_path(file, path);
+}
+
 int
 seqfrewind(SeqFile file)
 {
 	if(file == NULL)
 		return -1;
 	seqf_statep state = (seqf_statep)file;
-	if(lseek(state->fd, 0, SEEK_SET)==-1) {
+	if(state->writing) {
+		seqferrno_ = 12;
+		return -1;
+	}
+	seqf_share_stop(state);
+	seqf_pipe_stop(state);
+	if(!state->ranged && lseek(state->fd, 0, SEEK_SET)==-1) {
 		seqferrno_ = 1;
 		return -1;
 	}
 	state->have = 0;
-	state->eof = false;
+	state->nt_part = 0;
+	state->nt_break = false;
+	state->lent = 0;
+	state->map_pos = 0;
+	state->range_pos = state->range_start;
+	state->eof = state->ranged && state->range_start == state->range_end;
+	state->zresumed = false;
+
+	/* A cache has no stream to reset, only the record to start from */
+	if(state->cache != NULL) {
+		seqf_cache_seek(state, 0);
+		return state->share_nbatches && seqf_share_start(state) != 0 ? -1 : 0;
+	}
 #if defined _IGZIP_H
 	isal_inflate_reset(&state->stream);
-	state->stream.crc_flag = state->compression == GZIP ? ISAL_GZIP : ISAL_ZLIB;
+	state->stream.crc_flag = state->compression == ZLIB ? ISAL_ZLIB : ISAL_GZIP;
 	state->stream.next_in = state->in_buf;
 #else
 	if(state->stream_is_init) {
 		int ret;
-		if(state->compression == GZIP)
+		if(state->compression == GZIP || state->compression == BGZF)
 			ret = inflateReset2(&state->stream, 16 + MAX_WBITS);
 		else if(state->compression == ZLIB)
-			ret = inflateReset(&state->stream);
+			ret = inflateReset2(&state->stream, MAX_WBITS);
 		else
 			return -1;
 		if(ret != Z_OK)
 			return -1;
 		state->stream.next_in = state->in_buf;
 		state->stream.avail_in = 0;
+		state->zraw = false;
 	}
 #endif
+	/* Shared mode starts over with the file */
+	if(state->share_nbatches && seqf_share_start(state) != 0)
+		return -1;
 	return 0;
 }
 
@@ -250,11 +617,12 @@ seqfsetibuf(SeqFile file, size_t bufsize)
 	if(file == NULL)
 		return -1;
 	seqf_statep state = (seqf_statep)file;
+	if(state->pipe != NULL) /* in_buf is owned by the decompression thread */
+		return -1;
 
-	unsigned char *t = realloc(state->in_buf, bufsize);
-	if(t == NULL) return -1;
-	state->in_buf = t;
-	state->in_bufsiz = bufsize;
+	if(seqf_bufresize(&state->in_buf, &state->in_bufsiz, &state->in_huge,
+	                  bufsize, state->huge_pages) != 0)
+		return -1;
 	return 0;
 }
 
@@ -265,10 +633,20 @@ seqfsetobuf(SeqFile file, size_t bufsize)
 		return -1;
 	seqf_statep state = (seqf_statep)file;
 
-	unsigned char *t = realloc(state->out_buf, bufsize);
-	if(t == NULL) return -1;
-	state->out_buf = t;
-	state->out_bufsiz = bufsize;
+	if(seqf_bufresize(&state->out_buf, &state->out_bufsiz, &state->out_huge,
+	                  bufsize, state->huge_pages) != 0)
+		return -1;
+	state->out_bufbase = bufsize;
+	state->out_small = 0;
+	return 0;
+}
+
+int
+seqfsetobufmax(SeqFile file, size_t maxsize)
+{
+	if(file == NULL)
+		return -1;
+	((seqf_statep)file)->out_bufmax = maxsize;
 	return 0;
 }
 
@@ -281,3 +659,68 @@ seqfsetbuf(SeqFile file, size_t bufsize)
 		return -2;
 	return 0;
 }
+
+int
+seqfsethugepages(SeqFile file, bool enable)
+{
+	if(file == NULL)
+		return -1;
+	((seqf_statep)file)->huge_pages = enable;
+	return 0;
+}
+
+int
+seqfsetpipeline(SeqFile file, size_t nblocks)
+{
+	if(file == NULL)
+		return -1;
+	seqf_statep state = (seqf_statep)file;
+	if(state->pipe != NULL) /* already decompressing, too late to change */
+		return -1;
+	if(state->writer != NULL && state->writer->blocks != NULL) /* already compressing */
+		return -1;
+
+	state->pipe_nblocks = nblocks == 1 ? 2 : nblocks;
+	return 0;
+}
+
+int
+seqfsetthreads(SeqFile file, size_t nthreads)
+{
+	if(file == NULL)
+		return -1;
+	seqf_statep state = (seqf_statep)file;
+	if(state->pipe != NULL) /* already decompressing, too late to change */
+		return -1;
+
+	state->pipe_nthreads = nthreads;
+	return 0;
+}
+
+int
+seqfgetstats(SeqFile file, SeqfStats *stats)
+{
+	if(file == NULL || stats == NULL)
+		return -1;
+	seqf_statep state = (seqf_statep)file;
+
+	mtx_lock(&state->mutex);
+	*stats = state->stats;
+	stats->bytes_in = state->io.bytes_in;
+	stats->reads = state->io.reads;
+	stats->read_ns = state->io.read_ns;
+	stats->inflate_ns = state->io.inflate_ns;
+	stats->chunks_kept = state->io.chunks_kept;
+	mtx_unlock(&state->mutex);
+
+	return 0;
+}
+
+int
+seqfsettiming(SeqFile file, bool enable)
+{
+	if(file == NULL)
+		return -1;
+	((seqf_statep)file)->io.timing = enable;
+	return 0;
+}
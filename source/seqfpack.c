@@ -0,0 +1,175 @@
+/* seqfpack.c - seqf functions for reading sequences as 2-bit codes
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <stdlib.h>
+
+#include "seqf_read.h"
+
+#define SEQF_BYTES(c) (0x0101010101010101ULL * (unsigned char)(c))
+#define SEQF_HIGH     SEQF_BYTES(0x80)
+#define SEQF_LOW7     SEQF_BYTES(0x7F)
+
+/**
+ * @brief Set the high bit of every byte of `y' that is not zero, and clear
+ * every other bit. Unlike the usual "has a zero byte" test, this is exact for
+ * each byte, as no carry crosses into the next one.
+ */
+static inline uint64_t
+seqf_nonzero8(uint64_t y)
+{
+	return (((y & SEQF_LOW7) + SEQF_LOW7) | y) & SEQF_HIGH;
+}
+
+/**
+ * @brief Pack the 8 bases in `x' into 16 bits, the first base in the lowest
+ * two. Bits 1-2 and 2-3 of the ASCII codes of A, C, G and T differ in their
+ * exclusive or, which gives 0, 1, 2 and 3 for upper and lower case alike.
+ */
+static inline uint64_t
+seqf_pack8(uint64_t x)
+{
+	uint64_t k = ((x >> 1) ^ (x >> 2)) & SEQF_BYTES(3);
+	k = (k | k >> 6)  & 0x000F000F000F000FULL;
+	k = (k | k >> 12) & 0x000000FF000000FFULL;
+	return (k | k >> 24) & 0xFFFF;
+}
+
+/**
+ * @brief Add position `pos' to the ambiguous runs of `seq', extending the
+ * last run when it ends right before it.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_addambig(SeqfPacked *seq, size_t pos)
+{
+	size_t n = seq->nruns;
+	if(n && seq->run_start[n-1] + seq->run_len[n-1] == pos) {
+		seq->run_len[n-1]++;
+		return 0;
+	}
+	if(n == seq->runs_size) {
+		size_t size = n ? 2*n : 16;
+		/* Both arrays live in one allocation, one after the other */
+		size_t *tmp = seqf_realloc(seq->run_start, 2 * size * sizeof *tmp);
+		if(tmp == NULL) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		memmove(tmp + size, tmp + n, n * sizeof *tmp);
+		seq->run_start = tmp;
+		seq->run_len = tmp + size;
+		seq->runs_size = size;
+	}
+	seq->run_start[n] = pos;
+	seq->run_len[n] = 1;
+	seq->nruns++;
+	return 0;
+}
+
+/**
+ * @brief Pack the `len' bases at `p' into `seq', 8 at a time. Bases other
+ * than A, C, G and T are rare, so they are only looked at one by one when a
+ * group of 8 holds one.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_pack2b(SeqfPacked *seq, const unsigned char *p, size_t len)
+{
+	size_t nwords = (len + 31) / 32;
+	if(nwords > seq->words_size) {
+		size_t size = seq->words_size ? seq->words_size : 64;
+		while(size < nwords)
+			size <<= 1;
+		uint64_t *tmp = seqf_realloc(seq->words, size * sizeof *tmp);
+		if(tmp == NULL) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		seq->words = tmp;
+		seq->words_size = size;
+	}
+	seq->len = len;
+	seq->nruns = 0;
+
+	/* Bases are loaded 8 at a time as a little endian word, so that the first
+	   is in the lowest byte whatever the byte order of the machine */
+	uint64_t word = 0;
+	for(size_t i = 0; i < len; i += 8) {
+		uint64_t x;
+		if(len - i >= 8) {
+			x = seqf_get64(p + i);
+		} else {
+			/* Pad the last group with A's, which pack to 0 */
+			unsigned char tail[8];
+			memset(tail, 'A', sizeof tail);
+			memcpy(tail, p + i, len - i);
+			x = seqf_get64(tail);
+		}
+
+		uint64_t u = x & SEQF_BYTES(0xDF); /* Upper case */
+		uint64_t bad = seqf_nonzero8(u ^ SEQF_BYTES('A')) &
+		               seqf_nonzero8(u ^ SEQF_BYTES('C')) &
+		               seqf_nonzero8(u ^ SEQF_BYTES('G')) &
+		               seqf_nonzero8(u ^ SEQF_BYTES('T'));
+		uint64_t bits = seqf_pack8(x);
+		if(bad) {
+			for(int j = 0; j < 8; j++) {
+				if(!(bad >> (8*j + 7) & 1))
+					continue;
+				bits &= ~((uint64_t)3 << 2*j);
+				if(seqf_addambig(seq, i + j) != 0)
+					return 1;
+			}
+		}
+
+		word |= bits << 2*(i % 32);
+		if(i % 32 == 24 || i + 8 >= len) {
+			seq->words[i / 32] = word;
+			word = 0;
+		}
+	}
+	return 0;
+}
+
+int
+seqfgets2b_unlocked(SeqFile file, SeqfPacked *seq)
+{
+	if(file == NULL || seq == NULL)
+		return EOF;
+
+	SeqfRecord rec;
+	if(seqfnextrec_unlocked(file, &rec) != 0)
+		return EOF;
+	if(seqf_pack2b(seq, (const unsigned char *)rec.seq, rec.seq_len) != 0)
+		return EOF;
+	return 0;
+}
+
+int
+seqfgets2b(SeqFile file, SeqfPacked *seq)
+{
+	if(file == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	int ret = seqfgets2b_unlocked(file, seq);
+	seqf_unlock(state);
+
+	return ret;
+}
+
+void
+seqfpackedfree(SeqfPacked *seq)
+{
+	if(seq == NULL)
+		return;
+	seqf_free(seq->words);
+	seqf_free(seq->run_start);
+	memset(seq, 0, sizeof *seq);
+}
@@ -0,0 +1,206 @@
+/* seqfpaired.c - seqf functions for reading several files in step
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <string.h>
+
+#include "seqf_core.h"
+
+/* Blocks in the decompression ring of each file */
+#define SEQF_PAIRED_BLOCKS 4
+
+/**
+ * @brief One file of a `seqf_paired`, and the batch it is parsed into by the
+ * task of the current `seqfnextpaired()` call.
+ */
+struct seqf_mate {
+	SeqFile file;                  /** File of this mate */
+	SeqfBatch *batch;              /** Batch to parse the records into */
+	size_t max_records;            /** Largest number of records to parse */
+	size_t nrecords;               /** Number of records parsed */
+	int err;                       /** seqferrno of the task that parsed them */
+};
+
+struct seqf_paired {
+	struct seqf_mate *mates;       /** One per file */
+	size_t n;                      /** Number of files */
+	bool check;                    /** Compare the names of mates */
+	SeqfTaskGroup group;           /** Tasks parsing the mates of one call */
+	mtx_t mutex;                   /** Keeps the files in step between threads */
+};
+
+/**
+ * @brief Parse the next batch of a mate. Runs as a task on the pool, so the
+ * error is kept in the mate rather than in the seqferrno of the worker.
+ */
+static void
+seqf_mate_next(void *arg)
+{
+	struct seqf_mate *mate = (struct seqf_mate *)arg;
+	seqferrno_ = 0;
+	mate->nrecords = seqfnextbatch_unlocked(mate->file, mate->batch, mate->max_records);
+	mate->err = seqferrno_;
+}
+
+/**
+ * @brief Length of a read name without its mate suffix, such as "/1".
+ */
+static size_t
+seqf_matelen(const char *name, size_t len)
+{
+	if(len >= 2 && name[len - 2] == '/' && name[len - 1] >= '0' && name[len - 1] <= '9')
+		return len - 2;
+	return len;
+}
+
+/**
+ * @brief Check that record i of every batch has the same name as in the first.
+ */
+static bool
+seqf_matesagree(const SeqfBatch *batches, size_t n, size_t nrecords)
+{
+	for(size_t r = 0; r < nrecords; r++) {
+		const char *name = batches[0].data + batches[0].name_off[r];
+		size_t len = seqf_matelen(name, batches[0].name_len[r]);
+		for(size_t i = 1; i < n; i++) {
+			const char *other = batches[i].data + batches[i].name_off[r];
+			if(seqf_matelen(other, batches[i].name_len[r]) != len ||
+			   memcmp(name, other, len) != 0)
+				return false;
+		}
+	}
+	return true;
+}
+
+static void
+seqf_paired_free(struct seqf_paired *paired)
+{
+	for(size_t i = 0; i < paired->n; i++)
+		if(paired->mates[i].file != NULL)
+			seqfclose(paired->mates[i].file);
+	seqftaskgroupfree(paired->group);
+	seqf_free(paired->mates);
+	seqf_free(paired);
+}
+
+SeqfPaired
+seqfopen_paired(const char *const *paths, size_t n, const char *mode)
+{
+	if(paths == NULL || n == 0) {
+		seqferrno_ = 8;
+		return NULL;
+	}
+	struct seqf_paired *paired = seqf_calloc(1, sizeof *paired);
+	if(paired == NULL) {
+		seqferrno_ = 6;
+		return NULL;
+	}
+	paired->mates = seqf_calloc(n, sizeof *paired->mates);
+	if(paired->mates == NULL) {
+		seqf_free(paired);
+		seqferrno_ = 6;
+		return NULL;
+	}
+	paired->n = n;
+
+	/* Each file is inflated by its own ring, so the mates inflate at once */
+	for(size_t i = 0; i < n; i++) {
+		paired->mates[i].file = seqfopen(paths[i], mode);
+		if(paired->mates[i].file == NULL) {
+			int err = seqferrno_;
+			seqf_paired_free(paired);
+			seqferrno_ = err;
+			return NULL;
+		}
+		seqfsetpipeline(paired->mates[i].file, SEQF_PAIRED_BLOCKS);
+	}
+
+	if(n > 1 && (paired->group = seqftaskgroup()) == NULL) {
+		seqf_paired_free(paired);
+		return NULL;
+	}
+	if(mtx_init(&paired->mutex, mtx_plain) != thrd_success) {
+		seqf_paired_free(paired);
+		seqferrno_ = 2;
+		return NULL;
+	}
+	return (SeqfPaired)paired;
+}
+
+size_t
+seqfnextpaired(SeqfPaired paired, SeqfBatch *batches, size_t max_records)
+{
+	if(paired == NULL || batches == NULL)
+		return 0;
+	struct seqf_paired *p = (struct seqf_paired *)paired;
+
+	mtx_lock(&p->mutex);
+	for(size_t i = 0; i < p->n; i++) {
+		p->mates[i].batch = &batches[i];
+		p->mates[i].max_records = max_records;
+	}
+
+	/* The other mates are parsed on the pool while this thread parses the
+	   first; a mate that cannot be submitted is parsed here too */
+	for(size_t i = 1; i < p->n; i++)
+		if(seqfsubmit(p->group, seqf_mate_next, &p->mates[i]) != 0)
+			seqf_mate_next(&p->mates[i]);
+	seqf_mate_next(&p->mates[0]);
+	if(p->n > 1)
+		seqfwait(p->group);
+
+	size_t nrecords = p->mates[0].nrecords;
+	int err = 0;
+	for(size_t i = 0; i < p->n && err == 0; i++) {
+		if(p->mates[i].err != 0)
+			err = p->mates[i].err;
+		else if(p->mates[i].nrecords != nrecords)
+			err = 9;
+	}
+	if(err == 0 && p->check && !seqf_matesagree(batches, p->n, nrecords))
+		err = 9;
+	mtx_unlock(&p->mutex);
+
+	if(err != 0) {
+		seqferrno_ = err;
+		return 0;
+	}
+	return nrecords;
+}
+
+int
+seqfsetpairedcheck(SeqfPaired paired, bool enable)
+{
+	if(paired == NULL)
+		return -1;
+	((struct seqf_paired *)paired)->check = enable;
+	return 0;
+}
+
+SeqFile
+seqfpairedfile(SeqfPaired paired, size_t i)
+{
+	if(paired == NULL)
+		return NULL;
+	struct seqf_paired *p = (struct seqf_paired *)paired;
+	return i < p->n ? p->mates[i].file : NULL;
+}
+
+int
+seqfclose_paired(SeqfPaired paired)
+{
+	if(paired == NULL)
+		return 1;
+	struct seqf_paired *p = (struct seqf_paired *)paired;
+	int return_code = 0;
+	for(size_t i = 0; i < p->n; i++) {
+		if(seqfclose(p->mates[i].file) != 0)
+			return_code = 1;
+		p->mates[i].file = NULL;
+	}
+	mtx_destroy(&p->mutex);
+	seqf_paired_free(p);
+	return return_code;
+}
@@ -0,0 +1,830 @@
+/* seqfpipe.c - Background decompression of compressed SeqFile streams
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * A pipelined SeqFile decompresses on tasks of the library's thread pool into
+ * a ring of output blocks, while the reading thread parses the block before
+ * it. Only the background tasks touch the decompressor and the file
+ * descriptor once the ring is running.
+ */
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <io.h>
+    #include <basetsd.h>
+    #define read _read
+    typedef SSIZE_T ssize_t;
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#include <stdint.h>
+
+#include "seqf_read.h"
+#include "seqf_pipe.h"
+
+#if defined _IGZIP_H
+#  include <crc.h>
+#endif
+
+/**
+ * @brief Read exactly `bufsize` bytes from `fd`, unless end of file is reached
+ * first. Returns the number of bytes read, or -1 on error.
+ */
+static ssize_t
+seqf_readall(int fd, unsigned char *buffer, size_t bufsize, struct seqf_io *io)
+{
+	size_t got = 0;
+	ssize_t n = 0;
+	uint64_t start = seqf_tick(io->timing);
+	while(got < bufsize) {
+		n = read(fd, buffer + got, bufsize - got);
+		io->reads++;
+		if(n <= 0)
+			break;
+		got += n;
+	}
+	io->read_ns += seqf_tock(io->timing, start);
+	io->bytes_in += got;
+	return n == -1 ? -1 : (ssize_t)got;
+}
+
+/**
+ * @brief Add the counters of a block to those of the state.
+ */
+static void
+seqf_io_add(struct seqf_io *to, const struct seqf_io *from)
+{
+	to->bytes_in += from->bytes_in;
+	to->reads += from->reads;
+	to->read_ns += from->read_ns;
+	to->inflate_ns += from->inflate_ns;
+	to->chunks_kept += from->chunks_kept;
+}
+
+/**
+ * @brief Make sure `*buf` can hold `size` bytes, growing it geometrically.
+ */
+static bool
+seqf_reserve(unsigned char **buf, size_t *cap, size_t size)
+{
+	if(size <= *cap)
+		return true;
+	size_t newcap = *cap ? *cap : 1;
+	while(newcap < size)
+		newcap <<= 1;
+	unsigned char *t = seqf_realloc(*buf, newcap);
+	if(t == NULL)
+		return false;
+	*buf = t;
+	*cap = newcap;
+	return true;
+}
+
+/**
+ * @brief Read the next run of BGZF members from the file into `blk->in`, up to
+ * roughly SEQF_BGZF_CHUNK bytes of decompressed data. Must be called with the
+ * ring's mutex held, since the members are read sequentially from one fd.
+ *
+ * @param state Internal state pointer for the SeqFile
+ * @param blk   Block whose compressed input will be filled
+ * @return int 0 on success (blk->in_len is 0 at end of file), or the error to
+ * store in the block
+ */
+static int
+seqf_bgzf_read(seqf_statep state, struct seqf_block *blk)
+{
+	blk->in_len = 0;
+	blk->need = 0;
+	while(blk->need + 65536 <= SEQF_BGZF_CHUNK) {
+		/* Read header, which holds the size of the member */
+		if(!seqf_reserve(&blk->in, &blk->in_size, blk->in_len + BGZF_HDRSIZ)) {
+			seqferrno_ = 6;
+			return -1;
+		}
+		unsigned char *hdr = blk->in + blk->in_len;
+		ssize_t n = seqf_readall(state->fd, hdr, BGZF_HDRSIZ, &blk->io);
+		if(n == -1) {
+			seqferrno_ = 1;
+			return -1;
+		}
+		if(n == 0)
+			break;
+		if(!seqf_isbgzf(hdr, (size_t)n)) {
+			seqferrno_ = 1;
+			return 3;
+		}
+
+		/* Read rest of the member */
+		size_t msize = (size_t)seqf_get16(hdr + 16) + 1;
+		if(msize < BGZF_HDRSIZ + 8) {
+			seqferrno_ = 1;
+			return 3;
+		}
+		if(!seqf_reserve(&blk->in, &blk->in_size, blk->in_len + msize)) {
+			seqferrno_ = 6;
+			return -1;
+		}
+		hdr = blk->in + blk->in_len;
+		n = seqf_readall(state->fd, hdr + BGZF_HDRSIZ, msize - BGZF_HDRSIZ, &blk->io);
+		if(n == -1) {
+			seqferrno_ = 1;
+			return -1;
+		}
+		if((size_t)n < msize - BGZF_HDRSIZ) {
+			seqferrno_ = 1;
+			return 3;
+		}
+
+		/* ISIZE trailer gives the decompressed size of the member */
+		blk->need += seqf_get32(hdr + msize - 4);
+		blk->in_len += msize;
+	}
+	return 0;
+}
+
+/**
+ * @brief Inflate the BGZF members held in `blk->in` into `blk->data`. Each
+ * member is a complete gzip member, so the decompressor also verifies its CRC.
+ */
+#if defined _IGZIP_H
+static int
+seqf_bgzf_inflate(struct inflate_state *stream, struct seqf_block *blk)
+#else
+static int
+seqf_bgzf_inflate(z_stream *stream, struct seqf_block *blk)
+#endif
+{
+	blk->len = 0;
+	if(!seqf_reserve(&blk->data, &blk->size, blk->need)) {
+		seqferrno_ = 6;
+		return -1;
+	}
+
+	size_t pos = 0;
+	uint64_t start = seqf_tick(blk->io.timing);
+	while(pos < blk->in_len) {
+		unsigned char *member = blk->in + pos;
+		size_t msize = (size_t)seqf_get16(member + 16) + 1;
+#if defined _IGZIP_H
+		isal_inflate_reset(stream);
+		stream->crc_flag = ISAL_GZIP;
+		stream->next_in = member;
+		stream->avail_in = msize;
+		stream->next_out = blk->data + blk->len;
+		stream->avail_out = blk->size - blk->len;
+		int ret = isal_inflate(stream);
+		if(ret != ISAL_DECOMP_OK || stream->block_state != ISAL_BLOCK_FINISH) {
+			blk->io.inflate_ns += seqf_tock(blk->io.timing, start);
+			seqferrno_ = 1;
+			return 3;
+		}
+		blk->len = blk->size - stream->avail_out;
+#else
+		inflateReset(stream);
+		stream->next_in = member;
+		stream->avail_in = msize;
+		stream->next_out = blk->data + blk->len;
+		stream->avail_out = blk->size - blk->len;
+		if(inflate(stream, Z_FINISH) != Z_STREAM_END) {
+			blk->io.inflate_ns += seqf_tock(blk->io.timing, start);
+			seqferrno_ = 1;
+			return 3;
+		}
+		blk->len = blk->size - stream->avail_out;
+#endif
+		pos += msize;
+	}
+	blk->io.inflate_ns += seqf_tock(blk->io.timing, start);
+	return 0;
+}
+
+/**
+ * @brief Map the gzip file behind `state' and prepare `pipe' to inflate it in
+ * chunks on `nthreads' threads. Files that are not regular, too small to be
+ * worth splitting, or do not start with a gzip header are left to `seqf_loadz'.
+ *
+ * @return true if the file will be inflated speculatively
+ */
+static bool
+seqf_spec_open(seqf_statep state, struct seqf_pipe *pipe, size_t nthreads)
+{
+#ifndef _WIN32
+	struct stat st;
+	if(!state->use_map || fstat(state->fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	  st.st_size < 2 * SEQF_SPEC_MINCHUNK)
+		return false;
+
+	size_t size = (size_t)st.st_size;
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, state->fd, 0);
+	if(map == MAP_FAILED)
+		return false;
+	size_t hdr = seqf_inflate_header(map, size);
+	if(hdr == 0) {
+		munmap(map, size);
+		return false;
+	}
+
+	pipe->map = map;
+	pipe->map_size = size;
+	pipe->chunk = size / (4 * nthreads);
+	if(pipe->chunk < SEQF_SPEC_MINCHUNK)
+		pipe->chunk = SEQF_SPEC_MINCHUNK;
+	if(pipe->chunk > SEQF_SPEC_CHUNK)
+		pipe->chunk = SEQF_SPEC_CHUNK;
+	pipe->spec_pos = hdr * 8;
+	pipe->spec = true;
+	return true;
+#else
+	(void)state; (void)pipe; (void)nthreads;
+	return false;
+#endif
+}
+
+/**
+ * @brief Settle where chunk `c' starts and what it decodes to. Only one thread
+ * runs this at a time, in chunk order, right after the chunk before it. The
+ * speculative result in `inf' is kept if it started exactly where the chunk
+ * before ended, otherwise the chunk is inflated again from there with the real
+ * window. Either way, the window is moved past the chunk, and its previous
+ * contents are copied to `win' for `seqf_inflate_resolve'.
+ *
+ * @param pipe  Ring of the SeqFile
+ * @param inf   Decoder holding the speculative output of the chunk
+ * @param win   Receives the window that precedes the chunk
+ * @param wlen  Receives the number of bytes in win
+ * @param start Bit offset the speculative output starts at, SIZE_MAX if none
+ * @param end   Bit offset the chunk's blocks have to start before
+ * @param blk   Block of the chunk, to record the member trailer in
+ * @return int 0 on success, 3 if the stream is invalid, -1 when out of memory
+ */
+static int
+seqf_spec_settle(struct seqf_pipe *pipe, struct seqf_inflate *inf, unsigned char *win, size_t *wlen,
+                 size_t start, size_t end, struct seqf_block *blk)
+{
+	size_t pos = pipe->spec_pos;
+	*wlen = pipe->wlen;
+
+	/* Continue with the next member, if another one follows the trailer */
+	if(pipe->spec_final) {
+		size_t at = (pos + 7) / 8 + 8;
+		if(at >= pipe->map_size || pipe->map[at] != 0x1F) {
+			pipe->spec_done = true;
+			blk->last = true;
+			return 0;
+		}
+		size_t hdr = seqf_inflate_header(pipe->map + at, pipe->map_size - at);
+		if(hdr == 0)
+			return 3;
+		pos = (at + hdr) * 8;
+		*wlen = 0;
+	}
+
+	/* Speculation was wrong or impossible, inflate from where we really are */
+	if(start != pos) {
+		inf->out_len = 0;
+		inf->pos = pos;
+		inf->final = false;
+		if(pos < end) {
+			seqf_inflate_context(inf, pipe->window, *wlen);
+			int ret = seqf_inflate_run(inf, pos, end);
+			if(ret != 0)
+				return ret;
+		}
+	} else {
+		blk->io.chunks_kept++;
+	}
+
+	/* Slide the window past this chunk */
+	size_t n = inf->out_len;
+	size_t take = MIN2(n, SEQF_WINSIZ);
+	size_t keep = MIN2(*wlen, SEQF_WINSIZ - take);
+	memcpy(win, pipe->window, *wlen);
+	memmove(pipe->window, pipe->window + *wlen - keep, keep);
+	if(seqf_inflate_resolve(inf->out + SEQF_WINSIZ + n - take, take, win, *wlen, pipe->window + keep) != 0)
+		return 3;
+	pipe->wlen = keep + take;
+
+	/* The trailer of a member holds its CRC-32 and size */
+	if(inf->final) {
+		size_t at = (inf->pos + 7) / 8;
+		if(at + 8 > pipe->map_size)
+			return 3;
+		blk->member_end = true;
+		blk->trailer_crc = seqf_get32(pipe->map + at);
+		blk->trailer_isize = seqf_get32(pipe->map + at + 4);
+	}
+	pipe->spec_pos = inf->pos;
+	pipe->spec_final = inf->final;
+	return 0;
+}
+
+/**
+ * @brief Inflate chunk `c' of a gzip file into `blk'. The chunk holds the
+ * deflate blocks that start within its share of the compressed bytes. Those
+ * are first decoded without knowing the preceding window, starting from a
+ * block boundary found by `seqf_inflate_find'. When every chunk before it is
+ * settled, the chunk takes its turn in `seqf_spec_settle', and finally turns
+ * its markers into bytes in parallel with the other threads.
+ *
+ * @return int 0 on success, 3 if the stream is invalid, -1 when out of memory
+ */
+static int
+seqf_spec_chunk(struct seqf_pipe *pipe, struct seqf_inflate *inf, unsigned char *win,
+                size_t c, struct seqf_block *blk)
+{
+	/* The last chunk takes everything up to the end of the stream */
+	size_t begin = c * pipe->chunk;
+	size_t end = SIZE_MAX;
+	if(begin + pipe->chunk < pipe->map_size)
+		end = (begin + pipe->chunk) * 8;
+	if(begin < pipe->map_size)
+		blk->io.bytes_in += MIN2(pipe->chunk, pipe->map_size - begin);
+	uint64_t start_ns = seqf_tick(blk->io.timing);
+
+	/* Speculate. The first chunk knows where it starts, and that its window
+	   is empty; no other thread changes spec_pos before it is settled. */
+	size_t start = SIZE_MAX;
+	if(c == 0)
+		start = pipe->spec_pos;
+	else if(begin < pipe->map_size && !seqf_inflate_find(inf, begin * 8, end, &start))
+		start = SIZE_MAX;
+	if(start != SIZE_MAX) {
+		seqf_inflate_context(inf, NULL, 0);
+		if(seqf_inflate_run(inf, start, end) != 0)
+			start = SIZE_MAX;
+	}
+	blk->io.inflate_ns += seqf_tock(blk->io.timing, start_ns);
+
+	/* Wait for our turn, then settle */
+	mtx_lock(&pipe->mutex);
+	while(!pipe->stop && pipe->resolved != c)
+		cnd_wait(&pipe->filled, &pipe->mutex);
+	bool stop = pipe->stop;
+	mtx_unlock(&pipe->mutex);
+	if(stop)
+		return 0;
+
+	int ret = 0;
+	size_t wlen = 0;
+	start_ns = seqf_tick(blk->io.timing);
+	blk->len = 0;
+	blk->member_end = false;
+	if(pipe->spec_done)
+		blk->last = true;
+	else if((ret = seqf_spec_settle(pipe, inf, win, &wlen, start, end, blk)) != 0)
+		pipe->spec_done = true;
+
+	mtx_lock(&pipe->mutex);
+	pipe->resolved++;
+	cnd_broadcast(&pipe->filled);
+	mtx_unlock(&pipe->mutex);
+	if(ret != 0 || blk->last)
+		goto fail;
+
+	/* Resolve the markers of the whole chunk */
+	if(!seqf_reserve(&blk->data, &blk->size, inf->out_len)) {
+		ret = -1;
+		goto fail;
+	}
+	if(seqf_inflate_resolve(inf->out + SEQF_WINSIZ, inf->out_len, win, wlen, blk->data) != 0) {
+		ret = 3;
+		goto fail;
+	}
+	blk->len = inf->out_len;
+#if !defined _IGZIP_H
+	blk->crc = crc32(0L, blk->data, (uInt)blk->len);
+#endif
+	blk->io.inflate_ns += seqf_tock(blk->io.timing, start_ns);
+	return 0;
+
+fail:
+	blk->io.inflate_ns += seqf_tock(blk->io.timing, start_ns);
+	if(ret == 3)
+		seqferrno_ = 1;
+	else if(ret == -1)
+		seqferrno_ = 6;
+	return ret;
+}
+
+/**
+ * @brief Check a speculative chunk against the trailer of the gzip member it
+ * belongs to. Runs on the reader, which sees the chunks in order. A mismatch
+ * turns the block into a failed, last block.
+ */
+static void
+seqf_spec_verify(struct seqf_pipe *pipe, struct seqf_block *blk)
+{
+	if(blk->ret != 0)
+		return;
+#if defined _IGZIP_H
+	pipe->crc = crc32_gzip_refl(pipe->crc, blk->data, blk->len);
+#else
+	pipe->crc = (uint32_t)crc32_combine(pipe->crc, blk->crc, (z_off_t)blk->len);
+#endif
+	pipe->isize += blk->len;
+	if(!blk->member_end)
+		return;
+	if(pipe->crc != blk->trailer_crc || (uint32_t)pipe->isize != blk->trailer_isize) {
+		blk->ret = 3;
+		blk->err = 1;
+		blk->len = 0;
+		blk->last = true;
+	}
+	pipe->crc = 0;
+	pipe->isize = 0;
+}
+
+/**
+ * @brief Set up the private decompressors of `ctx', the first time a task
+ * borrows it.
+ */
+static void
+seqf_pipe_ctx_init(seqf_statep state, struct seqf_pipe_ctx *ctx)
+{
+	struct seqf_pipe *pipe = state->pipe;
+	ctx->init = true;
+	ctx->ok = true;
+
+	/* Private decompressor for BGZF members */
+	if(state->compression == BGZF) {
+#if defined _IGZIP_H
+		if((ctx->stream = seqf_malloc(sizeof *ctx->stream)) != NULL)
+			isal_inflate_init(ctx->stream);
+#else
+		ctx->zs.zalloc = seqf_zalloc;
+		ctx->zs.zfree = seqf_zfree;
+		ctx->zs.opaque = Z_NULL;
+		ctx->zs.avail_in = 0;
+		ctx->zs.next_in = Z_NULL;
+		if(inflateInit2(&ctx->zs, 16 + MAX_WBITS) == Z_OK)
+			ctx->stream = &ctx->zs;
+#endif
+		ctx->ok = ctx->stream != NULL;
+	}
+
+	/* Private decoder and window for speculative chunks */
+	if(pipe->spec) {
+		ctx->inf = seqf_malloc(sizeof *ctx->inf);
+		ctx->win = seqf_malloc(SEQF_WINSIZ);
+		if(ctx->inf != NULL && seqf_inflate_init(ctx->inf, pipe->map, pipe->map_size) != 0) {
+			seqf_free(ctx->inf);
+			ctx->inf = NULL;
+		}
+		ctx->ok = ctx->inf != NULL && ctx->win != NULL;
+	}
+}
+
+static void
+seqf_pipe_ctx_free(struct seqf_pipe_ctx *ctx)
+{
+#if defined _IGZIP_H
+	seqf_free(ctx->stream);
+#else
+	if(ctx->stream != NULL)
+		inflateEnd(ctx->stream);
+#endif
+	if(ctx->inf != NULL)
+		seqf_inflate_free(ctx->inf);
+	seqf_free(ctx->inf);
+	seqf_free(ctx->win);
+}
+
+/**
+ * @brief Fill blocks of the ring until it is full, the stream ends, or the
+ * ring is stopped. Runs as a task on the pool.
+ */
+static void
+seqf_pipe_task(void *arg)
+{
+	seqf_statep state = (seqf_statep)arg;
+	struct seqf_pipe *pipe = state->pipe;
+	bool bgzf = state->compression == BGZF;
+
+	mtx_lock(&pipe->mutex);
+	size_t ctx_index = pipe->free_ctx[--pipe->nfree];
+	mtx_unlock(&pipe->mutex);
+	struct seqf_pipe_ctx *ctx = &pipe->ctx[ctx_index];
+	if(!ctx->init)
+		seqf_pipe_ctx_init(state, ctx);
+
+	mtx_lock(&pipe->mutex);
+	while(!pipe->stop && !pipe->eos && pipe->claimed - pipe->head < pipe->nblocks) {
+		size_t c = pipe->claimed++;
+		struct seqf_block *blk = &pipe->blocks[c % pipe->nblocks];
+
+		/* BGZF members are read in order while holding the lock */
+		seqferrno_ = 0;
+		blk->ret = 0;
+		blk->last = false;
+		blk->io = (struct seqf_io){ .timing = state->io.timing };
+		if(!ctx->ok) {
+			seqferrno_ = 6;
+			blk->ret = -1;
+			pipe->eos = true;
+		} else if(bgzf) {
+			blk->ret = seqf_bgzf_read(state, blk);
+			if(blk->ret != 0 || blk->in_len == 0)
+				pipe->eos = true;
+		}
+		mtx_unlock(&pipe->mutex);
+
+		/* Decompress into the block without holding the lock */
+		if(blk->ret == 0 && pipe->spec)
+			blk->ret = seqf_spec_chunk(pipe, ctx->inf, ctx->win, c, blk);
+		else if(blk->ret == 0 && bgzf)
+			blk->ret = seqf_bgzf_inflate(ctx->stream, blk);
+		else if(blk->ret == 0)
+			blk->ret = seqf_loadz(state, blk->data, blk->size, &blk->len, &blk->io);
+		blk->err = seqferrno_;
+		if(blk->ret != 0)
+			blk->len = 0;
+
+		/* Speculative chunks may be empty, others are empty only at the end */
+		if(blk->ret != 0 || (!pipe->spec && blk->len == 0))
+			blk->last = true;
+
+		/* Publish it */
+		mtx_lock(&pipe->mutex);
+		blk->ready = true;
+		if(blk->last)
+			pipe->eos = true;
+		cnd_broadcast(&pipe->filled);
+	}
+
+	/* Leave. The ring may be freed as soon as the lock is released. */
+	pipe->free_ctx[pipe->nfree++] = ctx_index;
+	if(--pipe->running == 0)
+		cnd_broadcast(&pipe->idle);
+	mtx_unlock(&pipe->mutex);
+}
+
+/**
+ * @brief Submit tasks to fill the free blocks of the ring, as long as fewer
+ * than nthreads are running. Called with the lock held.
+ */
+static void
+seqf_pipe_kick(seqf_statep state)
+{
+	struct seqf_pipe *pipe = state->pipe;
+	size_t free_blocks = pipe->nblocks - (pipe->claimed - pipe->head);
+	while(!pipe->stop && !pipe->eos && pipe->running < pipe->nthreads &&
+	      pipe->running < free_blocks) {
+		if(seqf_pool_submit(pipe->pool, seqf_pipe_task, state) != 0)
+			break;
+		pipe->running++;
+	}
+}
+
+static void
+seqf_pipe_free(struct seqf_pipe *pipe)
+{
+	if(pipe->blocks) {
+		for(size_t i = 0; i < pipe->nblocks; i++) {
+			seqf_free(pipe->blocks[i].data);
+			seqf_free(pipe->blocks[i].in);
+		}
+		seqf_free(pipe->blocks);
+	}
+#ifndef _WIN32
+	if(pipe->map)
+		munmap(pipe->map, pipe->map_size);
+#endif
+	if(pipe->ctx) {
+		for(size_t i = 0; i < pipe->nthreads; i++)
+			seqf_pipe_ctx_free(&pipe->ctx[i]);
+		seqf_free(pipe->ctx);
+	}
+	seqf_free(pipe->free_ctx);
+	seqf_free(pipe);
+}
+
+extern int
+seqf_pipe_start(seqf_statep state)
+{
+	struct seqf_pool *pool = seqf_pool_get();
+	if(pool == NULL)
+		return 1;
+	struct seqf_pipe *pipe = seqf_calloc(1, sizeof *pipe);
+	if(pipe == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	pipe->pool = pool;
+
+	/* BGZF members are independent, and a large enough gzip file can be split
+	   speculatively. Any other stream is inflated by a single task. */
+	pipe->nthreads = state->pipe_nthreads ? state->pipe_nthreads : pool->nthreads;
+	if(state->compression == GZIP && pipe->nthreads > 1 && !state->zresumed)
+		seqf_spec_open(state, pipe, pipe->nthreads);
+	if(state->compression != BGZF && !pipe->spec)
+		pipe->nthreads = 1;
+	pipe->nblocks = state->pipe_nblocks;
+	if(pipe->nthreads > 1 && pipe->nblocks < 2 * pipe->nthreads)
+		pipe->nblocks = 2 * pipe->nthreads;
+
+	/* Allocate ring of blocks. BGZF blocks and chunks are sized by their
+	   contents, so they start out large and grow as needed. */
+	size_t blksiz = state->out_bufsiz > SEQF_PIPE_BLKSIZ ? state->out_bufsiz : SEQF_PIPE_BLKSIZ;
+	if(state->compression == BGZF || pipe->spec)
+		blksiz = SEQF_BGZF_CHUNK;
+	pipe->blocks = seqf_calloc(pipe->nblocks, sizeof *pipe->blocks);
+	pipe->ctx = seqf_calloc(pipe->nthreads, sizeof *pipe->ctx);
+	pipe->free_ctx = seqf_malloc(pipe->nthreads * sizeof *pipe->free_ctx);
+	if(pipe->blocks == NULL || pipe->ctx == NULL || pipe->free_ctx == NULL) {
+		seqf_pipe_free(pipe);
+		seqferrno_ = 6;
+		return 1;
+	}
+	for(size_t i = 0; i < pipe->nthreads; i++)
+		pipe->free_ctx[pipe->nfree++] = i;
+	for(size_t i = 0; i < pipe->nblocks; i++) {
+		pipe->blocks[i].data = seqf_malloc(blksiz);
+		pipe->blocks[i].size = blksiz;
+		if(pipe->blocks[i].data == NULL) {
+			seqf_pipe_free(pipe);
+			seqferrno_ = 6;
+			return 1;
+		}
+	}
+
+	/* Initialize synchronization primitives */
+	if(mtx_init(&pipe->mutex, mtx_plain) != thrd_success) {
+		seqf_pipe_free(pipe);
+		seqferrno_ = 2;
+		return 1;
+	}
+	if(cnd_init(&pipe->filled) != thrd_success) {
+		mtx_destroy(&pipe->mutex);
+		seqf_pipe_free(pipe);
+		seqferrno_ = 2;
+		return 1;
+	}
+	if(cnd_init(&pipe->idle) != thrd_success) {
+		cnd_destroy(&pipe->filled);
+		mtx_destroy(&pipe->mutex);
+		seqf_pipe_free(pipe);
+		seqferrno_ = 2;
+		return 1;
+	}
+
+	/* Start filling the ring */
+	state->pipe = pipe;
+	mtx_lock(&pipe->mutex);
+	seqf_pipe_kick(state);
+	bool started = pipe->running != 0;
+	mtx_unlock(&pipe->mutex);
+	if(!started) {
+		state->pipe = NULL;
+		cnd_destroy(&pipe->idle);
+		cnd_destroy(&pipe->filled);
+		mtx_destroy(&pipe->mutex);
+		seqf_pipe_free(pipe);
+		return 1;
+	}
+	return 0;
+}
+
+extern void
+seqf_pipe_stop(seqf_statep state)
+{
+	struct seqf_pipe *pipe = state->pipe;
+	if(pipe == NULL)
+		return;
+
+	mtx_lock(&pipe->mutex);
+	pipe->stop = true;
+	cnd_broadcast(&pipe->filled);
+	while(pipe->running != 0) {
+		/* A worker of the pool may be the one the queued tasks wait for */
+		mtx_unlock(&pipe->mutex);
+		bool helped = seqf_pool_help();
+		mtx_lock(&pipe->mutex);
+		if(!helped && pipe->running != 0)
+			cnd_wait(&pipe->idle, &pipe->mutex);
+	}
+	mtx_unlock(&pipe->mutex);
+
+	cnd_destroy(&pipe->idle);
+	cnd_destroy(&pipe->filled);
+	mtx_destroy(&pipe->mutex);
+	seqf_pipe_free(pipe);
+	state->pipe = NULL;
+}
+
+/**
+ * @brief Get the block the reader should consume from next. Keeps handing out
+ * the current block until all of its bytes were consumed, after which it is
+ * returned to the background tasks and the next one is awaited. The last
+ * block (empty or failed) is kept forever, so that every later call sees it.
+ *
+ * @param state Internal state pointer for the SeqFile
+ * @return struct seqf_block* Block to consume, NULL if the ring failed to start
+ * or no task could be submitted to fill it (seqferrno is set)
+ */
+static struct seqf_block *
+seqf_pipe_next(seqf_statep state)
+{
+	if(state->pipe == NULL && seqf_pipe_start(state) != 0)
+		return NULL;
+	struct seqf_pipe *pipe = state->pipe;
+	if(pipe->cur != NULL && (pipe->finished || pipe->cur_pos < pipe->cur->len))
+		return pipe->cur;
+
+	/* Skip speculative chunks that turned out empty */
+	mtx_lock(&pipe->mutex);
+	do {
+		if(pipe->cur != NULL) {
+			pipe->cur->ready = false;
+			pipe->head++;
+			seqf_pipe_kick(state);
+		}
+		pipe->cur = &pipe->blocks[pipe->head % pipe->nblocks];
+		while(!pipe->cur->ready) {
+			seqf_pipe_kick(state);
+			if(pipe->running == 0) {
+				/* Nothing will ever fill the block */
+				mtx_unlock(&pipe->mutex);
+				pipe->cur = NULL;
+				return NULL;
+			}
+
+			/* A reader on a worker of the pool runs the tasks it waits for */
+			mtx_unlock(&pipe->mutex);
+			bool helped = seqf_pool_help();
+			mtx_lock(&pipe->mutex);
+			if(!helped && !pipe->cur->ready) {
+				uint64_t start = seqf_tick(state->io.timing);
+				cnd_wait(&pipe->filled, &pipe->mutex);
+				state->stats.wait_ns += seqf_tock(state->io.timing, start);
+			}
+		}
+		seqf_io_add(&state->io, &pipe->cur->io);
+		if(pipe->spec)
+			seqf_spec_verify(pipe, pipe->cur);
+	} while(pipe->cur->len == 0 && !pipe->cur->last);
+	mtx_unlock(&pipe->mutex);
+
+	struct seqf_block *blk = pipe->cur;
+	pipe->cur_pos = 0;
+	pipe->finished = blk->last;
+	return blk;
+}
+
+extern int
+seqf_pipe_fetch(seqf_statep state)
+{
+	struct seqf_block *blk = seqf_pipe_next(state);
+	if(blk == NULL)
+		return 1;
+	if(blk->ret != 0) {
+		if(blk->err != 0)
+			seqferrno_ = blk->err;
+		return 1;
+	}
+
+	/* Nothing left to decompress */
+	if(blk->len == 0) {
+		state->have = 0;
+		state->eof = true;
+		return 0;
+	}
+
+	/* Lend the unread part of the block */
+	state->next = blk->data + state->pipe->cur_pos;
+	state->have = blk->len - state->pipe->cur_pos;
+	state->pipe->cur_pos = blk->len;
+	return 0;
+}
+
+extern int
+seqf_pipe_load(seqf_statep state, unsigned char *buffer, size_t bufsize, size_t *nread)
+{
+	size_t left = bufsize;
+	*nread = 0;
+	while(left) {
+		struct seqf_block *blk = seqf_pipe_next(state);
+		if(blk == NULL)
+			return -1;
+		if(blk->ret != 0) {
+			if(blk->err != 0)
+				seqferrno_ = blk->err;
+			return blk->ret;
+		}
+		if(blk->len == 0)
+			break;
+
+		size_t n = MIN2(left, blk->len - state->pipe->cur_pos);
+		memcpy(buffer, blk->data + state->pipe->cur_pos, n);
+		state->pipe->cur_pos += n;
+		buffer += n;
+		left -= n;
+	}
+	*nread = bufsize - left;
+	return 0;
+}
@@ -0,0 +1,445 @@
+/* seqfpool.c - Process-wide pool of worker threads
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * Every parallel part of the library runs its work as tasks on a single pool,
+ * so that the number of threads stays fixed however many files are open.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE /* sched_setaffinity */
+#endif
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+#ifdef __linux__
+    #include <sched.h>
+#endif
+
+#include "seqf_pool.h"
+
+/* The pool of the process, created on first use */
+static struct seqf_pool *seqf_pool_;
+static mtx_t seqf_pool_mutex;
+static once_flag seqf_pool_once = ONCE_FLAG_INIT;
+
+/* Pool and deque of the calling thread, when it is a worker */
+static _Thread_local struct seqf_pool *seqf_self_pool;
+static _Thread_local size_t seqf_self;
+
+extern size_t
+seqf_ncpu(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+static void
+seqf_pool_init_mutex(void)
+{
+	mtx_init(&seqf_pool_mutex, mtx_plain);
+}
+
+static int
+seqf_deque_push(struct seqf_deque *dq, const struct seqf_task *task)
+{
+	mtx_lock(&dq->mutex);
+	if(dq->bottom - dq->top == dq->size) {
+		/* Full, move the tasks to twice as many slots */
+		size_t size = 2 * dq->size;
+		struct seqf_task *tasks = seqf_malloc(size * sizeof *tasks);
+		if(tasks == NULL) {
+			mtx_unlock(&dq->mutex);
+			return 1;
+		}
+		for(size_t i = dq->top; i != dq->bottom; i++)
+			tasks[i & (size - 1)] = dq->tasks[i & (dq->size - 1)];
+		seqf_free(dq->tasks);
+		dq->tasks = tasks;
+		dq->size = size;
+	}
+	dq->tasks[dq->bottom++ & (dq->size - 1)] = *task;
+	mtx_unlock(&dq->mutex);
+	return 0;
+}
+
+/**
+ * @brief Take the newest task of `dq' when `owner', else the oldest one.
+ *
+ * @return bool true if a task was taken
+ */
+static bool
+seqf_deque_take(struct seqf_deque *dq, bool owner, struct seqf_task *task)
+{
+	mtx_lock(&dq->mutex);
+	bool found = dq->bottom != dq->top;
+	if(found && owner)
+		*task = dq->tasks[--dq->bottom & (dq->size - 1)];
+	else if(found)
+		*task = dq->tasks[dq->top++ & (dq->size - 1)];
+	mtx_unlock(&dq->mutex);
+	return found;
+}
+
+/**
+ * @brief Find a task for deque `self' of `pool': its own newest task, or else
+ * the oldest task of another deque. Threads outside the pool pass nthreads.
+ *
+ * @return bool true if a task was taken
+ */
+static bool
+seqf_pool_take(struct seqf_pool *pool, size_t self, struct seqf_task *task)
+{
+	bool found = self < pool->nthreads && seqf_deque_take(&pool->deques[self], true, task);
+	for(size_t i = 1; !found && i <= pool->nthreads; i++)
+		found = seqf_deque_take(&pool->deques[(self + i) % pool->nthreads], false, task);
+	if(found) {
+		mtx_lock(&pool->lock);
+		pool->queued--;
+		mtx_unlock(&pool->lock);
+	}
+	return found;
+}
+
+static void
+seqf_pool_exec(struct seqf_pool *pool, const struct seqf_task *task)
+{
+	task->fn(task->arg);
+	if(task->group == NULL)
+		return;
+	mtx_lock(&pool->lock);
+	if(--task->group->pending == 0)
+		cnd_broadcast(&pool->work);
+	mtx_unlock(&pool->lock);
+}
+
+static void
+seqf_pool_pin(size_t cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % CPU_SETSIZE, &set);
+	sched_setaffinity(0, sizeof set, &set); /* Best effort */
+#else
+	(void)cpu;
+#endif
+}
+
+struct seqf_pool_start {
+	struct seqf_pool *pool;
+	size_t self;
+};
+
+static int
+seqf_pool_worker(void *arg)
+{
+	struct seqf_pool *pool = ((struct seqf_pool_start *)arg)->pool;
+	size_t self = ((struct seqf_pool_start *)arg)->self;
+	seqf_free(arg);
+	seqf_self_pool = pool;
+	seqf_self = self;
+	if(pool->pin)
+		seqf_pool_pin(self % seqf_ncpu());
+
+	struct seqf_task task;
+	while(true) {
+		if(seqf_pool_take(pool, self, &task)) {
+			seqf_pool_exec(pool, &task);
+			continue;
+		}
+
+		mtx_lock(&pool->lock);
+		bool stop = pool->stop && pool->queued == 0;
+		bool pushing = pool->queued != 0; /* Counted, not yet in its deque */
+		if(!stop && !pushing)
+			cnd_wait(&pool->work, &pool->lock);
+		mtx_unlock(&pool->lock);
+		if(stop)
+			break;
+		if(pushing)
+			thrd_yield();
+	}
+	return 0;
+}
+
+static void
+seqf_pool_free(struct seqf_pool *pool)
+{
+	if(pool->deques) {
+		for(size_t i = 0; i < pool->nthreads; i++) {
+			if(pool->deques[i].tasks)
+				mtx_destroy(&pool->deques[i].mutex);
+			seqf_free(pool->deques[i].tasks);
+		}
+		seqf_free(pool->deques);
+	}
+	seqf_free(pool->threads);
+	seqf_free(pool);
+}
+
+/**
+ * @brief Stop the workers of `pool' once they ran every queued task, and
+ * release it.
+ */
+static void
+seqf_pool_stop(struct seqf_pool *pool)
+{
+	mtx_lock(&pool->lock);
+	pool->stop = true;
+	cnd_broadcast(&pool->work);
+	mtx_unlock(&pool->lock);
+	for(size_t i = 0; i < pool->nthreads; i++)
+		thrd_join(pool->threads[i], NULL);
+
+	cnd_destroy(&pool->work);
+	mtx_destroy(&pool->lock);
+	seqf_pool_free(pool);
+}
+
+static struct seqf_pool *
+seqf_pool_new(size_t nthreads, bool pin)
+{
+	struct seqf_pool *pool = seqf_calloc(1, sizeof *pool);
+	if(pool == NULL) {
+		seqferrno_ = 6;
+		return NULL;
+	}
+	pool->nthreads = nthreads ? nthreads : seqf_ncpu();
+	pool->pin = pin;
+	pool->threads = seqf_calloc(pool->nthreads, sizeof *pool->threads);
+	pool->deques = seqf_calloc(pool->nthreads, sizeof *pool->deques);
+	if(pool->threads == NULL || pool->deques == NULL) {
+		seqf_pool_free(pool);
+		seqferrno_ = 6;
+		return NULL;
+	}
+	for(size_t i = 0; i < pool->nthreads; i++) {
+		struct seqf_deque *dq = &pool->deques[i];
+		dq->tasks = seqf_malloc(SEQF_POOL_DEQUE * sizeof *dq->tasks);
+		if(dq->tasks == NULL) {
+			seqf_pool_free(pool);
+			seqferrno_ = 6;
+			return NULL;
+		}
+		dq->size = SEQF_POOL_DEQUE;
+		if(mtx_init(&dq->mutex, mtx_plain) != thrd_success) {
+			seqf_free(dq->tasks);
+			dq->tasks = NULL;
+			seqf_pool_free(pool);
+			seqferrno_ = 2;
+			return NULL;
+		}
+	}
+
+	/* Initialize synchronization primitives */
+	if(mtx_init(&pool->lock, mtx_plain) != thrd_success) {
+		seqf_pool_free(pool);
+		seqferrno_ = 2;
+		return NULL;
+	}
+	if(cnd_init(&pool->work) != thrd_success) {
+		mtx_destroy(&pool->lock);
+		seqf_pool_free(pool);
+		seqferrno_ = 2;
+		return NULL;
+	}
+
+	/* Start the workers. They read nthreads without the lock, so a pool that
+	   cannot have all of its workers is not started at all. */
+	size_t started = 0;
+	while(started < pool->nthreads) {
+		struct seqf_pool_start *arg = seqf_malloc(sizeof *arg);
+		if(arg == NULL)
+			break;
+		arg->pool = pool;
+		arg->self = started;
+		if(thrd_create(&pool->threads[started], seqf_pool_worker, arg) != thrd_success) {
+			seqf_free(arg);
+			break;
+		}
+		started++;
+	}
+	if(started < pool->nthreads) {
+		mtx_lock(&pool->lock);
+		pool->stop = true;
+		cnd_broadcast(&pool->work);
+		mtx_unlock(&pool->lock);
+		for(size_t i = 0; i < started; i++)
+			thrd_join(pool->threads[i], NULL);
+		cnd_destroy(&pool->work);
+		mtx_destroy(&pool->lock);
+		seqf_pool_free(pool);
+		seqferrno_ = 2;
+		return NULL;
+	}
+	return pool;
+}
+
+extern struct seqf_pool *
+seqf_pool_get(void)
+{
+	call_once(&seqf_pool_once, seqf_pool_init_mutex);
+	mtx_lock(&seqf_pool_mutex);
+	if(seqf_pool_ == NULL)
+		seqf_pool_ = seqf_pool_new(0, false);
+	struct seqf_pool *pool = seqf_pool_;
+	mtx_unlock(&seqf_pool_mutex);
+	return pool;
+}
+
+/**
+ * @brief Queue `task' on `pool', in the deque of the calling worker or, from
+ * outside the pool, in the deques in turn.
+ */
+static int
+seqf_pool_push(struct seqf_pool *pool, const struct seqf_task *task)
+{
+	/* Count it first, so that a worker never sees it before it is counted */
+	mtx_lock(&pool->lock);
+	pool->queued++;
+	size_t dq = seqf_self_pool == pool ? seqf_self : pool->next++ % pool->nthreads;
+	mtx_unlock(&pool->lock);
+
+	int ret = seqf_deque_push(&pool->deques[dq], task);
+	mtx_lock(&pool->lock);
+	if(ret != 0)
+		pool->queued--;
+	else
+		cnd_signal(&pool->work);
+	mtx_unlock(&pool->lock);
+	if(ret != 0)
+		seqferrno_ = 6;
+	return ret;
+}
+
+extern int
+seqf_pool_submit(struct seqf_pool *pool, void (*fn)(void *), void *arg)
+{
+	struct seqf_task task = {fn, arg, NULL};
+	return seqf_pool_push(pool, &task);
+}
+
+extern bool
+seqf_pool_help(void)
+{
+	struct seqf_pool *pool = seqf_self_pool;
+	struct seqf_task task;
+	if(pool == NULL || !seqf_pool_take(pool, seqf_self, &task))
+		return false;
+	seqf_pool_exec(pool, &task);
+	return true;
+}
+
+int
+seqfpoolcreate(size_t nthreads, bool pin)
+{
+	call_once(&seqf_pool_once, seqf_pool_init_mutex);
+	mtx_lock(&seqf_pool_mutex);
+	int ret = -1;
+	if(seqf_pool_ == NULL && (seqf_pool_ = seqf_pool_new(nthreads, pin)) != NULL)
+		ret = 0;
+	mtx_unlock(&seqf_pool_mutex);
+	return ret;
+}
+
+void
+seqfpoolfree(void)
+{
+	call_once(&seqf_pool_once, seqf_pool_init_mutex);
+	mtx_lock(&seqf_pool_mutex);
+	struct seqf_pool *pool = seqf_pool_;
+	seqf_pool_ = NULL;
+	mtx_unlock(&seqf_pool_mutex);
+	if(pool != NULL)
+		seqf_pool_stop(pool);
+}
+
+size_t
+seqfpoolthreads(void)
+{
+	struct seqf_pool *pool = seqf_pool_get();
+	return pool != NULL ? pool->nthreads : 0;
+}
+
+SeqfTaskGroup
+seqftaskgroup(void)
+{
+	struct seqf_taskgroup *group = seqf_calloc(1, sizeof *group);
+	if(group == NULL)
+		seqferrno_ = 6;
+	return (SeqfTaskGroup)group;
+}
+
+int
+seqfsubmit(SeqfTaskGroup group, void (*fn)(void *), void *arg)
+{
+	if(group == NULL || fn == NULL) {
+		seqferrno_ = 8;
+		return -1;
+	}
+	struct seqf_pool *pool = seqf_pool_get();
+	if(pool == NULL)
+		return -1;
+
+	struct seqf_task task = {fn, arg, (struct seqf_taskgroup *)group};
+	mtx_lock(&pool->lock);
+	task.group->pending++;
+	mtx_unlock(&pool->lock);
+	if(seqf_pool_push(pool, &task) != 0) {
+		mtx_lock(&pool->lock);
+		task.group->pending--;
+		mtx_unlock(&pool->lock);
+		return -1;
+	}
+	return 0;
+}
+
+void
+seqfwait(SeqfTaskGroup group)
+{
+	if(group == NULL)
+		return;
+	struct seqf_taskgroup *g = (struct seqf_taskgroup *)group;
+	struct seqf_pool *pool = seqf_pool_get();
+	if(pool == NULL)
+		return;
+
+	/* Run queued tasks rather than sleep, whether they belong to the group or
+	   not, so that tasks that wait for their own tasks cannot starve the pool */
+	size_t self = seqf_self_pool == pool ? seqf_self : pool->nthreads;
+	struct seqf_task task;
+	while(true) {
+		mtx_lock(&pool->lock);
+		bool done = g->pending == 0;
+		if(!done && pool->queued == 0)
+			cnd_wait(&pool->work, &pool->lock);
+		done = g->pending == 0;
+		mtx_unlock(&pool->lock);
+		if(done)
+			break;
+		if(seqf_pool_take(pool, self, &task))
+			seqf_pool_exec(pool, &task);
+	}
+}
+
+void
+seqftaskgroupfree(SeqfTaskGroup group)
+{
+	if(group == NULL)
+		return;
+	seqfwait(group);
+	seqf_free(group);
+}
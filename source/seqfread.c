@@ -25,9 +25,9 @@ seqfread(SeqFile file, char *buffer, size_t bufsize)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	size_t bytes_read = seqf_read(state, (unsigned char *)buffer, bufsize);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return bytes_read;
 }
@@ -105,9 +105,9 @@ seqfgets(SeqFile file, char *buffer, size_t bufsize)
 		return NULL;
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	char *ret = seqfgets_unlocked(file, buffer, bufsize);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
@@ -131,9 +131,9 @@ seqfgetc(SeqFile file)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	int ret = seqfgetc_unlocked(file);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
@@ -155,9 +155,9 @@ seqfgetnt(SeqFile file)
 {
 	seqf_statep state = (seqf_statep)file;
 
-	mtx_lock(&state->mutex);
+	seqf_lock(state);
 	int ret = seqfgetnt_unlocked(file);
-	mtx_unlock(&state->mutex);
+	seqf_unlock(state);
 
 	return ret;
 }
@@ -0,0 +1,302 @@
+/* seqfreadnt.c - seqf functions for reading only the nucleotides of a file
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <stdlib.h>
+
+#include "seqf_read.h"
+
+/* Where in a record seqfreadnt is. Lines are always entered at their start */
+enum {
+	SEQF_NT_START,   /** Start of a line before a header, or between reads */
+	SEQF_NT_HEADER,  /** Within a header line */
+	SEQF_NT_LINE,    /** Start of a line after the header */
+	SEQF_NT_SEQ,     /** Within a sequence line */
+	SEQF_NT_PLUS,    /** Within the '+' line of a fastq record */
+	SEQF_NT_QUAL     /** Within the quality lines of a fastq record */
+};
+
+/**
+ * @brief Move past the rest of the current line. The newline itself is
+ * consumed only when it is in the buffer.
+ *
+ * @return bool true if the newline was found
+ */
+static inline bool
+seqf_ntskip(seqf_statep state, size_t *skipped)
+{
+	unsigned char *eol = memchr(state->next, '\n', state->have);
+	size_t n = eol != NULL ? (size_t)(eol - state->next) : state->have;
+	*skipped = n;
+	if(eol != NULL)
+		n++;
+	state->next += n;
+	state->have -= n;
+	return eol != NULL;
+}
+
+/**
+ * @brief Copy the rest of the current sequence line into `buf', up to `room'
+ * bytes. The newline is consumed but not copied.
+ *
+ * @return bool true if the end of the line was reached
+ */
+static inline bool
+seqf_ntcopy(seqf_statep state, unsigned char *buf, size_t room, size_t *copied)
+{
+	size_t n = MIN2(state->have, room);
+	unsigned char *eol = memchr(state->next, '\n', n);
+	if(eol != NULL)
+		n = (size_t)(eol - state->next);
+	memcpy(buf, state->next, n);
+	*copied = n;
+	if(eol != NULL)
+		n++;
+	state->next += n;
+	state->have -= n;
+	return eol != NULL;
+}
+
+/**
+ * @brief The current record ended; its end is reported by the next call.
+ */
+static inline void
+seqf_ntend(seqf_statep state)
+{
+	state->nt_part = SEQF_NT_START;
+	state->nt_break = true;
+	state->stats.records++;
+}
+
+/**
+ * @brief Read nucleotides into `buffer', see `seqfreadnt()'. With `ended' not
+ * NULL, reading stops at the end of the current record instead, and *ended
+ * tells whether it was reached.
+ */
+static size_t
+seqf_readnt(seqf_statep state, unsigned char *buffer, size_t bufsize,
+            size_t *breaks, size_t *nbreaks, bool *ended)
+{
+	if(state->type != 'a' && state->type != 'q' && state->type != 's') {
+		seqferrno_ = 4;
+		return 0;
+	}
+
+	bool report = breaks != NULL && nbreaks != NULL;
+	size_t maxbreaks = report ? *nbreaks : 0;
+	size_t len = 0, nb = 0, n;
+	bool eol;
+	unsigned char marker = state->type == 'a' ? '>' : '@';
+
+	/* An end left pending by seqfreadnt belongs to a record already read */
+	if(ended != NULL) {
+		*ended = false;
+		state->nt_break = false;
+	}
+	do {
+		if(state->nt_break && ended != NULL) {
+			state->nt_break = false;
+			*ended = true;
+			break;
+		}
+
+		/* Report the end of a record once there is room for it */
+		if(state->nt_break) {
+			if(report && nb == maxbreaks)
+				break;
+			if(report)
+				breaks[nb++] = len;
+			state->nt_break = false;
+		}
+		if(len == bufsize)
+			break;
+
+		if(state->have == 0 && seqf_fetch(state) != 0)
+			break;
+		if(state->have == 0) {
+			/* A record in progress ends with the file */
+			if(state->nt_part != SEQF_NT_START) {
+				seqf_ntend(state);
+				continue;
+			}
+			break;
+		}
+
+		switch(state->nt_part) {
+		case SEQF_NT_START:
+			if(*state->next == '\n') {
+				state->next++;
+				state->have--;
+			} else if(state->type == 's') {
+				state->nt_part = SEQF_NT_SEQ;
+			} else if(*state->next == marker) {
+				state->nt_part = SEQF_NT_HEADER;
+				state->nt_seq = state->nt_qual = 0;
+			} else {
+				seqf_ntskip(state, &n); /* Not a record */
+			}
+			break;
+		case SEQF_NT_HEADER:
+			if(seqf_ntskip(state, &n))
+				state->nt_part = SEQF_NT_LINE;
+			break;
+		case SEQF_NT_LINE:
+			if(*state->next == '\n') {
+				state->next++;
+				state->have--;
+			} else if(state->type == 'a' && *state->next == '>') {
+				seqf_ntend(state);
+			} else if(state->type == 'q' && *state->next == '+') {
+				state->nt_part = SEQF_NT_PLUS;
+			} else {
+				state->nt_part = SEQF_NT_SEQ;
+			}
+			break;
+		case SEQF_NT_SEQ:
+			if(seqf_ntcopy(state, buffer + len, bufsize - len, &n)) {
+				if(state->type == 's') {
+					seqf_ntend(state);
+				} else {
+					state->nt_part = SEQF_NT_LINE;
+				}
+			}
+			len += n;
+			state->nt_seq += n;
+			break;
+		case SEQF_NT_PLUS:
+			if(!seqf_ntskip(state, &n))
+				break;
+			if(state->nt_seq) {
+				state->nt_part = SEQF_NT_QUAL;
+			} else {
+				seqf_ntend(state);
+			}
+			break;
+		case SEQF_NT_QUAL:
+			/* Quality lines continue until they are as long as the sequence */
+			eol = seqf_ntskip(state, &n);
+			state->nt_qual += n;
+			if(eol && state->nt_qual >= state->nt_seq) {
+				seqf_ntend(state);
+			}
+			break;
+		}
+	} while(true);
+
+	if(report)
+		*nbreaks = nb;
+	return len;
+}
+
+size_t
+seqfreadnt(SeqFile file, char *buffer, size_t bufsize, size_t *breaks, size_t *nbreaks)
+{
+	if(file == NULL || buffer == NULL)
+		return 0;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	size_t len = seqf_readnt(state, (unsigned char *)buffer, bufsize, breaks, nbreaks, NULL);
+	seqf_unlock(state);
+
+	return len;
+}
+
+size_t
+seqfreadnt_unlocked(SeqFile file, char *buffer, size_t bufsize, size_t *breaks, size_t *nbreaks)
+{
+	if(file == NULL || buffer == NULL)
+		return 0;
+	return seqf_readnt((seqf_statep)file, (unsigned char *)buffer, bufsize, breaks, nbreaks, NULL);
+}
+
+static int
+seqf_getseqpart(seqf_statep state, char *buffer, size_t bufsize, size_t *len, bool *more)
+{
+	if(bufsize == 0) {
+		seqferrno_ = 8;
+		return EOF;
+	}
+	bool ended;
+	*len = seqf_readnt(state, (unsigned char *)buffer, bufsize, NULL, NULL, &ended);
+	*more = !ended;
+	/* Nothing read and no record ended: end of file, or an error */
+	if(*len == 0 && !ended)
+		return EOF;
+	return 0;
+}
+
+int
+seqfgetseqpart(SeqFile file, char *buffer, size_t bufsize, size_t *len, bool *more)
+{
+	if(file == NULL || buffer == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	int ret = seqf_getseqpart(state, buffer, bufsize, len, more);
+	seqf_unlock(state);
+
+	return ret;
+}
+
+int
+seqfgetseqpart_unlocked(SeqFile file, char *buffer, size_t bufsize, size_t *len, bool *more)
+{
+	if(file == NULL || buffer == NULL)
+		return EOF;
+	return seqf_getseqpart((seqf_statep)file, buffer, bufsize, len, more);
+}
+
+static int
+seqf_getseq(seqf_statep state, char **buf, size_t *cap, size_t *len)
+{
+	size_t n = 0, got;
+	bool more = true;
+	if(*buf == NULL)
+		*cap = 0;
+	do {
+		/* Double the buffer whenever less than a byte is left past the null */
+		if(*cap - n < 2) {
+			size_t size = *cap ? *cap << 1 : SEQFBUFSIZ;
+			char *tmp = realloc(*buf, size);
+			if(tmp == NULL) {
+				seqferrno_ = 6;
+				return EOF;
+			}
+			*buf = tmp;
+			*cap = size;
+		}
+		if(seqf_getseqpart(state, *buf + n, *cap - n - 1, &got, &more) != 0)
+			return EOF;
+		n += got;
+	} while(more);
+
+	(*buf)[n] = '\0';
+	*len = n;
+	return 0;
+}
+
+int
+seqfgetseq(SeqFile file, char **buf, size_t *cap, size_t *len)
+{
+	if(file == NULL || buf == NULL || cap == NULL || len == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	int ret = seqf_getseq(state, buf, cap, len);
+	seqf_unlock(state);
+
+	return ret;
+}
+
+int
+seqfgetseq_unlocked(SeqFile file, char **buf, size_t *cap, size_t *len)
+{
+	if(file == NULL || buf == NULL || cap == NULL || len == NULL)
+		return EOF;
+	return seqf_getseq((seqf_statep)file, buf, cap, len);
+}
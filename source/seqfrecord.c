@@ -0,0 +1,611 @@
+/* seqfrecord.c - seqf functions for iterating over whole records
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <stdlib.h>
+
+#include "seqf_read.h"
+#include "seqf_cache.h"
+
+/* Parts of a record, in the order they are scanned */
+enum {
+	SEQF_REC_HEADER,
+	SEQF_REC_SEQ,
+	SEQF_REC_PLUS,
+	SEQF_REC_QUAL,
+	SEQF_REC_DONE
+};
+
+/**
+ * @brief Progress of the scan of a record. All offsets are relative to the
+ * first byte of the record, so that the scan can resume after the bytes seen
+ * so far have been moved to the scratch buffer.
+ */
+struct seqf_recscan {
+	int part;            /** Part of the record the next line belongs to */
+	size_t pos;          /** Offset of the next line to scan */
+	size_t end;          /** Length of the record, once it is done */
+	size_t hdr_end;      /** Offset of the newline ending the header */
+	size_t seq_start;    /** Offset of the first sequence line */
+	size_t seq_end;      /** Offset of the newline ending the last sequence line */
+	size_t seq_len;      /** Sequence bytes, without newlines */
+	size_t seq_lines;    /** Number of sequence lines */
+	size_t qual_start;   /** Offset of the first quality line */
+	size_t qual_end;     /** Offset of the newline ending the last quality line */
+	size_t qual_len;     /** Quality bytes, without newlines */
+	size_t qual_lines;   /** Number of quality lines */
+};
+
+/**
+ * @brief Scan the lines of the record in `buf', from where the last call left
+ * off. FASTA sequences end at the next '>' line, FASTQ sequences at the '+'
+ * line, after which quality lines are read until they are as long as the
+ * sequence. Other types have one line per record.
+ *
+ * @param type File type
+ * @param buf  Bytes of the record seen so far
+ * @param len  Number of bytes in buf
+ * @param eof  No bytes follow buf
+ * @param s    Progress of the scan
+ * @return int 1 when the record is complete, 0 if more bytes are needed
+ */
+static int
+seqf_scanrec(unsigned char type, const unsigned char *buf, size_t len, bool eof, struct seqf_recscan *s)
+{
+	while(s->part != SEQF_REC_DONE) {
+		size_t i = s->pos;
+		if(i == len) {
+			if(!eof)
+				return 0;
+			s->end = len;
+			s->part = SEQF_REC_DONE;
+			break;
+		}
+
+		/* The first byte of a line can end the sequence */
+		if(s->part == SEQF_REC_SEQ) {
+			if(type == 'a' && buf[i] == '>') {
+				s->end = i;
+				s->part = SEQF_REC_DONE;
+				break;
+			}
+			if(type == 'q' && buf[i] == '+') {
+				s->part = SEQF_REC_PLUS;
+				continue;
+			}
+		}
+
+		/* Only whole lines are scanned */
+		const unsigned char *nl = memchr(buf + i, '\n', len - i);
+		size_t eol = nl != NULL ? (size_t)(nl - buf) : len;
+		if(nl == NULL && !eof)
+			return 0;
+		s->pos = nl != NULL ? eol + 1 : len;
+
+		switch(s->part) {
+		case SEQF_REC_HEADER:
+			s->hdr_end = eol;
+			s->seq_start = s->seq_end = s->pos;
+			s->part = SEQF_REC_SEQ;
+			break;
+		case SEQF_REC_SEQ:
+			s->seq_end = eol;
+			s->seq_len += eol - i;
+			s->seq_lines++;
+			if(type == 's') {
+				s->end = s->pos;
+				s->part = SEQF_REC_DONE;
+			}
+			break;
+		case SEQF_REC_PLUS:
+			s->qual_start = s->qual_end = s->pos;
+			s->part = SEQF_REC_QUAL;
+			break;
+		case SEQF_REC_QUAL:
+			s->qual_end = eol;
+			s->qual_len += eol - i;
+			s->qual_lines++;
+			if(s->qual_len >= s->seq_len) {
+				s->end = s->pos;
+				s->part = SEQF_REC_DONE;
+			}
+			break;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief Make sure the scratch buffer holds at least `size' bytes.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_recreserve(seqf_statep state, size_t size)
+{
+	if(size <= state->rec_bufsiz)
+		return 0;
+	size_t n = state->rec_bufsiz ? state->rec_bufsiz : SEQFBUFSIZ;
+	while(n < size)
+		n <<= 1;
+	unsigned char *tmp = seqf_realloc(state->rec_buf, n);
+	if(tmp == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	state->rec_buf = tmp;
+	state->rec_bufsiz = n;
+	return 0;
+}
+
+/**
+ * @brief Copy the lines in `src[0..n)' to `dst' without their newlines. `dst'
+ * may overlap `src' as long as it does not come after it.
+ *
+ * @return size_t Number of bytes written to dst
+ */
+static size_t
+seqf_joinlines(unsigned char *dst, const unsigned char *src, size_t n)
+{
+	size_t len = 0;
+	while(n) {
+		const unsigned char *nl = memchr(src, '\n', n);
+		size_t line = nl != NULL ? (size_t)(nl - src) : n;
+		memmove(dst + len, src, line);
+		len += line;
+		if(nl != NULL)
+			line++;
+		src += line;
+		n -= line;
+	}
+	return len;
+}
+
+/**
+ * @brief Skip anything before the start of the next record: blank lines, and
+ * for FASTA/FASTQ files, lines that do not start with '>'/'@'.
+ *
+ * @return int 0 when at a record, EOF at end of file, 1 on error
+ */
+static int
+seqf_findrec(seqf_statep state, unsigned char marker)
+{
+	while(true) {
+		if(state->have == 0 && seqf_fetch(state) != 0)
+			return 1;
+		if(state->have == 0)
+			return EOF;
+		if(*state->next == '\n') {
+			state->have--;
+			state->next++;
+		} else if(marker && *state->next != marker) {
+			if(seqf_skipline(state) == NULL)
+				return state->eof ? EOF : 1;
+		} else {
+			return 0;
+		}
+	}
+}
+
+/**
+ * @brief Find the next whole record of `state' and consume it. The record is
+ * used in place when it lies within the buffer, and gathered into the scratch
+ * buffer otherwise.
+ *
+ * @param state  File to read from
+ * @param marker First byte of a header, 0 for one record per line
+ * @param s      Filled with the scan of the record
+ * @param rp     Set to the first byte of the record
+ * @return int 1 if the record is in the scratch buffer, 0 if it is in place,
+ * or EOF at the end of file or on error
+ */
+static int
+seqf_gatherrec(seqf_statep state, unsigned char marker, struct seqf_recscan *s, const unsigned char **rp)
+{
+	if(state->eof && state->have == 0)
+		return EOF;
+	if(seqf_findrec(state, marker) != 0)
+		return EOF;
+
+	memset(s, 0, sizeof *s);
+	s->part = marker ? SEQF_REC_HEADER : SEQF_REC_SEQ;
+
+	/* Usually the whole record is already in the buffer and is used in place */
+	*rp = state->next;
+	if(seqf_scanrec(state->type, state->next, state->have, false, s)) {
+		state->next += s->end;
+		state->have -= s->end;
+		return 0;
+	}
+
+	/* The record straddles the end of the buffer. Gather it into the scratch
+	   buffer, one line at a time so that only its bytes are copied. At a line
+	   boundary only the first byte is taken, as a FASTA record ends before a
+	   '>' line that must be left in place. */
+	size_t len = state->have;
+	if(seqf_recreserve(state, len) != 0)
+		return EOF;
+	memcpy(state->rec_buf, state->next, len);
+	state->next += len;
+	state->have = 0;
+	size_t took = 0;
+	bool eof = false;
+	while(!seqf_scanrec(state->type, state->rec_buf, len, eof, s)) {
+		if(state->have == 0 && seqf_fetch(state) != 0)
+			return EOF;
+		if(state->have == 0) {
+			eof = true;
+			continue;
+		}
+		const unsigned char *nl = memchr(state->next, '\n', state->have);
+		took = nl != NULL ? (size_t)(nl - state->next) + 1 : state->have;
+		if(s->pos == len)
+			took = 1;
+		if(seqf_recreserve(state, len + took) != 0)
+			return EOF;
+		memcpy(state->rec_buf + len, state->next, took);
+		state->next += took;
+		state->have -= took;
+		len += took;
+	}
+
+	/* Give back the start of the next record, still in the buffer */
+	state->next -= len - s->end;
+	state->have += len - s->end;
+	*rp = state->rec_buf;
+	return 1;
+}
+
+/* Header marker of each file type, or -1 if it has no records */
+static int
+seqf_marker(unsigned char type)
+{
+	switch(type) {
+	case 'a': return '>';
+	case 'q': return '@';
+	case 's': return 0;
+	default:  return -1;
+	}
+}
+
+int
+seqfnextrec_unlocked(SeqFile file, SeqfRecord *rec)
+{
+	if(file == NULL || rec == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+
+	int marker = seqf_marker(state->type);
+	if(marker < 0) {
+		seqferrno_ = 4;
+		return EOF;
+	}
+
+	/* A cache is read a record at a time, unless text of it is left over */
+	if(state->cache != NULL && state->have == 0 &&
+	   state->cache->text_pos == state->cache->text_len) {
+		if(seqf_cache_nextrec(state, rec) != 0)
+			return EOF;
+		state->stats.records++;
+		return 0;
+	}
+
+	struct seqf_recscan s;
+	const unsigned char *rp;
+	int scratch = seqf_gatherrec(state, (unsigned char)marker, &s, &rp);
+	if(scratch == EOF)
+		return EOF;
+
+	/* Sequences and qualities that span several lines are joined in the
+	   scratch buffer, after the record if it is there already */
+	size_t nseq = s.seq_end - s.seq_start;
+	size_t nqual = s.qual_end - s.qual_start;
+	const unsigned char *seq = rp + s.seq_start;
+	const unsigned char *qual = rp + s.qual_start;
+	if(s.seq_lines > 1 || s.qual_lines > 1) {
+		size_t base = scratch ? s.end : 0;
+		if(seqf_recreserve(state, base + nseq + nqual) != 0)
+			return EOF;
+		if(scratch) {
+			rp = state->rec_buf;
+			seq = rp + s.seq_start;
+			qual = rp + s.qual_start;
+		}
+		if(s.seq_lines > 1) {
+			seqf_joinlines(state->rec_buf + base, seq, nseq);
+			seq = state->rec_buf + base;
+			base += s.seq_len;
+		}
+		if(s.qual_lines > 1) {
+			seqf_joinlines(state->rec_buf + base, qual, nqual);
+			qual = state->rec_buf + base;
+		}
+	}
+	/* Split the header into name and comment */
+	rec->name = rec->comment = rec->qual = NULL;
+	rec->name_len = rec->comment_len = rec->qual_len = 0;
+	if(marker) {
+		size_t i = 1, end = s.hdr_end;
+		while(i < end && rp[i] != ' ' && rp[i] != '\t')
+			i++;
+		rec->name = (const char *)rp + 1;
+		rec->name_len = i - 1;
+		while(i < end && (rp[i] == ' ' || rp[i] == '\t'))
+			i++;
+		if(i < end) {
+			rec->comment = (const char *)rp + i;
+			rec->comment_len = end - i;
+		}
+	}
+
+	rec->seq = (const char *)seq;
+	rec->seq_len = s.seq_len;
+	if(state->type == 'q' && s.qual_lines != 0) {
+		rec->qual = (const char *)qual;
+		rec->qual_len = s.qual_len;
+	}
+	state->stats.records++;
+	return 0;
+}
+
+int
+seqfnextrec(SeqFile file, SeqfRecord *rec)
+{
+	if(file == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	int ret = seqfnextrec_unlocked(file, rec);
+	seqf_unlock(state);
+
+	return ret;
+}
+
+/**
+ * @brief Make sure `batch' has room for `nrecords' records and `size' bytes
+ * in its arena.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_batchreserve(SeqfBatch *batch, size_t nrecords, size_t size)
+{
+	if(size > batch->data_size) {
+		size_t n = batch->data_size ? batch->data_size : SEQFBUFSIZ;
+		while(n < size)
+			n <<= 1;
+		char *tmp = seqf_realloc(batch->data, n);
+		if(tmp == NULL) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		batch->data = tmp;
+		batch->data_size = n;
+	}
+	if(nrecords > batch->capacity) {
+		size_t n = batch->capacity ? batch->capacity : 64;
+		while(n < nrecords)
+			n <<= 1;
+		/* All arrays live in one allocation, one after the other */
+		size_t *tmp = seqf_realloc(batch->name_off, 8 * n * sizeof *tmp);
+		if(tmp == NULL) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		for(int i = 7; i > 0; i--)
+			memmove(tmp + i*n, tmp + i*batch->capacity, batch->nrecords * sizeof *tmp);
+		batch->name_off = tmp;
+		batch->name_len = tmp + n;
+		batch->comment_off = tmp + 2*n;
+		batch->comment_len = tmp + 3*n;
+		batch->seq_off = tmp + 4*n;
+		batch->seq_len = tmp + 5*n;
+		batch->qual_off = tmp + 6*n;
+		batch->qual_len = tmp + 7*n;
+		batch->capacity = n;
+	}
+	return 0;
+}
+
+/**
+ * @brief Append the `len' bytes of `field' and a null terminator to the arena
+ * of `batch', which must have room for them.
+ */
+static size_t
+seqf_batchappend(SeqfBatch *batch, const char *field, size_t len)
+{
+	size_t off = batch->data_len;
+	if(len)
+		memcpy(batch->data + off, field, len);
+	batch->data[off + len] = '\0';
+	batch->data_len += len + 1;
+	return off;
+}
+
+static size_t
+seqf_nextbatch(seqf_statep state, SeqfBatch *batch, size_t max_records)
+{
+	batch->nrecords = 0;
+	batch->data_len = 0;
+	SeqfRecord rec;
+	while(batch->nrecords < max_records &&
+	  seqfnextrec_unlocked((SeqFile)state, &rec) == 0) {
+		size_t size = batch->data_len + rec.name_len + rec.comment_len +
+		  rec.seq_len + rec.qual_len + 4;
+		if(seqf_batchreserve(batch, batch->nrecords + 1, size) != 0)
+			break;
+		size_t i = batch->nrecords++;
+		batch->name_off[i] = seqf_batchappend(batch, rec.name, rec.name_len);
+		batch->name_len[i] = rec.name_len;
+		batch->comment_off[i] = seqf_batchappend(batch, rec.comment, rec.comment_len);
+		batch->comment_len[i] = rec.comment_len;
+		batch->seq_off[i] = seqf_batchappend(batch, rec.seq, rec.seq_len);
+		batch->seq_len[i] = rec.seq_len;
+		batch->qual_off[i] = seqf_batchappend(batch, rec.qual, rec.qual_len);
+		batch->qual_len[i] = rec.qual_len;
+	}
+	return batch->nrecords;
+}
+
+size_t
+seqfnextbatch(SeqFile file, SeqfBatch *batch, size_t max_records)
+{
+	if(file == NULL || batch == NULL)
+		return 0;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	size_t nrecords = seqf_nextbatch(state, batch, max_records);
+	seqf_unlock(state);
+
+	return nrecords;
+}
+
+size_t
+seqfnextbatch_unlocked(SeqFile file, SeqfBatch *batch, size_t max_records)
+{
+	if(file == NULL || batch == NULL)
+		return 0;
+	return seqf_nextbatch((seqf_statep)file, batch, max_records);
+}
+
+void
+seqfbatchfree(SeqfBatch *batch)
+{
+	if(batch == NULL)
+		return;
+	seqf_free(batch->data);
+	seqf_free(batch->name_off);
+	memset(batch, 0, sizeof *batch);
+}
+
+/**
+ * @brief Find the length of the whole records at the start of `buf'. FASTA
+ * headers and reads are told apart from the end of the buffer, going back to
+ * the last record that starts in it. A FASTQ '@' may also start a quality
+ * line, so FASTQ records are scanned forward instead, up to `max' bytes.
+ *
+ * @return size_t Length of the whole records at the start of buf, 0 if there
+ * are none
+ */
+static size_t
+seqf_lastrec(unsigned char type, const unsigned char *buf, size_t len, size_t max)
+{
+	size_t i = len;
+	switch(type) {
+	case 'a':
+		while(--i > 0)
+			if(buf[i] == '>' && buf[i-1] == '\n')
+				return i;
+		return 0;
+	case 'q':
+		len = MIN2(len, max);
+		i = 0;
+		while(i < len && buf[i] == '@') {
+			/* Most records are four lines, with a bare '+' line and the
+			   quality on one line as long as the sequence */
+			const unsigned char *hdr = memchr(buf + i, '\n', len - i);
+			const unsigned char *eol = NULL;
+			if(hdr != NULL && hdr + 1 < buf + len && hdr[1] != '+')
+				eol = memchr(hdr + 1, '\n', (size_t)(buf + len - hdr - 1));
+			if(eol != NULL && eol > hdr + 1) {
+				size_t n = (size_t)(eol - hdr - 1);
+				size_t q = (size_t)(eol - buf) + 3;
+				if(q + n < len && eol[1] == '+' && eol[2] == '\n' &&
+				   buf[q + n] == '\n' && memchr(buf + q, '\n', n) == NULL) {
+					i = q + n + 1;
+					continue;
+				}
+			}
+			struct seqf_recscan s = {0};
+			s.part = SEQF_REC_HEADER;
+			if(!seqf_scanrec(type, buf + i, len - i, false, &s))
+				break;
+			i += s.end;
+		}
+		return i;
+	case 's':
+		while(i > 0 && buf[i-1] != '\n')
+			i--;
+		return i;
+	default:
+		return len;
+	}
+}
+
+int
+seqfread_borrow_unlocked(SeqFile file, const char **ptr, size_t *len)
+{
+	if(file == NULL || ptr == NULL || len == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+	seqfread_release_unlocked(file);
+
+	if(state->have == 0 && seqf_fetch(state) != 0)
+		return EOF;
+	if(state->have == 0)
+		return EOF;
+
+	/* Lend the whole records in the buffer. A mapping holds the rest of the
+	   file, so all of it is whole records, but FASTQ records are only lent a
+	   buffer's worth at a time as they have to be scanned. */
+	size_t n = state->have;
+	if(state->map == NULL || state->map_pos != state->map_size || state->type == 'q')
+		n = seqf_lastrec(state->type, state->next, state->have, state->out_bufsiz);
+	if(n != 0) {
+		*ptr = (const char *)state->next;
+		*len = n;
+		state->lent = n;
+		return 0;
+	}
+
+	/* The buffer ends within its first record, which is gathered on its own
+	   so that the records after it can again be lent in place */
+	struct seqf_recscan s;
+	const unsigned char *rp;
+	if(seqf_gatherrec(state, (unsigned char)seqf_marker(state->type), &s, &rp) == EOF)
+		return EOF;
+	*ptr = (const char *)rp;
+	*len = s.end;
+	return 0;
+}
+
+int
+seqfread_borrow(SeqFile file, const char **ptr, size_t *len)
+{
+	if(file == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	int ret = seqfread_borrow_unlocked(file, ptr, len);
+	seqf_unlock(state);
+
+	return ret;
+}
+
+void
+seqfread_release_unlocked(SeqFile file)
+{
+	if(file == NULL)
+		return;
+	seqf_statep state = (seqf_statep)file;
+	state->next += state->lent;
+	state->have -= state->lent;
+	state->lent = 0;
+}
+
+void
+seqfread_release(SeqFile file)
+{
+	if(file == NULL)
+		return;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	seqfread_release_unlocked(file);
+	seqf_unlock(state);
+}
@@ -0,0 +1,333 @@
+/* seqfshare.c - seqf functions for sharing one SeqFile between many threads
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <stdlib.h>
+
+#include "seqf_share.h"
+
+#if !defined(__STDC_NO_ATOMICS__)
+
+static int
+seqf_ring_init(struct seqf_ring *ring, size_t n)
+{
+	size_t size = 1;
+	while(size < n)
+		size <<= 1;
+	ring->slots = seqf_malloc(size * sizeof *ring->slots);
+	if(ring->slots == NULL)
+		return 1;
+	for(size_t i = 0; i < size; i++)
+		atomic_init(&ring->slots[i].seq, i);
+	ring->mask = size - 1;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return 0;
+}
+
+/**
+ * @brief Push `item' to `ring'.
+ *
+ * @return int 0 on success, 1 if the ring is full
+ */
+static int
+seqf_ring_push(struct seqf_ring *ring, struct seqf_shbatch *item)
+{
+	size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	struct seqf_slot *slot;
+	while(true) {
+		slot = &ring->slots[pos & ring->mask];
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		if(seq == pos) {
+			if(atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+			     memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if(seq < pos) {
+			return 1; /* Slot still holds the item of the last lap */
+		} else {
+			pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		}
+	}
+	slot->item = item;
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+	return 0;
+}
+
+/**
+ * @brief Pop the oldest item of `ring'.
+ *
+ * @return struct seqf_shbatch* Item, or NULL if the ring is empty
+ */
+static struct seqf_shbatch *
+seqf_ring_pop(struct seqf_ring *ring)
+{
+	size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	struct seqf_slot *slot;
+	while(true) {
+		slot = &ring->slots[pos & ring->mask];
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		if(seq == pos + 1) {
+			if(atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+			     memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if(seq < pos + 1) {
+			return NULL; /* Slot not filled yet */
+		} else {
+			pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		}
+	}
+	struct seqf_shbatch *item = slot->item;
+	atomic_store_explicit(&slot->seq, pos + ring->mask + 1, memory_order_release);
+	return item;
+}
+
+/**
+ * @brief Wake the threads asleep on `share', if any. Called after a push, the
+ * fence orders the push before the check of waiters, just as a thread going
+ * to sleep announces itself before checking the ring one last time.
+ */
+static void
+seqf_share_wake(struct seqf_share *share)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(&share->waiters, memory_order_relaxed) == 0)
+		return;
+	mtx_lock(&share->mutex);
+	cnd_broadcast(&share->wake);
+	mtx_unlock(&share->mutex);
+}
+
+/**
+ * @brief Pop from `ring', sleeping until there is something to pop or `quit'
+ * is set.
+ *
+ * @return struct seqf_shbatch* Item, or NULL once quit is set and the ring is
+ * empty
+ */
+static struct seqf_shbatch *
+seqf_share_take(struct seqf_share *share, struct seqf_ring *ring, atomic_bool *quit)
+{
+	struct seqf_shbatch *item;
+	while((item = seqf_ring_pop(ring)) == NULL) {
+		mtx_lock(&share->mutex);
+		atomic_fetch_add(&share->waiters, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		item = seqf_ring_pop(ring);
+		bool quitting = atomic_load(quit);
+		if(item == NULL && !quitting)
+			cnd_wait(&share->wake, &share->mutex);
+		atomic_fetch_sub(&share->waiters, 1);
+		mtx_unlock(&share->mutex);
+		if(item != NULL)
+			break;
+		if(quitting)
+			return seqf_ring_pop(ring);
+	}
+	return item;
+}
+
+static int
+seqf_share_worker(void *arg)
+{
+	seqf_statep state = (seqf_statep)arg;
+	struct seqf_share *share = state->share;
+
+	size_t seqno = 0;
+	struct seqf_shbatch *shb;
+	while((shb = seqf_share_take(share, &share->avail, &share->stop)) != NULL) {
+		if(atomic_load(&share->stop)) {
+			seqf_ring_push(&share->avail, shb);
+			break;
+		}
+
+		/* Other threads may still use the locked functions of the file */
+		seqf_lock(state);
+		size_t n = seqfnextbatch_unlocked((SeqFile)state, &shb->batch, share->nrecords);
+		seqf_unlock(state);
+		if(n == 0) {
+			share->err = seqferrno_;
+			seqf_ring_push(&share->avail, shb);
+			break;
+		}
+
+		shb->seqno = seqno++;
+		seqf_ring_push(&share->full, shb);
+		seqf_share_wake(share);
+	}
+
+	atomic_store(&share->done, true);
+	seqf_share_wake(share);
+	return 0;
+}
+
+static void
+seqf_share_free(struct seqf_share *share)
+{
+	if(share->batches) {
+		for(size_t i = 0; i < share->nbatches; i++)
+			seqfbatchfree(&share->batches[i].batch);
+		seqf_free(share->batches);
+	}
+	seqf_free(share->full.slots);
+	seqf_free(share->avail.slots);
+	seqf_free(share);
+}
+
+int
+seqf_share_start(seqf_statep state)
+{
+	struct seqf_share *share = seqf_calloc(1, sizeof *share);
+	if(share == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	share->nbatches = state->share_nbatches;
+	share->nrecords = state->share_nrecords;
+	share->batches = seqf_calloc(share->nbatches, sizeof *share->batches);
+	if(share->batches == NULL ||
+	   seqf_ring_init(&share->full, share->nbatches) != 0 ||
+	   seqf_ring_init(&share->avail, share->nbatches) != 0) {
+		seqf_share_free(share);
+		seqferrno_ = 6;
+		return 1;
+	}
+	for(size_t i = 0; i < share->nbatches; i++)
+		seqf_ring_push(&share->avail, &share->batches[i]);
+	atomic_init(&share->done, false);
+	atomic_init(&share->stop, false);
+	atomic_init(&share->waiters, 0);
+
+	if(mtx_init(&share->mutex, mtx_plain) != thrd_success) {
+		seqf_share_free(share);
+		seqferrno_ = 2;
+		return 1;
+	}
+	if(cnd_init(&share->wake) != thrd_success) {
+		mtx_destroy(&share->mutex);
+		seqf_share_free(share);
+		seqferrno_ = 2;
+		return 1;
+	}
+
+	state->share = share;
+	if(thrd_create(&share->thread, seqf_share_worker, state) != thrd_success) {
+		state->share = NULL;
+		cnd_destroy(&share->wake);
+		mtx_destroy(&share->mutex);
+		seqf_share_free(share);
+		seqferrno_ = 2;
+		return 1;
+	}
+	return 0;
+}
+
+void
+seqf_share_stop(seqf_statep state)
+{
+	struct seqf_share *share = state->share;
+	if(share == NULL)
+		return;
+
+	mtx_lock(&share->mutex);
+	atomic_store(&share->stop, true);
+	cnd_broadcast(&share->wake);
+	mtx_unlock(&share->mutex);
+	thrd_join(share->thread, NULL);
+
+	cnd_destroy(&share->wake);
+	mtx_destroy(&share->mutex);
+	seqf_share_free(share);
+	state->share = NULL;
+}
+
+const SeqfBatch *
+seqfclaimbatch(SeqFile file, size_t *seqno)
+{
+	if(file == NULL)
+		return NULL;
+	seqf_statep state = (seqf_statep)file;
+	struct seqf_share *share = state->share;
+	if(share == NULL) {
+		seqferrno_ = 8;
+		return NULL;
+	}
+
+	struct seqf_shbatch *shb = seqf_share_take(share, &share->full, &share->done);
+	if(shb == NULL) {
+		seqferrno_ = share->err;
+		return NULL;
+	}
+	if(seqno != NULL)
+		*seqno = shb->seqno;
+	return &shb->batch;
+}
+
+void
+seqfreturnbatch(SeqFile file, const SeqfBatch *batch)
+{
+	if(file == NULL || batch == NULL)
+		return;
+	seqf_statep state = (seqf_statep)file;
+	struct seqf_share *share = state->share;
+	if(share == NULL)
+		return;
+
+	/* The batch is the first member of its seqf_shbatch */
+	seqf_ring_push(&share->avail, (struct seqf_shbatch *)batch);
+	seqf_share_wake(share);
+}
+
+#else /* No C11 atomics, shared mode is unavailable */
+
+int
+seqf_share_start(seqf_statep state)
+{
+	(void)state;
+	seqferrno_ = 8;
+	return 1;
+}
+
+void
+seqf_share_stop(seqf_statep state)
+{
+	(void)state;
+}
+
+const SeqfBatch *
+seqfclaimbatch(SeqFile file, size_t *seqno)
+{
+	(void)file;
+	(void)seqno;
+	seqferrno_ = 8;
+	return NULL;
+}
+
+void
+seqfreturnbatch(SeqFile file, const SeqfBatch *batch)
+{
+	(void)file;
+	(void)batch;
+}
+
+#endif
+
+int
+seqfsetshared(SeqFile file, size_t nbatches, size_t nrecords)
+{
+	if(file == NULL)
+		return -1;
+	seqf_statep state = (seqf_statep)file;
+	if(state->type != 'a' && state->type != 'q' && state->type != 's') {
+		seqferrno_ = 4;
+		return -1;
+	}
+
+	seqf_share_stop(state);
+	state->share_nbatches = nbatches;
+	state->share_nrecords = nrecords ? nrecords : SEQF_SHARE_RECORDS;
+	if(nbatches == 0)
+		return 0;
+	return seqf_share_start(state) == 0 ? 0 : -1;
+}
@@ -17,16 +17,25 @@ strerror_r(int errnum, char *buf, size_t bufsize)
 }
 #endif
 
-static const char seqf_err_msg[7][60] = {
+/* Indexed by seqferrno. 1 is reported through errno and is never looked up */
+static const char seqf_err_msg[13][60] = {
 	"No error",
+	"System error",
 	"Mutex failed to initialize",
 	"Invalid mode passed to seqfopen",
 	"Read failed, could not determine type of file",
 	"Read failed, sequence is larger than input buffer",
 	"Out of memory",
-	"gets failed, sequence is larger than passed buffer"
+	"gets failed, sequence is larger than passed buffer",
+	"Invalid argument",
+	"Paired files are out of step",
+	"Cache or index file is malformed",
+	"Sequence is not in the index",
+	"Operation not supported on this file"
 };
 
+#define SEQF_NERR (int)(sizeof seqf_err_msg / sizeof seqf_err_msg[0])
+
 static const char seqf_undeferr[19] = "Unrecognized error";
 
 int
@@ -34,11 +43,11 @@ seqfstrerror_r(int _rnaferrno, char *buffer, size_t bufsize)
 {
 	if(_rnaferrno == 1)
 		return strerror_r(errno, buffer, bufsize);
-	if(0 <= _rnaferrno && _rnaferrno <= 7)
-		strncpy(buffer, seqf_err_msg[_rnaferrno], bufsize);
-	else
-		strncpy(buffer, seqf_undeferr, bufsize);
-	if(bufsize < strlen(seqf_err_msg[_rnaferrno])) // not enough space
+	const char *msg = seqf_undeferr;
+	if(0 <= _rnaferrno && _rnaferrno < SEQF_NERR)
+		msg = seqf_err_msg[_rnaferrno];
+	strncpy(buffer, msg, bufsize);
+	if(bufsize <= strlen(msg)) // not enough space
 		return 1;
 	return 0;
 }
@@ -48,7 +57,7 @@ seqfstrerror(int _rnaferrno)
 {
 	if(_rnaferrno == 1)
 		return strerror(errno);
-	if(0 <= _rnaferrno && _rnaferrno <= 7)
+	if(0 <= _rnaferrno && _rnaferrno < SEQF_NERR)
 		return seqf_err_msg[_rnaferrno];
 	return seqf_undeferr;
 }
@@ -0,0 +1,556 @@
+/* seqfwrite.c - seqf functions for writing files, compressed on the pool
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "seqf_read.h"
+#include "seqf_write.h"
+#include "seqf_pool.h"
+
+#ifdef _WIN32
+    #include <io.h>
+	#include <basetsd.h>
+    #define write _write
+	typedef SSIZE_T ssize_t;
+#else
+    #include <unistd.h>
+#endif
+
+#if defined _IGZIP_H
+#  include <crc.h>
+#endif
+
+/* Upper bound of the raw deflate stream of `n' bytes */
+#define SEQF_DEFLATE_BOUND(n) ((n) + ((n) >> 8) + 64)
+
+/* Size of the header of a gzip member without extra field, and of its trailer */
+#define GZIP_HDRSIZ 10
+#define GZIP_TRLSIZ 8
+
+/* Empty BGZF member that ends every BGZF file */
+static const unsigned char seqf_bgzf_eof[28] = {
+	0x1F, 0x8B, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x06, 0x00, 'B', 'C',
+	0x02, 0x00, 0x1B, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+extern int
+seqf_writefd(int fd, const unsigned char *buf, size_t len)
+{
+	while(len) {
+		ssize_t n = write(fd, buf, len);
+		if(n <= 0) {
+			seqferrno_ = 1;
+			return 1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * @brief Set up the compressor of `blk'. Runs on the task that first
+ * compresses the block, so that only the blocks in use take the memory.
+ *
+ * @return int 0 on success, 1 when out of memory (seqferrno is set)
+ */
+static int
+seqf_wblock_init(struct seqf_wblock *blk, int level)
+{
+#if defined _IGZIP_H
+	(void)level;
+	blk->level_buf = seqf_malloc(ISAL_DEF_LVL1_DEFAULT);
+	if(blk->level_buf == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+#else
+	blk->stream.zalloc = seqf_zalloc;
+	blk->stream.zfree = seqf_zfree;
+	blk->stream.opaque = Z_NULL;
+	if(deflateInit2(&blk->stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		seqferrno_ = 6;
+		return 1;
+	}
+#endif
+	blk->stream_init = true;
+	return 0;
+}
+
+/**
+ * @brief Deflate the `n' bytes at `src' into a raw deflate stream at `dst',
+ * which has room for `cap' bytes. ISA-L only has one level besides storing,
+ * which every level above 0 maps to.
+ *
+ * @return int 0 on success, 1 if the stream did not fit or failed
+ */
+static int
+seqf_deflate(struct seqf_wblock *blk, int level, const unsigned char *src, size_t n,
+             unsigned char *dst, size_t cap, size_t *clen)
+{
+#if defined _IGZIP_H
+	struct isal_zstream *stream = &blk->stream;
+	isal_deflate_stateless_init(stream);
+	stream->level = level == 0 ? 0 : 1;
+	stream->level_buf = level == 0 ? NULL : blk->level_buf;
+	stream->level_buf_size = level == 0 ? 0 : ISAL_DEF_LVL1_DEFAULT;
+	stream->gzip_flag = IGZIP_DEFLATE;
+	stream->end_of_stream = 1;
+	stream->flush = NO_FLUSH;
+	stream->next_in = (uint8_t *)src;
+	stream->avail_in = (uint32_t)n;
+	stream->next_out = dst;
+	stream->avail_out = (uint32_t)cap;
+	if(isal_deflate_stateless(stream) != COMP_OK)
+		return 1;
+	*clen = stream->total_out;
+#else
+	z_stream *stream = &blk->stream;
+	if(deflateReset(stream) != Z_OK ||
+	   deflateParams(stream, level, Z_DEFAULT_STRATEGY) != Z_OK)
+		return 1;
+	stream->next_in = (Bytef *)src;
+	stream->avail_in = (uInt)n;
+	stream->next_out = dst;
+	stream->avail_out = (uInt)cap;
+	if(deflate(stream, Z_FINISH) != Z_STREAM_END)
+		return 1;
+	*clen = cap - stream->avail_out;
+#endif
+	return 0;
+}
+
+/**
+ * @brief Compress the data of `blk' into complete gzip members: one for a
+ * gzip file, or one per SEQF_BGZF_BLOCK bytes for a BGZF file.
+ *
+ * @return int 0 on success, 3 if deflating failed, -1 when out of memory
+ * (seqferrno is set)
+ */
+static int
+seqf_wblock_deflate(struct seqf_wblock *blk, SEQF_COMPRESSION compression, int level)
+{
+	if(!blk->stream_init && seqf_wblock_init(blk, level) != 0)
+		return -1;
+
+	bool bgzf = compression == BGZF;
+	size_t piece = bgzf ? SEQF_BGZF_BLOCK : blk->len;
+	size_t npieces = (blk->len + piece - 1) / piece;
+	size_t hdrsiz = bgzf ? BGZF_HDRSIZ : GZIP_HDRSIZ;
+	size_t need = blk->len + (blk->len >> 8) + npieces * (hdrsiz + GZIP_TRLSIZ + 64);
+	if(need > blk->out_size) {
+		unsigned char *out = seqf_realloc(blk->out, need);
+		if(out == NULL) {
+			seqferrno_ = 6;
+			return -1;
+		}
+		blk->out = out;
+		blk->out_size = need;
+	}
+
+	blk->out_len = 0;
+	for(size_t pos = 0; pos < blk->len; pos += piece) {
+		const unsigned char *src = blk->data + pos;
+		size_t n = MIN2(piece, blk->len - pos);
+		unsigned char *member = blk->out + blk->out_len;
+		size_t cap = SEQF_DEFLATE_BOUND(n);
+		size_t clen;
+		if(seqf_deflate(blk, level, src, n, member + hdrsiz, cap, &clen) != 0) {
+			seqferrno_ = 1;
+			return 3;
+		}
+
+		/* A BGZF member must fit in 64 KiB, stored data always does */
+		if(bgzf && hdrsiz + clen + GZIP_TRLSIZ > 65536 &&
+		   seqf_deflate(blk, 0, src, n, member + hdrsiz, cap, &clen) != 0) {
+			seqferrno_ = 1;
+			return 3;
+		}
+
+		/* Header, without a name or time, and with the BC subfield for BGZF */
+		static const unsigned char gzip_hdr[BGZF_HDRSIZ] = {
+			0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF,
+			0x06, 0x00, 'B', 'C', 0x02, 0x00, 0x00, 0x00
+		};
+		memcpy(member, gzip_hdr, hdrsiz);
+		if(bgzf) {
+			member[3] = 0x04; /* FEXTRA */
+			seqf_put16(member + 16, (uint16_t)(hdrsiz + clen + GZIP_TRLSIZ - 1));
+		}
+
+		/* Trailer */
+#if defined _IGZIP_H
+		uint32_t crc = crc32_gzip_refl(0, src, n);
+#else
+		uint32_t crc = (uint32_t)crc32(0L, src, (uInt)n);
+#endif
+		seqf_put32(member + hdrsiz + clen, crc);
+		seqf_put32(member + hdrsiz + clen + 4, (uint32_t)n);
+		blk->out_len += hdrsiz + clen + GZIP_TRLSIZ;
+	}
+	return 0;
+}
+
+/**
+ * @brief Compress a block and tell the writer it is ready. Runs as a task on
+ * the pool, or inline when no task could be submitted.
+ */
+static void
+seqf_wblock_task(void *arg)
+{
+	struct seqf_wblock *blk = (struct seqf_wblock *)arg;
+	struct seqf_writer *w = blk->writer;
+	seqferrno_ = 0;
+	blk->ret = seqf_wblock_deflate(blk, w->compression, w->level);
+	blk->err = seqferrno_;
+
+	mtx_lock(&w->mutex);
+	blk->ready = true;
+	cnd_broadcast(&w->done);
+	mtx_unlock(&w->mutex);
+}
+
+/**
+ * @brief Record the first failure of the writer, which every later call
+ * returns.
+ *
+ * @return int Always 1
+ */
+static int
+seqf_wfail(struct seqf_writer *w, int err)
+{
+	if(w->err == 0)
+		w->err = err != 0 ? err : 1;
+	seqferrno_ = w->err;
+	return 1;
+}
+
+/**
+ * @brief Allocate the ring of a compressed file, on the first write so that
+ * `seqfsetpipeline()' can still size it. Each block of the ring can be
+ * compressed by its own task, so there are two per thread of the pool by
+ * default, which keeps the pool busy while the writer fills the next ones.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_wring(seqf_statep state)
+{
+	struct seqf_writer *w = state->writer;
+	w->pool = seqf_pool_get();
+	w->nblocks = state->pipe_nblocks;
+	if(w->nblocks == 0)
+		w->nblocks = w->pool != NULL ? 2 * w->pool->nthreads : 2;
+	if(w->nblocks < 2)
+		w->nblocks = 2;
+
+	w->blocks = seqf_calloc(w->nblocks, sizeof *w->blocks);
+	if(w->blocks == NULL)
+		return seqf_wfail(w, 6);
+	for(size_t i = 0; i < w->nblocks; i++) {
+		w->blocks[i].writer = w;
+		w->blocks[i].data = seqf_malloc(SEQF_WRITE_CHUNK);
+		if(w->blocks[i].data == NULL)
+			return seqf_wfail(w, 6);
+	}
+	return 0;
+}
+
+/**
+ * @brief Wait for the blocks before `upto' to be compressed, and write them
+ * out in order. Once the writer failed they are only waited for.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_wdrain(struct seqf_writer *w, int fd, size_t upto)
+{
+	while(w->head < upto) {
+		struct seqf_wblock *blk = &w->blocks[w->head % w->nblocks];
+		mtx_lock(&w->mutex);
+		while(!blk->ready) {
+			/* A writer on a worker of the pool runs the tasks it waits for */
+			mtx_unlock(&w->mutex);
+			bool helped = seqf_pool_help();
+			mtx_lock(&w->mutex);
+			if(!helped && !blk->ready)
+				cnd_wait(&w->done, &w->mutex);
+		}
+		mtx_unlock(&w->mutex);
+		w->head++;
+
+		if(w->err != 0)
+			continue;
+		if(blk->ret != 0)
+			seqf_wfail(w, blk->err);
+		else if(seqf_writefd(fd, blk->out, blk->out_len) != 0)
+			seqf_wfail(w, seqferrno_);
+	}
+	if(w->err != 0) {
+		seqferrno_ = w->err;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Hand the staged bytes on: written out for a plain file, queued for
+ * compression otherwise. The next block to fill is then written out if it
+ * still holds an earlier block.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_wemit(seqf_statep state)
+{
+	struct seqf_writer *w = state->writer;
+	if(w->len == 0)
+		return 0;
+	if(state->compression == PLAIN) {
+		if(seqf_writefd(state->fd, state->out_buf, w->len) != 0)
+			return seqf_wfail(w, seqferrno_);
+		w->len = 0;
+		return 0;
+	}
+
+	struct seqf_wblock *blk = &w->blocks[w->tail % w->nblocks];
+	blk->len = w->len;
+	blk->ready = false;
+	w->len = 0;
+	w->tail++;
+	if(w->pool == NULL || seqf_pool_submit(w->pool, seqf_wblock_task, blk) != 0)
+		seqf_wblock_task(blk);
+
+	if(w->tail - w->head == w->nblocks)
+		return seqf_wdrain(w, state->fd, w->head + 1);
+	return 0;
+}
+
+/**
+ * @brief Stage `len' bytes of `src', handing the staging buffer on each time
+ * it fills up. Plain writes larger than the buffer skip it.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_wput(seqf_statep state, const unsigned char *src, size_t len)
+{
+	struct seqf_writer *w = state->writer;
+	if(w->err != 0) {
+		seqferrno_ = w->err;
+		return 1;
+	}
+	bool plain = state->compression == PLAIN;
+	if(!plain && w->blocks == NULL && seqf_wring(state) != 0)
+		return 1;
+
+	while(len) {
+		unsigned char *buf = plain ? state->out_buf : w->blocks[w->tail % w->nblocks].data;
+		size_t size = plain ? state->out_bufsiz : SEQF_WRITE_CHUNK;
+		if(plain && w->len == 0 && len >= size) {
+			if(seqf_writefd(state->fd, src, len) != 0)
+				return seqf_wfail(w, seqferrno_);
+			return 0;
+		}
+
+		size_t n = MIN2(len, size - w->len);
+		memcpy(buf + w->len, src, n);
+		w->len += n;
+		src += n;
+		len -= n;
+		if(w->len == size && seqf_wemit(state) != 0)
+			return 1;
+	}
+	return 0;
+}
+
+extern int
+seqf_writer_start(seqf_statep state)
+{
+	struct seqf_writer *w = seqf_calloc(1, sizeof *w);
+	if(w == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	if(mtx_init(&w->mutex, mtx_plain) != thrd_success) {
+		seqf_free(w);
+		seqferrno_ = 2;
+		return 1;
+	}
+	if(cnd_init(&w->done) != thrd_success) {
+		mtx_destroy(&w->mutex);
+		seqf_free(w);
+		seqferrno_ = 2;
+		return 1;
+	}
+	w->compression = state->compression;
+	w->level = state->level;
+	state->writer = w;
+	return 0;
+}
+
+extern int
+seqf_writer_stop(seqf_statep state)
+{
+	struct seqf_writer *w = state->writer;
+	if(w == NULL)
+		return 0;
+
+	/* Hand on the last bytes, and wait for every block in flight */
+	if(w->err == 0 && (w->blocks != NULL || state->compression == PLAIN))
+		seqf_wemit(state);
+	if(w->blocks != NULL)
+		seqf_wdrain(w, state->fd, w->tail);
+	if(w->err == 0 && state->compression == BGZF &&
+	   seqf_writefd(state->fd, seqf_bgzf_eof, sizeof seqf_bgzf_eof) != 0)
+		seqf_wfail(w, seqferrno_);
+	int err = w->err;
+
+	if(w->blocks != NULL) {
+		for(size_t i = 0; i < w->nblocks; i++) {
+			struct seqf_wblock *blk = &w->blocks[i];
+#if defined _IGZIP_H
+			seqf_free(blk->level_buf);
+#else
+			if(blk->stream_init)
+				deflateEnd(&blk->stream);
+#endif
+			seqf_free(blk->data);
+			seqf_free(blk->out);
+		}
+		seqf_free(w->blocks);
+	}
+	cnd_destroy(&w->done);
+	mtx_destroy(&w->mutex);
+	seqf_free(w);
+	state->writer = NULL;
+
+	if(err != 0) {
+		seqferrno_ = err;
+		return 1;
+	}
+	return 0;
+}
+
+size_t
+seqfwrite_unlocked(SeqFile file, const char *buffer, size_t len)
+{
+	if(file == NULL || buffer == NULL)
+		return 0;
+	seqf_statep state = (seqf_statep)file;
+	if(state->writer == NULL) {
+		seqferrno_ = 12;
+		return 0;
+	}
+	return seqf_wput(state, (const unsigned char *)buffer, len) == 0 ? len : 0;
+}
+
+size_t
+seqfwrite(SeqFile file, const char *buffer, size_t len)
+{
+	if(file == NULL)
+		return 0;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	size_t ret = seqfwrite_unlocked(file, buffer, len);
+	seqf_unlock(state);
+
+	return ret;
+}
+
+int
+seqfputrec_unlocked(SeqFile file, const SeqfRecord *rec)
+{
+	if(file == NULL || rec == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+	if(state->writer == NULL) {
+		seqferrno_ = 12;
+		return EOF;
+	}
+
+	/* Header of fasta and fastq records */
+	int ret = 0;
+	if(state->type == 'a' || state->type == 'q') {
+		if(state->type == 'q' && rec->qual_len != rec->seq_len) {
+			seqferrno_ = 8;
+			return EOF;
+		}
+		ret |= seqf_wput(state, (const unsigned char *)(state->type == 'a' ? ">" : "@"), 1);
+		ret |= seqf_wput(state, (const unsigned char *)rec->name, rec->name_len);
+		if(rec->comment_len != 0) {
+			ret |= seqf_wput(state, (const unsigned char *)" ", 1);
+			ret |= seqf_wput(state, (const unsigned char *)rec->comment, rec->comment_len);
+		}
+		ret |= seqf_wput(state, (const unsigned char *)"\n", 1);
+	} else if(state->type != 's') {
+		seqferrno_ = 4;
+		return EOF;
+	}
+
+	ret |= seqf_wput(state, (const unsigned char *)rec->seq, rec->seq_len);
+	ret |= seqf_wput(state, (const unsigned char *)"\n", 1);
+	if(state->type == 'q') {
+		ret |= seqf_wput(state, (const unsigned char *)"+\n", 2);
+		ret |= seqf_wput(state, (const unsigned char *)rec->qual, rec->qual_len);
+		ret |= seqf_wput(state, (const unsigned char *)"\n", 1);
+	}
+	return ret == 0 ? 0 : EOF;
+}
+
+int
+seqfputrec(SeqFile file, const SeqfRecord *rec)
+{
+	if(file == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	int ret = seqfputrec_unlocked(file, rec);
+	seqf_unlock(state);
+
+	return ret;
+}
+
+int
+seqfflush_unlocked(SeqFile file)
+{
+	if(file == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+	struct seqf_writer *w = state->writer;
+	if(w == NULL) {
+		seqferrno_ = 12;
+		return EOF;
+	}
+	if(w->err != 0) {
+		seqferrno_ = w->err;
+		return EOF;
+	}
+	if(state->compression == PLAIN || w->blocks != NULL) {
+		if(seqf_wemit(state) != 0)
+			return EOF;
+	}
+	if(w->blocks != NULL && seqf_wdrain(w, state->fd, w->tail) != 0)
+		return EOF;
+	return 0;
+}
+
+int
+seqfflush(SeqFile file)
+{
+	if(file == NULL)
+		return EOF;
+	seqf_statep state = (seqf_statep)file;
+
+	seqf_lock(state);
+	int ret = seqfflush_unlocked(file);
+	seqf_unlock(state);
+
+	return ret;
+}
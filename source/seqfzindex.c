@@ -0,0 +1,677 @@
+/* seqfzindex.c - seqf functions for the checkpoint index of compressed files
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <io.h>
+    #define lseek _lseek
+#else
+    #include <unistd.h>
+#endif
+
+#include "seqf_read.h"
+#include "seqf_share.h"
+#include "seqf_pipe.h"
+#include "seqf_zindex.h"
+
+/* Bytes of the file read at a time while building an index */
+#define SEQF_ZINDEX_INSIZ ((size_t)1 << 20)
+
+static void
+seqf_zindex_release(struct seqf_zindex *zx)
+{
+	if(zx == NULL)
+		return;
+	seqf_free(zx->points);
+	seqf_free(zx->windows);
+	seqf_free(zx);
+}
+
+extern void
+seqf_zindex_free(seqf_statep state)
+{
+	seqf_zindex_release(state->zindex);
+	state->zindex = NULL;
+}
+
+/**
+ * @brief Index being built, and the records counted so far.
+ */
+struct seqf_zbuild {
+	struct seqf_zindex *zx;        /** Index being built */
+	size_t cap;                    /** Points allocated */
+	size_t windows_cap;            /** Bytes allocated for windows */
+	size_t pending;                /** First point without its record yet */
+	uint64_t last;                 /** Output offset of the last point */
+	uint64_t pos;                  /** Output offset of the next byte scanned */
+	uint64_t line;                 /** Lines started so far */
+	bool bol;                      /** Next byte starts a line */
+};
+
+/**
+ * @brief Count the records that start in the `n' bytes of `buf', which follow
+ * those scanned before. As in `seqf_resync()', FASTA records start at a '>'
+ * line, FASTQ records every four lines, and any other type is split into
+ * lines. Points waiting for a record get the first one that starts.
+ */
+static void
+seqf_zbuild_scan(struct seqf_zbuild *b, const unsigned char *buf, size_t n)
+{
+	struct seqf_zindex *zx = b->zx;
+	size_t i = 0;
+	while(i < n) {
+		if(b->bol) {
+			b->bol = false;
+			bool starts = zx->type == 'a' ? buf[i] == '>' :
+			              zx->type == 'q' ? b->line % 4 == 0 : true;
+			b->line++;
+			if(starts) {
+				for(; b->pending < zx->npoints; b->pending++) {
+					zx->points[b->pending].record = zx->nrecords;
+					zx->points[b->pending].rec_off = b->pos + i;
+				}
+				zx->nrecords++;
+			}
+		}
+		const unsigned char *eol = memchr(buf + i, '\n', n - i);
+		if(eol == NULL)
+			break;
+		i = (size_t)(eol - buf) + 1;
+		b->bol = true;
+	}
+	b->pos += n;
+}
+
+/**
+ * @brief Add a point of kind `kind' at compressed offset `coff' and output
+ * offset `uoff', whose window is the `wlen' bytes of `win'.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_zbuild_point(struct seqf_zbuild *b, uint8_t kind, uint64_t coff, uint64_t uoff, uint8_t bits,
+                  const unsigned char *win, size_t wlen)
+{
+	struct seqf_zindex *zx = b->zx;
+	if(zx->npoints == b->cap) {
+		size_t cap = b->cap ? 2 * b->cap : 64;
+		struct seqf_zpoint *tmp = seqf_realloc(zx->points, cap * sizeof *tmp);
+		if(tmp == NULL) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		zx->points = tmp;
+		b->cap = cap;
+	}
+	struct seqf_zpoint *p = &zx->points[zx->npoints];
+	memset(p, 0, sizeof *p);
+	p->coff = coff;
+	p->uoff = uoff;
+	p->bits = bits;
+	p->kind = kind;
+	p->win = zx->windows_len;
+
+#if !defined _IGZIP_H
+	if(wlen != 0) {
+		uLong bound = compressBound((uLong)wlen);
+		if(zx->windows_len + bound > b->windows_cap) {
+			size_t cap = b->windows_cap ? 2 * b->windows_cap : (size_t)1 << 20;
+			while(cap < zx->windows_len + bound)
+				cap *= 2;
+			unsigned char *tmp = seqf_realloc(zx->windows, cap);
+			if(tmp == NULL) {
+				seqferrno_ = 6;
+				return 1;
+			}
+			zx->windows = tmp;
+			b->windows_cap = cap;
+		}
+		uLongf wsize = bound;
+		if(compress2(zx->windows + zx->windows_len, &wsize, win, (uLong)wlen, 1) != Z_OK) {
+			seqferrno_ = 6;
+			return 1;
+		}
+		p->wsize = (uint32_t)wsize;
+		p->wlen = (uint32_t)wlen;
+		zx->windows_len += wsize;
+	}
+#else
+	(void)win; (void)wlen;
+#endif
+	zx->npoints++;
+	b->last = uoff;
+	return 0;
+}
+
+/**
+ * @brief Index the plain file of `state', with a point every span bytes.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_zbuild_plain(seqf_statep state, struct seqf_zbuild *b, unsigned char *buf)
+{
+	size_t chunk = b->zx->span < SEQF_ZINDEX_INSIZ ? (size_t)b->zx->span : SEQF_ZINDEX_INSIZ;
+	for(;;) {
+		size_t nread;
+		if(seqf_preadfd(state->fd, buf, chunk, b->pos, &nread, &state->io) != 0)
+			return 1;
+		if(nread == 0)
+			break;
+		if(b->pos - b->last >= b->zx->span &&
+		   seqf_zbuild_point(b, SEQF_ZPOINT_PLAIN, b->pos, b->pos, 0, NULL, 0) != 0)
+			return 1;
+		seqf_zbuild_scan(b, buf, nread);
+	}
+	return 0;
+}
+
+#if !defined _IGZIP_H
+/**
+ * @brief Index the compressed file of `state' as zlib's zran does: inflate it
+ * a deflate block at a time, and add a point at the first block boundary (or
+ * gzip member, for BGZF) after every span bytes of output.
+ *
+ * @return int 0 on success, 1 on error (seqferrno is set)
+ */
+static int
+seqf_zbuild_deflate(seqf_statep state, struct seqf_zbuild *b, unsigned char *in)
+{
+	struct seqf_zindex *zx = b->zx;
+	unsigned char *win = seqf_malloc(2 * SEQF_ZINDEX_WINSIZ);
+	if(win == NULL) {
+		seqferrno_ = 6;
+		return 1;
+	}
+	unsigned char *lin = win + SEQF_ZINDEX_WINSIZ;
+	z_stream strm;
+	strm.zalloc = seqf_zalloc;
+	strm.zfree = seqf_zfree;
+	strm.opaque = Z_NULL;
+	strm.avail_in = 0;
+	strm.next_in = Z_NULL;
+	if(inflateInit2(&strm, zx->compression == ZLIB ? MAX_WBITS : 16 + MAX_WBITS) != Z_OK) {
+		seqf_free(win);
+		seqferrno_ = 6;
+		return 1;
+	}
+
+	int ret = 1;
+	uint64_t totin = 0, readpos = 0, member_out = 0;
+	strm.avail_out = 0;
+	for(;;) {
+		if(strm.avail_in == 0) {
+			size_t nread;
+			if(seqf_preadfd(state->fd, in, SEQF_ZINDEX_INSIZ, readpos, &nread, &state->io) != 0)
+				goto done;
+			if(nread == 0)
+				break;
+			strm.next_in = in;
+			strm.avail_in = (uInt)nread;
+			readpos += nread;
+		}
+		if(strm.avail_out == 0) {
+			strm.next_out = win;
+			strm.avail_out = SEQF_ZINDEX_WINSIZ;
+		}
+
+		unsigned char *out = strm.next_out;
+		uInt avail_in = strm.avail_in;
+		int z = inflate(&strm, Z_BLOCK);
+		totin += avail_in - strm.avail_in;
+		size_t got = (size_t)(strm.next_out - out);
+		member_out += got;
+		seqf_zbuild_scan(b, out, got);
+		if(z != Z_OK && z != Z_STREAM_END && z != Z_BUF_ERROR) {
+			seqferrno_ = 1;
+			goto done;
+		}
+
+		if(z == Z_STREAM_END) {
+			/* Another gzip member may follow, which starts afresh */
+			if(zx->compression == ZLIB)
+				break;
+			if(strm.avail_in == 0) {
+				size_t nread;
+				if(seqf_preadfd(state->fd, in, SEQF_ZINDEX_INSIZ, readpos, &nread, &state->io) != 0)
+					goto done;
+				strm.next_in = in;
+				strm.avail_in = (uInt)nread;
+				readpos += nread;
+			}
+			if(strm.avail_in == 0 || strm.next_in[0] != 0x1F)
+				break;
+			if(b->pos - b->last >= zx->span &&
+			   seqf_zbuild_point(b, SEQF_ZPOINT_MEMBER, totin, b->pos, 0, NULL, 0) != 0)
+				goto done;
+			inflateReset(&strm);
+			member_out = 0;
+			continue;
+		}
+
+		/* At the end of a block that is not the last, the output so far is
+		   all a later block can refer to. BGZF members are points enough. */
+		if(zx->compression != BGZF && (strm.data_type & 128) && !(strm.data_type & 64) &&
+		   b->pos - b->last >= zx->span) {
+			size_t wlen = member_out < SEQF_ZINDEX_WINSIZ ? (size_t)member_out : SEQF_ZINDEX_WINSIZ;
+			size_t at = SEQF_ZINDEX_WINSIZ - strm.avail_out;
+			size_t from = (at + SEQF_ZINDEX_WINSIZ - wlen) % SEQF_ZINDEX_WINSIZ;
+			size_t first = SEQF_ZINDEX_WINSIZ - from < wlen ? SEQF_ZINDEX_WINSIZ - from : wlen;
+			memcpy(lin, win + from, first);
+			memcpy(lin + first, win, wlen - first);
+			if(seqf_zbuild_point(b, SEQF_ZPOINT_BLOCK, totin, b->pos, (uint8_t)(strm.data_type & 7),
+			                     lin, wlen) != 0)
+				goto done;
+		}
+	}
+	ret = 0;
+
+done:
+	inflateEnd(&strm);
+	seqf_free(win);
+	return ret;
+}
+#endif
+
+int
+seqfzindex_build(SeqFile file, size_t span)
+{
+	if(file == NULL) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	seqf_statep state = (seqf_statep)file;
+	if(state->writing || state->cache != NULL || state->ranged) {
+		seqferrno_ = 12;
+		return 1;
+	}
+#if defined _IGZIP_H
+	/* ISA-L cannot stop at the end of a deflate block */
+	if(state->compression != PLAIN) {
+		seqferrno_ = 12;
+		return 1;
+	}
+#endif
+	size_t file_size = seqf_filesize(state->fd);
+	if(file_size == (size_t)-1) {
+		seqferrno_ = 4;
+		return 1;
+	}
+
+	struct seqf_zbuild b = {0};
+	b.bol = true;
+	b.zx = seqf_calloc(1, sizeof *b.zx);
+	unsigned char *buf = seqf_malloc(SEQF_ZINDEX_INSIZ);
+	if(b.zx == NULL || buf == NULL) {
+		seqf_free(b.zx);
+		seqf_free(buf);
+		seqferrno_ = 6;
+		return 1;
+	}
+	b.zx->type = state->type;
+	b.zx->compression = state->compression;
+	b.zx->span = span ? span : SEQF_ZINDEX_SPAN;
+	b.zx->file_size = file_size;
+
+	/* The file is read with pread, so reading it is not disturbed */
+	seqf_lock(state);
+	seqferrno_ = 0;
+	int ret;
+#if !defined _IGZIP_H
+	if(state->compression != PLAIN)
+		ret = seqf_zbuild_deflate(state, &b, buf);
+	else
+#endif
+		ret = seqf_zbuild_plain(state, &b, buf);
+	if(ret == 0) {
+		for(; b.pending < b.zx->npoints; b.pending++) {
+			b.zx->points[b.pending].record = b.zx->nrecords;
+			b.zx->points[b.pending].rec_off = b.pos;
+		}
+		b.zx->size = b.pos;
+		seqf_zindex_free(state);
+		state->zindex = b.zx;
+	} else {
+		seqf_zindex_release(b.zx);
+	}
+	seqf_unlock(state);
+	seqf_free(buf);
+	return ret;
+}
+
+int
+seqfzindex_save(SeqFile file, const char *path)
+{
+	if(file == NULL || path == NULL) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	struct seqf_zindex *zx = ((seqf_statep)file)->zindex;
+	if(zx == NULL) {
+		seqferrno_ = 12;
+		return 1;
+	}
+	FILE *fp = fopen(path, "wb");
+	if(fp == NULL) {
+		seqferrno_ = 1;
+		return 1;
+	}
+
+	unsigned char hdr[SEQF_ZINDEX_HDRSIZ] = {0};
+	memcpy(hdr, SEQF_ZINDEX_MAGIC, 4);
+	seqf_put32(hdr + 4, SEQF_ZINDEX_VERSION);
+	hdr[8] = zx->type;
+	hdr[9] = (unsigned char)zx->compression;
+	seqf_put64(hdr + 16, zx->span);
+	seqf_put64(hdr + 24, zx->npoints);
+	seqf_put64(hdr + 32, zx->nrecords);
+	seqf_put64(hdr + 40, zx->size);
+	seqf_put64(hdr + 48, zx->file_size);
+	seqf_put64(hdr + 56, zx->windows_len);
+	bool ok = fwrite(hdr, sizeof hdr, 1, fp) == 1;
+	for(size_t i = 0; ok && i < zx->npoints; i++) {
+		const struct seqf_zpoint *p = &zx->points[i];
+		unsigned char rec[SEQF_ZINDEX_POINTSIZ];
+		seqf_put64(rec, p->coff);
+		seqf_put64(rec + 8, p->uoff);
+		seqf_put64(rec + 16, p->record);
+		seqf_put64(rec + 24, p->rec_off);
+		seqf_put64(rec + 32, p->win);
+		seqf_put32(rec + 40, p->wsize);
+		seqf_put16(rec + 44, (uint16_t)p->wlen);
+		rec[46] = p->bits;
+		rec[47] = p->kind;
+		ok = fwrite(rec, sizeof rec, 1, fp) == 1;
+	}
+	if(ok && zx->windows_len != 0)
+		ok = fwrite(zx->windows, zx->windows_len, 1, fp) == 1;
+	if(fclose(fp) != 0 || !ok) {
+		seqferrno_ = 1;
+		remove(path);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Check that the points of `zx' follow each other and stay within the
+ * file and its windows.
+ */
+static bool
+seqf_zindex_valid(const struct seqf_zindex *zx)
+{
+	for(size_t i = 0; i < zx->npoints; i++) {
+		const struct seqf_zpoint *p = &zx->points[i];
+		const struct seqf_zpoint *q = i ? &zx->points[i - 1] : NULL;
+		if(p->coff > zx->file_size || p->uoff > zx->size || p->rec_off > zx->size ||
+		   p->record > zx->nrecords || p->bits > 7 || p->wlen > SEQF_ZINDEX_WINSIZ ||
+		   p->win > zx->windows_len || p->wsize > zx->windows_len - p->win)
+			return false;
+		if(p->rec_off < p->uoff || (p->kind == SEQF_ZPOINT_BLOCK) != (p->wlen != 0) ||
+		   (p->kind == SEQF_ZPOINT_PLAIN) != (zx->compression == PLAIN) || p->kind > SEQF_ZPOINT_PLAIN)
+			return false;
+		if(q != NULL && (p->uoff <= q->uoff || p->coff < q->coff || p->record < q->record))
+			return false;
+	}
+	return true;
+}
+
+int
+seqfzindex_load(SeqFile file, const char *path)
+{
+	if(file == NULL || path == NULL) {
+		seqferrno_ = 8;
+		return 1;
+	}
+	seqf_statep state = (seqf_statep)file;
+	if(state->writing || state->cache != NULL || state->ranged) {
+		seqferrno_ = 12;
+		return 1;
+	}
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL) {
+		seqferrno_ = 1;
+		return 1;
+	}
+
+	int err = 10;
+	unsigned char hdr[SEQF_ZINDEX_HDRSIZ];
+	struct seqf_zindex *zx = seqf_calloc(1, sizeof *zx);
+	if(zx == NULL) {
+		err = 6;
+		goto fail;
+	}
+	if(fread(hdr, sizeof hdr, 1, fp) != 1 || memcmp(hdr, SEQF_ZINDEX_MAGIC, 4) != 0 ||
+	   seqf_get32(hdr + 4) != SEQF_ZINDEX_VERSION)
+		goto fail;
+	zx->type = hdr[8];
+	zx->compression = (SEQF_COMPRESSION)hdr[9];
+	zx->span = seqf_get64(hdr + 16);
+	uint64_t npoints = seqf_get64(hdr + 24);
+	zx->nrecords = seqf_get64(hdr + 32);
+	zx->size = seqf_get64(hdr + 40);
+	zx->file_size = seqf_get64(hdr + 48);
+	uint64_t windows_len = seqf_get64(hdr + 56);
+
+	/* The index must be that of this file, read as it was then */
+	if(zx->type != state->type || zx->compression != state->compression ||
+	   zx->file_size != seqf_filesize(state->fd) || npoints > SIZE_MAX / sizeof *zx->points ||
+	   windows_len > zx->file_size + SEQF_ZINDEX_WINSIZ * npoints)
+		goto fail;
+
+	zx->points = seqf_malloc((size_t)(npoints ? npoints : 1) * sizeof *zx->points);
+	zx->windows = seqf_malloc(windows_len ? (size_t)windows_len : 1);
+	if(zx->points == NULL || zx->windows == NULL) {
+		err = 6;
+		goto fail;
+	}
+	for(; zx->npoints < npoints; zx->npoints++) {
+		unsigned char rec[SEQF_ZINDEX_POINTSIZ];
+		if(fread(rec, sizeof rec, 1, fp) != 1)
+			goto fail;
+		struct seqf_zpoint *p = &zx->points[zx->npoints];
+		p->coff = seqf_get64(rec);
+		p->uoff = seqf_get64(rec + 8);
+		p->record = seqf_get64(rec + 16);
+		p->rec_off = seqf_get64(rec + 24);
+		p->win = seqf_get64(rec + 32);
+		p->wsize = seqf_get32(rec + 40);
+		p->wlen = seqf_get16(rec + 44);
+		p->bits = rec[46];
+		p->kind = rec[47];
+	}
+	zx->windows_len = (size_t)windows_len;
+	if((windows_len != 0 && fread(zx->windows, zx->windows_len, 1, fp) != 1) || !seqf_zindex_valid(zx))
+		goto fail;
+	fclose(fp);
+
+	seqf_lock(state);
+	seqf_zindex_free(state);
+	state->zindex = zx;
+	seqf_unlock(state);
+	return 0;
+
+fail:
+	fclose(fp);
+	seqf_zindex_release(zx);
+	seqferrno_ = err;
+	return 1;
+}
+
+/**
+ * @brief Start reading the file of `state' over at point `p'. The stream is
+ * left where inflation of the point begins, with nothing in the buffers.
+ *
+ * @return int 0 on success, -1 on error (seqferrno is set)
+ */
+static int
+seqf_zindex_resume(seqf_statep state, const struct seqf_zpoint *p)
+{
+	state->have = 0;
+	state->nt_part = 0;
+	state->nt_break = false;
+	state->lent = 0;
+	state->eof = false;
+
+	if(p->kind == SEQF_ZPOINT_PLAIN) {
+		if(state->map != NULL)
+			state->map_pos = (size_t)p->coff;
+		else if(lseek(state->fd, (off_t)p->coff, SEEK_SET) == -1) {
+			seqferrno_ = 1;
+			return -1;
+		}
+		return 0;
+	}
+
+#if defined _IGZIP_H
+	seqferrno_ = 12;
+	return -1;
+#else
+	/* A block starts within the byte before its first whole byte */
+	unsigned char byte = 0;
+	if(p->bits != 0) {
+		size_t nread;
+		if(seqf_preadfd(state->fd, &byte, 1, (size_t)p->coff - 1, &nread, &state->io) != 0)
+			return -1;
+	}
+	if(lseek(state->fd, (off_t)p->coff, SEEK_SET) == -1) {
+		seqferrno_ = 1;
+		return -1;
+	}
+
+	int ret;
+	if(p->kind == SEQF_ZPOINT_MEMBER) {
+		ret = inflateReset2(&state->stream, state->compression == ZLIB ? MAX_WBITS : 16 + MAX_WBITS);
+	} else {
+		unsigned char win[SEQF_ZINDEX_WINSIZ];
+		uLongf wlen = SEQF_ZINDEX_WINSIZ;
+		if(uncompress(win, &wlen, state->zindex->windows + p->win, p->wsize) != Z_OK || wlen != p->wlen) {
+			seqferrno_ = 10;
+			return -1;
+		}
+		ret = inflateReset2(&state->stream, -MAX_WBITS);
+		if(ret == Z_OK && p->bits != 0)
+			ret = inflatePrime(&state->stream, p->bits, byte >> (8 - p->bits));
+		if(ret == Z_OK)
+			ret = inflateSetDictionary(&state->stream, win, (uInt)wlen);
+	}
+	if(ret != Z_OK) {
+		seqferrno_ = 1;
+		return -1;
+	}
+	state->stream.next_in = state->in_buf;
+	state->stream.avail_in = 0;
+	state->zraw = p->kind == SEQF_ZPOINT_BLOCK;
+	state->zresumed = p->coff != 0;
+	return 0;
+#endif
+}
+
+/**
+ * @brief Discard the next `n' bytes of output of `state'.
+ *
+ * @return int 0 on success, -1 on error (seqferrno is set)
+ */
+static int
+seqf_zindex_skip(seqf_statep state, uint64_t n)
+{
+	while(n != 0) {
+		if(state->have == 0 && seqf_fetch(state) != 0)
+			return -1;
+		if(state->have == 0) {
+			/* The file ended before its index says it does */
+			seqferrno_ = 10;
+			return -1;
+		}
+		size_t k = n < state->have ? (size_t)n : state->have;
+		state->next += k;
+		state->have -= k;
+		n -= k;
+	}
+	return 0;
+}
+
+/**
+ * @brief Last point of `zx' at or before output offset `offset', or, with
+ * `by_record', the last one whose first record is at or before `offset'.
+ * Returns `start' when there is none.
+ */
+static const struct seqf_zpoint *
+seqf_zindex_find(const struct seqf_zindex *zx, uint64_t offset, bool by_record, const struct seqf_zpoint *start)
+{
+	size_t lo = 0, hi = zx->npoints;
+	while(lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint64_t key = by_record ? zx->points[mid].record : zx->points[mid].uoff;
+		if(key <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo == 0 ? start : &zx->points[lo - 1];
+}
+
+extern int
+seqf_zindex_seekrec(seqf_statep state, uint64_t record)
+{
+	struct seqf_zindex *zx = state->zindex;
+	if(record > zx->nrecords) {
+		seqferrno_ = 8;
+		return -1;
+	}
+	seqf_pipe_stop(state);
+	struct seqf_zpoint start = {0};
+	start.kind = state->compression == PLAIN ? SEQF_ZPOINT_PLAIN : SEQF_ZPOINT_MEMBER;
+	const struct seqf_zpoint *p = seqf_zindex_find(zx, record, true, &start);
+	if(seqf_zindex_resume(state, p) != 0 || seqf_zindex_skip(state, p->rec_off - p->uoff) != 0)
+		return -1;
+
+	/* Records from there on are read through */
+	SeqfRecord rec;
+	seqferrno_ = 0;
+	for(uint64_t i = p->record; i < record; i++)
+		if(seqfnextrec_unlocked((SeqFile)state, &rec) != 0)
+			return seqferrno_ != 0 ? -1 : 0;
+	return 0;
+}
+
+int
+seqfseek_offset(SeqFile file, size_t offset)
+{
+	if(file == NULL)
+		return -1;
+	seqf_statep state = (seqf_statep)file;
+	if(state->writing || state->cache != NULL || state->ranged ||
+	   (state->zindex == NULL && state->compression != PLAIN)) {
+		seqferrno_ = 12;
+		return -1;
+	}
+	struct seqf_zindex *zx = state->zindex;
+	size_t size = zx != NULL ? (size_t)zx->size : seqf_filesize(state->fd);
+	if(size == (size_t)-1 || offset > size) {
+		seqferrno_ = 8;
+		return -1;
+	}
+
+	seqf_share_stop(state);
+	seqf_pipe_stop(state);
+	struct seqf_zpoint start = {0};
+	start.kind = state->compression == PLAIN ? SEQF_ZPOINT_PLAIN : SEQF_ZPOINT_MEMBER;
+	if(zx == NULL) {
+		/* Plain files are entered anywhere */
+		start.coff = start.uoff = offset;
+	}
+	const struct seqf_zpoint *p = zx != NULL ? seqf_zindex_find(zx, offset, false, &start) : &start;
+	if(seqf_zindex_resume(state, p) != 0 || seqf_zindex_skip(state, offset - p->uoff) != 0)
+		return -1;
+	if(state->share_nbatches && seqf_share_start(state) != 0)
+		return -1;
+	return 0;
+}
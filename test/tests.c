@@ -1,4 +1,7 @@
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "minunit.h"
 
@@ -65,6 +68,43 @@ test_seqfclose(void)
 	unit_tests_end;
 }
 
+static UTEST_TYPE
+test_seqfreopen(void)
+{
+	init_unit_tests("Testing seqfreopen");
+
+	SeqfRecord rec;
+	SeqFile file = seqfreopen(NULL, TXT2STR(EXAMPLE_FASTQ_GZ), "q");
+	mu_assert("Reopen without a file opens one", file != NULL &&
+	  seqfnextrec(file, &rec) == 0 && rec.name_len == 8 && memcmp(rec.name, "SEQ_ID_1", 8) == 0);
+
+	/* Reuse the handle for files of other kinds and compressions */
+	seqf_statep state = (seqf_statep)file;
+	unsigned char *in_buf = state->in_buf, *out_buf = state->out_buf;
+	mu_assert("Reopen as fasta", seqfreopen(file, TXT2STR(EXAMPLE_FASTA), "a") == file &&
+	  seqfnextrec(file, &rec) == 0 && rec.name[0] != '\0' && rec.qual == NULL &&
+	  state->in_buf == in_buf && state->out_buf == out_buf);
+
+	char expected[4096], got[4096];
+	bool passed = true;
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_READS), "s");
+	for(int pass = 0; pass < 2; pass++) {
+		file = seqfreopen(file, TXT2STR(EXAMPLE_READS_GZ), "s");
+		seqfrewind(plain);
+		while(seqfgets(plain, expected, sizeof expected) != NULL)
+			if(file == NULL || seqfgets(file, got, sizeof got) == NULL || strcmp(expected, got) != 0)
+				passed = false;
+		passed = passed && seqfgets(file, got, sizeof got) == NULL && seqfeof(file);
+	}
+	seqfclose(plain);
+	mu_assert("Reopen compressed file twice", passed && state->out_buf == out_buf);
+
+	mu_assert("Failed reopen closes the file",
+	  seqfreopen(file, "non-existent-path/no-existent-file", "s") == NULL && seqferrno == 1);
+
+	unit_tests_end;
+}
+
 static UTEST_TYPE
 test_seqferrno(void)
 {
@@ -141,6 +181,1461 @@ test_seqfgetc(void)
 	unit_tests_end;
 }
 
+static UTEST_TYPE
+test_seqfqgets(void)
+{
+	init_unit_tests("Testing seqfqgets");
+
+	/* Records whose quality line is found by the length of the sequence,
+	   and records where that length would be wrong */
+	const char *text =
+	  "@r1 named\nACGTACGT\n+r1 named\nIIIIIIII\n"  /* '+' line with the name */
+	  "@r2\nGGGGG\n+\nIII\n@\nAAAA\n+\nIIII\n"      /* Quality line shorter */
+	  "@r3\nTTTT\n+\nIIIIII\n"                      /* Quality line longer */
+	  "@r4\nACGT\nAC\n+\nIIIIII\n"                  /* Wrapped sequence */
+	  "@r5\nACGT\nACGT\nA\n+\nIIII\nIIII\nI\n"      /* Wrapped quality too */
+	  "@r6\nCCCCC\n+\nIIIII\n";
+	const char *seqs[7] = {"ACGTACGT", "GGGGG", "AAAA", "TTTT", "ACGTAC", "ACGTACGTA", "CCCCC"};
+	const char *path = "qgets_test.fastq";
+	FILE *fp = fopen(path, "wb");
+	fputs(text, fp);
+	fclose(fp);
+
+	/* Through output buffers of every small size, so that the '+' and
+	   quality lines straddle fetches at every point */
+	bool passed = true;
+	char buf[64];
+	for(size_t size = 8; size <= 96 && passed; size++) {
+		SeqFile file = seqfopen(path, size == 96 ? "q" : "qu");
+		if(size != 96)
+			seqfsetobuf(file, size);
+		for(int i = 0; i < 7; i++)
+			passed = passed && seqfgets(file, buf, sizeof buf) != NULL && strcmp(buf, seqs[i]) == 0;
+		passed = passed && seqfgets(file, buf, sizeof buf) == NULL && seqfeof(file);
+		seqfclose(file);
+	}
+	mu_assert("Odd records read in order", passed);
+
+	remove(path);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfmmap(void)
+{
+	init_unit_tests("Testing memory mapped input");
+
+	char mapped[200], unmapped[200];
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	mu_assert("Plain file is mapped", ((seqf_statep)file)->map != NULL);
+	seqfgets(file, mapped, sizeof mapped);
+	seqfclose(file);
+
+	file = seqfopen(TXT2STR(EXAMPLE_FASTA), "au");
+	mu_assert("Plain file with 'u' is not mapped", ((seqf_statep)file)->map == NULL);
+	seqfgets(file, unmapped, sizeof unmapped);
+	seqfclose(file);
+	mu_assert("Mapped and unmapped reads match", strcmp(mapped, unmapped) == 0);
+
+	file = seqfopen(TXT2STR(EXAMPLE_FASTA_GZ), "a");
+	mu_assert("Compressed file is not mapped", ((seqf_statep)file)->map == NULL);
+	seqfclose(file);
+
+	int nt = 0;
+	file = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	while(seqfgetnt(file) != EOF) nt++;
+	mu_assert("seqfgetnt stops at end of mapping", nt == 183);
+	seqfclose(file);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfpipeline(void)
+{
+	init_unit_tests("Testing pipelined decompression");
+
+	char expected[1000], got[1000];
+	bool passed = true;
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	SeqFile piped = seqfopen(TXT2STR(EXAMPLE_FASTQ_GZ), "qt");
+	mu_assert("Open compressed file with 't'", piped != NULL);
+	while(seqfgets(plain, expected, sizeof expected) != NULL) {
+		if(seqfgets(piped, got, sizeof got) == NULL || strcmp(expected, got) != 0) {
+			passed = false;
+			break;
+		}
+	}
+	mu_assert("Pipelined sequences match plain file", passed);
+	mu_assert("Pipelined file reaches end of file",
+	  seqfgets(piped, got, sizeof got) == NULL && seqfeof(piped));
+	mu_assert("Cannot change a running ring", seqfsetpipeline(piped, 8) == -1);
+
+	seqfrewind(plain);
+	seqfrewind(piped);
+	size_t nplain = seqfread(plain, expected, sizeof expected);
+	size_t npiped = seqfread(piped, got, sizeof got);
+	mu_assert("seqfread after rewind",
+	  nplain == npiped && memcmp(expected, got, nplain) == 0);
+	seqfclose(plain);
+	seqfclose(piped);
+
+	piped = seqfopen(TXT2STR(EXAMPLE_READS_GZ), "s");
+	mu_assert("Set ring before reading", seqfsetpipeline(piped, 2) == 0);
+	mu_assert("seqfgetc through the ring", seqfgetc(piped) == 'G');
+	seqfclose(piped);
+
+	/* The ring takes over from reads already made without it */
+	plain = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	piped = seqfopen(TXT2STR(EXAMPLE_FASTQ_GZ), "q");
+	passed = seqfgets(plain, expected, sizeof expected) != NULL &&
+	  seqfgets(piped, got, sizeof got) != NULL && strcmp(expected, got) == 0;
+	mu_assert("Set ring after reading", seqfsetpipeline(piped, 2) == 0);
+	while(passed && seqfgets(plain, expected, sizeof expected) != NULL)
+		passed = seqfgets(piped, got, sizeof got) != NULL && strcmp(expected, got) == 0;
+	mu_assert("Reading carries on through the ring", passed &&
+	  seqfgets(piped, got, sizeof got) == NULL);
+	seqfclose(plain);
+	seqfclose(piped);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfbgzf(void)
+{
+	init_unit_tests("Testing BGZF decompression");
+
+	char expected[1000], got[1000];
+	bool passed = true;
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	SeqFile bgzf = seqfopen(TXT2STR(EXAMPLE_FASTQ_BGZ), "q");
+	mu_assert("Open BGZF file", bgzf != NULL);
+	while(seqfgets(plain, expected, sizeof expected) != NULL) {
+		if(seqfgets(bgzf, got, sizeof got) == NULL || strcmp(expected, got) != 0) {
+			passed = false;
+			break;
+		}
+	}
+	mu_assert("BGZF sequences match plain file", passed);
+	mu_assert("BGZF file reaches end of file",
+	  seqfgets(bgzf, got, sizeof got) == NULL && seqfeof(bgzf));
+
+	seqfrewind(plain);
+	seqfrewind(bgzf);
+	size_t nplain = seqfread(plain, expected, sizeof expected);
+	size_t nbgzf = seqfread(bgzf, got, sizeof got);
+	mu_assert("seqfread BGZF after rewind",
+	  nplain == nbgzf && memcmp(expected, got, nplain) == 0);
+	seqfclose(plain);
+	seqfclose(bgzf);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfthreads(void)
+{
+	init_unit_tests("Testing parallel gzip decompression");
+
+	char expected[4096], got[4096];
+	bool passed = true;
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_READS), "s");
+	SeqFile gz = seqfopen(TXT2STR(EXAMPLE_READS_GZ), "st");
+	mu_assert("Set threads before reading", seqfsetthreads(gz, 3) == 0);
+	size_t nplain, ngz;
+	do {
+		nplain = seqfread(plain, expected, sizeof expected);
+		ngz = seqfread(gz, got, sizeof got);
+		if(nplain != ngz || memcmp(expected, got, nplain) != 0) {
+			passed = false;
+			break;
+		}
+	} while(nplain != 0);
+	mu_assert("Chunks inflated in parallel match plain file", passed);
+	SeqfStats st;
+	mu_assert("Chunks after the first are kept", seqfgetstats(gz, &st) == 0 &&
+	  st.chunks_kept >= 2);
+	mu_assert("Parallel gzip reaches end of file", seqfeof(gz) && seqferrno == 0);
+	mu_assert("Cannot change threads after reading", seqfsetthreads(gz, 2) == -1);
+
+	seqfrewind(plain);
+	seqfrewind(gz);
+	passed = true;
+	while(seqfgets(plain, expected, sizeof expected) != NULL) {
+		if(seqfgets(gz, got, sizeof got) == NULL || strcmp(expected, got) != 0) {
+			passed = false;
+			break;
+		}
+	}
+	mu_assert("seqfgets after rewind", passed);
+	seqfclose(plain);
+	seqfclose(gz);
+
+	unit_tests_end;
+}
+
+/* A task squaring its slot, and one splitting its range into more tasks */
+struct pool_range {
+	size_t *out;
+	size_t begin, end;
+};
+
+static void
+square_task(void *arg)
+{
+	size_t *slot = arg;
+	*slot = *slot * *slot;
+}
+
+static void
+split_task(void *arg)
+{
+	struct pool_range *r = arg;
+	if(r->end - r->begin == 1) {
+		r->out[r->begin] = r->begin;
+		return;
+	}
+	size_t mid = r->begin + (r->end - r->begin) / 2;
+	struct pool_range halves[2] = {{r->out, r->begin, mid}, {r->out, mid, r->end}};
+	SeqfTaskGroup group = seqftaskgroup();
+	seqfsubmit(group, split_task, &halves[0]);
+	seqfsubmit(group, split_task, &halves[1]);
+	seqftaskgroupfree(group);
+}
+
+static UTEST_TYPE
+test_seqfpool(void)
+{
+	init_unit_tests("Testing the thread pool");
+
+	seqfpoolfree();
+	mu_assert("Create pool", seqfpoolcreate(3, true) == 0 && seqfpoolthreads() == 3);
+	mu_assert("Pool already running", seqfpoolcreate(2, false) == -1);
+
+	size_t out[200];
+	bool passed = true;
+	SeqfTaskGroup group = seqftaskgroup();
+	for(size_t i = 0; i < 200; i++) {
+		out[i] = i;
+		passed = passed && seqfsubmit(group, square_task, &out[i]) == 0;
+	}
+	seqfwait(group);
+	for(size_t i = 0; i < 200; i++)
+		passed = passed && out[i] == i * i;
+	mu_assert("Wait for group of tasks", passed);
+
+	/* Tasks waiting for their own tasks, deeper than there are workers */
+	struct pool_range all = {out, 0, 200};
+	seqfsubmit(group, split_task, &all);
+	seqftaskgroupfree(group);
+	passed = true;
+	for(size_t i = 0; i < 200; i++)
+		passed = passed && out[i] == i;
+	mu_assert("Nested groups of tasks", passed);
+
+	/* Several pipelined files share the workers */
+	char expected[4096], got[4096];
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_READS), "s");
+	SeqFile gz[4];
+	for(int i = 0; i < 4; i++)
+		gz[i] = seqfopen(TXT2STR(EXAMPLE_READS_GZ), "st");
+	passed = true;
+	while(seqfgets(plain, expected, sizeof expected) != NULL) {
+		for(int i = 0; i < 4; i++)
+			if(seqfgets(gz[i], got, sizeof got) == NULL || strcmp(expected, got) != 0)
+				passed = false;
+	}
+	for(int i = 0; i < 4; i++)
+		seqfclose(gz[i]);
+	seqfclose(plain);
+	mu_assert("Files read on the same pool", passed);
+	seqfpoolfree();
+
+	unit_tests_end;
+}
+
+/* Allocator counting the blocks it hands out, from any thread */
+struct counting_allocator {
+	mtx_t mutex;
+	long live, calls;
+};
+
+static void *
+count_alloc(size_t size, void *opaque)
+{
+	struct counting_allocator *c = opaque;
+	void *ptr = malloc(size);
+	mtx_lock(&c->mutex);
+	c->live += ptr != NULL;
+	c->calls++;
+	mtx_unlock(&c->mutex);
+	return ptr;
+}
+
+static void *
+count_resize(void *ptr, size_t size, void *opaque)
+{
+	struct counting_allocator *c = opaque;
+	void *t = realloc(ptr, size);
+	mtx_lock(&c->mutex);
+	c->live += ptr == NULL && t != NULL;
+	c->calls++;
+	mtx_unlock(&c->mutex);
+	return t;
+}
+
+static void
+count_release(void *ptr, void *opaque)
+{
+	struct counting_allocator *c = opaque;
+	free(ptr);
+	mtx_lock(&c->mutex);
+	c->live--;
+	c->calls++;
+	mtx_unlock(&c->mutex);
+}
+
+static UTEST_TYPE
+test_seqfallocator(void)
+{
+	init_unit_tests("Testing seqfsetallocator");
+
+	SeqfAllocator bad = {count_alloc, NULL, count_release, NULL};
+	mu_assert("Reject incomplete allocator", seqfsetallocator(&bad) == -1);
+
+	struct counting_allocator counter = {.live = 0, .calls = 0};
+	mtx_init(&counter.mutex, mtx_plain);
+	SeqfAllocator allocator = {count_alloc, count_resize, count_release, &counter};
+	seqfpoolfree();
+	mu_assert("Set allocator", seqfsetallocator(&allocator) == 0);
+
+	/* A pipelined file, its pool, and a batch */
+	SeqfBatch batch = {0};
+	size_t nrecords = 0, n;
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTQ_GZ), "qt");
+	while((n = seqfnextbatch(file, &batch, 2)) != 0)
+		nrecords += n;
+	mu_assert("Read through allocator", nrecords == 6 && counter.calls > 0 &&
+	  counter.live > 0);
+	seqfbatchfree(&batch);
+	seqfclose(file);
+	seqfpoolfree();
+	mu_assert("Everything released through allocator", counter.live == 0);
+	mu_assert("Restore allocator", seqfsetallocator(NULL) == 0);
+	mtx_destroy(&counter.mutex);
+
+	/* Large output buffer on huge pages */
+	char expected[4096], got[4096];
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_READS), "s");
+	file = seqfopen(TXT2STR(EXAMPLE_READS_GZ), "s");
+	seqf_statep state = (seqf_statep)file;
+	mu_assert("Huge output buffer", seqfsethugepages(file, true) == 0 &&
+	  seqfsetobuf(file, 3 << 20) == 0 && state->out_bufsiz == 3 << 20);
+	bool passed = true;
+	while(seqfgets(plain, expected, sizeof expected) != NULL)
+		if(seqfgets(file, got, sizeof got) == NULL || strcmp(expected, got) != 0)
+			passed = false;
+	mu_assert("Read into huge output buffer", passed);
+	seqfclose(plain);
+	seqfclose(file);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfrange(void)
+{
+	init_unit_tests("Testing byte ranges");
+
+	char expected[1000], got[1000];
+	bool passed = true;
+	FILE *fp = fopen(TXT2STR(EXAMPLE_READS), "rb");
+	fseek(fp, 0, SEEK_END);
+	size_t size = ftell(fp);
+	fclose(fp);
+
+	/* Split at offsets that fall in the middle of records */
+	size_t cuts[] = {0, size/3, 2*size/3 + 1, size};
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_READS), "s");
+	for(int i=0; i<3 && passed; i++) {
+		SeqFile part = seqfopen_range(TXT2STR(EXAMPLE_READS), "s", cuts[i], cuts[i+1]);
+		if(part == NULL) {
+			passed = false;
+			break;
+		}
+		while(seqfgets(part, got, sizeof got) != NULL) {
+			if(seqfgets(plain, expected, sizeof expected) == NULL || strcmp(expected, got) != 0) {
+				passed = false;
+				break;
+			}
+		}
+		seqfclose(part);
+	}
+	mu_assert("Ranges cover every record once", passed &&
+	  seqfgets(plain, expected, sizeof expected) == NULL);
+	seqfclose(plain);
+
+	/* A range starting inside the first record begins at the second one */
+	SeqFile part = seqfopen_range(TXT2STR(EXAMPLE_FASTQ), "qu", 1, 1000);
+	seqfgets(part, expected, sizeof expected);
+	mu_assert("Range starts at the next record",
+	  strcmp(expected, "GATCTANNNNNAGTGTGTA") == 0);
+	seqfrewind(part);
+	mu_assert("Rewind returns to the start of the range",
+	  seqfgets(part, got, sizeof got) != NULL && strcmp(expected, got) == 0);
+	seqfclose(part);
+
+	/* Cut FASTQ anywhere, including next to the quality line that is a lone
+	   '@', and every record still comes back once */
+	char names[1000] = "", parts[1000];
+	SeqfRecord rec;
+	plain = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	while(seqfnextrec(plain, &rec) == 0)
+		sprintf(names + strlen(names), "%.*s\n", (int)rec.name_len, rec.name);
+	seqfclose(plain);
+	fp = fopen(TXT2STR(EXAMPLE_FASTQ), "rb");
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fclose(fp);
+	const size_t gaps[3] = {1, 17, 60};
+	passed = true;
+	for(size_t c = 1; c < size && passed; c++) {
+		for(int g = 0; g < 3 && passed; g++) {
+			size_t fqcuts[4] = {0, c, c + gaps[g] < size ? c + gaps[g] : size, size};
+			parts[0] = '\0';
+			for(int i = 0; i < 3 && passed; i++) {
+				part = seqfopen_range(TXT2STR(EXAMPLE_FASTQ), "q", fqcuts[i], fqcuts[i+1]);
+				if(part == NULL) {
+					passed = false;
+					break;
+				}
+				while(seqfnextrec(part, &rec) == 0 && strlen(parts) + rec.name_len + 2 < sizeof parts)
+					sprintf(parts + strlen(parts), "%.*s\n", (int)rec.name_len, rec.name);
+				seqfclose(part);
+			}
+			passed = passed && strcmp(parts, names) == 0;
+		}
+	}
+	mu_assert("FASTQ ranges cover every record once", passed && strstr(names, "SEQ_ID_6") != NULL);
+
+	part = seqfopen_range(TXT2STR(EXAMPLE_FASTQ_GZ), "q", 0, 100);
+	mu_assert("Compressed files cannot be split", part == NULL && seqferrno == 12);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfnextrec(void)
+{
+	init_unit_tests("Testing seqfnextrec");
+
+	SeqfRecord rec;
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	mu_assert("Read first fastq record", seqfnextrec(file, &rec) == 0 &&
+	  rec.name_len == 8 && memcmp(rec.name, "SEQ_ID_1", 8) == 0 &&
+	  rec.comment == NULL && rec.seq_len == 24 &&
+	  memcmp(rec.seq, "GATTTGGGGTTTAAATGGAAGAAA", 24) == 0 &&
+	  rec.qual_len == 24 && memcmp(rec.qual, "IIIIIIIIIIIIIIIIIIIIIIII", 24) == 0);
+	mu_assert("Record points into the internal buffer",
+	  (const unsigned char *)rec.seq > ((seqf_statep)file)->map);
+
+	/* Compare every record with seqfgets, through a tiny output buffer so
+	   that records straddle fetches */
+	char expected[20000];
+	bool passed = true;
+	seqfclose(file);
+	file = seqfopen(TXT2STR(EXAMPLE_FASTQ), "qu");
+	seqfsetobuf(file, 64);
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	int nrec = 0;
+	while(seqfnextrec(file, &rec) == 0) {
+		nrec++;
+		if(seqfgets(plain, expected, sizeof expected) == NULL ||
+		  strlen(expected) != rec.seq_len ||
+		  memcmp(expected, rec.seq, rec.seq_len) != 0) {
+			passed = false;
+			break;
+		}
+	}
+	mu_assert("Records across fetches match seqfgets", passed && nrec == 6 &&
+	  seqfeof(file));
+	seqfclose(plain);
+	seqfclose(file);
+
+	/* Multiline fasta sequences are joined */
+	file = seqfopen(TXT2STR(EXAMPLE_FASTA_GZ), "a");
+	seqfnextrec(file, &rec);
+	seqfnextrec(file, &rec);
+	seqfnextrec(file, &rec);
+	mu_assert("Multiline fasta record", rec.name_len == 26 &&
+	  rec.seq_len == 103 && rec.qual == NULL &&
+	  memcmp(rec.seq + 100, "GAC", 3) == 0);
+	seqfnextrec(file, &rec);
+	mu_assert("Last fasta record", seqfnextrec(file, &rec) == 0 &&
+	  rec.seq_len == 7 && memcmp(rec.seq, "TAGAGGC", 7) == 0);
+	mu_assert("No record after the last", seqfnextrec(file, &rec) == EOF);
+	seqfclose(file);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfnextbatch(void)
+{
+	init_unit_tests("Testing seqfnextbatch");
+
+	SeqfBatch batch = {0};
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	mu_assert("Read a full batch", seqfnextbatch(file, &batch, 4) == 4);
+	mu_assert("Fields of the first record",
+	  strcmp(batch.data + batch.name_off[0], "SEQ_ID_1") == 0 &&
+	  batch.seq_len[0] == 24 && batch.qual_len[0] == 24 &&
+	  strcmp(batch.data + batch.seq_off[0], "GATTTGGGGTTTAAATGGAAGAAA") == 0);
+	mu_assert("Fields of the last record",
+	  strcmp(batch.data + batch.name_off[3], "SEQ_ID_4") == 0 &&
+	  strcmp(batch.data + batch.qual_off[3], "!~^!~^!~^!~^") == 0);
+
+	mu_assert("Read the rest of the file", seqfnextbatch(file, &batch, 4) == 2 &&
+	  strcmp(batch.data + batch.seq_off[0], "T") == 0);
+	mu_assert("Empty batch at end of file", seqfnextbatch(file, &batch, 4) == 0 &&
+	  batch.nrecords == 0);
+
+	/* A batch that is large enough is reused as is */
+	char *data = batch.data;
+	size_t *name_off = batch.name_off;
+	seqfrewind(file);
+	mu_assert("Reuse batch without allocating", seqfnextbatch(file, &batch, 4) == 4 &&
+	  batch.data == data && batch.name_off == name_off);
+	seqfclose(file);
+
+	seqfbatchfree(&batch);
+	mu_assert("Free batch", batch.data == NULL && batch.capacity == 0);
+
+	unit_tests_end;
+}
+
+/* Check every base of `seq' against the ASCII sequence `ascii' of length `len' */
+static bool
+packed_matches(const SeqfPacked *seq, const char *ascii, size_t len)
+{
+	if(seq->len != len)
+		return false;
+	size_t run = 0;
+	for(size_t i = 0; i < len; i++) {
+		int code = (int)(seq->words[i / 32] >> (2 * (i % 32)) & 3);
+		const char *base = strchr("ACGT", toupper((unsigned char)ascii[i]));
+		while(run < seq->nruns && seq->run_start[run] + seq->run_len[run] <= i)
+			run++;
+		bool ambig = run < seq->nruns && seq->run_start[run] <= i;
+		bool valid = ascii[i] != '\0' && base != NULL;
+		if(valid ? ambig || code != base - "ACGT" : !ambig || code != 0)
+			return false;
+	}
+	return true;
+}
+
+static UTEST_TYPE
+test_seqfgets2b(void)
+{
+	init_unit_tests("Testing seqfgets2b");
+
+	SeqfPacked seq = {0};
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	mu_assert("Pack first sequence", seqfgets2b(file, &seq) == 0 &&
+	  packed_matches(&seq, "GATTTGGGGTTTAAATGGAAGAAA", 24) && seq.nruns == 0);
+	mu_assert("Run of N's", seqfgets2b(file, &seq) == 0 &&
+	  packed_matches(&seq, "GATCTANNNNNAGTGTGTA", 19) && seq.nruns == 1 &&
+	  seq.run_start[0] == 6 && seq.run_len[0] == 5);
+	seqfclose(file);
+
+	/* Long multi-line sequences pack like their ASCII records */
+	bool same = true;
+	size_t nrecords = 0;
+	SeqfRecord rec;
+	SeqFile ascii = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	file = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	while(seqfnextrec(ascii, &rec) == 0 && same) {
+		same = seqfgets2b(file, &seq) == 0 && packed_matches(&seq, rec.seq, rec.seq_len);
+		nrecords++;
+	}
+	mu_assert("Fasta records pack like their sequences", same && nrecords > 0);
+	mu_assert("EOF after last record", seqfgets2b(file, &seq) == EOF);
+	seqfclose(ascii);
+	seqfclose(file);
+
+	seqfpackedfree(&seq);
+	mu_assert("Free packed sequence", seq.words == NULL && seq.runs_size == 0);
+
+	unit_tests_end;
+}
+
+/* Canonical k-mer of `seq' at `i', or UINT64_MAX if it holds a base other than ACGT */
+static uint64_t
+canonical_kmer(const char *seq, size_t i, int k)
+{
+	uint64_t fwd = 0, rev = 0;
+	for(int j = 0; j < k; j++) {
+		const char *base = strchr("ACGT", toupper((unsigned char)seq[i + j]));
+		if(seq[i + j] == '\0' || base == NULL)
+			return UINT64_MAX;
+		fwd = fwd << 2 | (uint64_t)(base - "ACGT");
+		rev |= (uint64_t)(3 - (base - "ACGT")) << 2*j;
+	}
+	return rev < fwd ? rev : fwd;
+}
+
+static UTEST_TYPE
+test_seqfkmer(void)
+{
+	init_unit_tests("Testing seqfkmer");
+
+	SeqfKmerIter it;
+	uint64_t kmers[64];
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	mu_assert("Reject k over 32", seqfkmerinit(&it, file, 33, false) == 1 && seqferrno == 8);
+	mu_assert("Set up iterator", seqfkmerinit(&it, file, 3, false) == 0);
+	mu_assert("K-mers of first record", seqfkmernext(&it, kmers, 22) == 22 &&
+	  kmers[0] == 35 /* GAT */ && kmers[21] == 0 /* AAA */);
+	mu_assert("Restart after N's", seqfkmernext(&it, kmers, 10) == 10 &&
+	  kmers[3] == 28 /* CTA */ && kmers[4] == 11 /* AGT */);
+	seqfclose(file);
+
+	/* Canonical k-mers match those computed from each whole record */
+	bool same = true;
+	size_t nkmers = 0;
+	SeqfRecord rec;
+	SeqFile ascii = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	file = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	seqfkmerinit(&it, file, 21, true);
+	size_t n = 0, next = 0;
+	while(same && seqfnextrec(ascii, &rec) == 0) {
+		for(size_t i = 0; same && i + 21 <= rec.seq_len; i++) {
+			uint64_t kmer = canonical_kmer(rec.seq, i, 21);
+			if(kmer == UINT64_MAX)
+				continue;
+			if(next == n) {
+				n = seqfkmernext(&it, kmers, 64);
+				next = 0;
+			}
+			same = next < n && kmers[next++] == kmer;
+			nkmers++;
+		}
+	}
+	mu_assert("Canonical k-mers of fasta file", same && nkmers > 0 && next == n);
+	mu_assert("No k-mers after end of file", seqfkmernext(&it, kmers, 64) == 0);
+	seqfclose(ascii);
+	seqfclose(file);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfreadnt(void)
+{
+	init_unit_tests("Testing seqfreadnt");
+
+	char buffer[100];
+	size_t breaks[4], nbreaks = 4;
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	mu_assert("Sequences without headers or qualities",
+	  seqfreadnt(file, buffer, 43, breaks, &nbreaks) == 43 &&
+	  memcmp(buffer, "GATTTGGGGTTTAAATGGAAGAAAGATCTANNNNNAGTGTGTA", 43) == 0);
+	mu_assert("Record ends", nbreaks == 1 && breaks[0] == 24);
+	nbreaks = 4;
+	mu_assert("End of record continued from last call",
+	  seqfreadnt(file, buffer, sizeof buffer, breaks, &nbreaks) > 0 &&
+	  nbreaks > 0 && breaks[0] == 0);
+	seqfclose(file);
+
+	/* The stream holds the sequences of seqfnextrec, one after the other */
+	SeqfRecord rec;
+	SeqFile ascii = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	file = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	bool same = true;
+	size_t nrecords = 0, ends = 0, have = 0, pos = 0;
+	while(same && seqfnextrec(ascii, &rec) == 0) {
+		for(size_t i = 0; same && i < rec.seq_len; i++) {
+			if(pos == have) {
+				nbreaks = 4;
+				have = seqfreadnt(file, buffer, sizeof buffer, breaks, &nbreaks);
+				ends += nbreaks;
+				pos = 0;
+			}
+			same = pos < have && buffer[pos++] == rec.seq[i];
+		}
+		nrecords++;
+	}
+	nbreaks = 4;
+	ends += pos == have && seqfreadnt(file, buffer, sizeof buffer, breaks, &nbreaks) == 0 ? nbreaks : 0;
+	mu_assert("Fasta sequences streamed", same && nrecords > 0 && ends == nrecords);
+	seqfclose(ascii);
+	seqfclose(file);
+
+	unit_tests_end;
+}
+
+/* A consumer of a shared file, counting the records and batches it claims */
+struct share_consumer {
+	SeqFile file;
+	size_t records;
+	bool seen[64];
+	bool passed;
+};
+
+static int
+consume_shared(void *arg)
+{
+	struct share_consumer *c = arg;
+	const SeqfBatch *batch;
+	size_t seqno;
+	while((batch = seqfclaimbatch(c->file, &seqno)) != NULL) {
+		if(seqno >= 64 || batch->nrecords == 0)
+			c->passed = false;
+		else
+			c->seen[seqno] = true;
+		c->records += batch->nrecords;
+		seqfreturnbatch(c->file, batch);
+	}
+	return 0;
+}
+
+static UTEST_TYPE
+test_seqfshared(void)
+{
+	init_unit_tests("Testing seqfsetshared");
+
+	SeqfRecord rec;
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_READS), "s");
+	size_t expected = 0;
+	while(seqfnextrec(file, &rec) == 0)
+		expected++;
+	seqfrewind(file);
+
+	mu_assert("Claim needs shared mode", seqfclaimbatch(file, NULL) == NULL &&
+	  seqferrno == 8);
+	mu_assert("Share file", seqfsetshared(file, 2, 3) == 0);
+
+	bool passed = true;
+	for(int pass = 0; pass < 2; pass++) {
+		struct share_consumer c[3] = {0};
+		thrd_t threads[3];
+		for(int i = 0; i < 3; i++) {
+			c[i].file = file;
+			c[i].passed = true;
+			thrd_create(&threads[i], consume_shared, &c[i]);
+		}
+		size_t records = 0, nbatches = 0;
+		for(int i = 0; i < 3; i++) {
+			thrd_join(threads[i], NULL);
+			records += c[i].records;
+			passed = passed && c[i].passed;
+		}
+
+		/* Every batch is claimed by exactly one thread, numbered in order */
+		for(size_t seqno = 0; seqno < 64; seqno++) {
+			int claims = c[0].seen[seqno] + c[1].seen[seqno] + c[2].seen[seqno];
+			if(claims > 1 || (claims == 1 && seqno != nbatches))
+				passed = false;
+			nbatches += claims;
+		}
+		passed = passed && records == expected && nbatches == (expected + 2) / 3;
+		seqfrewind(file);
+	}
+	mu_assert("Consumers claim every record once, after rewind too", passed);
+	mu_assert("Stop sharing file", seqfsetshared(file, 0, 0) == 0 &&
+	  seqfnextrec(file, &rec) == 0);
+	seqfclose(file);
+
+	file = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	mu_assert("Share fastq file", seqfsetshared(file, 4, 0) == 0);
+	size_t seqno;
+	const SeqfBatch *batch = seqfclaimbatch(file, &seqno);
+	mu_assert("Whole file in one default batch", batch != NULL && seqno == 0 &&
+	  batch->nrecords == 6 && strcmp(batch->data + batch->name_off[0], "SEQ_ID_1") == 0);
+	seqfreturnbatch(file, batch);
+	mu_assert("No batch at end of file", seqfclaimbatch(file, &seqno) == NULL &&
+	  seqferrno == 0);
+	seqfclose(file);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfread_borrow(void)
+{
+	init_unit_tests("Testing seqfread_borrow");
+
+	/* Whole file, to compare the borrowed records with */
+	static char whole[1 << 16];
+	FILE *fp = fopen(TXT2STR(EXAMPLE_FASTQ), "rb");
+	size_t size = fread(whole, 1, sizeof whole, fp);
+	fclose(fp);
+
+	const char *ptr;
+	size_t len;
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	mu_assert("Borrow from mapped file", seqfread_borrow(file, &ptr, &len) == 0 &&
+	  ptr[0] == '@' && len > 0 && ptr[len-1] == '\n' && memcmp(ptr, whole, len) == 0);
+	mu_assert("Borrow again without release", seqfread_borrow(file, &ptr, &len) == 0 &&
+	  ptr[0] == '@');
+	seqfclose(file);
+
+	/* A small buffer ends within records, which are gathered one by one */
+	const char *modes[2] = {"q", "qu"};
+	for(int m = 0; m < 2; m++) {
+		file = seqfopen(TXT2STR(EXAMPLE_FASTQ), modes[m]);
+		seqfsetobuf(file, 64);
+		bool same = true, aligned = true;
+		size_t pos = 0;
+		while(seqfread_borrow(file, &ptr, &len) == 0) {
+			same = same && pos + len <= size && memcmp(ptr, whole + pos, len) == 0;
+			aligned = aligned && ptr[0] == '@';
+			pos += len;
+			seqfread_release(file);
+		}
+		mu_assert(m ? "Unmapped records borrowed in order" : "Mapped records borrowed in order",
+		  same && aligned && pos == size);
+		seqfclose(file);
+	}
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfobufmax(void)
+{
+	init_unit_tests("Testing seqfsetobufmax");
+
+	/* The last record of the file does not fit in a 1 KiB output buffer */
+	static char whole[12000], buf[12000];
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_FASTQ), "b");
+	size_t size = seqfread(plain, whole, sizeof whole);
+	seqfclose(plain);
+
+	SeqFile file = seqfopen(TXT2STR(EXAMPLE_FASTQ_GZ), "q");
+	seqf_statep state = (seqf_statep)file;
+	seqfsetobuf(file, 1024);
+	size_t first = seqfqread(file, buf, 11000);
+	mu_assert("Output buffer grows for a straddling record", first > 0 &&
+	  memcmp(buf, whole, first) == 0 && state->out_bufsiz == 16384);
+	size_t second = seqfqread(file, buf, sizeof buf);
+	mu_assert("Straddling record is read next", first + second == size &&
+	  memcmp(buf, whole + first, second) == 0);
+
+	/* Small records in a row give the memory back */
+	bool passed = true;
+	for(int i = 0; i < 64; i++) {
+		seqfrewind(file);
+		passed = passed && seqfqread(file, buf, 150) > 0;
+	}
+	mu_assert("Output buffer shrinks back", passed && state->out_bufsiz == 1024);
+
+	seqfsetobufmax(file, 4096);
+	seqfrewind(file);
+	mu_assert("Output buffer does not grow past the maximum",
+	  seqfqread(file, buf, 11000) == 0 && seqferrno == 5 && state->out_bufsiz == 1024);
+	seqfclose(file);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfgetseq(void)
+{
+	init_unit_tests("Testing seqfgetseq");
+
+	/* Compare with seqfnextrec, which never truncates either */
+	const char *paths[3] = {TXT2STR(EXAMPLE_FASTA), TXT2STR(EXAMPLE_FASTQ_GZ), TXT2STR(EXAMPLE_READS)};
+	const char *modes[3] = {"a", "q", "s"};
+	bool whole = true, parts = true;
+	size_t longest = 0;
+	char *buf = NULL, part[7];
+	size_t cap = 0, len;
+	for(int i = 0; i < 3; i++) {
+		SeqFile file = seqfopen(paths[i], modes[i]);
+		SeqFile ref = seqfopen(paths[i], modes[i]);
+		SeqFile stream = seqfopen(paths[i], modes[i]);
+		SeqfRecord rec;
+		while(seqfnextrec(ref, &rec) == 0) {
+			whole = whole && seqfgetseq(file, &buf, &cap, &len) == 0 && len == rec.seq_len &&
+			  memcmp(buf, rec.seq, len) == 0 && buf[len] == '\0';
+			if(len > longest)
+				longest = len;
+
+			size_t pos = 0;
+			bool more = true;
+			while(parts && more) {
+				parts = seqfgetseqpart(stream, part, sizeof part, &len, &more) == 0 &&
+				  pos + len <= rec.seq_len && memcmp(part, rec.seq + pos, len) == 0;
+				pos += len;
+			}
+			parts = parts && pos == rec.seq_len;
+		}
+		whole = whole && seqfgetseq(file, &buf, &cap, &len) == EOF;
+		parts = parts && seqfgetseqpart(stream, part, sizeof part, &len, &(bool){0}) == EOF;
+		seqfclose(file);
+		seqfclose(ref);
+		seqfclose(stream);
+	}
+	free(buf);
+	mu_assert("Whole sequences match seqfnextrec", whole && longest > SEQFBUFSIZ && cap > longest);
+	mu_assert("Sequences in parts match seqfnextrec", parts);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfstats(void)
+{
+	init_unit_tests("Testing seqfgetstats");
+
+	/* Plain files are mapped, so nothing is read() */
+	SeqfStats st;
+	SeqfRecord rec;
+	uint64_t nrecords = 0;
+	SeqFile plain = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	while(seqfnextrec(plain, &rec) == 0)
+		nrecords++;
+	mu_assert("Get stats", seqfgetstats(plain, &st) == 0);
+	mu_assert("Plain bytes and records are counted", st.bytes_in == 11493 &&
+	  st.bytes_out == 11493 && st.records == nrecords && nrecords != 0);
+	mu_assert("Times are not kept by default", st.read_ns == 0 &&
+	  st.inflate_ns == 0 && st.parse_ns == 0 && st.lock_ns == 0);
+	seqfclose(plain);
+
+	/* Inline decompression, timed */
+	char buffer[256];
+	SeqFile gz = seqfopen(TXT2STR(EXAMPLE_FASTQ_GZ), "q");
+	mu_assert("Enable timing", seqfsettiming(gz, true) == 0);
+	uint64_t ngets = 0;
+	while(seqfgets(gz, buffer, sizeof buffer) != NULL)
+		ngets++;
+	seqfgetstats(gz, &st);
+	mu_assert("Compressed bytes are counted", st.bytes_in == 4747 &&
+	  st.bytes_out == 11493 && st.reads != 0 && st.fetches != 0);
+	mu_assert("Gets records and copies are counted",
+	  st.records == nrecords && ngets == nrecords && st.bytes_copied != 0);
+	mu_assert("Timing is kept", st.inflate_ns != 0 && st.parse_ns != 0);
+	seqfclose(gz);
+
+	/* Blocks decompressed in the background are counted by the reader */
+	SeqFile bgzf = seqfopen(TXT2STR(EXAMPLE_FASTQ_BGZ), "q");
+	seqfsetpipeline(bgzf, 2);
+	uint64_t nnt = 0;
+	while(seqfreadnt(bgzf, buffer, sizeof buffer, NULL, NULL) != 0)
+		nnt++;
+	seqfgetstats(bgzf, &st);
+	mu_assert("Background bytes are counted", st.bytes_in == 4840 &&
+	  st.bytes_out == 11493 && st.records == nrecords && nnt != 0);
+	seqfclose(bgzf);
+
+	mu_assert("Reject NULL", seqfgetstats(NULL, &st) == -1 &&
+	  seqfgetstats((SeqFile)&st, NULL) == -1 && seqfsettiming(NULL, true) == -1);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfpaired(void)
+{
+	init_unit_tests("Testing seqfopen_paired");
+
+	/* The same reads, plain, gzip and BGZF, are mates of each other */
+	const char *paths[3] = {TXT2STR(EXAMPLE_FASTQ), TXT2STR(EXAMPLE_FASTQ_GZ), TXT2STR(EXAMPLE_FASTQ_BGZ)};
+	SeqfPaired paired = seqfopen_paired(paths, 3, "q");
+	mu_assert("Open three files in step", paired != NULL);
+	mu_assert("Enable the name check", seqfsetpairedcheck(paired, true) == 0);
+	SeqFile ref = seqfopen(paths[0], "q");
+	SeqfBatch batches[3] = {{0}}, expect = {0};
+	bool same = true;
+	size_t n, total = 0;
+	while((n = seqfnextpaired(paired, batches, 3)) != 0) {
+		same = same && seqfnextbatch(ref, &expect, 3) == n;
+		for(int i = 0; i < 3; i++)
+			same = same && batches[i].data_len == expect.data_len &&
+			  memcmp(batches[i].data, expect.data, expect.data_len) == 0;
+		total += n;
+	}
+	mu_assert("Mates match the records of each file", same && total != 0 &&
+	  seqfnextbatch(ref, &expect, 3) == 0 && seqferrno == 0);
+	mu_assert("Files of the tuple are accessible",
+	  seqfpairedfile(paired, 2) != NULL && seqfpairedfile(paired, 3) == NULL);
+	mu_assert("Close files in step", seqfclose_paired(paired) == 0);
+	seqfclose(ref);
+
+	/* Files that end apart are out of step */
+	const char *uneven[2] = {TXT2STR(EXAMPLE_FASTQ), TXT2STR(EXAMPLE_FASTQ)};
+	paired = seqfopen_paired(uneven, 2, "q");
+	seqfnextbatch_unlocked(seqfpairedfile(paired, 1), &expect, 1);
+	while(seqfnextpaired(paired, batches, 1000) != 0)
+		;
+	mu_assert("Files that end apart are out of step", seqferrno == 9);
+	seqferrno = 0;
+	seqfclose_paired(paired);
+
+	/* Mates named apart are out of step, but only when checked */
+	const char *named[2] = {"paired_r1.fastq", "paired_r2.fastq"};
+	FILE *fp = fopen(named[0], "w");
+	fputs("@read/1\nACGT\n+\nIIII\n@read2/1\nACGT\n+\nIIII\n", fp);
+	fclose(fp);
+	fp = fopen(named[1], "w");
+	fputs("@read/2\nACGT\n+\nIIII\n@other/2\nACGT\n+\nIIII\n", fp);
+	fclose(fp);
+	paired = seqfopen_paired(named, 2, "q");
+	mu_assert("Mate suffixes are ignored", seqfnextpaired(paired, batches, 1) == 1);
+	mu_assert("Unchecked names are not compared", seqfnextpaired(paired, batches, 1) == 1);
+	seqfclose_paired(paired);
+	paired = seqfopen_paired(named, 2, "q");
+	seqfsetpairedcheck(paired, true);
+	mu_assert("Mates named apart are out of step", seqfnextpaired(paired, batches, 2) == 0 &&
+	  seqferrno == 9);
+	seqferrno = 0;
+	seqfclose_paired(paired);
+	remove(named[0]);
+	remove(named[1]);
+
+	mu_assert("Missing file fails to open",
+	  seqfopen_paired((const char *[]){paths[0], "non-existent-file"}, 2, "q") == NULL);
+	seqferrno = 0;
+
+	for(int i = 0; i < 3; i++)
+		seqfbatchfree(&batches[i]);
+	seqfbatchfree(&expect);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfwrite(void)
+{
+	init_unit_tests("Testing seqfputrec");
+
+	/* Each writer gets the example reads many times over, so that the
+	   compressed ones fill several blocks. The last read is malformed, its
+	   quality is shorter than its sequence, and is left out */
+	const char *modes[3] = {"wq", "wqg", "wqz1"};
+	const char *names[3] = {"write_out.fastq", "write_out.fastq.gz", "write_out.fastq.bgz"};
+	const int copies = 3000;
+	SeqFile in = seqfopen(TXT2STR(EXAMPLE_FASTQ), "q");
+	SeqfRecord rec, back;
+	for(int m = 0; m < 3; m++) {
+		SeqFile out = seqfopen(names[m], modes[m]);
+		mu_assert("Open a file for writing", out != NULL);
+		if(m > 0)
+			mu_assert("Set the blocks being compressed", seqfsetpipeline(out, 2) == 0);
+		bool wrote = true;
+		for(int c = 0; c < copies; c++) {
+			seqfrewind(in);
+			while(seqfnextrec(in, &rec) == 0)
+				if(rec.qual_len == rec.seq_len)
+					wrote = wrote && seqfputrec(out, &rec) == 0;
+			if(c == copies / 2)
+				wrote = wrote && seqfflush(out) == 0;
+		}
+		mu_assert("Write every record", wrote && seqferrno == 0);
+		mu_assert("Close the written file", seqfclose(out) == 0);
+	}
+
+	/* Whatever was written reads back as the records it was given */
+	for(int m = 0; m < 3; m++) {
+		SeqFile written = seqfopen(names[m], "q");
+		bool same = true;
+		for(int c = 0; c < copies; c++) {
+			seqfrewind(in);
+			while(seqfnextrec(in, &rec) == 0) {
+				if(rec.qual_len != rec.seq_len)
+					continue;
+				same = same && seqfnextrec(written, &back) == 0 &&
+				  back.name_len == rec.name_len && back.seq_len == rec.seq_len &&
+				  back.qual_len == rec.qual_len &&
+				  memcmp(back.name, rec.name, rec.name_len) == 0 &&
+				  memcmp(back.seq, rec.seq, rec.seq_len) == 0 &&
+				  memcmp(back.qual, rec.qual, rec.qual_len) == 0;
+			}
+		}
+		mu_assert("Records read back as written", same &&
+		  seqfnextrec(written, &back) == EOF && seqferrno == 0);
+		seqfclose(written);
+	}
+
+	/* The "z" file is made of BGZF members */
+	unsigned char header[18] = {0};
+	FILE *fp = fopen(names[2], "rb");
+	mu_assert("Read the BGZF header", fp != NULL && fread(header, 1, 18, fp) == 18);
+	fclose(fp);
+	mu_assert("BGZF members carry their size", header[0] == 0x1f && header[1] == 0x8b &&
+	  (header[3] & 4) && header[12] == 'B' && header[13] == 'C');
+
+	/* Raw bytes are written as they are */
+	SeqFile out = seqfopen(names[0], "wsg");
+	mu_assert("Write raw bytes", seqfwrite(out, "ACGT\nTTGA\n", 10) == 10);
+	mu_assert("Raw bytes are flushed", seqfclose(out) == 0);
+	SeqFile written = seqfopen(names[0], "s");
+	mu_assert("Raw bytes read back", seqfnextrec(written, &back) == 0 &&
+	  back.seq_len == 4 && memcmp(back.seq, "ACGT", 4) == 0);
+	seqfclose(written);
+
+	/* Writers and readers do not mix */
+	out = seqfopen(names[0], "wq");
+	rec = (SeqfRecord){.name = "r", .name_len = 1, .seq = "ACGT", .seq_len = 4,
+	  .qual = "II", .qual_len = 2};
+	mu_assert("Quality must be as long as the sequence",
+	  seqfputrec(out, &rec) == EOF && seqferrno == 8);
+	seqferrno = 0;
+	mu_assert("Writers cannot be read", seqfnextrec(out, &back) == EOF);
+	seqferrno = 0;
+	mu_assert("Writers cannot be rewound", seqfrewind(out) == -1 && seqferrno == 12);
+	seqferrno = 0;
+	seqfclose(out);
+	mu_assert("Readers cannot be written", seqfwrite(in, "A", 1) == 0 && seqferrno == 12);
+	mu_assert("Unsupported operations have a message",
+	  strcmp(seqfstrerror(seqferrno), "Operation not supported on this file") == 0);
+	seqferrno = 0;
+	mu_assert("Compression needs a writer", seqfopen(names[0], "qg") == NULL);
+	seqferrno = 0;
+	seqfclose(in);
+
+	for(int m = 0; m < 3; m++)
+		remove(names[m]);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfcache(void)
+{
+	init_unit_tests("Testing seqfcache");
+
+	/* More reads than fit in one block of the cache, with runs of N's and
+	   other bytes in some of them */
+	const char *fq = "cache_in.fastq", *cache = "cache_out.sqfc";
+	FILE *fp = fopen(fq, "w");
+	for(int i = 0; i < 5000; i++) {
+		const char *seq = i % 7 == 0 ? "ACGTNNNNACGTRYA" : i % 5 == 0 ? "N" : "GATTACAGATTACAT";
+		size_t len = strlen(seq) > 2 ? strlen(seq) - (size_t)(i % 3) : strlen(seq);
+		fprintf(fp, "@read%d%s\n%.*s\n+\n%.*s\n", i, i % 2 ? " some comment" : "",
+		  (int)len, seq, (int)len, "!#'05:?CFIIIIII");
+	}
+	fclose(fp);
+
+	SeqFile in = seqfopen(fq, "q");
+	mu_assert("Write the cache", seqfcache(in, cache, false) == 0);
+	seqfclose(in);
+	SeqFile c = seqfopen(cache, "a");
+	mu_assert("Open the cache", c != NULL && seqfnrecords(c) == 5000);
+
+	/* Records read back as they were, whatever type the mode gave */
+	in = seqfopen(fq, "q");
+	SeqfRecord rec, back;
+	bool same = true;
+	while(seqfnextrec(in, &rec) == 0) {
+		same = same && seqfnextrec(c, &back) == 0 &&
+		  back.name_len == rec.name_len && memcmp(back.name, rec.name, rec.name_len) == 0 &&
+		  back.comment_len == rec.comment_len &&
+		  (rec.comment_len == 0 || memcmp(back.comment, rec.comment, rec.comment_len) == 0) &&
+		  back.seq_len == rec.seq_len && memcmp(back.seq, rec.seq, rec.seq_len) == 0 &&
+		  back.qual_len == rec.qual_len && memcmp(back.qual, rec.qual, rec.qual_len) == 0;
+	}
+	mu_assert("Records read back as written", same && seqfnextrec(c, &back) == EOF &&
+	  seqferrno == 0);
+
+	/* The text of the cache is that of the file */
+	char line[64], expect[64];
+	seqfrewind(in);
+	seqfrewind(c);
+	same = true;
+	while(seqfgets(in, expect, sizeof expect) != NULL)
+		same = same && seqfgets(c, line, sizeof line) != NULL && strcmp(line, expect) == 0;
+	mu_assert("Text reads back as written", same && seqfgets(c, line, sizeof line) == NULL);
+	seqfclose(in);
+
+	/* Any record can be read next */
+	mu_assert("Seek to a record", seqfseekrec(c, 4097) == 0 && seqfnextrec(c, &back) == 0 &&
+	  back.name_len == 8 && memcmp(back.name, "read4097", 8) == 0);
+	mu_assert("Seek to a record of the first block", seqfseekrec(c, 7) == 0 &&
+	  seqfnextrec(c, &back) == 0 && back.seq_len == 14 && memcmp(back.seq, "ACGTNNNNACGTRY", 14) == 0);
+	mu_assert("Seek to the end", seqfseekrec(c, 5000) == 0 && seqfnextrec(c, &back) == EOF);
+	mu_assert("Seek past the end", seqfseekrec(c, 5001) == -1 && seqferrno == 8);
+	seqferrno = 0;
+	seqfclose(c);
+
+	/* Binned qualities read back as their bins */
+	in = seqfopen(fq, "q");
+	mu_assert("Write a binned cache", seqfcache(in, cache, true) == 0);
+	seqfclose(in);
+	c = seqfopen(cache, "q");
+	mu_assert("Binned qualities", seqfnextrec(c, &back) == 0 && back.qual_len == 15 &&
+	  memcmp(back.qual, "##'07<BBFIIIIII", 15) == 0);
+	seqfclose(c);
+
+	/* FASTA sequences on several lines are joined */
+	in = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	mu_assert("Cache a fasta file", seqfcache(in, cache, true) == 0);
+	seqfclose(in);
+	in = seqfopen(TXT2STR(EXAMPLE_FASTA), "a");
+	c = seqfopen(cache, "a");
+	same = true;
+	while(seqfnextrec(in, &rec) == 0)
+		same = same && seqfnextrec(c, &back) == 0 && back.seq_len == rec.seq_len &&
+		  memcmp(back.seq, rec.seq, rec.seq_len) == 0 && back.qual == NULL;
+	mu_assert("Fasta records read back", same && seqfnextrec(c, &back) == EOF);
+	seqfclose(in);
+	seqfclose(c);
+
+	/* Soft-masked bases keep their case, next to N's of either case */
+	fp = fopen(fq, "w");
+	fprintf(fp, ">masked\ncnANTACgg\nacgtacgtNNnnACGTt\n");
+	fclose(fp);
+	in = seqfopen(fq, "a");
+	mu_assert("Cache a soft-masked file", seqfcache(in, cache, false) == 0);
+	seqfclose(in);
+	c = seqfopen(cache, "a");
+	mu_assert("Soft-masking is kept", seqfnextrec(c, &back) == 0 && back.seq_len == 26 &&
+	  memcmp(back.seq, "cnANTACggacgtacgtNNnnACGTt", 26) == 0);
+	seqfclose(c);
+
+	/* Only caches have records to seek to */
+	in = seqfopen(fq, "q");
+	mu_assert("Files are not caches", seqfseekrec(in, 0) == -1 && seqferrno == 12 &&
+	  seqfnrecords(in) == (size_t)-1 && seqferrno == 12);
+	seqferrno = 0;
+	seqfclose(in);
+
+	/* A cache cut short is not read */
+	fp = fopen(cache, "r+b");
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fclose(fp);
+	char *bytes = malloc(size);
+	fp = fopen(cache, "rb");
+	fread(bytes, 1, size, fp);
+	fclose(fp);
+	fp = fopen(cache, "wb");
+	fwrite(bytes, 1, size / 2, fp);
+	fclose(fp);
+	free(bytes);
+	mu_assert("Truncated cache fails to open", seqfopen(cache, "a") == NULL && seqferrno == 10);
+	seqferrno = 0;
+
+	remove(fq);
+	remove(cache);
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfaidx(void)
+{
+	init_unit_tests("Testing seqfaidx");
+
+	/* Sequences of several lines, with the last line short or full */
+	char seqs[3][200];
+	const char *names[3] = {"chrA", "chrB", "chrC"};
+	const size_t lens[3] = {150, 7, 120};
+	char text[1024];
+	size_t n = 0;
+	for(int s = 0; s < 3; s++) {
+		for(size_t i = 0; i < lens[s]; i++)
+			seqs[s][i] = "ACGTN"[(i * 7 + i / 3 + s) % 5];
+		seqs[s][lens[s]] = '\0';
+		n += sprintf(text + n, ">%s%s\n", names[s], s == 1 ? " a description" : "");
+		for(size_t i = 0; i < lens[s]; i += 60)
+			n += sprintf(text + n, "%.60s\n", seqs[s] + i);
+	}
+	FILE *fp = fopen("faidx_test.fa", "wb");
+	fwrite(text, 1, n, fp);
+	fclose(fp);
+	SeqFile out = seqfopen("faidx_test.fa.gz", "waz");
+	seqfwrite(out, text, n);
+	seqfclose(out);
+
+	mu_assert("Index a FASTA file", seqfaidx_build("faidx_test.fa") == 0);
+	char line[64] = {0};
+	fp = fopen("faidx_test.fa.fai", "r");
+	mu_assert("Index is that of samtools", fp != NULL && fgets(line, sizeof line, fp) != NULL &&
+	  strcmp(line, "chrA\t150\t6\t60\t61\n") == 0);
+	fclose(fp);
+
+	const char *paths[2] = {"faidx_test.fa", "faidx_test.fa.gz"};
+	for(int p = 0; p < 2; p++) {
+		if(p == 1)
+			mu_assert("Index a BGZF file", seqfaidx_build(paths[p]) == 0);
+		SeqFile file = seqfopen(paths[p], "a");
+		char buf[256];
+		bool same = true;
+		for(int s = 0; s < 3; s++)
+			for(size_t start = 0; start < lens[s]; start += 13)
+				for(size_t end = start; end <= lens[s] + 2; end += 29) {
+					size_t want = end < lens[s] ? end - start : lens[s] - start;
+					same = same && seqfafetch(file, names[s], start, end, buf) == want &&
+					  strlen(buf) == want && memcmp(buf, seqs[s] + start, want) == 0;
+				}
+		mu_assert(p ? "Fetch regions of a BGZF file" : "Fetch regions of a plain file", same);
+		mu_assert("Fetch a whole sequence", seqfafetch(file, "chrC", 0, (size_t)-1, buf) == 120 &&
+		  strcmp(buf, seqs[2]) == 0);
+		mu_assert("Fetch from no sequence", seqfafetch(file, "chrD", 0, 10, buf) == 0 &&
+		  seqferrno == 11);
+		seqferrno = 0;
+		mu_assert("Fetching leaves reading alone", seqfagets(file, buf, sizeof buf) != NULL &&
+		  strncmp(buf, seqs[0], 60) == 0);
+		seqfclose(file);
+	}
+
+	/* The index of another path, for a file that has none of its own */
+	fp = fopen("faidx_copy.fa", "wb");
+	fwrite(text, 1, n, fp);
+	fclose(fp);
+	SeqFile file = seqfopen("faidx_copy.fa", "a");
+	char buf[16];
+	mu_assert("Fetch needs an index", seqfafetch(file, "chrB", 0, 7, buf) == 0 && seqferrno == 1);
+	seqferrno = 0;
+	mu_assert("Load the index", seqfaidx_load(file, "faidx_test.fa") == 0 &&
+	  seqfafetch(file, "chrB", 2, 5, buf) == 3 && strcmp(buf, "ATA") == 0);
+	seqfclose(file);
+
+	/* Lines of a sequence that differ cannot be indexed */
+	mu_assert("Lines of different lengths", seqfaidx_build(TXT2STR(EXAMPLE_FASTA)) == 1 &&
+	  seqferrno == 8);
+	seqferrno = 0;
+
+	/* Only BGZF members can be found again in a gzip file */
+	out = seqfopen("faidx_plain.fa.gz", "wag");
+	seqfwrite(out, text, n);
+	seqfclose(out);
+	mu_assert("Gzip that is not BGZF", seqfaidx_build("faidx_plain.fa.gz") == 1 &&
+	  seqferrno == 12);
+	seqferrno = 0;
+	file = seqfopen("faidx_plain.fa.gz", "a");
+	mu_assert("Gzip cannot load an index", seqfaidx_load(file, "faidx_test.fa") == 1 &&
+	  seqferrno == 12);
+	seqferrno = 0;
+	seqfclose(file);
+
+	remove("faidx_test.fa");
+	remove("faidx_plain.fa.gz");
+	remove("faidx_copy.fa");
+	remove("faidx_test.fa.fai");
+	remove("faidx_test.fa.gz");
+	remove("faidx_test.fa.gz.fai");
+	remove("faidx_test.fa.gz.gzi");
+
+	unit_tests_end;
+}
+
+static UTEST_TYPE
+test_seqfzindex(void)
+{
+	init_unit_tests("Testing seqfzindex");
+
+	/* Enough reads for many points, in a plain, a gzip and a BGZF file */
+	const int nreads = 20000;
+	const char *paths[3] = {"zindex_test.fastq", "zindex_test.fastq.gz", "zindex_test.fastq.bgz"};
+	const char *modes[3] = {"wq", "wqg", "wqz"};
+	size_t *offsets = malloc((nreads + 1) * sizeof *offsets);
+	SeqFile out[3];
+	for(int p = 0; p < 3; p++)
+		out[p] = seqfopen(paths[p], modes[p]);
+	size_t n = 0;
+	for(int i = 0; i < nreads; i++) {
+		char text[128];
+		int len = sprintf(text, "@read%d\n%.*s\n+\n%.*s\n", i, 20 + i % 17,
+		  "GATTACAGATTACACGTACGTACGTTTGCA", 20 + i % 17, "IIIIIIIIIIIIFFFFFFFFFFFFF:::::");
+		for(int p = 0; p < 3; p++)
+			seqfwrite(out[p], text, (size_t)len);
+		offsets[i] = n;
+		n += (size_t)len;
+	}
+	offsets[nreads] = n;
+	for(int p = 0; p < 3; p++)
+		seqfclose(out[p]);
+
+	const int seeks[6] = {12345, 0, 19999, 7, 4096, 12346};
+	char name[32];
+	SeqfRecord rec;
+	for(int p = 0; p < 3; p++) {
+		for(int t = 0; t < 2; t++) {
+			SeqFile file = seqfopen(paths[p], t ? "qt" : "q");
+			mu_assert("Build an index", seqfzindex_build(file, 65536) == 0 &&
+			  seqfnrecords(file) == (size_t)nreads);
+
+			/* Any record, then any offset, is read next */
+			bool same = true;
+			for(int i = 0; i < 6; i++) {
+				int len = sprintf(name, "read%d", seeks[i]);
+				same = same && seqfseekrec(file, seeks[i]) == 0 && seqfnextrec(file, &rec) == 0 &&
+				  rec.name_len == (size_t)len && memcmp(rec.name, name, len) == 0;
+			}
+			mu_assert("Seek to records", same);
+			for(int i = 0; i < 6; i++) {
+				int len = sprintf(name, "read%d", seeks[i]);
+				same = same && seqfseek_offset(file, offsets[seeks[i]]) == 0 &&
+				  seqfnextrec(file, &rec) == 0 && rec.name_len == (size_t)len &&
+				  memcmp(rec.name, name, len) == 0;
+			}
+			mu_assert("Seek to offsets", same);
+			mu_assert("Read on after a seek", seqfnextrec(file, &rec) == 0 &&
+			  rec.name_len == 9 && memcmp(rec.name, "read12347", 9) == 0);
+			mu_assert("Seek to the end", seqfseekrec(file, nreads) == 0 &&
+			  seqfnextrec(file, &rec) == EOF && seqfseek_offset(file, n) == 0 &&
+			  seqfgetc(file) == EOF);
+			mu_assert("Seek past the end", seqfseekrec(file, nreads + 1) == -1 && seqferrno == 8);
+			seqferrno = 0;
+			mu_assert("Rewind after a seek", seqfrewind(file) == 0 && seqfnextrec(file, &rec) == 0 &&
+			  rec.name_len == 5 && memcmp(rec.name, "read0", 5) == 0);
+			mu_assert("Save the index", seqfzindex_save(file, "zindex_test.sqfz") == 0);
+			seqfclose(file);
+
+			/* A saved index spares a build */
+			file = seqfopen(paths[p], t ? "qt" : "q");
+			if(p != 0) {
+				mu_assert("Compressed files need an index", seqfseekrec(file, 5) == -1 &&
+				  seqfseek_offset(file, 0) == -1 && seqferrno == 12);
+				seqferrno = 0;
+			}
+			mu_assert("Load the index", seqfzindex_load(file, "zindex_test.sqfz") == 0 &&
+			  seqfnrecords(file) == (size_t)nreads);
+			mu_assert("Seek with a loaded index", seqfseekrec(file, 15000) == 0 &&
+			  seqfnextrec(file, &rec) == 0 && rec.name_len == 9 &&
+			  memcmp(rec.name, "read15000", 9) == 0);
+			seqfclose(file);
+		}
+	}
+
+	/* Plain files are entered anywhere, without an index */
+	SeqFile file = seqfopen(paths[0], "q");
+	mu_assert("Seek in a plain file", seqfseek_offset(file, offsets[333]) == 0 &&
+	  seqfnextrec(file, &rec) == 0 && rec.name_len == 7 && memcmp(rec.name, "read333", 7) == 0);
+	mu_assert("No index to save", seqfzindex_save(file, "zindex_test.sqfz") == 1 && seqferrno == 12);
+	seqferrno = 0;
+
+	/* An index is only loaded for the file it was built for */
+	mu_assert("Index of another file", seqfzindex_load(file, "zindex_test.sqfz") == 1 &&
+	  seqferrno == 10);
+	seqferrno = 0;
+	FILE *fp = fopen("zindex_test.sqfz", "wb");
+	fwrite("SQFZ", 1, 4, fp);
+	fclose(fp);
+	mu_assert("Malformed index", seqfzindex_load(file, "zindex_test.sqfz") == 1 && seqferrno == 10);
+	seqferrno = 0;
+	seqfclose(file);
+
+	/* Ranges are entered by offset already, and have no index of their own */
+	file = seqfopen_range(paths[0], "q", 0, 1000);
+	mu_assert("Ranges cannot be indexed", seqfzindex_build(file, 0) == 1 && seqferrno == 12 &&
+	  seqfzindex_load(file, "zindex_test.sqfz") == 1 && seqferrno == 12);
+	seqferrno = 0;
+	seqfclose(file);
+
+	free(offsets);
+	for(int p = 0; p < 3; p++)
+		remove(paths[p]);
+	remove("zindex_test.sqfz");
+
+	unit_tests_end;
+}
+
 static void all_tests() {
 	init_run_test;
 
@@ -149,6 +1644,30 @@ static void all_tests() {
 	mu_run_test(test_seqfclose);
 	mu_run_test(test_seqferrno);
 	mu_run_test(test_seqfgetc);
+	mu_run_test(test_seqfqgets);
+	mu_run_test(test_seqfreopen);
+	mu_run_test(test_seqfmmap);
+	mu_run_test(test_seqfpipeline);
+	mu_run_test(test_seqfbgzf);
+	mu_run_test(test_seqfthreads);
+	mu_run_test(test_seqfpool);
+	mu_run_test(test_seqfallocator);
+	mu_run_test(test_seqfrange);
+	mu_run_test(test_seqfnextrec);
+	mu_run_test(test_seqfnextbatch);
+	mu_run_test(test_seqfgets2b);
+	mu_run_test(test_seqfkmer);
+	mu_run_test(test_seqfreadnt);
+	mu_run_test(test_seqfread_borrow);
+	mu_run_test(test_seqfshared);
+	mu_run_test(test_seqfobufmax);
+	mu_run_test(test_seqfgetseq);
+	mu_run_test(test_seqfstats);
+	mu_run_test(test_seqfpaired);
+	mu_run_test(test_seqfwrite);
+	mu_run_test(test_seqfcache);
+	mu_run_test(test_seqfaidx);
+	mu_run_test(test_seqfzindex);
 
 	/* End of tests */
 	run_test_end;
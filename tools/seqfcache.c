@@ -0,0 +1,131 @@
+/* seqfcache.c - Convert sequence files to seqf's binary cache
+ *
+ * Copyright (c) 2024-2025 Francisco F. Cavazos
+ * Subject to the MIT License
+ *
+ * Reads a FASTA, FASTQ or sequence file, plain or compressed, and writes it
+ * as a cache that seqfopen() maps and reads without decompressing or parsing,
+ * see seqfcache().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+
+#include "seqfile.h"
+
+/**
+ * @brief Command line options
+ */
+struct cache_opts {
+	const char *mode;              /** Mode to open the input with */
+	bool bin_quals;                /** Bin the qualities */
+	bool quiet;                    /** Print nothing on success */
+	const char *input;             /** File to convert */
+	const char *output;            /** Cache to write */
+};
+
+static void
+cache_usage(FILE *out)
+{
+	fprintf(out,
+	  "usage: seqf-cache [options] INPUT OUTPUT\n"
+	  "\n"
+	  "Writes the records of INPUT (FASTA, FASTQ or sequences, plain, gzip, zlib\n"
+	  "or BGZF) to OUTPUT as a binary cache, which seqfopen() reads like INPUT\n"
+	  "without decompressing or parsing it again.\n"
+	  "\n"
+	  "  -m MODE   mode to open INPUT with, e.g. a, q, s or qt (default q)\n"
+	  "  -b        bin qualities into the 8 Illumina levels, 4 bits each\n"
+	  "  -q        print nothing on success\n");
+}
+
+static int
+cache_parse(int argc, char **argv, struct cache_opts *opts)
+{
+	opts->mode = "q";
+	int npos = 0;
+	for(int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if(strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+			cache_usage(stdout);
+			exit(0);
+		}
+		if(strcmp(arg, "-b") == 0) {
+			opts->bin_quals = true;
+		} else if(strcmp(arg, "-q") == 0) {
+			opts->quiet = true;
+		} else if(strcmp(arg, "-m") == 0) {
+			if(i + 1 == argc) {
+				fprintf(stderr, "seqf-cache: %s needs a value\n", arg);
+				return -1;
+			}
+			opts->mode = argv[++i];
+		} else if(arg[0] == '-' && arg[1] != '\0') {
+			fprintf(stderr, "seqf-cache: unknown option %s\n", arg);
+			return -1;
+		} else if(npos == 0) {
+			opts->input = arg;
+			npos++;
+		} else if(npos == 1) {
+			opts->output = arg;
+			npos++;
+		} else {
+			return -1;
+		}
+	}
+	return npos == 2 ? 0 : -1;
+}
+
+/**
+ * @brief Size of the file at `path' in MB, 0 if it cannot be told
+ */
+static double
+cache_mb(const char *path)
+{
+	struct stat st;
+	if(stat(path, &st) != 0)
+		return 0;
+	return (double)st.st_size / (1 << 20);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct cache_opts opts;
+	memset(&opts, 0, sizeof opts);
+	if(cache_parse(argc, argv, &opts) != 0) {
+		cache_usage(stderr);
+		return 2;
+	}
+
+	clock_t start = clock();
+	SeqFile in = seqfopen(opts.input, opts.mode);
+	if(in == NULL) {
+		fprintf(stderr, "seqf-cache: %s: %s\n", opts.input, seqfstrerror(seqferrno));
+		return 1;
+	}
+	if(seqfcache(in, opts.output, opts.bin_quals) != 0) {
+		fprintf(stderr, "seqf-cache: %s: %s\n", opts.output, seqfstrerror(seqferrno));
+		seqfclose(in);
+		return 1;
+	}
+	seqfclose(in);
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	/* Open the cache again, which also checks that it reads */
+	SeqFile cache = seqfopen(opts.output, NULL);
+	if(cache == NULL) {
+		fprintf(stderr, "seqf-cache: %s: %s\n", opts.output, seqfstrerror(seqferrno));
+		return 1;
+	}
+	if(!opts.quiet)
+		printf("%s: %zu records, %.1f MB -> %s: %.1f MB in %.2f s\n", opts.input,
+		       seqfnrecords(cache), cache_mb(opts.input), opts.output,
+		       cache_mb(opts.output), seconds);
+	seqfclose(cache);
+	return 0;
+}